@@ -0,0 +1,146 @@
+#include "syntheticvault.h"
+#include "core/encryption.h"
+#include "models/attachmentmanager.h"
+
+#include <QBuffer>
+#include <QRandomGenerator>
+#include <benchmark/benchmark.h>
+#include <memory>
+
+static const int BENCH_USER_ID = 1;
+static const int BENCH_OWNER_ID = 1;
+
+// Random bytes, so compression cannot make the sealed chunks smaller.
+static QByteArray attachmentPayload(const qint64 size) {
+    QByteArray payload(static_cast<int>(size), Qt::Uninitialized);
+    QRandomGenerator random(size);
+    random.fillRange(reinterpret_cast<quint32 *>(payload.data()), payload.size() / sizeof(quint32));
+    return payload;
+}
+
+static int storeAttachment(const AttachmentManager &manager, const QByteArray &payload) {
+    QBuffer buffer;
+    buffer.setData(payload);
+    buffer.open(QIODevice::ReadOnly);
+    int id = -1;
+    if (!manager.addAttachment(AttachmentManager::PasswordOwner, BENCH_OWNER_ID, "bench.bin", buffer,
+                               AttachmentManager::Progress(), &id)) {
+        return -1;
+    }
+    return id;
+}
+
+static void BM_AddAttachment(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const AttachmentManager manager(BENCH_USER_ID, encryption);
+    const QByteArray payload = attachmentPayload(state.range(0) * 1024 * 1024);
+
+    if (!storeOpen) {
+        state.SkipWithError("Failed to open the synthetic vault");
+        return;
+    }
+
+    for (auto _: state) {
+        const int id = storeAttachment(manager, payload);
+        if (id < 0) {
+            state.SkipWithError("Upload failed");
+            break;
+        }
+        state.PauseTiming();
+        manager.deleteAttachment(id);
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+BENCHMARK(BM_AddAttachment)->Arg(1)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Uploading a file the vault already holds only hashes it and writes
+// references, so this should run far faster than BM_AddAttachment.
+static void BM_AddDuplicateAttachment(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const AttachmentManager manager(BENCH_USER_ID, encryption);
+    const QByteArray payload = attachmentPayload(state.range(0) * 1024 * 1024);
+
+    const int original = storeOpen ? storeAttachment(manager, payload) : -1;
+    if (original < 0) {
+        state.SkipWithError("Failed to store the attachment");
+        return;
+    }
+
+    for (auto _: state) {
+        const int id = storeAttachment(manager, payload);
+        if (id < 0) {
+            state.SkipWithError("Upload failed");
+            break;
+        }
+        state.PauseTiming();
+        manager.deleteAttachment(id);
+        state.ResumeTiming();
+    }
+    manager.deleteAttachment(original);
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+BENCHMARK(BM_AddDuplicateAttachment)->Arg(1)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ReadAttachment(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const AttachmentManager manager(BENCH_USER_ID, encryption);
+    const QByteArray payload = attachmentPayload(state.range(0) * 1024 * 1024);
+
+    const int id = storeOpen ? storeAttachment(manager, payload) : -1;
+    if (id < 0) {
+        state.SkipWithError("Failed to store the attachment");
+        return;
+    }
+
+    QByteArray block(AttachmentManager::chunkSize(), Qt::Uninitialized);
+    for (auto _: state) {
+        const std::unique_ptr<AttachmentReader> reader(manager.openAttachment(id));
+        qint64 total = 0;
+        qint64 read = 0;
+        while (reader && (read = reader->read(block.data(), block.size())) > 0) {
+            total += read;
+        }
+        if (total != payload.size()) {
+            state.SkipWithError("Short read");
+            break;
+        }
+    }
+    manager.deleteAttachment(id);
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+BENCHMARK(BM_ReadAttachment)->Arg(1)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Time from opening an attachment to holding its first 4 KiB, which should
+// not grow with the file size.
+static void BM_AttachmentFirstBytes(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const AttachmentManager manager(BENCH_USER_ID, encryption);
+    const QByteArray payload = attachmentPayload(state.range(0) * 1024 * 1024);
+
+    const int id = storeOpen ? storeAttachment(manager, payload) : -1;
+    if (id < 0) {
+        state.SkipWithError("Failed to store the attachment");
+        return;
+    }
+
+    for (auto _: state) {
+        const std::unique_ptr<AttachmentReader> reader(manager.openAttachment(id));
+        const QByteArray head = reader ? reader->read(4096) : QByteArray();
+        if (head.size() != 4096) {
+            state.SkipWithError("Short read");
+            break;
+        }
+        benchmark::DoNotOptimize(head);
+    }
+    manager.deleteAttachment(id);
+}
+
+BENCHMARK(BM_AttachmentFirstBytes)->Arg(1)->Arg(64)->Unit(benchmark::kMicrosecond)->UseRealTime();
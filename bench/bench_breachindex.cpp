@@ -0,0 +1,62 @@
+#include "core/breachindex.h"
+
+#include <QTemporaryFile>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <algorithm>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+static const int VAULT_PASSWORDS = 10000;
+
+// Fills an index with `hashCount` random hashes. Only the first eight bytes of
+// a hash are indexed, so the rest stays zero.
+static bool writeSyntheticIndex(const QString &path, const qint64 hashCount) {
+    QRandomGenerator random(1);
+    std::vector<quint64> heads(hashCount);
+    for (quint64 &head: heads) {
+        head = random.generate64();
+    }
+    std::sort(heads.begin(), heads.end());
+
+    BreachIndexWriter writer(path);
+    if (!writer.open()) {
+        return false;
+    }
+    QByteArray sha1(20, 0);
+    for (const quint64 head: heads) {
+        qToBigEndian(head, sha1.data());
+        if (!writer.add(sha1)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+// Checks a vault's worth of passwords against corpora of growing size.
+static void BM_CheckVaultAgainstBreaches(benchmark::State &state) {
+    QTemporaryFile file;
+    BreachIndex index;
+    if (!file.open() || !writeSyntheticIndex(file.fileName(), state.range(0)) || !index.open(file.fileName())) {
+        state.SkipWithError("Failed to build the synthetic breach index");
+        return;
+    }
+
+    QRandomGenerator random(2);
+    QStringList passwords;
+    for (int i = 0; i < VAULT_PASSWORDS; ++i) {
+        passwords.append(QString::number(random.generate64(), 36));
+    }
+
+    for (auto _: state) {
+        int found = 0;
+        for (const QString &password: passwords) {
+            found += index.contains(password);
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * VAULT_PASSWORDS);
+}
+
+BENCHMARK(BM_CheckVaultAgainstBreaches)->RangeMultiplier(10)->Range(100000, 10000000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,179 @@
+#include "syntheticvault.h"
+#include "core/encryption.h"
+#include "core/recordcodec.h"
+#include "core/deltacodec.h"
+#include "core/pbkdf2batch.h"
+
+#include <benchmark/benchmark.h>
+
+static QString plaintextOfSize(const int size) {
+    return QString(size, QChar('x'));
+}
+
+static void BM_EncryptWithSalt(benchmark::State &state) {
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const QString plaintext = plaintextOfSize(static_cast<int>(state.range(0)));
+    const QByteArray salt(16, '\x11');
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encryption.encryptWithSalt(plaintext, salt));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_EncryptWithSalt)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+
+static void BM_DecryptWithSalt(benchmark::State &state) {
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    const QByteArray salt(16, '\x11');
+    const QByteArray ciphertext = encryption.encryptWithSalt(plaintextOfSize(static_cast<int>(state.range(0))), salt);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encryption.decryptWithSalt(ciphertext, salt, Encryption::CurrentKeySchedule));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_DecryptWithSalt)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+
+static void BM_DeriveKeyFromPassword(benchmark::State &state) {
+    const QByteArray salt(16, '\x22');
+    const KdfParams params = KeyDerivation::recommended();
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(Encryption::deriveKeyFromPassword("correct horse battery staple", salt, params));
+    }
+    state.SetLabel(params.algorithmName().toStdString());
+}
+
+BENCHMARK(BM_DeriveKeyFromPassword)->Unit(benchmark::kMillisecond);
+
+static void BM_DeriveKeyFromPasswordLegacy(benchmark::State &state) {
+    const QByteArray salt(16, '\x22');
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(Encryption::deriveKeyFromPassword("correct horse battery staple", salt));
+    }
+}
+
+BENCHMARK(BM_DeriveKeyFromPasswordLegacy)->Unit(benchmark::kMillisecond);
+
+// Row keys for a page of 64 rows under each key schedule.
+static void BM_DeriveRecordKeys(benchmark::State &state) {
+    const Encryption encryption(SyntheticVault::benchmarkKey());
+    QList<QByteArray> salts;
+    for (int i = 0; i < 64; ++i) {
+        salts.append(QByteArray(16, static_cast<char>(i)));
+    }
+    const QList<int> schedules(salts.size(), static_cast<int>(state.range(0)));
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encryption.deriveEntryKeys(salts, schedules));
+    }
+    state.SetItemsProcessed(state.iterations() * salts.size());
+    state.SetLabel(state.range(0) == Encryption::HkdfKeySchedule ? "hkdf" : "pbkdf2");
+}
+
+BENCHMARK(BM_DeriveRecordKeys)
+        ->Arg(Encryption::Pbkdf2KeySchedule)
+        ->Arg(Encryption::HkdfKeySchedule)
+        ->Unit(benchmark::kMicrosecond);
+
+// Row keys for a page of 64 rows with each kernel; unsupported kernels are skipped.
+static void BM_DeriveEntryKeys(benchmark::State &state) {
+    const auto kernel = static_cast<Pbkdf2Batch::Kernel>(state.range(0));
+    if (!Pbkdf2Batch::isSupported(kernel)) {
+        state.SkipWithError("kernel not supported on this CPU");
+        return;
+    }
+    const QByteArray vaultKey = SyntheticVault::benchmarkKey();
+    QList<QByteArray> salts;
+    for (int i = 0; i < 64; ++i) {
+        salts.append(QByteArray(16, static_cast<char>(i)));
+    }
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(Pbkdf2Batch::deriveKeysWith(kernel, vaultKey, salts, 10000, 32));
+    }
+    state.SetItemsProcessed(state.iterations() * salts.size());
+    state.SetLabel(Pbkdf2Batch::kernelName(kernel));
+}
+
+BENCHMARK(BM_DeriveEntryKeys)
+        ->Arg(Pbkdf2Batch::OpenSslKernel)
+        ->Arg(Pbkdf2Batch::PortableKernel)
+        ->Arg(Pbkdf2Batch::ShaNiKernel)
+        ->Arg(Pbkdf2Batch::Avx2Kernel)
+        ->Arg(Pbkdf2Batch::Avx512Kernel)
+        ->Unit(benchmark::kMillisecond);
+
+static QString configTextOfSize(const int size) {
+    QString text;
+    for (int line = 0; text.size() < size; ++line) {
+        text += QString("server.node%1.listen = 10.0.%2.%3:8443\n").arg(line).arg(line % 16).arg(line % 251);
+    }
+    text.truncate(size);
+    return text;
+}
+
+static void BM_EncodeNoteField(benchmark::State &state) {
+    const QString text = configTextOfSize(static_cast<int>(state.range(0)));
+
+    qint64 encodedSize = 0;
+    for (auto _: state) {
+        const QByteArray field = RecordCodec::encodeField(text, true);
+        encodedSize = field.size();
+        benchmark::DoNotOptimize(field);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    state.counters["ratio"] = static_cast<double>(state.range(0)) / static_cast<double>(encodedSize);
+}
+
+BENCHMARK(BM_EncodeNoteField)->Arg(256)->Arg(4096)->Arg(65536);
+
+static void BM_DecodeNoteField(benchmark::State &state) {
+    const QByteArray field = RecordCodec::encodeField(configTextOfSize(static_cast<int>(state.range(0))), true);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(RecordCodec::decodeField(field, RecordCodec::HeaderedRecord));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_DecodeNoteField)->Arg(256)->Arg(4096)->Arg(65536);
+
+// A revision of a note that differs from the one before by a short edit in
+// the middle, as autosave produces.
+static QByteArray editedCopy(const QByteArray &base) {
+    QByteArray edited = base;
+    edited.replace(edited.size() / 2, 32, "a short edit in the middle of the note");
+    return edited;
+}
+
+static void BM_EncodeNoteDelta(benchmark::State &state) {
+    const QByteArray base = configTextOfSize(static_cast<int>(state.range(0))).toUtf8();
+    const QByteArray target = editedCopy(base);
+
+    qint64 deltaSize = 0;
+    for (auto _: state) {
+        const QByteArray delta = DeltaCodec::encode(base, target);
+        deltaSize = delta.size();
+        benchmark::DoNotOptimize(delta);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    state.counters["delta_bytes"] = static_cast<double>(deltaSize);
+}
+
+BENCHMARK(BM_EncodeNoteDelta)->Arg(4096)->Arg(65536)->Arg(262144);
+
+static void BM_ApplyNoteDelta(benchmark::State &state) {
+    const QByteArray base = configTextOfSize(static_cast<int>(state.range(0))).toUtf8();
+    const QByteArray delta = DeltaCodec::encode(base, editedCopy(base));
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(DeltaCodec::apply(base, delta));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_ApplyNoteDelta)->Arg(4096)->Arg(65536)->Arg(262144);
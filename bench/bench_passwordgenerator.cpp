@@ -0,0 +1,60 @@
+#include "ui/passwordgeneratorwidget.h"
+#include "core/passwordgenerator.h"
+#include "core/passphrasegenerator.h"
+
+#include <QSpinBox>
+#include <benchmark/benchmark.h>
+
+static void BM_GeneratePassword(benchmark::State &state) {
+    PasswordGeneratorWidget widget;
+    widget.findChild<QSpinBox *>("lengthSpinBox")->setValue(static_cast<int>(state.range(0)));
+
+    for (auto _: state) {
+        QMetaObject::invokeMethod(&widget, "generatePassword", Qt::DirectConnection);
+    }
+}
+
+// Bulk provisioning: one call per batch of 10,000 passwords of the given length.
+static void BM_GeneratePasswordBatch(benchmark::State &state) {
+    static const int BATCH_SIZE = 10000;
+
+    PasswordPolicy policy;
+    policy.length = static_cast<int>(state.range(0));
+    PasswordGenerator generator(policy);
+
+    for (auto _: state) {
+        bool ok;
+        benchmark::DoNotOptimize(generator.generate(BATCH_SIZE, &ok));
+        if (!ok) {
+            state.SkipWithError("Failed to generate secure random bytes");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+
+// The same batch as passphrases of the given number of words, each with a
+// random capital and a digit.
+static void BM_GeneratePassphraseBatch(benchmark::State &state) {
+    static const int BATCH_SIZE = 10000;
+
+    PassphrasePolicy policy;
+    policy.wordCount = static_cast<int>(state.range(0));
+    policy.capitalization = PassphrasePolicy::RandomCapitalized;
+    policy.insertDigit = true;
+    PassphraseGenerator generator(policy);
+
+    for (auto _: state) {
+        bool ok;
+        benchmark::DoNotOptimize(generator.generate(BATCH_SIZE, &ok));
+        if (!ok) {
+            state.SkipWithError("Failed to generate secure random bytes");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+
+BENCHMARK(BM_GeneratePassword)->Arg(12)->Arg(32);
+BENCHMARK(BM_GeneratePasswordBatch)->Arg(16)->Arg(32)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GeneratePassphraseBatch)->Arg(4)->Arg(6)->Arg(10)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,57 @@
+#include "syntheticvault.h"
+#include "core/encryption.h"
+#include "models/passwordmanager.h"
+#include "models/passwordaudit.h"
+
+#include <benchmark/benchmark.h>
+
+static const int BENCH_USER_ID = 1;
+
+static void BM_GetPasswords(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    Encryption encryption(SyntheticVault::benchmarkKey());
+    const int rowCount = static_cast<int>(state.range(0));
+
+    if (!storeOpen || !SyntheticVault::populatePasswords(BENCH_USER_ID, rowCount, &encryption)) {
+        state.SkipWithError("Failed to build the synthetic vault");
+        return;
+    }
+
+    const PasswordManager manager(BENCH_USER_ID, &encryption);
+    for (auto _: state) {
+        const QList<PasswordEntry> passwords = manager.getPasswords();
+        if (passwords.size() != rowCount) {
+            state.SkipWithError("Unexpected number of rows");
+            break;
+        }
+        benchmark::DoNotOptimize(passwords);
+    }
+    state.SetItemsProcessed(state.iterations() * rowCount);
+}
+
+BENCHMARK(BM_GetPasswords)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The synthetic vault repeats its template rows, so most entries are reused.
+static void BM_FindReusedPasswords(benchmark::State &state) {
+    static const bool storeOpen = SyntheticVault::openInMemoryStore();
+    Encryption encryption(SyntheticVault::benchmarkKey());
+    const int rowCount = static_cast<int>(state.range(0));
+
+    if (!storeOpen || !SyntheticVault::populatePasswords(BENCH_USER_ID, rowCount, &encryption)) {
+        state.SkipWithError("Failed to build the synthetic vault");
+        return;
+    }
+
+    for (auto _: state) {
+        bool ok = false;
+        const QList<QList<int> > groups = PasswordAudit::findReusedPasswords(BENCH_USER_ID, &ok);
+        if (!ok) {
+            state.SkipWithError("Reuse query failed");
+            break;
+        }
+        benchmark::DoNotOptimize(groups);
+    }
+    state.SetItemsProcessed(state.iterations() * rowCount);
+}
+
+BENCHMARK(BM_FindReusedPasswords)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,30 @@
+#include "core/passwordstrength.h"
+
+#include <benchmark/benchmark.h>
+
+static const QString SAMPLE = "correcthorsebatterystaple-Summer2024!qwertyuiop1987-05-01zaq12wsx";
+
+// Scores a password from scratch, as the generator does.
+static void BM_EstimateStrength(benchmark::State &state) {
+    const QString password = SAMPLE.left(static_cast<int>(state.range(0)));
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(PasswordStrength::estimate(password).guesses);
+    }
+}
+
+// Types the password one character at a time, as the entry editor sees it.
+static void BM_StrengthPerKeystroke(benchmark::State &state) {
+    const QString password = SAMPLE.left(static_cast<int>(state.range(0)));
+
+    for (auto _: state) {
+        PasswordStrength strength;
+        for (int i = 1; i <= password.size(); ++i) {
+            benchmark::DoNotOptimize(strength.update(password.left(i)).guesses);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * password.size());
+}
+
+BENCHMARK(BM_EstimateStrength)->Arg(12)->Arg(32)->Arg(64)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StrengthPerKeystroke)->Arg(12)->Arg(32)->Arg(64)->Unit(benchmark::kMicrosecond);
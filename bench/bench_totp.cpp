@@ -0,0 +1,24 @@
+#include "core/totpgenerator.h"
+
+#include <benchmark/benchmark.h>
+
+static const QString SECRET = "JBSWY3DPEHPK3PXPJBSWY3DPEHPK3PXP";
+
+static void BM_GenerateTOTP(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(TOTPGenerator::generateTOTP(SECRET));
+    }
+}
+
+BENCHMARK(BM_GenerateTOTP);
+
+static void BM_Base32Decode(benchmark::State &state) {
+    const QString input = SECRET.repeated(static_cast<int>(state.range(0)) / SECRET.size());
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(TOTPGenerator::base32Decode(input));
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+BENCHMARK(BM_Base32Decode)->Arg(32)->Arg(1024);
@@ -0,0 +1,211 @@
+#include "breachindex.h"
+#include "core/trace.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDir>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+#include <algorithm>
+
+// Layout: the magic, the hash count as a little-endian quint64, BucketCount + 1
+// little-endian quint64 entry offsets, then the entries. Bucket b holds
+// entries [offset b, offset b + 1). Entries are big-endian, so they compare
+// with memcmp.
+const QByteArray BreachIndex::Magic = "ENIGHIB1";
+
+BreachIndex::BreachIndex()
+    : fanout(nullptr)
+      , entries(nullptr)
+      , count(0) {
+}
+
+qint64 BreachIndex::headerSize() {
+    return Magic.size() + static_cast<qint64>(sizeof(quint64)) * (BucketCount + 2);
+}
+
+bool BreachIndex::open(const QString &path) {
+    ENIGMA_TRACE_SCOPE("model", "BreachIndex::open");
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open breach index" << path << file.errorString();
+        return false;
+    }
+    const qint64 fileSize = file.size();
+    if (fileSize < headerSize()) {
+        qWarning() << "Breach index" << path << "is truncated";
+        file.close();
+        return false;
+    }
+
+    const uchar *data = file.map(0, fileSize);
+    if (!data || std::memcmp(data, Magic.constData(), Magic.size()) != 0) {
+        qWarning() << "Breach index" << path << "is not a breach index";
+        file.close();
+        return false;
+    }
+    const quint64 hashes = qFromLittleEndian<quint64>(data + Magic.size());
+    if (static_cast<quint64>(fileSize - headerSize()) != hashes * SuffixBytes) {
+        qWarning() << "Breach index" << path << "has the wrong size for" << hashes << "hashes";
+        file.close();
+        return false;
+    }
+
+    fanout = data + Magic.size() + sizeof(quint64);
+    entries = data + headerSize();
+    count = hashes;
+    return true;
+}
+
+bool BreachIndex::isOpen() const {
+    return entries != nullptr;
+}
+
+quint64 BreachIndex::hashCount() const {
+    return count;
+}
+
+void BreachIndex::splitHash(const QByteArray &sha1, quint32 *bucket, quint64 *suffix) {
+    const quint64 head = qFromBigEndian<quint64>(sha1.constData());
+    *bucket = static_cast<quint32>(head >> (64 - PrefixBits));
+    *suffix = (head >> (64 - PrefixBits - 8 * SuffixBytes)) & ((Q_UINT64_C(1) << (8 * SuffixBytes)) - 1);
+}
+
+bool BreachIndex::contains(const QString &password) const {
+    if (password.isEmpty() || !isOpen()) {
+        return false;
+    }
+    return containsHash(QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Sha1));
+}
+
+bool BreachIndex::containsHash(const QByteArray &sha1) const {
+    if (!isOpen() || sha1.size() < static_cast<int>(sizeof(quint64))) {
+        return false;
+    }
+    quint32 bucket;
+    quint64 suffix;
+    splitHash(sha1, &bucket, &suffix);
+
+    uchar key[sizeof(quint64)];
+    qToBigEndian(suffix, key);
+    const uchar *needle = key + sizeof(quint64) - SuffixBytes;
+
+    quint64 low = qFromLittleEndian<quint64>(fanout + sizeof(quint64) * bucket);
+    quint64 high = qFromLittleEndian<quint64>(fanout + sizeof(quint64) * (bucket + 1));
+    if (high > count || low > high) {
+        return false;
+    }
+    while (low < high) {
+        const quint64 mid = low + (high - low) / 2;
+        const int order = std::memcmp(entries + mid * SuffixBytes, needle, SuffixBytes);
+        if (order == 0) {
+            return true;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+// ENIGMA_BREACH_INDEX overrides where the index is looked for.
+QString BreachIndex::defaultPath() {
+    const QString path = qEnvironmentVariable("ENIGMA_BREACH_INDEX");
+    if (!path.isEmpty()) {
+        return path;
+    }
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("pwned-passwords.idx");
+}
+
+// Opened once on first use. Without an index every lookup reports no match.
+const BreachIndex &BreachIndex::instance() {
+    static BreachIndex index;
+    static const bool opened = QFile::exists(defaultPath()) && index.open(defaultPath());
+    Q_UNUSED(opened)
+    return index;
+}
+
+BreachIndexWriter::BreachIndexWriter(const QString &path)
+    : out(path)
+      , counts(BreachIndex::BucketCount, 0)
+      , total(0)
+      , currentBucket(-1) {
+}
+
+// The count and fan-out table are written by finish().
+bool BreachIndexWriter::open() {
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const QByteArray header = BreachIndex::Magic
+                              + QByteArray(BreachIndex::headerSize() - BreachIndex::Magic.size(), 0);
+    return out.write(header) == header.size();
+}
+
+bool BreachIndexWriter::add(const QByteArray &sha1) {
+    quint32 bucket;
+    quint64 suffix;
+    BreachIndex::splitHash(sha1, &bucket, &suffix);
+    if (static_cast<qint64>(bucket) != currentBucket) {
+        if (static_cast<qint64>(bucket) < currentBucket) {
+            error = "input is not ordered by hash";
+            return false;
+        }
+        if (!flush()) {
+            return false;
+        }
+        currentBucket = bucket;
+    }
+    pending.append(suffix);
+    return true;
+}
+
+bool BreachIndexWriter::finish() {
+    if (!flush()) {
+        return false;
+    }
+    QByteArray header(BreachIndex::headerSize() - BreachIndex::Magic.size(), 0);
+    uchar *data = reinterpret_cast<uchar *>(header.data());
+    qToLittleEndian(total, data);
+    quint64 offset = 0;
+    for (int bucket = 0; bucket <= BreachIndex::BucketCount; ++bucket) {
+        qToLittleEndian(offset, data + sizeof(quint64) * (bucket + 1));
+        if (bucket < BreachIndex::BucketCount) {
+            offset += counts.at(bucket);
+        }
+    }
+    return out.seek(BreachIndex::Magic.size()) && out.write(header) == header.size() && out.flush();
+}
+
+quint64 BreachIndexWriter::hashCount() const {
+    return total;
+}
+
+QString BreachIndexWriter::errorString() const {
+    return error.isEmpty() ? out.errorString() : error;
+}
+
+// Truncation can make distinct hashes collide, so each bucket is deduplicated.
+bool BreachIndexWriter::flush() {
+    if (pending.isEmpty()) {
+        return true;
+    }
+    std::sort(pending.begin(), pending.end());
+    pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+    QByteArray block(pending.size() * BreachIndex::SuffixBytes, 0);
+    uchar *data = reinterpret_cast<uchar *>(block.data());
+    for (const quint64 suffix: pending) {
+        uchar bytes[sizeof(quint64)];
+        qToBigEndian(suffix, bytes);
+        std::copy(bytes + sizeof(quint64) - BreachIndex::SuffixBytes, bytes + sizeof(quint64), data);
+        data += BreachIndex::SuffixBytes;
+    }
+    counts[currentBucket] = pending.size();
+    total += pending.size();
+    pending.clear();
+    return out.write(block) == block.size();
+}
@@ -0,0 +1,76 @@
+#ifndef BREACHINDEX_H
+#define BREACHINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+
+// A local copy of the Have I Been Pwned password corpus, built from the SHA-1
+// range files by enigma_breachindex. Hashes are truncated to their first 60
+// bits: the top 20 select a bucket in a fan-out table and the next 40 are
+// stored sorted, five bytes each. The file is memory mapped, so a lookup is a
+// jump to its bucket and a binary search of a few hundred entries, and only
+// the touched pages are ever read.
+class BreachIndex {
+public:
+    static const QByteArray Magic;
+    static const int PrefixBits = 20;
+    static const int BucketCount = 1 << PrefixBits;
+    static const int SuffixBytes = 5;
+
+    BreachIndex();
+
+    bool open(const QString &path);
+
+    bool isOpen() const;
+
+    quint64 hashCount() const;
+
+    bool contains(const QString &password) const;
+
+    bool containsHash(const QByteArray &sha1) const;
+
+    static void splitHash(const QByteArray &sha1, quint32 *bucket, quint64 *suffix);
+
+    static qint64 headerSize();
+
+    static QString defaultPath();
+
+    static const BreachIndex &instance();
+
+private:
+    QFile file;
+    const uchar *fanout;
+    const uchar *entries;
+    quint64 count;
+};
+
+// Writes an index from hashes added in ascending order. Only one bucket is held
+// in memory at a time, so memory stays flat however large the corpus is.
+class BreachIndexWriter {
+public:
+    explicit BreachIndexWriter(const QString &path);
+
+    bool open();
+
+    bool add(const QByteArray &sha1);
+
+    bool finish();
+
+    quint64 hashCount() const;
+
+    QString errorString() const;
+
+private:
+    bool flush();
+
+    QFile out;
+    QVector<quint64> counts;
+    QVector<quint64> pending;
+    quint64 total;
+    qint64 currentBucket;
+    QString error;
+};
+
+#endif // BREACHINDEX_H
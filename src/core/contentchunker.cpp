@@ -0,0 +1,59 @@
+#include "contentchunker.h"
+
+#include <array>
+#include <algorithm>
+#include <bit>
+
+// The gear table only has to look random and stay identical across builds,
+// since stored chunks are matched against freshly cut ones.
+static std::array<quint64, 256> makeGearTable() {
+    std::array<quint64, 256> table{};
+    quint64 state = 0x656e69676d61ULL;
+    for (quint64 &value: table) {
+        state += 0x9e3779b97f4a7c15ULL;
+        quint64 z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+static const std::array<quint64, 256> GEAR = makeGearTable();
+
+ContentChunker::ContentChunker(const int minSize, const int averageSize, const int maxSize)
+    : minSize(std::max(minSize, 1))
+      , maxSize(std::max(maxSize, minSize))
+      , mask(0) {
+    // The high bits of the gear hash cover the last 64 bytes, so test those.
+    const int bits = std::bit_width(static_cast<quint32>(std::max(averageSize, 2))) - 1;
+    mask = ~0ULL << (64 - bits);
+}
+
+int ContentChunker::nextBoundary(const char *data, const int size) const {
+    if (size <= minSize) {
+        return size;
+    }
+
+    const int limit = std::min(size, maxSize);
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+    quint64 hash = 0;
+    for (int i = minSize; i < limit; ++i) {
+        hash = (hash << 1) + GEAR[bytes[i]];
+        if ((hash & mask) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+QList<QByteArray> ContentChunker::split(const QByteArray &data) const {
+    QList<QByteArray> chunks;
+    int offset = 0;
+    while (offset < data.size()) {
+        const int length = nextBoundary(data.constData() + offset, data.size() - offset);
+        chunks.append(data.mid(offset, length));
+        offset += length;
+    }
+    return chunks;
+}
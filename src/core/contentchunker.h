@@ -0,0 +1,24 @@
+#ifndef CONTENTCHUNKER_H
+#define CONTENTCHUNKER_H
+
+#include <QByteArray>
+#include <QList>
+
+// Content-defined chunking with a gear rolling hash. Boundaries depend only on
+// the bytes just before them, so an edit changes the chunk it falls in (and at
+// most the next one) while every other chunk keeps its exact bytes.
+class ContentChunker {
+public:
+    ContentChunker(int minSize, int averageSize, int maxSize);
+
+    int nextBoundary(const char *data, int size) const;
+
+    QList<QByteArray> split(const QByteArray &data) const;
+
+private:
+    int minSize;
+    int maxSize;
+    quint64 mask;
+};
+
+#endif // CONTENTCHUNKER_H
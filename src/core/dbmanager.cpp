@@ -1,5 +1,33 @@
 #include "dbmanager.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/sqlrecorder.h"
 #include <QDebug>
+#include <QThread>
+#include <QThreadStorage>
+#include <QAtomicInt>
+
+namespace {
+    // QSqlDatabase handles may only be used from the thread that created them, so
+    // worker threads get their own clone of the main connection. The clone is
+    // removed again when the owning thread exits.
+    struct ThreadConnection {
+        QString name;
+
+        ~ThreadConnection() {
+            {
+                QSqlDatabase db = QSqlDatabase::database(name, false);
+                if (db.isOpen()) {
+                    db.close();
+                }
+            }
+            QSqlDatabase::removeDatabase(name);
+        }
+    };
+
+    QThreadStorage<ThreadConnection *> threadConnections;
+    QAtomicInt threadConnectionCounter;
+}
 
 DBManager &DBManager::instance() {
     static DBManager instance;
@@ -8,11 +36,26 @@ DBManager &DBManager::instance() {
 
 bool DBManager::openConnection(const QString &host, const QString &dbName, const QString &user,
                                const QString &password) {
+    ENIGMA_TRACE_SCOPE("db", "DBManager::openConnection");
     db = QSqlDatabase::addDatabase("QMYSQL");
     db.setHostName(host);
     db.setDatabaseName(dbName);
     db.setUserName(user);
     db.setPassword(password);
+    ownerThread = QThread::currentThread();
+
+    if (!db.open()) {
+        qDebug() << "Database Error:" << db.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::openSqliteConnection(const QString &path) {
+    ENIGMA_TRACE_SCOPE("db", "DBManager::openSqliteConnection");
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(path);
+    ownerThread = QThread::currentThread();
 
     if (!db.open()) {
         qDebug() << "Database Error:" << db.lastError().text();
@@ -22,7 +65,58 @@ bool DBManager::openConnection(const QString &host, const QString &dbName, const
 }
 
 QSqlDatabase DBManager::getDatabase() {
-    return db;
+    if (!ownerThread || QThread::currentThread() == ownerThread) {
+        return db;
+    }
+    return threadDatabase();
+}
+
+QSqlDatabase DBManager::threadDatabase() {
+    if (threadConnections.hasLocalData()) {
+        Metrics::increment(Metrics::ThreadConnectionHits);
+        return QSqlDatabase::database(threadConnections.localData()->name);
+    }
+    Metrics::increment(Metrics::ThreadConnectionMisses);
+
+    ENIGMA_TRACE_SCOPE("db", "DBManager::openThreadConnection");
+    const auto connection = new ThreadConnection;
+    connection->name = QString("enigma_worker_%1").arg(threadConnectionCounter.fetchAndAddRelaxed(1));
+    threadConnections.setLocalData(connection);
+
+    QSqlDatabase workerDb = QSqlDatabase::cloneDatabase(db.connectionName(), connection->name);
+    if (!workerDb.open()) {
+        qDebug() << "Worker Database Error:" << workerDb.lastError().text();
+    }
+    return workerDb;
+}
+
+// Every statement goes through exec() or execBatch() so it is counted per
+// operation, shows up as its own span in traces and can be recorded.
+bool DBManager::exec(QSqlQuery &query, const char *statementId) {
+    ENIGMA_TRACE_SCOPE("sql", statementId);
+    Metrics::recordSql(1);
+    if (!SqlRecorder::isRecording()) {
+        return query.exec();
+    }
+
+    const qint64 start = SqlRecorder::now();
+    const bool ok = query.exec();
+    SqlRecorder::record(query, statementId, start, SqlRecorder::now() - start, ok, false);
+    return ok;
+}
+
+bool DBManager::execBatch(QSqlQuery &query, const char *statementId) {
+    ENIGMA_TRACE_SCOPE("sql", statementId);
+    const QVariantList boundValues = query.boundValues().values();
+    Metrics::recordSql(boundValues.isEmpty() ? 1 : qMax(1, static_cast<int>(boundValues.first().toList().size())));
+    if (!SqlRecorder::isRecording()) {
+        return query.execBatch();
+    }
+
+    const qint64 start = SqlRecorder::now();
+    const bool ok = query.execBatch();
+    SqlRecorder::record(query, statementId, start, SqlRecorder::now() - start, ok, true);
+    return ok;
 }
 
 void DBManager::closeConnection() {
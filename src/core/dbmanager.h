@@ -9,8 +9,14 @@ public:
 
     bool openConnection(const QString &host, const QString &dbName, const QString &user, const QString &password);
 
+    bool openSqliteConnection(const QString &path);
+
     QSqlDatabase getDatabase();
 
+    bool exec(QSqlQuery &query, const char *statementId);
+
+    bool execBatch(QSqlQuery &query, const char *statementId);
+
     void closeConnection();
 
 private:
@@ -23,7 +29,10 @@ private:
 
     DBManager &operator=(const DBManager &) = delete;
 
+    QSqlDatabase threadDatabase();
+
     QSqlDatabase db;
+    QThread *ownerThread = nullptr;
 };
 
 #endif // DBMANAGER_H
@@ -0,0 +1,180 @@
+#include "deltacodec.h"
+#include "core/trace.h"
+#include <QHash>
+#include <QDebug>
+#include <cstring>
+
+// A delta starts with a version byte and the base and target sizes. Each
+// instruction is a varint holding the run length shifted left by one, with the
+// low bit set for literal bytes that follow inline and clear for a copy from
+// the base whose offset follows as another varint.
+static const char DELTA_VERSION = 1;
+static const int BLOCK_SIZE = 16;
+static const quint64 HASH_MULTIPLIER = 0x100000001b3ULL;
+static const qint64 MAX_TARGET_SIZE = 256 * 1024 * 1024;
+
+static quint64 blockHash(const char *data) {
+    quint64 hash = 0;
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        hash = hash * HASH_MULTIPLIER + static_cast<uchar>(data[i]);
+    }
+    return hash;
+}
+
+static quint64 leadingFactor() {
+    quint64 factor = 1;
+    for (int i = 1; i < BLOCK_SIZE; ++i) {
+        factor *= HASH_MULTIPLIER;
+    }
+    return factor;
+}
+
+static void appendVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+static bool readVarint(const char *&pos, const char *end, quint64 &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        const auto byte = static_cast<uchar>(*pos++);
+        value |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void appendLiteral(QByteArray &out, const QByteArray &target, const int from, const int to) {
+    if (to > from) {
+        appendVarint(out, (static_cast<quint64>(to - from) << 1) | 1);
+        out.append(target.constData() + from, to - from);
+    }
+}
+
+QByteArray DeltaCodec::encode(const QByteArray &base, const QByteArray &target) {
+    ENIGMA_TRACE_SCOPE("codec", "DeltaCodec::encode");
+    QByteArray delta;
+    delta.append(DELTA_VERSION);
+    appendVarint(delta, base.size());
+    appendVarint(delta, target.size());
+
+    QHash<quint64, int> blocks;
+    blocks.reserve(base.size() / BLOCK_SIZE);
+    for (int offset = 0; offset + BLOCK_SIZE <= base.size(); offset += BLOCK_SIZE) {
+        const quint64 hash = blockHash(base.constData() + offset);
+        if (!blocks.contains(hash)) {
+            blocks.insert(hash, offset);
+        }
+    }
+
+    const char *from = base.constData();
+    const char *to = target.constData();
+    const quint64 factor = leadingFactor();
+    int literalStart = 0;
+    int pos = 0;
+    quint64 hash = target.size() >= BLOCK_SIZE ? blockHash(to) : 0;
+    while (pos + BLOCK_SIZE <= target.size()) {
+        const auto match = blocks.constFind(hash);
+        if (match != blocks.constEnd() && std::memcmp(from + match.value(), to + pos, BLOCK_SIZE) == 0) {
+            // Grow the match both ways; backwards only into bytes not yet emitted.
+            int baseStart = match.value();
+            int targetStart = pos;
+            while (targetStart > literalStart && baseStart > 0 && from[baseStart - 1] == to[targetStart - 1]) {
+                --baseStart;
+                --targetStart;
+            }
+            int length = pos - targetStart + BLOCK_SIZE;
+            while (targetStart + length < target.size() && baseStart + length < base.size()
+                   && from[baseStart + length] == to[targetStart + length]) {
+                ++length;
+            }
+
+            appendLiteral(delta, target, literalStart, targetStart);
+            appendVarint(delta, static_cast<quint64>(length) << 1);
+            appendVarint(delta, baseStart);
+            pos = targetStart + length;
+            literalStart = pos;
+            if (pos + BLOCK_SIZE <= target.size()) {
+                hash = blockHash(to + pos);
+            }
+            continue;
+        }
+
+        if (pos + BLOCK_SIZE < target.size()) {
+            hash = (hash - static_cast<uchar>(to[pos]) * factor) * HASH_MULTIPLIER
+                   + static_cast<uchar>(to[pos + BLOCK_SIZE]);
+        }
+        ++pos;
+    }
+    appendLiteral(delta, target, literalStart, target.size());
+    return delta;
+}
+
+QByteArray DeltaCodec::apply(const QByteArray &base, const QByteArray &delta, bool *ok) {
+    ENIGMA_TRACE_SCOPE("codec", "DeltaCodec::apply");
+    if (ok) {
+        *ok = false;
+    }
+
+    const char *pos = delta.constData();
+    const char *end = pos + delta.size();
+    quint64 baseSize = 0;
+    quint64 targetSize = 0;
+    if (pos == end || *pos++ != DELTA_VERSION || !readVarint(pos, end, baseSize) || !readVarint(pos, end, targetSize)) {
+        qWarning() << "Malformed delta header!";
+        return QByteArray();
+    }
+    if (baseSize != static_cast<quint64>(base.size())) {
+        qWarning() << "Delta was made for a different base!";
+        return QByteArray();
+    }
+    if (targetSize > static_cast<quint64>(MAX_TARGET_SIZE)) {
+        qWarning() << "Delta target exceeds" << MAX_TARGET_SIZE << "bytes!";
+        return QByteArray();
+    }
+
+    QByteArray target;
+    target.reserve(static_cast<int>(targetSize));
+    while (pos < end) {
+        quint64 header = 0;
+        if (!readVarint(pos, end, header)) {
+            qWarning() << "Truncated delta instruction!";
+            return QByteArray();
+        }
+        const quint64 length = header >> 1;
+        if (length > targetSize - static_cast<quint64>(target.size())) {
+            qWarning() << "Delta overruns its target size!";
+            return QByteArray();
+        }
+
+        if (header & 1) {
+            if (length > static_cast<quint64>(end - pos)) {
+                qWarning() << "Truncated delta literal!";
+                return QByteArray();
+            }
+            target.append(pos, static_cast<int>(length));
+            pos += length;
+        } else {
+            quint64 offset = 0;
+            if (!readVarint(pos, end, offset) || offset > baseSize || length > baseSize - offset) {
+                qWarning() << "Delta copies outside its base!";
+                return QByteArray();
+            }
+            target.append(base.constData() + offset, static_cast<int>(length));
+        }
+    }
+    if (static_cast<quint64>(target.size()) != targetSize) {
+        qWarning() << "Delta is shorter than its target size!";
+        return QByteArray();
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return target;
+}
@@ -0,0 +1,18 @@
+#ifndef DELTACODEC_H
+#define DELTACODEC_H
+
+#include <QByteArray>
+
+// Binary deltas made of copy and insert instructions. encode() finds runs of
+// the target that also occur in the base through a hash of aligned base
+// blocks, so the delta grows with the size of the edit rather than the size
+// of the data. apply() checks every instruction against both buffers and
+// rejects deltas made for a different base.
+class DeltaCodec {
+public:
+    static QByteArray encode(const QByteArray &base, const QByteArray &target);
+
+    static QByteArray apply(const QByteArray &base, const QByteArray &delta, bool *ok = nullptr);
+};
+
+#endif // DELTACODEC_H
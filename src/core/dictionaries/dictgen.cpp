@@ -0,0 +1,142 @@
+// Compiles the ranked word lists next to this file into the flat tries of
+// core/strengthdictionaries.h. Runs at build time, so it only uses the
+// standard library.
+//
+// Usage: enigma_dictgen <output.cpp> <list.txt>...
+//
+// Each list has one word per line, most common first; blank lines and lines
+// starting with '#' are skipped. Anything after the first whitespace on a line
+// is ignored, so zxcvbn's "word count" frequency lists can be used as they are.
+// A word keeps the rank of its first line, and the dictionary is named after
+// the file.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BuildNode {
+    std::map<char, std::unique_ptr<BuildNode> > children;
+    uint32_t rank = 0;
+};
+
+struct FlatNode {
+    uint32_t firstEdge;
+    uint32_t rank;
+    uint16_t edgeCount;
+};
+
+struct FlatEdge {
+    char label;
+    uint32_t child;
+};
+
+static std::string baseName(const std::string &path) {
+    const size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static std::string escapeLabel(const char label) {
+    if (label == '\'' || label == '\\') {
+        return std::string("'\\") + label + "'";
+    }
+    return std::string("'") + label + "'";
+}
+
+// Nodes are laid out breadth first, so every node's edges are contiguous and
+// sorted by label.
+static void flatten(const BuildNode &root, std::vector<FlatNode> &nodes, std::vector<FlatEdge> &edges) {
+    std::vector<const BuildNode *> queue = {&root};
+    nodes.push_back({0, root.rank, 0});
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const BuildNode *node = queue[i];
+        nodes[i].firstEdge = static_cast<uint32_t>(edges.size());
+        nodes[i].edgeCount = static_cast<uint16_t>(node->children.size());
+        for (const auto &[label, child]: node->children) {
+            edges.push_back({label, static_cast<uint32_t>(queue.size())});
+            queue.push_back(child.get());
+            nodes.push_back({0, child->rank, 0});
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: enigma_dictgen <output.cpp> <list.txt>..." << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(argv[1]);
+    if (!out) {
+        std::cerr << "enigma_dictgen: cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    out << "// Generated by enigma_dictgen from src/core/dictionaries. Do not edit.\n\n"
+        << "#include \"core/strengthdictionaries.h\"\n\n"
+        << "namespace StrengthDictionaries {\n";
+
+    std::vector<std::string> names;
+    std::vector<uint32_t> wordCounts;
+    for (int list = 2; list < argc; ++list) {
+        std::ifstream in(argv[list]);
+        if (!in) {
+            std::cerr << "enigma_dictgen: cannot read " << argv[list] << std::endl;
+            return 1;
+        }
+
+        BuildNode root;
+        uint32_t rank = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            const auto isSpace = [](const unsigned char c) { return std::isspace(c) != 0; };
+            line.erase(line.begin(), std::find_if_not(line.begin(), line.end(), isSpace));
+            line.erase(std::find_if(line.begin(), line.end(), isSpace), line.end());
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            BuildNode *node = &root;
+            for (const char c: line) {
+                auto &child = node->children[static_cast<char>(std::tolower(static_cast<unsigned char>(c)))];
+                if (!child) {
+                    child = std::make_unique<BuildNode>();
+                }
+                node = child.get();
+            }
+            if (node->rank == 0) {
+                node->rank = ++rank;
+            }
+        }
+
+        std::vector<FlatNode> nodes;
+        std::vector<FlatEdge> edges;
+        flatten(root, nodes, edges);
+
+        const std::string name = baseName(argv[list]);
+        out << "\nstatic const TrieNode " << name << "Nodes[] = {\n";
+        for (const FlatNode &node: nodes) {
+            out << "    {" << node.firstEdge << "u, " << node.rank << "u, " << node.edgeCount << "u},\n";
+        }
+        out << "};\n\nstatic const TrieEdge " << name << "Edges[] = {\n";
+        for (const FlatEdge &edge: edges) {
+            out << "    {" << escapeLabel(edge.label) << ", " << edge.child << "u},\n";
+        }
+        out << "};\n";
+        names.push_back(name);
+        wordCounts.push_back(rank);
+    }
+
+    out << "\nconst Dictionary dictionaries[] = {\n";
+    for (size_t i = 0; i < names.size(); ++i) {
+        out << "    {\"" << names[i] << "\", " << names[i] << "Nodes, " << names[i] << "Edges, " << wordCounts[i]
+            << "u},\n";
+    }
+    out << "};\n\nconst int dictionaryCount = " << names.size() << ";\n}\n";
+    return out ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+// Compiles a passphrase wordlist into the offset table of
+// core/passphrasewordlist.h. Runs at build time, so it only uses the standard
+// library.
+//
+// Usage: enigma_wordlistgen <output.cpp> <list.txt>
+//
+// Lines follow the EFF lists: an optional dice roll, then the word. Blank
+// lines and lines starting with '#' are skipped. Words must be unique and
+// made of lowercase letters, hyphens and apostrophes, starting with a letter:
+// capitalising a word and appending a digit then always yield a new string,
+// so the reported entropy is exact.
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static bool validWord(const std::string &word) {
+    if (word.empty() || word.size() > 255 || word[0] < 'a' || word[0] > 'z') {
+        return false;
+    }
+    for (const char c: word) {
+        if ((c < 'a' || c > 'z') && c != '-' && c != '\'') {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: enigma_wordlistgen <output.cpp> <list.txt>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[2]);
+    if (!in) {
+        std::cerr << "enigma_wordlistgen: cannot read " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> words;
+    std::set<std::string> seen;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string word;
+        std::string field;
+        while (fields >> field) {
+            word = field;
+        }
+        if (word.empty() || line.find_first_not_of(" \t") == line.find('#')) {
+            continue;
+        }
+        if (!validWord(word) || !seen.insert(word).second) {
+            std::cerr << "enigma_wordlistgen: invalid or duplicate word '" << word << "'" << std::endl;
+            return 1;
+        }
+        words.push_back(word);
+    }
+
+    std::ofstream out(argv[1]);
+    if (!out) {
+        std::cerr << "enigma_wordlistgen: cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    out << "// Generated by enigma_wordlistgen from src/core/dictionaries. Do not edit.\n\n"
+        << "#include \"core/passphrasewordlist.h\"\n\n"
+        << "namespace PassphraseWords {\n"
+        << "const char text[] =";
+    for (size_t i = 0; i < words.size(); i += 8) {
+        out << "\n    \"";
+        for (size_t j = i; j < words.size() && j < i + 8; ++j) {
+            out << words[j];
+        }
+        out << "\"";
+    }
+    out << ";\n\nconst Word words[] = {\n";
+    size_t offset = 0;
+    for (const std::string &word: words) {
+        out << "    {" << offset << "u, " << word.size() << "u},\n";
+        offset += word.size();
+    }
+    out << "};\n\nconst int wordCount = " << words.size() << ";\n}\n";
+    return out ? 0 : 1;
+}
@@ -1,66 +1,185 @@
 #include "encryption.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/pbkdf2batch.h"
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/kdf.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
 #include <QDebug>
 
-static const int PBKDF2_ITERATIONS = 10000;
+static const int ENTRY_KEY_ITERATIONS = 10000;
 static const int AES_KEY_SIZE = 32;
+static const int GCM_NONCE_SIZE = 12;
+static const int GCM_TAG_SIZE = 16;
+static const QByteArray KEY_WRAP_LABEL = "enigma-key-wrap";
+static const QByteArray RECORD_KEY_LABEL = "enigma-record-key";
+static const QByteArray FINGERPRINT_KEY_LABEL = "enigma-password-fingerprint";
+static const QByteArray FIELD_MAC_LABEL = "enigma-field-mac";
 
-Encryption::Encryption(const QByteArray &baseKey) : baseKey(baseKey)
+// Row fields are AES-256-CBC followed by a truncated HMAC-SHA256 of the IV and
+// ciphertext under a key derived from the row key (encrypt-then-MAC). CBC
+// output is a whole number of blocks, so the 24-byte tag leaves tagged fields
+// 8 bytes off a block boundary; fields written before tags existed are still
+// read, without authentication.
+static const int FIELD_TAG_SIZE = 24;
+
+static QByteArray hmacSha256(const QByteArray &key, const QByteArray &data)
+{
+    QByteArray mac(EVP_MAX_MD_SIZE, 0);
+    unsigned int len = 0;
+    if (!HMAC(EVP_sha256(), key.constData(), key.size(),
+              reinterpret_cast<const unsigned char*>(data.constData()), data.size(),
+              reinterpret_cast<unsigned char*>(mac.data()), &len)) {
+        return QByteArray();
+    }
+    mac.resize(static_cast<int>(len));
+    return mac;
+}
+
+static bool isTaggedField(const QByteArray &ciphertext)
+{
+    return ciphertext.size() % AES_BLOCK_SIZE == FIELD_TAG_SIZE % AES_BLOCK_SIZE;
+}
+
+Encryption::Encryption(const QByteArray &baseKey)
+    : baseKey(baseKey)
+    , fingerprintKey(baseKey.isEmpty() ? QByteArray() : deriveKeyHKDF(baseKey, QByteArray(), FINGERPRINT_KEY_LABEL))
 {
 }
 
 QByteArray Encryption::deriveKeyPBKDF2(const QByteArray &baseKey, const QByteArray &entrySalt)
 {
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::deriveEntryKey");
+    QByteArray outKey = Pbkdf2Batch::deriveKey(baseKey, entrySalt, ENTRY_KEY_ITERATIONS, AES_KEY_SIZE);
+    if (outKey.isEmpty()) {
+        qWarning() << "Failed to derive PBKDF2 key!";
+    }
+    return outKey;
+}
+
+// The vault key is already 32 random bytes, so stretching it per row buys
+// nothing; HKDF-SHA256 with the row salt yields an independent key per row at
+// the cost of two HMACs. The fetched KDF is shared by all threads.
+QByteArray Encryption::deriveKeyHKDF(const QByteArray &baseKey, const QByteArray &entrySalt, const QByteArray &label)
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::deriveRecordKey");
+    static EVP_KDF *const kdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+    if (!kdf) {
+        qWarning() << "HKDF is not available in this OpenSSL build!";
+        return QByteArray();
+    }
+
+    EVP_KDF_CTX *ctx = EVP_KDF_CTX_new(kdf);
+    const OSSL_PARAM kdfParams[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY,
+                                          const_cast<char *>(baseKey.constData()), baseKey.size()),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+                                          const_cast<char *>(entrySalt.constData()), entrySalt.size()),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, const_cast<char *>(label.constData()), label.size()),
+        OSSL_PARAM_construct_end()
+    };
+
     QByteArray outKey;
     outKey.resize(AES_KEY_SIZE);
+    const int result = ctx ? EVP_KDF_derive(ctx, reinterpret_cast<unsigned char*>(outKey.data()), AES_KEY_SIZE,
+                                            kdfParams) : 0;
+    EVP_KDF_CTX_free(ctx);
 
-    int result = PKCS5_PBKDF2_HMAC(
-        baseKey.constData(),
-        baseKey.size(),
-        reinterpret_cast<const unsigned char*>(entrySalt.constData()),
-        entrySalt.size(),
-        PBKDF2_ITERATIONS,
-        EVP_sha256(),
-        AES_KEY_SIZE,
-        reinterpret_cast<unsigned char*>(outKey.data())
-    );
     if (result != 1) {
-        qWarning() << "Failed to derive PBKDF2 key!";
+        qWarning() << "Failed to derive HKDF key!";
         return QByteArray();
     }
     return outKey;
 }
 
-QByteArray Encryption::deriveKeyFromPassword(const QString &password, const QByteArray &userSalt)
+// Row keys are counted here and in deriveEntryKeys only, once per row; the
+// KDF helpers below them do not count.
+QByteArray Encryption::deriveEntryKey(const QByteArray &entrySalt, const int keySchedule) const
 {
-    QByteArray outKey;
-    outKey.resize(AES_KEY_SIZE);
+    Metrics::increment(Metrics::EntryKeyDerivations);
+    if (keySchedule == HkdfKeySchedule) {
+        return deriveKeyHKDF(baseKey, entrySalt, RECORD_KEY_LABEL);
+    }
+    return deriveKeyPBKDF2(baseKey, entrySalt);
+}
 
-    QByteArray passBytes = password.toUtf8();
+// Row keys for a whole page of rows are derived together; rows still on the
+// PBKDF2 schedule go through the batch kernel so it can fill its lanes. The
+// keys line up with the salts.
+QList<QByteArray> Encryption::deriveEntryKeys(const QList<QByteArray> &entrySalts, const QList<int> &keySchedules) const
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::deriveEntryKeys");
+    Metrics::increment(Metrics::EntryKeyDerivations, entrySalts.size());
+    QList<QByteArray> keys;
+    keys.reserve(entrySalts.size());
+    QList<int> legacyRows;
+    QList<QByteArray> legacySalts;
+    for (int i = 0; i < entrySalts.size(); ++i) {
+        if (keySchedules.value(i) == HkdfKeySchedule) {
+            keys.append(deriveKeyHKDF(baseKey, entrySalts.at(i), RECORD_KEY_LABEL));
+        } else {
+            keys.append(QByteArray());
+            legacyRows.append(i);
+            legacySalts.append(entrySalts.at(i));
+        }
+    }
 
-    int result = PKCS5_PBKDF2_HMAC(
-        passBytes.constData(),
-        passBytes.size(),
-        reinterpret_cast<const unsigned char*>(userSalt.constData()),
-        userSalt.size(),
-        PBKDF2_ITERATIONS,
-        EVP_sha256(),
-        AES_KEY_SIZE,
-        reinterpret_cast<unsigned char*>(outKey.data())
-    );
+    if (!legacySalts.isEmpty()) {
+        const QList<QByteArray> legacyKeys = Pbkdf2Batch::deriveKeys(baseKey, legacySalts, ENTRY_KEY_ITERATIONS,
+                                                                     AES_KEY_SIZE);
+        for (int i = 0; i < legacyRows.size(); ++i) {
+            keys[legacyRows.at(i)] = legacyKeys.at(i);
+        }
+    }
+    return keys;
+}
 
-    if (result != 1) {
-        qWarning() << "Failed to derive user base key from password!";
+// Equal passwords get equal fingerprints within one vault, which is all the
+// reuse audit needs; the key is derived from the vault key, so fingerprints
+// reveal nothing across vaults and change when the vault key is rotated. An
+// empty password gets an empty, non-null fingerprint so it is not picked up
+// again by the backfill.
+QByteArray Encryption::passwordFingerprint(const QString &password) const
+{
+    if (fingerprintKey.isEmpty()) {
+        return QByteArray();
+    }
+    if (password.isEmpty()) {
+        return QByteArray("", 0);
+    }
+    const QByteArray utf8 = password.toUtf8();
+    QByteArray fingerprint(EVP_MAX_MD_SIZE, 0);
+    unsigned int len = 0;
+    if (!HMAC(EVP_sha256(), fingerprintKey.constData(), fingerprintKey.size(),
+              reinterpret_cast<const unsigned char*>(utf8.constData()), utf8.size(),
+              reinterpret_cast<unsigned char*>(fingerprint.data()), &len)) {
+        qWarning() << "Failed to compute password fingerprint!";
         return QByteArray();
     }
+    fingerprint.resize(static_cast<int>(len));
+    return fingerprint;
+}
+
+QByteArray Encryption::deriveKeyFromPassword(const QString &password, const QByteArray &userSalt,
+                                             const KdfParams &params)
+{
+    QByteArray outKey = KeyDerivation::deriveKey(password, userSalt, params);
+    if (outKey.isEmpty()) {
+        qWarning() << "Failed to derive user base key from password!";
+    }
     return outKey;
 }
 
 QByteArray Encryption::aesEncrypt(const QByteArray &plain, const QByteArray &key, QByteArray &ivOut)
 {
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::aesEncrypt");
     ivOut.resize(AES_BLOCK_SIZE);
     if (RAND_bytes(reinterpret_cast<unsigned char*>(ivOut.data()), AES_BLOCK_SIZE) != 1) {
         qWarning() << "Failed to generate IV!";
@@ -96,11 +215,14 @@ QByteArray Encryption::aesEncrypt(const QByteArray &plain, const QByteArray &key
 
     cipher.resize(totalLen);
 
+    Metrics::increment(Metrics::CipherOperations);
+    Metrics::increment(Metrics::BytesEncrypted, plain.size());
     return cipher;
 }
 
 QByteArray Encryption::aesDecrypt(const QByteArray &cipher, const QByteArray &key)
 {
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::aesDecrypt");
     if (cipher.size() < AES_BLOCK_SIZE) {
         qWarning() << "Ciphertext too short!";
         return QByteArray();
@@ -136,6 +258,9 @@ QByteArray Encryption::aesDecrypt(const QByteArray &cipher, const QByteArray &ke
     EVP_CIPHER_CTX_free(ctx);
 
     plain.resize(totalLen);
+
+    Metrics::increment(Metrics::CipherOperations);
+    Metrics::increment(Metrics::BytesDecrypted, totalLen);
     return plain;
 }
 
@@ -144,30 +269,138 @@ QByteArray Encryption::encryptWithSalt(const QString &plaintext, const QByteArra
     if (plaintext.isEmpty()) {
         return QByteArray();
     }
-    QByteArray finalKey = deriveKeyPBKDF2(this->baseKey, entrySalt);
+    QByteArray finalKey = deriveEntryKey(entrySalt, CurrentKeySchedule);
     if (finalKey.isEmpty()) {
         return QByteArray();
     }
-
-    QByteArray iv;
-    QByteArray cipher = aesEncrypt(plaintext.toUtf8(), finalKey, iv);
-
-    return iv + cipher;
+    return encryptBytesWithKey({plaintext.toUtf8()}, finalKey).at(0);
 }
 
-QString Encryption::decryptWithSalt(const QByteArray &ciphertext, const QByteArray &entrySalt) const
+QString Encryption::decryptWithSalt(const QByteArray &ciphertext, const QByteArray &entrySalt,
+                                    const int keySchedule) const
 {
     if (ciphertext.isEmpty()) {
         return QString();
     }
 
-    QByteArray finalKey = deriveKeyPBKDF2(this->baseKey, entrySalt);
+    QByteArray finalKey = deriveEntryKey(entrySalt, keySchedule);
     if (finalKey.isEmpty()) {
         return QString();
     }
 
-    QByteArray plain = aesDecrypt(ciphertext, finalKey);
-    return QString::fromUtf8(plain);
+    return QString::fromUtf8(decryptBytesWithKey({ciphertext}, finalKey).at(0));
+}
+
+QList<QByteArray> Encryption::encryptFieldsWithSalt(const QStringList &plaintexts, const QByteArray &entrySalt) const
+{
+    QList<QByteArray> encoded;
+    encoded.reserve(plaintexts.size());
+    for (const QString &plaintext : plaintexts) {
+        encoded.append(plaintext.toUtf8());
+    }
+    return encryptBytesWithSalt(encoded, entrySalt);
+}
+
+QStringList Encryption::decryptFieldsWithSalt(const QList<QByteArray> &ciphertexts, const QByteArray &entrySalt,
+                                              const int keySchedule) const
+{
+    QStringList plaintexts;
+    plaintexts.reserve(ciphertexts.size());
+    for (const QByteArray &plain : decryptBytesWithSalt(ciphertexts, entrySalt, keySchedule)) {
+        plaintexts.append(QString::fromUtf8(plain));
+    }
+    return plaintexts;
+}
+
+// The entry key is only derived when there is something to encrypt. Writes
+// always use the current key schedule.
+QList<QByteArray> Encryption::encryptBytesWithSalt(const QList<QByteArray> &plaintexts, const QByteArray &entrySalt) const
+{
+    for (const QByteArray &plaintext : plaintexts) {
+        if (!plaintext.isEmpty()) {
+            return encryptBytesWithKey(plaintexts, deriveEntryKey(entrySalt, CurrentKeySchedule));
+        }
+    }
+    return QList<QByteArray>(plaintexts.size());
+}
+
+QList<QByteArray> Encryption::decryptBytesWithSalt(const QList<QByteArray> &ciphertexts, const QByteArray &entrySalt,
+                                                   const int keySchedule) const
+{
+    for (const QByteArray &ciphertext : ciphertexts) {
+        if (!ciphertext.isEmpty()) {
+            return decryptBytesWithKey(ciphertexts, deriveEntryKey(entrySalt, keySchedule));
+        }
+    }
+    return QList<QByteArray>(ciphertexts.size());
+}
+
+QList<QByteArray> Encryption::encryptBytesWithKey(const QList<QByteArray> &plaintexts, const QByteArray &entryKey)
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::encryptFields");
+    QList<QByteArray> ciphertexts;
+    ciphertexts.reserve(plaintexts.size());
+    QByteArray macKey;
+    for (const QByteArray &plaintext : plaintexts) {
+        if (plaintext.isEmpty() || entryKey.isEmpty()) {
+            ciphertexts.append(QByteArray());
+            continue;
+        }
+        if (macKey.isEmpty()) {
+            macKey = hmacSha256(entryKey, FIELD_MAC_LABEL);
+        }
+
+        QByteArray iv;
+        const QByteArray cipher = aesEncrypt(plaintext, entryKey, iv);
+        const QByteArray tag = hmacSha256(macKey, iv + cipher);
+        if (cipher.isEmpty() || tag.size() < FIELD_TAG_SIZE) {
+            ciphertexts.append(QByteArray());
+            continue;
+        }
+        ciphertexts.append(iv + cipher + tag.left(FIELD_TAG_SIZE));
+    }
+    return ciphertexts;
+}
+
+// A tagged field that fails its check decrypts to nothing, the same as a
+// padding failure, so callers need no new failure path.
+QList<QByteArray> Encryption::decryptBytesWithKey(const QList<QByteArray> &ciphertexts, const QByteArray &entryKey,
+                                                  bool *authenticated)
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::decryptFields");
+    QList<QByteArray> plaintexts;
+    plaintexts.reserve(ciphertexts.size());
+    bool allTagged = !entryKey.isEmpty();
+    QByteArray macKey;
+    for (const QByteArray &ciphertext : ciphertexts) {
+        if (ciphertext.isEmpty() || entryKey.isEmpty()) {
+            plaintexts.append(QByteArray());
+            continue;
+        }
+        if (!isTaggedField(ciphertext)) {
+            allTagged = false;
+            plaintexts.append(aesDecrypt(ciphertext, entryKey));
+            continue;
+        }
+
+        if (macKey.isEmpty()) {
+            macKey = hmacSha256(entryKey, FIELD_MAC_LABEL);
+        }
+        const QByteArray body = ciphertext.left(ciphertext.size() - FIELD_TAG_SIZE);
+        const QByteArray expected = hmacSha256(macKey, body);
+        if (expected.size() < FIELD_TAG_SIZE
+            || CRYPTO_memcmp(expected.constData(), ciphertext.constData() + body.size(), FIELD_TAG_SIZE) != 0) {
+            qWarning() << "Field authentication failed!";
+            allTagged = false;
+            plaintexts.append(QByteArray());
+            continue;
+        }
+        plaintexts.append(aesDecrypt(body, entryKey));
+    }
+    if (authenticated) {
+        *authenticated = allTagged;
+    }
+    return plaintexts;
 }
 
 QByteArray Encryption::encrypt(const QString &plaintext) const
@@ -185,3 +418,118 @@ QString Encryption::decrypt(const QByteArray &ciphertext) const
     QByteArray plain = aesDecrypt(ciphertext, baseKey);
     return QString::fromUtf8(plain);
 }
+
+QByteArray Encryption::aeadEncrypt(const QByteArray &plain, const QByteArray &key, const QByteArray &associatedData)
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::aeadEncrypt");
+    if (key.size() != AES_KEY_SIZE) {
+        qWarning() << "Invalid AEAD key size!";
+        return QByteArray();
+    }
+
+    QByteArray sealed;
+    sealed.resize(GCM_NONCE_SIZE + plain.size() + GCM_TAG_SIZE);
+    auto *nonce = reinterpret_cast<unsigned char*>(sealed.data());
+    unsigned char *cipher = nonce + GCM_NONCE_SIZE;
+    if (RAND_bytes(nonce, GCM_NONCE_SIZE) != 1) {
+        qWarning() << "Failed to generate nonce!";
+        return QByteArray();
+    }
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    bool ok = EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr,
+                                 reinterpret_cast<const unsigned char*>(key.constData()), nonce) == 1;
+    if (ok && !associatedData.isEmpty()) {
+        ok = EVP_EncryptUpdate(ctx, nullptr, &len,
+                               reinterpret_cast<const unsigned char*>(associatedData.constData()),
+                               associatedData.size()) == 1;
+    }
+    if (ok && !plain.isEmpty()) {
+        ok = EVP_EncryptUpdate(ctx, cipher, &len,
+                               reinterpret_cast<const unsigned char*>(plain.constData()), plain.size()) == 1;
+    }
+    if (ok) {
+        ok = EVP_EncryptFinal_ex(ctx, cipher + plain.size(), &len) == 1;
+    }
+    if (ok) {
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, cipher + plain.size()) == 1;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+
+    if (!ok) {
+        qWarning() << "AEAD encryption failed!";
+        return QByteArray();
+    }
+    Metrics::increment(Metrics::CipherOperations);
+    Metrics::increment(Metrics::BytesEncrypted, plain.size());
+    return sealed;
+}
+
+QByteArray Encryption::aeadDecrypt(const QByteArray &sealed, const QByteArray &key, const QByteArray &associatedData,
+                                   bool *ok)
+{
+    ENIGMA_TRACE_SCOPE("crypto", "Encryption::aeadDecrypt");
+    if (ok) {
+        *ok = false;
+    }
+    if (key.size() != AES_KEY_SIZE || sealed.size() < GCM_NONCE_SIZE + GCM_TAG_SIZE) {
+        qWarning() << "Invalid AEAD input!";
+        return QByteArray();
+    }
+
+    const auto *nonce = reinterpret_cast<const unsigned char*>(sealed.constData());
+    const unsigned char *cipher = nonce + GCM_NONCE_SIZE;
+    const int cipherSize = sealed.size() - GCM_NONCE_SIZE - GCM_TAG_SIZE;
+
+    QByteArray plain;
+    plain.resize(cipherSize);
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    bool success = EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr,
+                                      reinterpret_cast<const unsigned char*>(key.constData()), nonce) == 1;
+    if (success && !associatedData.isEmpty()) {
+        success = EVP_DecryptUpdate(ctx, nullptr, &len,
+                                    reinterpret_cast<const unsigned char*>(associatedData.constData()),
+                                    associatedData.size()) == 1;
+    }
+    if (success && cipherSize > 0) {
+        success = EVP_DecryptUpdate(ctx, reinterpret_cast<unsigned char*>(plain.data()), &len,
+                                    cipher, cipherSize) == 1;
+    }
+    if (success) {
+        success = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE,
+                                      const_cast<unsigned char*>(cipher + cipherSize)) == 1;
+    }
+    if (success) {
+        success = EVP_DecryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(plain.data()) + cipherSize, &len) == 1;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+
+    if (!success) {
+        qWarning() << "AEAD authentication failed!";
+        return QByteArray();
+    }
+    if (ok) {
+        *ok = true;
+    }
+    Metrics::increment(Metrics::CipherOperations);
+    Metrics::increment(Metrics::BytesDecrypted, cipherSize);
+    return plain;
+}
+
+QByteArray Encryption::wrapKey(const QByteArray &key, const QByteArray &wrappingKey)
+{
+    return aeadEncrypt(key, wrappingKey, KEY_WRAP_LABEL);
+}
+
+QByteArray Encryption::unwrapKey(const QByteArray &wrappedKey, const QByteArray &wrappingKey)
+{
+    bool ok = false;
+    QByteArray key = aeadDecrypt(wrappedKey, wrappingKey, KEY_WRAP_LABEL, &ok);
+    if (!ok || key.size() != AES_KEY_SIZE) {
+        return QByteArray();
+    }
+    return key;
+}
@@ -3,26 +3,75 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QList>
+#include <QStringList>
+#include "core/keyderivation.h"
 
 class Encryption {
 public:
+    // How a row key is derived from the vault key and the row salt. Rows
+    // record theirs in key_schedule, and every write uses the current one.
+    enum KeySchedule {
+        Pbkdf2KeySchedule = 0,
+        HkdfKeySchedule = 1
+    };
+
+    static const KeySchedule CurrentKeySchedule = HkdfKeySchedule;
+
     explicit Encryption(const QByteArray &baseKey);
 
     QByteArray encryptWithSalt(const QString &plaintext, const QByteArray &entrySalt) const;
 
-    QString decryptWithSalt(const QByteArray &ciphertext, const QByteArray &entrySalt) const;
+    QString decryptWithSalt(const QByteArray &ciphertext, const QByteArray &entrySalt, int keySchedule) const;
+
+    QList<QByteArray> encryptFieldsWithSalt(const QStringList &plaintexts, const QByteArray &entrySalt) const;
+
+    QStringList decryptFieldsWithSalt(const QList<QByteArray> &ciphertexts, const QByteArray &entrySalt,
+                                      int keySchedule) const;
+
+    QList<QByteArray> encryptBytesWithSalt(const QList<QByteArray> &plaintexts, const QByteArray &entrySalt) const;
+
+    QList<QByteArray> decryptBytesWithSalt(const QList<QByteArray> &ciphertexts, const QByteArray &entrySalt,
+                                           int keySchedule) const;
+
+    QList<QByteArray> deriveEntryKeys(const QList<QByteArray> &entrySalts, const QList<int> &keySchedules) const;
+
+    static QList<QByteArray> encryptBytesWithKey(const QList<QByteArray> &plaintexts, const QByteArray &entryKey);
+
+    // `authenticated` is set when every non-empty field carried a valid tag;
+    // fields written before tags existed decrypt but leave it false.
+    static QList<QByteArray> decryptBytesWithKey(const QList<QByteArray> &ciphertexts, const QByteArray &entryKey,
+                                                 bool *authenticated = nullptr);
+
+    QByteArray passwordFingerprint(const QString &password) const;
 
     QByteArray encrypt(const QString &plaintext) const;
 
     QString decrypt(const QByteArray &ciphertext) const;
 
-    static QByteArray deriveKeyFromPassword(const QString &password, const QByteArray &userSalt);
+    static QByteArray deriveKeyFromPassword(const QString &password, const QByteArray &userSalt,
+                                            const KdfParams &params = KdfParams());
+
+    static QByteArray aeadEncrypt(const QByteArray &plain, const QByteArray &key,
+                                  const QByteArray &associatedData = QByteArray());
+
+    static QByteArray aeadDecrypt(const QByteArray &sealed, const QByteArray &key,
+                                  const QByteArray &associatedData = QByteArray(), bool *ok = nullptr);
+
+    static QByteArray wrapKey(const QByteArray &key, const QByteArray &wrappingKey);
+
+    static QByteArray unwrapKey(const QByteArray &wrappedKey, const QByteArray &wrappingKey);
 
 private:
     QByteArray baseKey;
+    QByteArray fingerprintKey;
+
+    QByteArray deriveEntryKey(const QByteArray &entrySalt, int keySchedule) const;
 
     static QByteArray deriveKeyPBKDF2(const QByteArray &baseKey, const QByteArray &entrySalt);
 
+    static QByteArray deriveKeyHKDF(const QByteArray &baseKey, const QByteArray &entrySalt, const QByteArray &label);
+
     static QByteArray aesEncrypt(const QByteArray &plain, const QByteArray &key, QByteArray &ivOut);
 
     static QByteArray aesDecrypt(const QByteArray &cipher, const QByteArray &key);
@@ -0,0 +1,262 @@
+#include "keyderivation.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QtConcurrent>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/core_names.h>
+#include <openssl/opensslv.h>
+
+#include <algorithm>
+
+static const int DERIVED_KEY_SIZE = 32;
+
+// scrypt runs with r = 8, so every unit of N costs exactly 1 KiB of memory and
+// memoryKiB maps directly onto N. iterations becomes scrypt's p.
+static const int SCRYPT_BLOCK_SIZE = 8;
+
+static const int MIN_PBKDF2_ITERATIONS = 10000;
+static const int MIN_SCRYPT_MEMORY_KIB = 1 << 14;
+static const int MAX_SCRYPT_MEMORY_KIB = 1 << 18;
+static const int MIN_ARGON2_MEMORY_KIB = 19 * 1024;
+static const int DEFAULT_ARGON2_MEMORY_KIB = 64 * 1024;
+static const int MAX_TIME_COST = 64;
+
+bool KdfParams::isValid() const {
+    switch (algorithm) {
+        case Pbkdf2Sha256:
+            return iterations > 0;
+        case Scrypt:
+            return iterations > 0 && memoryKiB > 1 && (memoryKiB & (memoryKiB - 1)) == 0;
+        case Argon2id:
+            return iterations > 0 && parallelism > 0 && memoryKiB >= 8 * parallelism;
+    }
+    return false;
+}
+
+QString KdfParams::algorithmName() const {
+    switch (algorithm) {
+        case Pbkdf2Sha256:
+            return "pbkdf2-sha256";
+        case Scrypt:
+            return "scrypt";
+        case Argon2id:
+            return "argon2id";
+    }
+    return QString();
+}
+
+KdfParams::Algorithm KdfParams::algorithmFromName(const QString &name, bool *ok) {
+    if (ok) {
+        *ok = true;
+    }
+    if (name == "scrypt") {
+        return Scrypt;
+    }
+    if (name == "argon2id") {
+        return Argon2id;
+    }
+    if (ok && name != "pbkdf2-sha256") {
+        *ok = false;
+    }
+    return Pbkdf2Sha256;
+}
+
+QByteArray KeyDerivation::deriveKey(const QString &password, const QByteArray &salt, const KdfParams &params) {
+    ENIGMA_TRACE_SCOPE("crypto", "KeyDerivation::deriveKey");
+    Metrics::increment(Metrics::KdfInvocations);
+    if (!params.isValid()) {
+        qWarning() << "Invalid key derivation parameters!";
+        return QByteArray();
+    }
+
+    const QByteArray passBytes = password.toUtf8();
+    switch (params.algorithm) {
+        case KdfParams::Pbkdf2Sha256:
+            return derivePbkdf2(passBytes, salt, params);
+        case KdfParams::Scrypt:
+            return deriveScrypt(passBytes, salt, params);
+        case KdfParams::Argon2id:
+            return deriveArgon2id(passBytes, salt, params);
+    }
+    return QByteArray();
+}
+
+QByteArray KeyDerivation::derivePbkdf2(const QByteArray &password, const QByteArray &salt, const KdfParams &params) {
+    QByteArray outKey;
+    outKey.resize(DERIVED_KEY_SIZE);
+
+    const int result = PKCS5_PBKDF2_HMAC(
+        password.constData(),
+        password.size(),
+        reinterpret_cast<const unsigned char *>(salt.constData()),
+        salt.size(),
+        params.iterations,
+        EVP_sha256(),
+        DERIVED_KEY_SIZE,
+        reinterpret_cast<unsigned char *>(outKey.data())
+    );
+
+    if (result != 1) {
+        qWarning() << "Failed to derive PBKDF2 key from password!";
+        return QByteArray();
+    }
+    return outKey;
+}
+
+QByteArray KeyDerivation::deriveScrypt(const QByteArray &password, const QByteArray &salt, const KdfParams &params) {
+    QByteArray outKey;
+    outKey.resize(DERIVED_KEY_SIZE);
+
+    const uint64_t n = static_cast<uint64_t>(params.memoryKiB);
+    const uint64_t p = static_cast<uint64_t>(params.iterations);
+    const uint64_t maxMemory = 128 * SCRYPT_BLOCK_SIZE * (n + p + 2) + 1024 * 1024;
+
+    const int result = EVP_PBE_scrypt(
+        password.constData(),
+        password.size(),
+        reinterpret_cast<const unsigned char *>(salt.constData()),
+        salt.size(),
+        n,
+        SCRYPT_BLOCK_SIZE,
+        p,
+        maxMemory,
+        reinterpret_cast<unsigned char *>(outKey.data()),
+        DERIVED_KEY_SIZE
+    );
+
+    if (result != 1) {
+        qWarning() << "Failed to derive scrypt key from password!";
+        return QByteArray();
+    }
+    return outKey;
+}
+
+QByteArray KeyDerivation::deriveArgon2id(const QByteArray &password, const QByteArray &salt, const KdfParams &params) {
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    EVP_KDF *kdf = EVP_KDF_fetch(nullptr, "ARGON2ID", nullptr);
+    if (!kdf) {
+        qWarning() << "Argon2id is not available in this OpenSSL build!";
+        return QByteArray();
+    }
+    EVP_KDF_CTX *ctx = EVP_KDF_CTX_new(kdf);
+    EVP_KDF_free(kdf);
+
+    uint32_t timeCost = static_cast<uint32_t>(params.iterations);
+    uint32_t memoryCost = static_cast<uint32_t>(params.memoryKiB);
+    uint32_t lanes = static_cast<uint32_t>(params.parallelism);
+    uint32_t threads = 1;
+
+    const OSSL_PARAM kdfParams[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PASSWORD,
+                                          const_cast<char *>(password.constData()), password.size()),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+                                          const_cast<char *>(salt.constData()), salt.size()),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ITER, &timeCost),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_MEMCOST, &memoryCost),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_LANES, &lanes),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_THREADS, &threads),
+        OSSL_PARAM_construct_end()
+    };
+
+    QByteArray outKey;
+    outKey.resize(DERIVED_KEY_SIZE);
+    const int result = EVP_KDF_derive(ctx, reinterpret_cast<unsigned char *>(outKey.data()),
+                                      DERIVED_KEY_SIZE, kdfParams);
+    EVP_KDF_CTX_free(ctx);
+
+    if (result != 1) {
+        qWarning() << "Failed to derive Argon2id key from password!";
+        return QByteArray();
+    }
+    return outKey;
+#else
+    Q_UNUSED(password);
+    Q_UNUSED(salt);
+    Q_UNUSED(params);
+    qWarning() << "Argon2id requires OpenSSL 3.2 or newer!";
+    return QByteArray();
+#endif
+}
+
+bool KeyDerivation::isAlgorithmAvailable(const KdfParams::Algorithm algorithm) {
+    if (algorithm != KdfParams::Argon2id) {
+        return true;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    EVP_KDF *kdf = EVP_KDF_fetch(nullptr, "ARGON2ID", nullptr);
+    EVP_KDF_free(kdf);
+    return kdf != nullptr;
+#else
+    return false;
+#endif
+}
+
+qint64 KeyDerivation::measure(const KdfParams &params) {
+    QElapsedTimer timer;
+    timer.start();
+    if (deriveKey("calibration", QByteArray(16, '\0'), params).isEmpty()) {
+        return -1;
+    }
+    return std::max<qint64>(1, timer.elapsed());
+}
+
+KdfParams KeyDerivation::calibrate(const int targetMilliseconds) {
+    KdfParams params;
+
+    if (isAlgorithmAvailable(KdfParams::Argon2id)) {
+        params.algorithm = KdfParams::Argon2id;
+        params.memoryKiB = DEFAULT_ARGON2_MEMORY_KIB;
+        params.iterations = 1;
+
+        qint64 elapsed = measure(params);
+        if (elapsed > 0) {
+            while (elapsed > targetMilliseconds && params.memoryKiB / 2 >= MIN_ARGON2_MEMORY_KIB) {
+                params.memoryKiB /= 2;
+                elapsed /= 2;
+            }
+            params.iterations = std::clamp(static_cast<int>(targetMilliseconds / elapsed), 1, MAX_TIME_COST);
+            return params;
+        }
+    }
+
+    // Without Argon2id, scrypt is the memory-hard function OpenSSL 3.0 offers.
+    // Memory grows first so that most of the budget goes to memory hardness,
+    // then p scales the remaining time linearly.
+    params.algorithm = KdfParams::Scrypt;
+    params.memoryKiB = MIN_SCRYPT_MEMORY_KIB;
+    params.iterations = 1;
+
+    qint64 elapsed = measure(params);
+    if (elapsed > 0) {
+        while (elapsed * 2 <= targetMilliseconds && params.memoryKiB < MAX_SCRYPT_MEMORY_KIB) {
+            params.memoryKiB *= 2;
+            elapsed *= 2;
+        }
+        params.iterations = std::clamp(static_cast<int>(targetMilliseconds / elapsed), 1, MAX_TIME_COST);
+        return params;
+    }
+
+    KdfParams fallback;
+    const qint64 baseline = std::max<qint64>(1, measure(fallback));
+    const qint64 scaled = static_cast<qint64>(fallback.iterations) * targetMilliseconds / baseline;
+    fallback.iterations = static_cast<int>(std::clamp<qint64>(scaled, MIN_PBKDF2_ITERATIONS, 10000000));
+    return fallback;
+}
+
+// Calibration runs once per process; whoever asks first starts it.
+static QFuture<KdfParams> recommendedCalibration() {
+    static const QFuture<KdfParams> calibration = QtConcurrent::run([] { return KeyDerivation::calibrate(); });
+    return calibration;
+}
+
+void KeyDerivation::calibrateInBackground() {
+    recommendedCalibration();
+}
+
+KdfParams KeyDerivation::recommended() {
+    return recommendedCalibration().result();
+}
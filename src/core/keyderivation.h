@@ -0,0 +1,54 @@
+#ifndef KEYDERIVATION_H
+#define KEYDERIVATION_H
+
+#include <QString>
+#include <QByteArray>
+
+struct KdfParams {
+    enum Algorithm {
+        Pbkdf2Sha256,
+        Scrypt,
+        Argon2id
+    };
+
+    // Defaults describe the fixed scheme every account used before parameters
+    // were stored per user, so rows without explicit values keep unlocking.
+    Algorithm algorithm = Pbkdf2Sha256;
+    int iterations = 10000;
+    int memoryKiB = 0;
+    int parallelism = 1;
+
+    bool isValid() const;
+
+    QString algorithmName() const;
+
+    static Algorithm algorithmFromName(const QString &name, bool *ok = nullptr);
+};
+
+class KeyDerivation {
+public:
+    static const int DEFAULT_TARGET_MS = 250;
+
+    static QByteArray deriveKey(const QString &password, const QByteArray &salt, const KdfParams &params);
+
+    static KdfParams calibrate(int targetMilliseconds = DEFAULT_TARGET_MS);
+
+    // Starts calibrating the recommended parameters on the thread pool, so a
+    // later recommended() does not stall the thread that asks for them.
+    static void calibrateInBackground();
+
+    static KdfParams recommended();
+
+    static bool isAlgorithmAvailable(KdfParams::Algorithm algorithm);
+
+private:
+    static qint64 measure(const KdfParams &params);
+
+    static QByteArray derivePbkdf2(const QByteArray &password, const QByteArray &salt, const KdfParams &params);
+
+    static QByteArray deriveScrypt(const QByteArray &password, const QByteArray &salt, const KdfParams &params);
+
+    static QByteArray deriveArgon2id(const QByteArray &password, const QByteArray &salt, const KdfParams &params);
+};
+
+#endif // KEYDERIVATION_H
@@ -0,0 +1,240 @@
+#include "metrics.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <atomic>
+#include <bit>
+
+namespace {
+    // Latency histograms are log-linear in the style of HdrHistogram: values
+    // below 32 ns get exact buckets, every power of two above that is split
+    // into 16 linear sub-buckets, bounding the relative error to about 6%.
+    const int SUB_BUCKET_BITS = 4;
+    const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+    const char *const COUNTER_NAMES[Metrics::CounterCount] = {
+        "kdf_invocations",
+        "entry_key_derivations",
+        "cipher_operations",
+        "bytes_encrypted",
+        "bytes_decrypted",
+        "sql_statements",
+        "sql_round_trips",
+        "prefetch_hits",
+        "prefetch_misses",
+        "thread_connection_hits",
+        "thread_connection_misses",
+        "note_revision_replays"
+    };
+
+    const char *const HISTOGRAM_NAMES[Metrics::HistogramCount] = {
+        "login",
+        "get_passwords",
+        "add_password",
+        "update_password"
+    };
+
+    struct LatencyHistogram {
+        std::atomic<qint64> buckets[BUCKET_COUNT] = {};
+        std::atomic<qint64> count{0};
+        std::atomic<qint64> sum{0};
+        std::atomic<qint64> max{0};
+    };
+
+    struct OperationStats {
+        qint64 invocations = 0;
+        qint64 statements = 0;
+        qint64 roundTrips = 0;
+    };
+
+    std::atomic<qint64> counters[Metrics::CounterCount] = {};
+    LatencyHistogram histograms[Metrics::HistogramCount];
+
+    QMutex operationsMutex;
+    QHash<QByteArray, OperationStats> operations;
+
+    thread_local const char *currentOperation = nullptr;
+
+    int bucketIndex(const quint64 value) {
+        if (value < 2 * SUB_BUCKET_COUNT) {
+            return static_cast<int>(value);
+        }
+        const int shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return shift * SUB_BUCKET_COUNT + static_cast<int>(value >> shift);
+    }
+
+    qint64 bucketUpperBound(const int index) {
+        if (index < 2 * SUB_BUCKET_COUNT) {
+            return index;
+        }
+        const int shift = index / SUB_BUCKET_COUNT - 1;
+        const qint64 subBucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+        return ((subBucket + 1) << shift) - 1;
+    }
+}
+
+void Metrics::increment(const Counter counter, const qint64 delta) {
+    counters[counter].fetch_add(delta, std::memory_order_relaxed);
+}
+
+qint64 Metrics::value(const Counter counter) {
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+void Metrics::recordLatency(const Histogram histogram, const qint64 nanoseconds) {
+    if (histogram == NoHistogram || nanoseconds < 0) {
+        return;
+    }
+    LatencyHistogram &h = histograms[histogram];
+    h.buckets[bucketIndex(static_cast<quint64>(nanoseconds))].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    qint64 previousMax = h.max.load(std::memory_order_relaxed);
+    while (nanoseconds > previousMax
+           && !h.max.compare_exchange_weak(previousMax, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+qint64 Metrics::latencyPercentile(const Histogram histogram, const double percentile) {
+    const LatencyHistogram &h = histograms[histogram];
+    const qint64 count = h.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+
+    const qint64 rank = qMax<qint64>(1, static_cast<qint64>(percentile / 100.0 * count + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += h.buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return qMin(bucketUpperBound(i), h.max.load(std::memory_order_relaxed));
+        }
+    }
+    return h.max.load(std::memory_order_relaxed);
+}
+
+void Metrics::recordSql(const int roundTrips) {
+    increment(SqlStatements);
+    increment(SqlRoundTrips, roundTrips);
+
+    if (!currentOperation) {
+        return;
+    }
+    QMutexLocker locker(&operationsMutex);
+    OperationStats &stats = operations[QByteArray(currentOperation)];
+    stats.statements += 1;
+    stats.roundTrips += roundTrips;
+}
+
+void Metrics::beginOperation(const char *name) {
+    QMutexLocker locker(&operationsMutex);
+    operations[QByteArray(name)].invocations += 1;
+}
+
+void Metrics::reset() {
+    for (auto &counter: counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto &h: histograms) {
+        for (auto &bucket: h.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        h.count.store(0, std::memory_order_relaxed);
+        h.sum.store(0, std::memory_order_relaxed);
+        h.max.store(0, std::memory_order_relaxed);
+    }
+    QMutexLocker locker(&operationsMutex);
+    operations.clear();
+}
+
+QString Metrics::toText() {
+    QString text;
+    QTextStream out(&text);
+
+    out << "Counters\n";
+    for (int i = 0; i < CounterCount; ++i) {
+        out << QString("  %1 %2\n").arg(COUNTER_NAMES[i], -26).arg(value(static_cast<Counter>(i)));
+    }
+
+    out << "\nLatency (ms)           count      p50      p90      p99      max\n";
+    for (int i = 0; i < HistogramCount; ++i) {
+        const auto histogram = static_cast<Histogram>(i);
+        out << QString("  %1 %2 %3 %4 %5 %6\n")
+                .arg(HISTOGRAM_NAMES[i], -16)
+                .arg(histograms[i].count.load(std::memory_order_relaxed), 10)
+                .arg(latencyPercentile(histogram, 50) / 1e6, 8, 'f', 2)
+                .arg(latencyPercentile(histogram, 90) / 1e6, 8, 'f', 2)
+                .arg(latencyPercentile(histogram, 99) / 1e6, 8, 'f', 2)
+                .arg(histograms[i].max.load(std::memory_order_relaxed) / 1e6, 8, 'f', 2);
+    }
+
+    out << "\nSQL per operation      calls   statements  round trips\n";
+    QMutexLocker locker(&operationsMutex);
+    for (auto it = operations.constBegin(); it != operations.constEnd(); ++it) {
+        out << QString("  %1 %2 %3 %4\n")
+                .arg(QString::fromUtf8(it.key()), -16)
+                .arg(it->invocations, 8)
+                .arg(it->statements, 12)
+                .arg(it->roundTrips, 12);
+    }
+    return text;
+}
+
+QByteArray Metrics::toJson() {
+    QJsonObject counterObject;
+    for (int i = 0; i < CounterCount; ++i) {
+        counterObject.insert(COUNTER_NAMES[i], value(static_cast<Counter>(i)));
+    }
+
+    QJsonObject histogramObject;
+    for (int i = 0; i < HistogramCount; ++i) {
+        const auto histogram = static_cast<Histogram>(i);
+        const qint64 count = histograms[i].count.load(std::memory_order_relaxed);
+        histogramObject.insert(HISTOGRAM_NAMES[i], QJsonObject{
+                                   {"count", count},
+                                   {"mean_ns", count ? histograms[i].sum.load(std::memory_order_relaxed) / count : 0},
+                                   {"p50_ns", latencyPercentile(histogram, 50)},
+                                   {"p90_ns", latencyPercentile(histogram, 90)},
+                                   {"p99_ns", latencyPercentile(histogram, 99)},
+                                   {"max_ns", histograms[i].max.load(std::memory_order_relaxed)}
+                               });
+    }
+
+    QJsonObject operationObject;
+    {
+        QMutexLocker locker(&operationsMutex);
+        for (auto it = operations.constBegin(); it != operations.constEnd(); ++it) {
+            operationObject.insert(QString::fromUtf8(it.key()), QJsonObject{
+                                       {"invocations", it->invocations},
+                                       {"statements", it->statements},
+                                       {"round_trips", it->roundTrips}
+                                   });
+        }
+    }
+
+    return QJsonDocument(QJsonObject{
+        {"counters", counterObject},
+        {"latency", histogramObject},
+        {"sql_per_operation", operationObject}
+    }).toJson();
+}
+
+MetricsOperation::MetricsOperation(const char *name, const Metrics::Histogram histogram)
+    : previous(currentOperation)
+      , histogram(histogram) {
+    currentOperation = name;
+    Metrics::beginOperation(name);
+    timer.start();
+}
+
+MetricsOperation::~MetricsOperation() {
+    Metrics::recordLatency(histogram, timer.nsecsElapsed());
+    currentOperation = previous;
+}
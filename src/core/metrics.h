@@ -0,0 +1,75 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+class Metrics {
+public:
+    enum Counter {
+        KdfInvocations,
+        EntryKeyDerivations,
+        CipherOperations,
+        BytesEncrypted,
+        BytesDecrypted,
+        SqlStatements,
+        SqlRoundTrips,
+        PrefetchHits,
+        PrefetchMisses,
+        ThreadConnectionHits,
+        ThreadConnectionMisses,
+        NoteRevisionReplays,
+        CounterCount
+    };
+
+    enum Histogram {
+        LoginLatency,
+        GetPasswordsLatency,
+        AddPasswordLatency,
+        UpdatePasswordLatency,
+        NoHistogram,
+        HistogramCount = NoHistogram
+    };
+
+    static void increment(Counter counter, qint64 delta = 1);
+
+    static qint64 value(Counter counter);
+
+    static void recordLatency(Histogram histogram, qint64 nanoseconds);
+
+    static qint64 latencyPercentile(Histogram histogram, double percentile);
+
+    static void recordSql(int roundTrips);
+
+    static void reset();
+
+    static QString toText();
+
+    static QByteArray toJson();
+
+private:
+    friend class MetricsOperation;
+
+    static void beginOperation(const char *name);
+};
+
+// Names the operation that SQL statements on this thread belong to and, when
+// given a histogram, records the operation's latency when it goes out of scope.
+class MetricsOperation {
+public:
+    explicit MetricsOperation(const char *name, Metrics::Histogram histogram = Metrics::NoHistogram);
+
+    ~MetricsOperation();
+
+    MetricsOperation(const MetricsOperation &) = delete;
+
+    MetricsOperation &operator=(const MetricsOperation &) = delete;
+
+private:
+    const char *previous;
+    Metrics::Histogram histogram;
+    QElapsedTimer timer;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,107 @@
+#include "passphrasegenerator.h"
+#include "core/trace.h"
+
+#include <QDebug>
+#include <cmath>
+
+// Longer than any word in the built-in or EFF lists; only sizes the buffer.
+static const int RESERVED_WORD_LENGTH = 12;
+
+PassphraseGenerator::PassphraseGenerator(const PassphrasePolicy &policy, const PassphraseWordlist &wordlist)
+    : policy(policy)
+      , wordlist(wordlist) {
+}
+
+bool PassphraseGenerator::isValid() const {
+    return policy.wordCount > 0 && wordlist.size() > 1;
+}
+
+double PassphraseGenerator::entropyBits() const {
+    if (!isValid()) {
+        return 0;
+    }
+    double bits = policy.wordCount * std::log2(static_cast<double>(wordlist.size()));
+    if (policy.capitalization == PassphrasePolicy::RandomCapitalized) {
+        bits += policy.wordCount;
+    }
+    if (policy.insertDigit) {
+        bits += std::log2(10.0 * policy.wordCount);
+    }
+    return bits;
+}
+
+// Words are letters, '-' and '\'', and the inserted digit is a digit, so a
+// separator without any of those marks every word boundary.
+bool PassphraseGenerator::isEntropyExact() const {
+    if (policy.separator.isEmpty()) {
+        return wordlist.isPrefixFree();
+    }
+    for (const QChar c: policy.separator) {
+        if (c.isLetterOrNumber() || c == '-' || c == '\'') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Appends straight into `passphrase`, which keeps its capacity between calls,
+// so reusing one string allocates nothing after the first passphrase.
+bool PassphraseGenerator::generate(QString &passphrase) {
+    if (!isValid()) {
+        qWarning() << "PassphraseGenerator: needs at least one word and a wordlist of two";
+        return false;
+    }
+
+    quint32 digitWord = 0;
+    quint32 digit = 0;
+    if (policy.insertDigit && (!random.bounded(policy.wordCount, digitWord) || !random.bounded(10, digit))) {
+        return false;
+    }
+
+    passphrase.reserve(policy.wordCount * (RESERVED_WORD_LENGTH + policy.separator.size()) + 1);
+    passphrase.resize(0);
+    for (int i = 0; i < policy.wordCount; ++i) {
+        quint32 index;
+        if (!random.bounded(wordlist.size(), index)) {
+            return false;
+        }
+        if (i > 0) {
+            passphrase.append(policy.separator);
+        }
+        const int start = passphrase.size();
+        passphrase.append(wordlist.word(index));
+
+        quint32 capitalize = policy.capitalization == PassphrasePolicy::Capitalized;
+        if (policy.capitalization == PassphrasePolicy::RandomCapitalized && !random.bounded(2, capitalize)) {
+            return false;
+        }
+        if (capitalize) {
+            passphrase[start] = passphrase.at(start).toUpper();
+        }
+        if (policy.insertDigit && static_cast<quint32>(i) == digitWord) {
+            passphrase.append(QChar('0' + digit));
+        }
+    }
+    return true;
+}
+
+QStringList PassphraseGenerator::generate(const int count, bool *ok) {
+    ENIGMA_TRACE_SCOPE("crypto", "PassphraseGenerator::generate");
+
+    QStringList passphrases;
+    passphrases.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        QString passphrase;
+        if (!generate(passphrase)) {
+            if (ok) {
+                *ok = false;
+            }
+            return QStringList();
+        }
+        passphrases.append(passphrase);
+    }
+    if (ok) {
+        *ok = true;
+    }
+    return passphrases;
+}
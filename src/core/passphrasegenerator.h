@@ -0,0 +1,52 @@
+#ifndef PASSPHRASEGENERATOR_H
+#define PASSPHRASEGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+
+#include "core/passphrasewordlist.h"
+#include "core/securerandom.h"
+
+struct PassphrasePolicy {
+    enum Capitalization {
+        LowerCase,
+        Capitalized,
+        RandomCapitalized
+    };
+
+    int wordCount = 6;
+    QString separator = "-";
+    Capitalization capitalization = LowerCase;
+    bool insertDigit = false;
+};
+
+// Diceware-style passphrases: words drawn uniformly from a wordlist, joined by
+// a separator. RandomCapitalized flips a fair coin per word, and insertDigit
+// appends one random digit to one random word. Each choice is independent and
+// uniform, so entropyBits() counts them all. It is exact only when every
+// passphrase comes from one set of choices (see isEntropyExact()); a separator
+// made of letters, digits, '-' or '\'', or none with a list that has prefix
+// words, lets two sets of choices give the same text, and it is then an upper
+// bound. Not thread-safe; give each thread its own generator.
+class PassphraseGenerator {
+public:
+    explicit PassphraseGenerator(const PassphrasePolicy &policy,
+                                 const PassphraseWordlist &wordlist = PassphraseWordlist::instance());
+
+    bool isValid() const;
+
+    double entropyBits() const;
+
+    bool isEntropyExact() const;
+
+    bool generate(QString &passphrase);
+
+    QStringList generate(int count, bool *ok = nullptr);
+
+private:
+    PassphrasePolicy policy;
+    const PassphraseWordlist &wordlist;
+    SecureRandom random;
+};
+
+#endif // PASSPHRASEGENERATOR_H
@@ -0,0 +1,144 @@
+#include "passphrasewordlist.h"
+#include "core/trace.h"
+
+#include <QDebug>
+#include <QSet>
+#include <algorithm>
+
+static bool isSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Same rule as enigma_wordlistgen.
+static bool validWord(const QByteArray &word) {
+    if (word.isEmpty() || word.size() > 255 || word.at(0) < 'a' || word.at(0) > 'z') {
+        return false;
+    }
+    for (const char c: word) {
+        if ((c < 'a' || c > 'z') && c != '-' && c != '\'') {
+            return false;
+        }
+    }
+    return true;
+}
+
+PassphraseWordlist::PassphraseWordlist()
+    : text(PassphraseWords::text)
+      , words(PassphraseWords::words)
+      , count(PassphraseWords::wordCount)
+      , prefixFree(false) {
+    prefixFree = checkPrefixFree();
+}
+
+// Lines follow the EFF lists: an optional dice roll, then the word. Only the
+// offsets are kept; the words stay in the mapping. Meant to be called once,
+// like BreachIndex::open; on failure the built-in list stays in use.
+bool PassphraseWordlist::open(const QString &path) {
+    ENIGMA_TRACE_SCOPE("model", "PassphraseWordlist::open");
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open wordlist" << path << file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+    if (!data) {
+        qWarning() << "Failed to map wordlist" << path;
+        file.close();
+        return false;
+    }
+
+    QVector<PassphraseWords::Word> parsed;
+    QSet<QByteArray> seen;
+    for (qint64 lineStart = 0; lineStart < size;) {
+        qint64 lineEnd = lineStart;
+        while (lineEnd < size && data[lineEnd] != '\n') {
+            ++lineEnd;
+        }
+        qint64 first = lineStart;
+        while (first < lineEnd && isSpace(data[first])) {
+            ++first;
+        }
+        qint64 wordEnd = lineEnd;
+        while (wordEnd > first && isSpace(data[wordEnd - 1])) {
+            --wordEnd;
+        }
+        qint64 wordStart = wordEnd;
+        while (wordStart > first && !isSpace(data[wordStart - 1])) {
+            --wordStart;
+        }
+        lineStart = lineEnd + 1;
+        if (wordStart == wordEnd || data[first] == '#') {
+            continue;
+        }
+
+        const QByteArray word = QByteArray::fromRawData(data + wordStart, static_cast<int>(wordEnd - wordStart));
+        if (!validWord(word) || seen.contains(word)) {
+            qWarning() << "Wordlist" << path << "has an invalid or duplicate word:" << word;
+            file.close();
+            return false;
+        }
+        seen.insert(word);
+        parsed.append({static_cast<uint32_t>(wordStart), static_cast<uint8_t>(word.size())});
+    }
+    if (parsed.size() < 2) {
+        qWarning() << "Wordlist" << path << "needs at least two words";
+        file.close();
+        return false;
+    }
+
+    mappedWords = parsed;
+    text = data;
+    words = mappedWords.constData();
+    count = mappedWords.size();
+    prefixFree = checkPrefixFree();
+    if (!prefixFree) {
+        qWarning() << "Wordlist" << path << "has words that are prefixes of others;"
+                   << "passphrase entropy is reported as an upper bound";
+    }
+    return true;
+}
+
+// Once sorted, a word that is a prefix of any other is a prefix of the word
+// right after it.
+bool PassphraseWordlist::checkPrefixFree() const {
+    QVector<QLatin1String> sorted;
+    sorted.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        sorted.append(word(i));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    for (int i = 1; i < sorted.size(); ++i) {
+        if (sorted.at(i).startsWith(sorted.at(i - 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int PassphraseWordlist::size() const {
+    return count;
+}
+
+QLatin1String PassphraseWordlist::word(const int index) const {
+    const PassphraseWords::Word &entry = words[index];
+    return QLatin1String(text + entry.offset, entry.length);
+}
+
+bool PassphraseWordlist::isPrefixFree() const {
+    return prefixFree;
+}
+
+QString PassphraseWordlist::defaultPath() {
+    return qEnvironmentVariable("ENIGMA_WORDLIST");
+}
+
+// Loaded once on first use. ENIGMA_WORDLIST swaps in another list, such as
+// the EFF large list; without it, or if it fails to load, the built-in list
+// is used.
+const PassphraseWordlist &PassphraseWordlist::instance() {
+    static PassphraseWordlist wordlist;
+    static const bool opened = !defaultPath().isEmpty() && wordlist.open(defaultPath());
+    Q_UNUSED(opened)
+    return wordlist;
+}
@@ -0,0 +1,55 @@
+#ifndef PASSPHRASEWORDLIST_H
+#define PASSPHRASEWORDLIST_H
+
+#include <QFile>
+#include <QLatin1String>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+
+// src/core/dictionaries/passphrase.txt, compiled into an offset table by
+// enigma_wordlistgen at build time. Word i is `length` bytes of `text`
+// starting at `offset`.
+namespace PassphraseWords {
+    struct Word {
+        uint32_t offset;
+        uint8_t length;
+    };
+
+    extern const char text[];
+    extern const Word words[];
+    extern const int wordCount;
+}
+
+// The words a passphrase is drawn from: the built-in list, or an EFF-style
+// list memory mapped from disk. Words are unique, lowercase and start with a
+// letter. Lists where no word is a prefix of another are flagged, since only
+// those split one way when joined without a separator.
+class PassphraseWordlist {
+public:
+    PassphraseWordlist();
+
+    bool open(const QString &path);
+
+    int size() const;
+
+    QLatin1String word(int index) const;
+
+    bool isPrefixFree() const;
+
+    static QString defaultPath();
+
+    static const PassphraseWordlist &instance();
+
+private:
+    QFile file;
+    const char *text;
+    const PassphraseWords::Word *words;
+    int count;
+    bool prefixFree;
+    QVector<PassphraseWords::Word> mappedWords;
+
+    bool checkPrefixFree() const;
+};
+
+#endif // PASSPHRASEWORDLIST_H
@@ -0,0 +1,110 @@
+#include "passwordgenerator.h"
+#include "core/trace.h"
+
+#include <QDebug>
+#include <utility>
+
+const QString PasswordPolicy::Uppercase = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+const QString PasswordPolicy::Lowercase = "abcdefghijklmnopqrstuvwxyz";
+const QString PasswordPolicy::Numbers = "0123456789";
+const QString PasswordPolicy::Symbols = "!@#$%^&*()-_=+[]{}|;:,.<>?";
+
+QStringList PasswordPolicy::characterSets() const {
+    QStringList result;
+    if (uppercase) {
+        result.append(Uppercase);
+    }
+    if (lowercase) {
+        result.append(Lowercase);
+    }
+    if (numbers) {
+        result.append(Numbers);
+    }
+    if (symbols) {
+        result.append(Symbols);
+    }
+    if (!custom.isEmpty()) {
+        result.append(custom);
+    }
+    return result;
+}
+
+PasswordGenerator::PasswordGenerator(const PasswordPolicy &policy)
+    : length(policy.length) {
+    // Characters are deduplicated so one typed twice in the custom set, or
+    // also present in a built-in set, is not drawn more often than the rest.
+    for (const QString &characters: policy.characterSets()) {
+        QVector<QChar> set;
+        for (const QChar c: characters) {
+            if (!set.contains(c)) {
+                set.append(c);
+            }
+            if (!pool.contains(c)) {
+                pool.append(c);
+            }
+        }
+        sets.append(set);
+    }
+}
+
+bool PasswordGenerator::isValid() const {
+    return !pool.isEmpty() && length >= sets.size();
+}
+
+int PasswordGenerator::requiredLength() const {
+    return sets.size();
+}
+
+// One character from each set, the rest from the whole pool, then a
+// Fisher-Yates shuffle so the required characters can land anywhere.
+bool PasswordGenerator::generate(QString &password) {
+    if (!isValid()) {
+        qWarning() << "PasswordGenerator: policy allows no password of length" << length;
+        return false;
+    }
+
+    password.resize(length);
+    QChar *out = password.data();
+    quint32 index;
+    int i = 0;
+    for (const QVector<QChar> &set: sets) {
+        if (!random.bounded(set.size(), index)) {
+            return false;
+        }
+        out[i++] = set.at(index);
+    }
+    for (; i < length; ++i) {
+        if (!random.bounded(pool.size(), index)) {
+            return false;
+        }
+        out[i] = pool.at(index);
+    }
+    for (i = length - 1; i > 0; --i) {
+        if (!random.bounded(i + 1, index)) {
+            return false;
+        }
+        std::swap(out[i], out[index]);
+    }
+    return true;
+}
+
+QStringList PasswordGenerator::generate(const int count, bool *ok) {
+    ENIGMA_TRACE_SCOPE("crypto", "PasswordGenerator::generate");
+
+    QStringList passwords;
+    passwords.reserve(count);
+    QString password;
+    for (int i = 0; i < count; ++i) {
+        if (!generate(password)) {
+            if (ok) {
+                *ok = false;
+            }
+            return QStringList();
+        }
+        passwords.append(password);
+    }
+    if (ok) {
+        *ok = true;
+    }
+    return passwords;
+}
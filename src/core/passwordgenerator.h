@@ -0,0 +1,52 @@
+#ifndef PASSWORDGENERATOR_H
+#define PASSWORDGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "core/securerandom.h"
+
+// Which characters a generated password may use. Every enabled set, custom
+// characters included, appears at least once in each password.
+struct PasswordPolicy {
+    static const QString Uppercase;
+    static const QString Lowercase;
+    static const QString Numbers;
+    static const QString Symbols;
+
+    int length = 16;
+    bool uppercase = true;
+    bool lowercase = true;
+    bool numbers = true;
+    bool symbols = true;
+    QString custom;
+
+    QStringList characterSets() const;
+};
+
+// Draws passwords from SecureRandom. Every draw, including the shuffle's, is
+// uniform within the set it picks from; characters of small required sets
+// still turn up more often than those of large ones. Not thread-safe; give
+// each thread its own generator.
+class PasswordGenerator {
+public:
+    explicit PasswordGenerator(const PasswordPolicy &policy);
+
+    bool isValid() const;
+
+    int requiredLength() const;
+
+    bool generate(QString &password);
+
+    QStringList generate(int count, bool *ok = nullptr);
+
+private:
+    int length;
+    QVector<QVector<QChar> > sets;
+    QVector<QChar> pool;
+
+    SecureRandom random;
+};
+
+#endif // PASSWORDGENERATOR_H
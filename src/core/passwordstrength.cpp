@@ -0,0 +1,795 @@
+#include "passwordstrength.h"
+#include "core/strengthdictionaries.h"
+
+#include <QDate>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using StrengthDictionaries::Dictionary;
+using StrengthDictionaries::TrieEdge;
+using StrengthDictionaries::TrieNode;
+
+// The constants are zxcvbn's. Only the first MAX_ANALYZED_LENGTH characters
+// are matched; each one after that is counted as brute force.
+static const int MAX_ANALYZED_LENGTH = 100;
+static const double BRUTEFORCE_CARDINALITY = 10;
+static const double MIN_SUBMATCH_GUESSES_SINGLE_CHAR = 10;
+static const double MIN_SUBMATCH_GUESSES_MULTI_CHAR = 50;
+static const double MIN_GUESSES_BEFORE_GROWING_SEQUENCE = 10000;
+static const int MIN_YEAR_SPACE = 20;
+static const int MAX_SEQUENCE_DELTA = 5;
+static const double SCORE_THRESHOLDS[] = {1e3 + 5, 1e6 + 5, 1e8 + 5, 1e10 + 5};
+
+struct KeyboardGraph {
+    bool slanted = false;
+    QHash<ushort, QPair<int, int> > keys;
+    QSet<ushort> shifted;
+    double startingPositions = 0;
+    double averageDegree = 0;
+};
+
+// Keys are placed in half-key units, so the stagger of a slanted keyboard is
+// exact. A step between two adjacent keys gets a direction code; keyboard
+// walks count how often it changes.
+static int keyStep(const KeyboardGraph &graph, const QPair<int, int> &from, const QPair<int, int> &to) {
+    const int dr = to.first - from.first;
+    const int dx = to.second - from.second;
+    const bool adjacent = graph.slanted
+                              ? (dr == 0 && std::abs(dx) == 2) || (std::abs(dr) == 1 && std::abs(dx) == 1)
+                              : std::abs(dr) <= 1 && std::abs(dx) <= 2 && (dr != 0 || dx != 0);
+    return adjacent ? (dr + 1) * 8 + dx + 2 : -1;
+}
+
+static KeyboardGraph buildGraph(const QStringList &rows, const QStringList &shiftedRows, const QList<int> &offsets,
+                                const bool slanted) {
+    KeyboardGraph graph;
+    graph.slanted = slanted;
+    QList<QPair<int, int> > places;
+    for (int row = 0; row < rows.size(); ++row) {
+        for (int col = 0; col < rows.at(row).size(); ++col) {
+            const QPair<int, int> place(row, offsets.at(row) + 2 * col);
+            places.append(place);
+            graph.keys.insert(rows.at(row).at(col).unicode(), place);
+            if (row < shiftedRows.size()) {
+                graph.keys.insert(shiftedRows.at(row).at(col).unicode(), place);
+                graph.shifted.insert(shiftedRows.at(row).at(col).unicode());
+            }
+        }
+    }
+
+    int edges = 0;
+    for (const auto &from: places) {
+        for (const auto &to: places) {
+            edges += keyStep(graph, from, to) >= 0;
+        }
+    }
+    graph.startingPositions = places.size();
+    graph.averageDegree = static_cast<double>(edges) / places.size();
+    return graph;
+}
+
+static const QList<KeyboardGraph> &keyboardGraphs() {
+    static const QList<KeyboardGraph> graphs = {
+        buildGraph({"`1234567890-=", "qwertyuiop[]\\", "asdfghjkl;'", "zxcvbnm,./"},
+                   {"~!@#$%^&*()_+", "QWERTYUIOP{}|", "ASDFGHJKL:\"", "ZXCVBNM<>?"}, {0, 3, 4, 5}, true),
+        buildGraph({"/*-", "789+", "456", "123", "0."}, {}, {2, 0, 0, 0, 2}, false)
+    };
+    return graphs;
+}
+
+static int referenceYear() {
+    static const int year = QDate::currentDate().year();
+    return year;
+}
+
+static double nCk(const int n, const int k) {
+    if (k > n) {
+        return 0;
+    }
+    double r = 1;
+    for (int d = 1; d <= k; ++d) {
+        r = r * (n - k + d) / d;
+    }
+    return r;
+}
+
+// l! + MIN_GUESSES_BEFORE_GROWING_SEQUENCE^(l - 1) splits into the factor
+// and the penalty of a cover of l matches; both are looked up per update.
+struct SequenceCosts {
+    double factorial[MAX_ANALYZED_LENGTH + 1];
+    double penalty[MAX_ANALYZED_LENGTH + 1];
+    double bruteforce[MAX_ANALYZED_LENGTH + 1];
+
+    SequenceCosts() : factorial(), penalty(), bruteforce() {
+        factorial[0] = 1;
+        penalty[0] = 0;
+        bruteforce[0] = 1;
+        for (int l = 1; l <= MAX_ANALYZED_LENGTH; ++l) {
+            factorial[l] = factorial[l - 1] * l;
+            penalty[l] = std::pow(MIN_GUESSES_BEFORE_GROWING_SEQUENCE, l - 1);
+            bruteforce[l] = std::max(std::pow(BRUTEFORCE_CARDINALITY, l),
+                                     l == 1 ? MIN_SUBMATCH_GUESSES_SINGLE_CHAR + 1 : MIN_SUBMATCH_GUESSES_MULTI_CHAR + 1);
+        }
+    }
+};
+
+static const SequenceCosts &sequenceCosts() {
+    static const SequenceCosts costs;
+    return costs;
+}
+
+// Letters a character commonly stands in for.
+static const char *l33tLetters(const ushort c) {
+    switch (c) {
+        case '4':
+        case '@':
+            return "a";
+        case '8':
+            return "b";
+        case '(':
+        case '{':
+        case '[':
+        case '<':
+            return "c";
+        case '3':
+            return "e";
+        case '6':
+        case '9':
+            return "g";
+        case '1':
+        case '|':
+            return "il";
+        case '!':
+            return "i";
+        case '0':
+            return "o";
+        case '$':
+        case '5':
+            return "s";
+        case '+':
+        case '7':
+            return "t";
+        case '%':
+            return "x";
+        case '2':
+            return "z";
+        default:
+            return "";
+    }
+}
+
+static qint64 trieChild(const Dictionary &dictionary, const quint32 node, const char label) {
+    const TrieNode &parent = dictionary.nodes[node];
+    const TrieEdge *first = dictionary.edges + parent.firstEdge;
+    const TrieEdge *last = first + parent.edgeCount;
+    const TrieEdge *edge = std::lower_bound(first, last, label, [](const TrieEdge &e, const char l) {
+        return e.label < l;
+    });
+    return edge != last && edge->label == label ? static_cast<qint64>(edge->child) : -1;
+}
+
+static bool isDictionary(const int index, const char *name) {
+    return index >= 0 && qstrcmp(StrengthDictionaries::dictionaries[index].name, name) == 0;
+}
+
+static double bruteforceGuesses(const int length) {
+    return sequenceCosts().bruteforce[length];
+}
+
+static double submatchGuesses(const StrengthMatch &match) {
+    return std::max(match.guesses,
+                    match.length() == 1 ? MIN_SUBMATCH_GUESSES_SINGLE_CHAR : MIN_SUBMATCH_GUESSES_MULTI_CHAR);
+}
+
+static int charClass(const QChar c) {
+    return c.isLower() ? 0 : c.isUpper() ? 1 : c.isDigit() ? 2 : -1;
+}
+
+// Day, month and year of a date written as three numbers, or an invalid date.
+static QDate dateFromParts(const int first, const int second, const int third, const bool yearFirst,
+                           const int yearDigits) {
+    int year = yearFirst ? first : third;
+    if (yearDigits == 2) {
+        year += year > 50 ? 1900 : 2000;
+    }
+    if (year < 1000 || year > 2050) {
+        return QDate();
+    }
+    const int a = yearFirst ? second : first;
+    const int b = yearFirst ? third : second;
+    QDate date(year, a, b);
+    if (!date.isValid()) {
+        date = QDate(year, b, a);
+    }
+    return date;
+}
+
+PasswordStrength::PasswordStrength() {
+}
+
+// Details of the entry itself, such as the service or username, are cheap
+// guesses too. Changing them starts over.
+void PasswordStrength::setUserInputs(const QStringList &inputs) {
+    userInputs.clear();
+    for (const QString &input: inputs) {
+        const QString word = input.toLower();
+        if (!word.isEmpty() && !userInputs.contains(word)) {
+            userInputs.append(word);
+        }
+    }
+    truncate(0);
+}
+
+StrengthResult PasswordStrength::update(const QString &password) {
+    const QString analyzed = password.left(MAX_ANALYZED_LENGTH);
+    int common = 0;
+    while (common < text.size() && common < analyzed.size() && text.at(common) == analyzed.at(common)) {
+        ++common;
+    }
+    truncate(common);
+    for (int i = common; i < analyzed.size(); ++i) {
+        append(analyzed.at(i));
+    }
+    return result(password);
+}
+
+StrengthResult PasswordStrength::estimate(const QString &password, const QStringList &userInputs) {
+    PasswordStrength strength;
+    strength.setUserInputs(userInputs);
+    return strength.update(password);
+}
+
+int PasswordStrength::scoreForGuesses(const double guesses) {
+    int score = 0;
+    while (score < 4 && guesses >= SCORE_THRESHOLDS[score]) {
+        ++score;
+    }
+    return score;
+}
+
+QString PasswordStrength::scoreName(const int score) {
+    static const char *const names[] = {"Very Weak", "Weak", "Moderate", "Strong", "Very Strong"};
+    return names[qBound(0, score, 4)];
+}
+
+void PasswordStrength::truncate(const int length) {
+    text.truncate(length);
+    lower.truncate(length);
+    positions.resize(length);
+}
+
+void PasswordStrength::append(const QChar c) {
+    text.append(c);
+    lower.append(c.toLower());
+    const int k = text.size() - 1;
+    positions.append(Position());
+    Position &position = positions[k];
+
+    matchDictionaries(k, position);
+    matchReversed(k, position);
+    matchUserInputs(k, position);
+    matchSpatial(k, position);
+    matchRepeats(k, position);
+    matchSequences(k, position);
+    matchDates(k, position);
+    extendOptimal(k);
+}
+
+void PasswordStrength::addMatch(Position &position, const StrengthMatch &match) {
+    position.matches.append(match);
+    const auto best = position.spanGuesses.constFind(match.start);
+    if (best == position.spanGuesses.constEnd() || match.guesses < best.value()) {
+        position.spanGuesses.insert(match.start, match.guesses);
+    }
+}
+
+// zxcvbn's count of the ways to capitalize a word: 1 if it is all lowercase,
+// 2 if only the first or last letter or every letter is uppercase.
+double PasswordStrength::uppercaseVariations(const int start, const int end) const {
+    int upper = 0;
+    int lowerCount = 0;
+    for (int i = start; i <= end; ++i) {
+        upper += text.at(i).isUpper();
+        lowerCount += text.at(i).isLower();
+    }
+    if (upper == 0) {
+        return 1;
+    }
+    if (lowerCount == 0 || (upper == 1 && (text.at(start).isUpper() || text.at(end).isUpper()))) {
+        return 2;
+    }
+    double variations = 0;
+    for (int i = 1; i <= std::min(upper, lowerCount); ++i) {
+        variations += nCk(upper + lowerCount, i);
+    }
+    return variations;
+}
+
+// Every word that could still be under way keeps a cursor into the trie, so
+// a new character only advances those and starts one more.
+void PasswordStrength::matchDictionaries(const int k, Position &position) {
+    const ushort c = lower.at(k).unicode();
+    const char *substitutes = l33tLetters(text.at(k).unicode());
+    position.cursors.resize(StrengthDictionaries::dictionaryCount);
+
+    for (int d = 0; d < StrengthDictionaries::dictionaryCount; ++d) {
+        const Dictionary &dictionary = StrengthDictionaries::dictionaries[d];
+        QVector<Cursor> live = k > 0 ? positions.at(k - 1).cursors.at(d) : QVector<Cursor>();
+        live.append(Cursor{k, 0, 0});
+
+        QVector<Cursor> &advanced = position.cursors[d];
+        for (const Cursor &cursor: live) {
+            for (int s = -1; s < static_cast<int>(qstrlen(substitutes)); ++s) {
+                if (s < 0 && c >= 128) {
+                    continue;
+                }
+                const char letter = s < 0 ? static_cast<char>(c) : substitutes[s];
+                const qint64 child = trieChild(dictionary, cursor.node, letter);
+                if (child < 0) {
+                    continue;
+                }
+                const Cursor next{cursor.start, static_cast<quint32>(child),
+                                  cursor.substitutions | (s < 0 ? 0u : 1u << (letter - 'a'))};
+                advanced.append(next);
+
+                const quint32 rank = dictionary.nodes[child].rank;
+                if (rank == 0 || (next.substitutions && k == next.start)) {
+                    continue;
+                }
+                StrengthMatch match;
+                match.pattern = StrengthMatch::Dictionary;
+                match.start = next.start;
+                match.end = k;
+                match.dictionary = d;
+                match.rank = static_cast<int>(rank);
+                match.l33t = next.substitutions != 0;
+                match.guesses = rank * uppercaseVariations(next.start, k)
+                                * std::pow(2.0, qPopulationCount(next.substitutions));
+                addMatch(position, match);
+            }
+        }
+    }
+}
+
+// A reversed word ends here if the trie accepts the characters read backwards.
+void PasswordStrength::matchReversed(const int k, Position &position) {
+    for (int d = 0; d < StrengthDictionaries::dictionaryCount; ++d) {
+        const Dictionary &dictionary = StrengthDictionaries::dictionaries[d];
+        quint32 node = 0;
+        for (int j = k; j >= 0; --j) {
+            const ushort c = lower.at(j).unicode();
+            const qint64 child = c < 128 ? trieChild(dictionary, node, static_cast<char>(c)) : -1;
+            if (child < 0) {
+                break;
+            }
+            node = static_cast<quint32>(child);
+            if (dictionary.nodes[node].rank == 0 || j == k) {
+                continue;
+            }
+            StrengthMatch match;
+            match.pattern = StrengthMatch::Dictionary;
+            match.start = j;
+            match.end = k;
+            match.dictionary = d;
+            match.rank = static_cast<int>(dictionary.nodes[node].rank);
+            match.reversed = true;
+            match.guesses = match.rank * uppercaseVariations(j, k) * 2;
+            addMatch(position, match);
+        }
+    }
+}
+
+void PasswordStrength::matchUserInputs(const int k, Position &position) {
+    for (int i = 0; i < userInputs.size(); ++i) {
+        const QString &word = userInputs.at(i);
+        const int start = k - word.size() + 1;
+        if (start < 0 || lower.midRef(start, word.size()) != word) {
+            continue;
+        }
+        StrengthMatch match;
+        match.pattern = StrengthMatch::UserInput;
+        match.start = start;
+        match.end = k;
+        match.rank = i + 1;
+        match.guesses = match.rank * uppercaseVariations(start, k);
+        addMatch(position, match);
+    }
+}
+
+// Walks of three or more adjacent keys ending here, on a QWERTY keyboard or
+// a keypad. Guesses follow zxcvbn: the number of walks of that length with at
+// most as many turns, times the ways to place the shifted keys.
+void PasswordStrength::matchSpatial(const int k, Position &position) {
+    for (int g = 0; g < keyboardGraphs().size(); ++g) {
+        const KeyboardGraph &graph = keyboardGraphs().at(g);
+        const auto last = graph.keys.constFind(text.at(k).unicode());
+        if (last == graph.keys.constEnd()) {
+            continue;
+        }
+
+        int turns = 1;
+        int previousStep = -1;
+        int shifted = graph.shifted.contains(text.at(k).unicode());
+        QPair<int, int> place = last.value();
+        for (int s = k - 1; s >= 0; --s) {
+            const auto key = graph.keys.constFind(text.at(s).unicode());
+            if (key == graph.keys.constEnd()) {
+                break;
+            }
+            const int step = keyStep(graph, key.value(), place);
+            if (step < 0) {
+                break;
+            }
+            if (previousStep >= 0 && step != previousStep) {
+                ++turns;
+            }
+            previousStep = step;
+            place = key.value();
+            shifted += graph.shifted.contains(text.at(s).unicode());
+
+            const int length = k - s + 1;
+            if (length < 3) {
+                continue;
+            }
+            double guesses = 0;
+            for (int i = 2; i <= length; ++i) {
+                for (int j = 1; j <= std::min(turns, i - 1); ++j) {
+                    guesses += nCk(i - 1, j - 1) * graph.startingPositions * std::pow(graph.averageDegree, j);
+                }
+            }
+            if (shifted > 0) {
+                const int unshifted = length - shifted;
+                if (unshifted == 0) {
+                    guesses *= 2;
+                } else {
+                    double variations = 0;
+                    for (int i = 1; i <= std::min(shifted, unshifted); ++i) {
+                        variations += nCk(length, i);
+                    }
+                    guesses *= variations;
+                }
+            }
+
+            StrengthMatch match;
+            match.pattern = StrengthMatch::Spatial;
+            match.start = s;
+            match.end = k;
+            match.turns = turns;
+            match.guesses = guesses;
+            addMatch(position, match);
+        }
+    }
+}
+
+// The longest run ending here that repeats a base of each length. Bases that
+// are repeats themselves are left to the shorter period. A repeat costs its
+// base, guessed as cheaply as any single match of it, times the count.
+void PasswordStrength::matchRepeats(const int k, Position &position) {
+    for (int period = 1; period <= (k + 1) / 2; ++period) {
+        int t = k;
+        while (t - period >= 0 && text.at(t) == text.at(t - period)) {
+            --t;
+        }
+        const int count = (k - t + period) / period;
+        if (count < 2) {
+            continue;
+        }
+        const int start = k - count * period + 1;
+
+        bool primitive = true;
+        for (int q = 1; q < period && primitive; ++q) {
+            if (period % q != 0) {
+                continue;
+            }
+            bool periodic = true;
+            for (int i = start + q; i < start + period && periodic; ++i) {
+                periodic = text.at(i) == text.at(i - q);
+            }
+            primitive = !periodic;
+        }
+        if (!primitive) {
+            continue;
+        }
+
+        const double baseGuesses = std::min(bruteforceGuesses(period),
+                                            positions.at(start + period - 1).spanGuesses.value(
+                                                start, std::numeric_limits<double>::infinity()));
+        StrengthMatch match;
+        match.pattern = StrengthMatch::Repeat;
+        match.start = start;
+        match.end = k;
+        match.baseLength = period;
+        match.guesses = baseGuesses * count;
+        addMatch(position, match);
+    }
+}
+
+// Runs like "abc", "7531" or "ZYX": characters of one class that step by the
+// same amount, up to MAX_SEQUENCE_DELTA.
+void PasswordStrength::matchSequences(const int k, Position &position) {
+    if (k < 1 || charClass(text.at(k)) < 0 || charClass(text.at(k)) != charClass(text.at(k - 1))) {
+        return;
+    }
+    const int delta = text.at(k).unicode() - text.at(k - 1).unicode();
+    if (delta == 0 || std::abs(delta) > MAX_SEQUENCE_DELTA) {
+        return;
+    }
+    int first = k - 1;
+    while (first > 0 && charClass(text.at(first - 1)) == charClass(text.at(k))
+           && text.at(first).unicode() - text.at(first - 1).unicode() == delta) {
+        --first;
+    }
+
+    for (int s = first; s < k; ++s) {
+        const int length = k - s + 1;
+        if (length < 3 && std::abs(delta) != 1) {
+            continue;
+        }
+        const QChar head = text.at(s);
+        double base = QString("aAzZ019").contains(head) ? 4 : head.isDigit() ? 10 : 26;
+        if (delta < 0) {
+            base *= 2;
+        }
+        StrengthMatch match;
+        match.pattern = StrengthMatch::Sequence;
+        match.start = s;
+        match.end = k;
+        match.guesses = base * length;
+        addMatch(position, match);
+    }
+}
+
+// Years from 1900 to 2099, and dates of six or eight digits or of three
+// numbers with a repeated separator ("1.5.1987", "87-05-01").
+void PasswordStrength::matchDates(const int k, Position &position) {
+    for (int length = 4; length <= 10 && length <= k + 1; ++length) {
+        const int start = k - length + 1;
+        const QString token = text.mid(start, length);
+
+        bool digitsOnly = true;
+        for (const QChar c: token) {
+            digitsOnly = digitsOnly && c.isDigit();
+        }
+
+        QList<QDate> candidates;
+        bool separated = false;
+        if (digitsOnly && length == 4) {
+            const int year = token.toInt();
+            if (year >= 1900 && year <= 2099) {
+                StrengthMatch match;
+                match.pattern = StrengthMatch::Year;
+                match.start = start;
+                match.end = k;
+                match.guesses = std::max(std::abs(year - referenceYear()), MIN_YEAR_SPACE);
+                addMatch(position, match);
+            }
+            continue;
+        }
+        if (digitsOnly && (length == 6 || length == 8)) {
+            const int yearDigits = length == 6 ? 2 : 4;
+            const int restDigits = (length - yearDigits) / 2;
+            candidates.append(dateFromParts(token.left(yearDigits).toInt(), token.mid(yearDigits, restDigits).toInt(),
+                                            token.right(restDigits).toInt(), true, yearDigits));
+            candidates.append(dateFromParts(token.left(restDigits).toInt(), token.mid(restDigits, restDigits).toInt(),
+                                            token.right(yearDigits).toInt(), false, yearDigits));
+        } else if (!digitsOnly && length >= 6) {
+            static const QString separators = " -/\\_.";
+            int firstSeparator = 0;
+            while (token.at(firstSeparator).isDigit()) {
+                ++firstSeparator;
+            }
+            const QChar separator = token.at(firstSeparator);
+            const QStringList parts = token.split(separator);
+            bool numeric = separators.contains(separator) && parts.size() == 3;
+            for (const QString &part: parts) {
+                for (const QChar c: part) {
+                    numeric = numeric && c.isDigit();
+                }
+                numeric = numeric && !part.isEmpty() && part.size() <= 4;
+            }
+            if (!numeric || parts.at(1).size() > 2) {
+                continue;
+            }
+            separated = true;
+            if (parts.at(0).size() == 4 || (parts.at(0).size() == 2 && parts.at(2).size() <= 2)) {
+                candidates.append(dateFromParts(parts.at(0).toInt(), parts.at(1).toInt(), parts.at(2).toInt(), true,
+                                                parts.at(0).size()));
+            }
+            if (parts.at(2).size() == 4 || parts.at(2).size() == 2) {
+                candidates.append(dateFromParts(parts.at(0).toInt(), parts.at(1).toInt(), parts.at(2).toInt(), false,
+                                                parts.at(2).size()));
+            }
+        }
+
+        int space = -1;
+        for (const QDate &date: candidates) {
+            if (date.isValid()) {
+                const int candidateSpace = std::max(std::abs(date.year() - referenceYear()), MIN_YEAR_SPACE);
+                space = space < 0 ? candidateSpace : std::min(space, candidateSpace);
+            }
+        }
+        if (space < 0) {
+            continue;
+        }
+        StrengthMatch match;
+        match.pattern = StrengthMatch::Date;
+        match.start = start;
+        match.end = k;
+        match.guesses = 365.0 * space * (separated ? 4 : 1);
+        addMatch(position, match);
+    }
+}
+
+// zxcvbn's search for the cheapest cover: optimal[l - 1] at position k holds
+// the best way to cover the first k + 1 characters with l matches. A cover of
+// l matches costs l! times the product of their guesses, plus a penalty that
+// grows with l, and brute force never follows brute force.
+void PasswordStrength::extendOptimal(const int k) {
+    const QList<StrengthMatch> matches = positions.at(k).matches;
+    for (const StrengthMatch &match: matches) {
+        if (match.start == 0) {
+            updateCell(k, match, 1);
+            continue;
+        }
+        const QVector<Cell> &before = positions.at(match.start - 1).optimal;
+        for (int l = 1; l <= before.size(); ++l) {
+            if (before.at(l - 1).valid) {
+                updateCell(k, match, l + 1);
+            }
+        }
+    }
+
+    StrengthMatch bruteforce;
+    bruteforce.pattern = StrengthMatch::Bruteforce;
+    bruteforce.end = k;
+    for (int start = 0; start <= k; ++start) {
+        bruteforce.start = start;
+        bruteforce.guesses = bruteforceGuesses(k - start + 1);
+        if (start == 0) {
+            updateCell(k, bruteforce, 1);
+            continue;
+        }
+        const QVector<Cell> &before = positions.at(start - 1).optimal;
+        for (int l = 1; l <= before.size(); ++l) {
+            if (before.at(l - 1).valid && before.at(l - 1).match.pattern != StrengthMatch::Bruteforce) {
+                updateCell(k, bruteforce, l + 1);
+            }
+        }
+    }
+}
+
+void PasswordStrength::updateCell(const int k, const StrengthMatch &match, const int l) {
+    double pi = submatchGuesses(match);
+    if (l > 1) {
+        pi *= positions.at(match.start - 1).optimal.at(l - 2).pi;
+    }
+    const double g = sequenceCosts().factorial[l] * pi + sequenceCosts().penalty[l];
+
+    QVector<Cell> &optimal = positions[k].optimal;
+    for (int competing = 0; competing < std::min(l, static_cast<int>(optimal.size())); ++competing) {
+        if (optimal.at(competing).valid && optimal.at(competing).g <= g) {
+            return;
+        }
+    }
+    if (optimal.size() < l) {
+        optimal.resize(l);
+    }
+    optimal[l - 1] = Cell{true, pi, g, match};
+}
+
+StrengthResult PasswordStrength::result(const QString &password) const {
+    StrengthResult result;
+    const int n = text.size();
+    if (n == 0) {
+        result.suggestions = {"Use a few words, avoid common phrases.",
+                              "No need for symbols, digits, or uppercase letters."};
+        return result;
+    }
+
+    const QVector<Cell> &last = positions.at(n - 1).optimal;
+    int bestL = 0;
+    for (int l = 1; l <= last.size(); ++l) {
+        if (last.at(l - 1).valid && (bestL == 0 || last.at(l - 1).g < last.at(bestL - 1).g)) {
+            bestL = l;
+        }
+    }
+    result.guesses = last.at(bestL - 1).g;
+    for (int k = n - 1, l = bestL; k >= 0; --l) {
+        const StrengthMatch &match = positions.at(k).optimal.at(l - 1).match;
+        result.sequence.prepend(match);
+        k = match.start - 1;
+    }
+
+    // A match that covers the whole password is not held to the submatch
+    // minimum.
+    for (const StrengthMatch &match: positions.at(n - 1).matches) {
+        if (password.size() == n && match.start == 0 && match.guesses + 1 < result.guesses) {
+            result.guesses = match.guesses + 1;
+            result.sequence = {match};
+        }
+    }
+    result.guesses *= std::pow(BRUTEFORCE_CARDINALITY, password.size() - n);
+
+    result.score = scoreForGuesses(result.guesses);
+    if (result.score > 2) {
+        return result;
+    }
+
+    const StrengthMatch *longest = &result.sequence.first();
+    for (const StrengthMatch &match: result.sequence) {
+        if (match.length() > longest->length()) {
+            longest = &match;
+        }
+    }
+    const bool sole = result.sequence.size() == 1;
+    const QString token = text.mid(longest->start, longest->length());
+    result.suggestions.append("Add another word or two. Uncommon words are better.");
+
+    switch (longest->pattern) {
+        case StrengthMatch::Dictionary:
+            if (isDictionary(longest->dictionary, "passwords")) {
+                if (sole && !longest->l33t && !longest->reversed) {
+                    result.warning = longest->rank <= 10
+                                         ? "This is a top-10 common password."
+                                         : longest->rank <= 100
+                                               ? "This is a top-100 common password."
+                                               : "This is a very common password.";
+                } else if (longest->guesses <= 1e4) {
+                    result.warning = "This is similar to a commonly used password.";
+                }
+            } else if (isDictionary(longest->dictionary, "english")) {
+                if (sole) {
+                    result.warning = "A word by itself is easy to guess.";
+                }
+            } else if (sole) {
+                result.warning = "Names and surnames by themselves are easy to guess.";
+            } else {
+                result.warning = "Common names and surnames are easy to guess.";
+            }
+            if (token.at(0).isUpper() && token.mid(1).toLower() == token.mid(1)) {
+                result.suggestions.append("Capitalization doesn't help very much.");
+            } else if (token.toUpper() == token && token.toLower() != token) {
+                result.suggestions.append("All-uppercase is almost as easy to guess as all-lowercase.");
+            }
+            if (longest->reversed && token.size() >= 4) {
+                result.suggestions.append("Reversed words aren't much harder to guess.");
+            }
+            if (longest->l33t) {
+                result.suggestions.append("Predictable substitutions like '@' instead of 'a' don't help very much.");
+            }
+            break;
+        case StrengthMatch::UserInput:
+            result.warning = "This password contains details of the entry itself.";
+            break;
+        case StrengthMatch::Spatial:
+            result.warning = longest->turns == 1
+                                 ? "Straight rows of keys are easy to guess."
+                                 : "Short keyboard patterns are easy to guess.";
+            result.suggestions.append("Use a longer keyboard pattern with more turns.");
+            break;
+        case StrengthMatch::Repeat:
+            result.warning = longest->baseLength == 1
+                                 ? "Repeats like \"aaa\" are easy to guess."
+                                 : "Repeats like \"abcabcabc\" are only slightly harder to guess than \"abc\".";
+            result.suggestions.append("Avoid repeated words and characters.");
+            break;
+        case StrengthMatch::Sequence:
+            result.warning = "Sequences like abc or 6543 are easy to guess.";
+            result.suggestions.append("Avoid sequences.");
+            break;
+        case StrengthMatch::Year:
+            result.warning = "Recent years are easy to guess.";
+            result.suggestions.append("Avoid recent years.");
+            result.suggestions.append("Avoid years that are associated with you.");
+            break;
+        case StrengthMatch::Date:
+            result.warning = "Dates are often easy to guess.";
+            result.suggestions.append("Avoid dates and years that are associated with you.");
+            break;
+        case StrengthMatch::Bruteforce:
+            break;
+    }
+    return result;
+}
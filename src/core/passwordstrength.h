@@ -0,0 +1,123 @@
+#ifndef PASSWORDSTRENGTH_H
+#define PASSWORDSTRENGTH_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+// One guessable piece of a password. `start` and `end` are inclusive indexes.
+struct StrengthMatch {
+    enum Pattern {
+        Bruteforce,
+        Dictionary,
+        UserInput,
+        Spatial,
+        Repeat,
+        Sequence,
+        Year,
+        Date
+    };
+
+    Pattern pattern = Bruteforce;
+    int start = 0;
+    int end = 0;
+    double guesses = 1;
+
+    int dictionary = -1;
+    int rank = 0;
+    bool reversed = false;
+    bool l33t = false;
+    int turns = 0;
+    int baseLength = 0;
+
+    int length() const { return end - start + 1; }
+};
+
+struct StrengthResult {
+    int score = 0;
+    double guesses = 1;
+    QString warning;
+    QStringList suggestions;
+    QList<StrengthMatch> sequence;
+};
+
+// Estimates how many guesses an attacker needs, the way zxcvbn does: find every
+// dictionary word (plain, reversed or with l33t substitutions), keyboard walk,
+// repeat, sequence and date in the password, then pick the cheapest way to
+// cover it with those and brute force. Scores run from 0 (under 10^3 guesses)
+// to 4 (over 10^10).
+//
+// Matches and the cheapest cover are kept per position, so update() only
+// redoes the characters after the first one that changed; typing at the end
+// costs one position.
+class PasswordStrength {
+public:
+    PasswordStrength();
+
+    void setUserInputs(const QStringList &inputs);
+
+    StrengthResult update(const QString &password);
+
+    static StrengthResult estimate(const QString &password, const QStringList &userInputs = QStringList());
+
+    static int scoreForGuesses(double guesses);
+
+    static QString scoreName(int score);
+
+private:
+    struct Cursor {
+        int start;
+        quint32 node;
+        quint32 substitutions;
+    };
+
+    struct Cell {
+        bool valid = false;
+        double pi = 0;
+        double g = 0;
+        StrengthMatch match;
+    };
+
+    struct Position {
+        QList<StrengthMatch> matches;
+        QHash<int, double> spanGuesses;
+        QVector<QVector<Cursor> > cursors;
+        QVector<Cell> optimal;
+    };
+
+    void truncate(int length);
+
+    void append(QChar c);
+
+    void addMatch(Position &position, const StrengthMatch &match);
+
+    void matchDictionaries(int k, Position &position);
+
+    void matchReversed(int k, Position &position);
+
+    void matchUserInputs(int k, Position &position);
+
+    void matchSpatial(int k, Position &position);
+
+    void matchRepeats(int k, Position &position);
+
+    void matchSequences(int k, Position &position);
+
+    void matchDates(int k, Position &position);
+
+    void extendOptimal(int k);
+
+    void updateCell(int k, const StrengthMatch &match, int l);
+
+    StrengthResult result(const QString &password) const;
+
+    double uppercaseVariations(int start, int end) const;
+
+    QString text;
+    QString lower;
+    QStringList userInputs;
+    QVector<Position> positions;
+};
+
+#endif // PASSWORDSTRENGTH_H
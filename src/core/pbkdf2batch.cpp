@@ -0,0 +1,542 @@
+#include "pbkdf2batch.h"
+#include "core/trace.h"
+#include <QDebug>
+#include <QString>
+#include <cstring>
+#include <openssl/evp.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENIGMA_PBKDF2_X86
+#include <immintrin.h>
+// The lane helpers pass vectors by value but are only ever inlined into
+// functions built for the matching ISA, so the ABI note does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// After the first, every PBKDF2 iteration hashes a 32 byte digest behind a
+// 64 byte HMAC pad, so both of its blocks have fixed padding and the whole
+// iteration is two compressions from precomputed pad states. Kernels run those
+// iterations for a group of lanes whose U and T words are stored lane by lane;
+// the first iteration, which hashes the salt, stays scalar.
+static const quint32 SHA256_INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+alignas(16) static const quint32 SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const int HMAC_BLOCK_SIZE = 64;
+static const int DIGEST_SIZE = 32;
+static const int DIGEST_WORDS = 8;
+static const quint32 DIGEST_BLOCK_BITS = (HMAC_BLOCK_SIZE + DIGEST_SIZE) * 8;
+
+#define ENIGMA_INLINE __attribute__((always_inline)) inline
+
+// The lane templates are written once for plain words and for GCC vector
+// types; a kernel instantiates them inside a function built for its ISA.
+template<typename V>
+static ENIGMA_INLINE V rotr(const V &x, const int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+template<typename V>
+static ENIGMA_INLINE V splat(const quint32 value) {
+    V v = {};
+    return v + value;
+}
+
+template<typename V>
+static ENIGMA_INLINE void compressLanes(V state[8], const V block[16]) {
+    V w[16];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = block[i];
+    }
+    V a = state[0];
+    V b = state[1];
+    V c = state[2];
+    V d = state[3];
+    V e = state[4];
+    V f = state[5];
+    V g = state[6];
+    V h = state[7];
+#pragma GCC unroll 64
+    for (int i = 0; i < 64; ++i) {
+        if (i >= 16) {
+            const V w15 = w[(i - 15) & 15];
+            const V w2 = w[(i - 2) & 15];
+            w[i & 15] += (rotr(w15, 7) ^ rotr(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15]
+                    + (rotr(w2, 17) ^ rotr(w2, 19) ^ (w2 >> 10));
+        }
+        const V t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i & 15];
+        const V t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+template<typename V, int Lanes>
+static ENIGMA_INLINE V loadLanes(const quint32 *words, const int index) {
+    alignas(64) quint32 values[Lanes];
+    for (int lane = 0; lane < Lanes; ++lane) {
+        values[lane] = words[lane * DIGEST_WORDS + index];
+    }
+    V v;
+    std::memcpy(&v, values, sizeof(v));
+    return v;
+}
+
+template<typename V, int Lanes>
+static ENIGMA_INLINE void storeLanes(quint32 *words, const int index, const V &v) {
+    alignas(64) quint32 values[Lanes];
+    std::memcpy(values, &v, sizeof(v));
+    for (int lane = 0; lane < Lanes; ++lane) {
+        words[lane * DIGEST_WORDS + index] = values[lane];
+    }
+}
+
+template<typename V, int Lanes>
+static ENIGMA_INLINE void iterateLanes(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t,
+                                       const int rounds) {
+    V innerState[8];
+    V outerState[8];
+    V uState[8];
+    V tState[8];
+    V block[16];
+    for (int i = 0; i < 8; ++i) {
+        innerState[i] = splat<V>(inner[i]);
+        outerState[i] = splat<V>(outer[i]);
+        uState[i] = loadLanes<V, Lanes>(u, i);
+        tState[i] = loadLanes<V, Lanes>(t, i);
+    }
+    block[8] = splat<V>(0x80000000);
+    for (int i = 9; i < 15; ++i) {
+        block[i] = splat<V>(0);
+    }
+    block[15] = splat<V>(DIGEST_BLOCK_BITS);
+
+    for (int round = 0; round < rounds; ++round) {
+        V state[8];
+        for (int i = 0; i < 8; ++i) {
+            block[i] = uState[i];
+            state[i] = innerState[i];
+        }
+        compressLanes(state, block);
+        for (int i = 0; i < 8; ++i) {
+            block[i] = state[i];
+            state[i] = outerState[i];
+        }
+        compressLanes(state, block);
+        for (int i = 0; i < 8; ++i) {
+            uState[i] = state[i];
+            tState[i] ^= state[i];
+        }
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        storeLanes<V, Lanes>(u, i, uState[i]);
+        storeLanes<V, Lanes>(t, i, tState[i]);
+    }
+}
+
+typedef void (*IterateKernel)(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t, int rounds);
+
+static void iteratePortable(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t, const int rounds) {
+    iterateLanes<quint32, 1>(inner, outer, u, t, rounds);
+}
+
+#ifdef ENIGMA_PBKDF2_X86
+typedef quint32 Lanes8 __attribute__((vector_size(32)));
+typedef quint32 Lanes16 __attribute__((vector_size(64)));
+
+__attribute__((target("avx2")))
+static void iterateAvx2(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t, const int rounds) {
+    iterateLanes<Lanes8, 8>(inner, outer, u, t, rounds);
+}
+
+__attribute__((target("avx512f")))
+static void iterateAvx512(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t, const int rounds) {
+    iterateLanes<Lanes16, 16>(inner, outer, u, t, rounds);
+}
+
+// SHA-NI keeps the state as ABEF and CDGH halves. The pad states are converted
+// once, and each iteration's digest is rebuilt as message words only where the
+// next block needs them.
+__attribute__((target("sha,sse4.1")))
+static ENIGMA_INLINE void toShaNiState(const quint32 state[8], __m128i &abef, __m128i &cdgh) {
+    const __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+    const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+    abef = _mm_alignr_epi8(abcd, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, abcd, 0xF0);
+}
+
+__attribute__((target("sha,sse4.1")))
+static ENIGMA_INLINE void fromShaNiState(const __m128i abef, const __m128i cdgh, __m128i &abcd, __m128i &efgh) {
+    const __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    abcd = _mm_blend_epi16(feba, dchg, 0xF0);
+    efgh = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+__attribute__((target("sha,sse4.1")))
+static ENIGMA_INLINE void compressShaNi(__m128i &abef, __m128i &cdgh, const __m128i message[4]) {
+    const __m128i abefStart = abef;
+    const __m128i cdghStart = cdgh;
+    __m128i m[4] = {message[0], message[1], message[2], message[3]};
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) {
+        __m128i words = _mm_add_epi32(m[i & 3], _mm_load_si128(reinterpret_cast<const __m128i *>(SHA256_K + 4 * i)));
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+        if (i >= 3 && i <= 14) {
+            m[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[(i + 1) & 3], _mm_alignr_epi8(m[i & 3], m[(i - 1) & 3], 4)),
+                                                  m[i & 3]);
+        }
+        words = _mm_shuffle_epi32(words, 0x0E);
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, words);
+        if (i >= 1 && i <= 12) {
+            m[(i - 1) & 3] = _mm_sha256msg1_epu32(m[(i - 1) & 3], m[i & 3]);
+        }
+    }
+    abef = _mm_add_epi32(abef, abefStart);
+    cdgh = _mm_add_epi32(cdgh, cdghStart);
+}
+
+__attribute__((target("sha,sse4.1")))
+static void iterateShaNi(const quint32 *inner, const quint32 *outer, quint32 *u, quint32 *t, const int rounds) {
+    __m128i innerAbef;
+    __m128i innerCdgh;
+    __m128i outerAbef;
+    __m128i outerCdgh;
+    toShaNiState(inner, innerAbef, innerCdgh);
+    toShaNiState(outer, outerAbef, outerCdgh);
+
+    __m128i block[4];
+    block[0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u));
+    block[1] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + 4));
+    block[2] = _mm_set_epi32(0, 0, 0, static_cast<int>(0x80000000));
+    block[3] = _mm_set_epi32(static_cast<int>(DIGEST_BLOCK_BITS), 0, 0, 0);
+    __m128i tLow = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t));
+    __m128i tHigh = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + 4));
+
+    for (int round = 0; round < rounds; ++round) {
+        __m128i abef = innerAbef;
+        __m128i cdgh = innerCdgh;
+        compressShaNi(abef, cdgh, block);
+        fromShaNiState(abef, cdgh, block[0], block[1]);
+        abef = outerAbef;
+        cdgh = outerCdgh;
+        compressShaNi(abef, cdgh, block);
+        fromShaNiState(abef, cdgh, block[0], block[1]);
+        tLow = _mm_xor_si128(tLow, block[0]);
+        tHigh = _mm_xor_si128(tHigh, block[1]);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(u), block[0]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(u + 4), block[1]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(t), tLow);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(t + 4), tHigh);
+}
+#endif
+
+static quint32 loadBigEndian(const char *data) {
+    const auto *bytes = reinterpret_cast<const uchar *>(data);
+    return static_cast<quint32>(bytes[0]) << 24 | static_cast<quint32>(bytes[1]) << 16
+           | static_cast<quint32>(bytes[2]) << 8 | static_cast<quint32>(bytes[3]);
+}
+
+static void appendBigEndian(QByteArray &out, const quint32 word) {
+    out.append(static_cast<char>(word >> 24));
+    out.append(static_cast<char>(word >> 16));
+    out.append(static_cast<char>(word >> 8));
+    out.append(static_cast<char>(word));
+}
+
+// Pads and hashes the rest of a message whose first prefixBytes the state has
+// already absorbed.
+static void finishHash(quint32 state[8], const QByteArray &message, const quint64 prefixBytes) {
+    QByteArray padded = message;
+    padded.append(static_cast<char>(0x80));
+    while (padded.size() % HMAC_BLOCK_SIZE != HMAC_BLOCK_SIZE - 8) {
+        padded.append('\0');
+    }
+    const quint64 bits = (prefixBytes + static_cast<quint64>(message.size())) * 8;
+    appendBigEndian(padded, static_cast<quint32>(bits >> 32));
+    appendBigEndian(padded, static_cast<quint32>(bits));
+
+    for (int offset = 0; offset < padded.size(); offset += HMAC_BLOCK_SIZE) {
+        quint32 block[16];
+        for (int i = 0; i < 16; ++i) {
+            block[i] = loadBigEndian(padded.constData() + offset + 4 * i);
+        }
+        compressLanes<quint32>(state, block);
+    }
+}
+
+struct HmacPads {
+    quint32 inner[8];
+    quint32 outer[8];
+};
+
+static HmacPads hmacPads(const QByteArray &password) {
+    QByteArray key = password;
+    if (key.size() > HMAC_BLOCK_SIZE) {
+        quint32 digest[8];
+        std::memcpy(digest, SHA256_INIT, sizeof(digest));
+        finishHash(digest, key, 0);
+        key.clear();
+        for (const quint32 word: digest) {
+            appendBigEndian(key, word);
+        }
+    }
+    key.append(QByteArray(HMAC_BLOCK_SIZE - key.size(), '\0'));
+
+    HmacPads pads;
+    quint32 innerBlock[16];
+    quint32 outerBlock[16];
+    for (int i = 0; i < 16; ++i) {
+        const quint32 word = loadBigEndian(key.constData() + 4 * i);
+        innerBlock[i] = word ^ 0x36363636;
+        outerBlock[i] = word ^ 0x5c5c5c5c;
+    }
+    std::memcpy(pads.inner, SHA256_INIT, sizeof(pads.inner));
+    std::memcpy(pads.outer, SHA256_INIT, sizeof(pads.outer));
+    compressLanes<quint32>(pads.inner, innerBlock);
+    compressLanes<quint32>(pads.outer, outerBlock);
+    return pads;
+}
+
+// U1 = HMAC(password, salt || INT(blockIndex)), written to both u and t.
+static void firstIteration(const HmacPads &pads, const QByteArray &salt, const quint32 blockIndex, quint32 *u,
+                           quint32 *t) {
+    QByteArray message = salt;
+    appendBigEndian(message, blockIndex);
+    quint32 state[8];
+    std::memcpy(state, pads.inner, sizeof(state));
+    finishHash(state, message, HMAC_BLOCK_SIZE);
+
+    quint32 block[16] = {};
+    std::memcpy(block, state, sizeof(state));
+    block[8] = 0x80000000;
+    block[15] = DIGEST_BLOCK_BITS;
+    std::memcpy(state, pads.outer, sizeof(state));
+    compressLanes<quint32>(state, block);
+    std::memcpy(u, state, sizeof(state));
+    std::memcpy(t, state, sizeof(state));
+}
+
+static IterateKernel iterateKernel(const Pbkdf2Batch::Kernel kernel) {
+    switch (kernel) {
+#ifdef ENIGMA_PBKDF2_X86
+        case Pbkdf2Batch::ShaNiKernel:
+            return &iterateShaNi;
+        case Pbkdf2Batch::Avx2Kernel:
+            return &iterateAvx2;
+        case Pbkdf2Batch::Avx512Kernel:
+            return &iterateAvx512;
+#endif
+        default:
+            return &iteratePortable;
+    }
+}
+
+static QList<QByteArray> deriveWithOpenSsl(const QByteArray &password, const QList<QByteArray> &salts,
+                                           const int iterations, const int keyLength) {
+    QList<QByteArray> keys;
+    keys.reserve(salts.size());
+    for (const QByteArray &salt: salts) {
+        QByteArray key(keyLength, Qt::Uninitialized);
+        if (PKCS5_PBKDF2_HMAC(password.constData(), password.size(),
+                              reinterpret_cast<const unsigned char *>(salt.constData()), salt.size(), iterations,
+                              EVP_sha256(), keyLength, reinterpret_cast<unsigned char *>(key.data())) != 1) {
+            qWarning() << "Failed to derive PBKDF2 key!";
+            key.clear();
+        }
+        keys.append(key);
+    }
+    return keys;
+}
+
+int Pbkdf2Batch::laneCount(const Kernel kernel) {
+    switch (kernel) {
+        case Avx2Kernel:
+            return 8;
+        case Avx512Kernel:
+            return 16;
+        default:
+            return 1;
+    }
+}
+
+const char *Pbkdf2Batch::kernelName(const Kernel kernel) {
+    switch (kernel) {
+        case OpenSslKernel:
+            return "openssl";
+        case PortableKernel:
+            return "portable";
+        case ShaNiKernel:
+            return "sha-ni";
+        case Avx2Kernel:
+            return "avx2";
+        case Avx512Kernel:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+bool Pbkdf2Batch::isSupported(const Kernel kernel) {
+    switch (kernel) {
+        case OpenSslKernel:
+        case PortableKernel:
+            return true;
+#ifdef ENIGMA_PBKDF2_X86
+        case ShaNiKernel:
+            return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+        case Avx2Kernel:
+            return __builtin_cpu_supports("avx2");
+        case Avx512Kernel:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+QList<QByteArray> Pbkdf2Batch::deriveKeysWith(const Kernel kernel, const QByteArray &password,
+                                              const QList<QByteArray> &salts, const int iterations,
+                                              const int keyLength) {
+    ENIGMA_TRACE_SCOPE("crypto", "Pbkdf2Batch::deriveKeys");
+    if (kernel == OpenSslKernel || iterations < 1 || keyLength < 1) {
+        return deriveWithOpenSsl(password, salts, iterations, keyLength);
+    }
+
+    // Every output block of every salt is an independent lane.
+    const HmacPads pads = hmacPads(password);
+    const int blocks = (keyLength + DIGEST_SIZE - 1) / DIGEST_SIZE;
+    const int jobs = salts.size() * blocks;
+    const int lanes = laneCount(kernel);
+    const int padded = (jobs + lanes - 1) / lanes * lanes;
+    QList<quint32> u(padded * DIGEST_WORDS, 0);
+    QList<quint32> t(padded * DIGEST_WORDS, 0);
+    for (int job = 0; job < jobs; ++job) {
+        firstIteration(pads, salts.at(job / blocks), static_cast<quint32>(job % blocks + 1),
+                       u.data() + job * DIGEST_WORDS, t.data() + job * DIGEST_WORDS);
+    }
+
+    const IterateKernel iterate = iterateKernel(kernel);
+    for (int first = 0; first < jobs; first += lanes) {
+        iterate(pads.inner, pads.outer, u.data() + first * DIGEST_WORDS, t.data() + first * DIGEST_WORDS,
+                iterations - 1);
+    }
+
+    QList<QByteArray> keys;
+    keys.reserve(salts.size());
+    for (int salt = 0; salt < salts.size(); ++salt) {
+        QByteArray key;
+        key.reserve(blocks * DIGEST_SIZE);
+        for (int word = 0; word < blocks * DIGEST_WORDS; ++word) {
+            appendBigEndian(key, t.at(salt * blocks * DIGEST_WORDS + word));
+        }
+        key.truncate(keyLength);
+        keys.append(key);
+    }
+    return keys;
+}
+
+// Salt lengths straddle the one- and two-block cases of the first iteration,
+// the long password is hashed down first, and two output blocks and a partial
+// lane group are covered.
+static bool passesSelfCheck(const Pbkdf2Batch::Kernel kernel) {
+    QList<QByteArray> salts;
+    for (int i = 0; i < 19; ++i) {
+        salts.append(QByteArray(i * 7, static_cast<char>('a' + i)));
+    }
+    for (const QByteArray &password: {QByteArray("enigma"), QByteArray(100, '\x5a')}) {
+        if (Pbkdf2Batch::deriveKeysWith(kernel, password, salts, 3, 40)
+            != deriveWithOpenSsl(password, salts, 3, 40)) {
+            qWarning() << "PBKDF2 kernel" << Pbkdf2Batch::kernelName(kernel) << "failed its self-check; not using it.";
+            return false;
+        }
+    }
+    return true;
+}
+
+static Pbkdf2Batch::Kernel firstUsable(const QList<Pbkdf2Batch::Kernel> &preference) {
+    const QString forced = qEnvironmentVariable("ENIGMA_PBKDF2_KERNEL");
+    if (!forced.isEmpty()) {
+        for (const Pbkdf2Batch::Kernel kernel: {Pbkdf2Batch::OpenSslKernel, Pbkdf2Batch::PortableKernel,
+                                                Pbkdf2Batch::ShaNiKernel, Pbkdf2Batch::Avx2Kernel,
+                                                Pbkdf2Batch::Avx512Kernel}) {
+            if (forced == QLatin1String(Pbkdf2Batch::kernelName(kernel)) && Pbkdf2Batch::isSupported(kernel)
+                && passesSelfCheck(kernel)) {
+                return kernel;
+            }
+        }
+        qWarning() << "PBKDF2 kernel" << forced << "is unavailable; choosing one automatically.";
+    }
+
+    for (const Pbkdf2Batch::Kernel kernel: preference) {
+        if (Pbkdf2Batch::isSupported(kernel) && passesSelfCheck(kernel)) {
+            return kernel;
+        }
+    }
+    return Pbkdf2Batch::OpenSslKernel;
+}
+
+// SHA-NI hashes one lane faster than AVX2 hashes eight, and the portable
+// kernel is slower than OpenSSL, so it is only chosen by name.
+Pbkdf2Batch::Kernel Pbkdf2Batch::batchKernel() {
+    static const Kernel kernel = firstUsable({Avx512Kernel, ShaNiKernel, Avx2Kernel});
+    return kernel;
+}
+
+Pbkdf2Batch::Kernel Pbkdf2Batch::singleKernel() {
+    static const Kernel kernel = firstUsable({ShaNiKernel});
+    return kernel;
+}
+
+// A lane group costs the same however few lanes are filled, so salts that
+// would leave the last group less than half full go through the single kernel.
+QList<QByteArray> Pbkdf2Batch::deriveKeys(const QByteArray &password, const QList<QByteArray> &salts,
+                                          const int iterations, const int keyLength) {
+    const Kernel kernel = batchKernel();
+    const int lanes = laneCount(kernel);
+    const int blocks = qMax(1, (keyLength + DIGEST_SIZE - 1) / DIGEST_SIZE);
+    const int remainder = salts.size() % lanes;
+    if (lanes == 1 || remainder * blocks * 2 >= lanes) {
+        return deriveKeysWith(salts.size() == 1 ? singleKernel() : kernel, password, salts, iterations, keyLength);
+    }
+
+    const int grouped = salts.size() - remainder;
+    QList<QByteArray> keys;
+    if (grouped > 0) {
+        keys = deriveKeysWith(kernel, password, salts.mid(0, grouped), iterations, keyLength);
+    }
+    keys.append(deriveKeysWith(singleKernel(), password, salts.mid(grouped), iterations, keyLength));
+    return keys;
+}
+
+QByteArray Pbkdf2Batch::deriveKey(const QByteArray &password, const QByteArray &salt, const int iterations,
+                                  const int keyLength) {
+    return deriveKeysWith(singleKernel(), password, {salt}, iterations, keyLength).at(0);
+}
@@ -0,0 +1,42 @@
+#ifndef PBKDF2BATCH_H
+#define PBKDF2BATCH_H
+
+#include <QByteArray>
+#include <QList>
+
+// PBKDF2-HMAC-SHA256 for many salts under one password, which is how every
+// row key is derived from the vault key. The HMAC pads are hashed once per
+// batch and independent derivations run side by side in SIMD lanes (16 with
+// AVX-512, 8 with AVX2); single derivations use SHA-NI when the CPU has it.
+// Each kernel is checked against OpenSSL before it is first used, and
+// OpenSSL itself is the last resort.
+class Pbkdf2Batch {
+public:
+    enum Kernel {
+        OpenSslKernel,
+        PortableKernel,
+        ShaNiKernel,
+        Avx2Kernel,
+        Avx512Kernel
+    };
+
+    static QList<QByteArray> deriveKeys(const QByteArray &password, const QList<QByteArray> &salts,
+                                        int iterations, int keyLength);
+
+    static QByteArray deriveKey(const QByteArray &password, const QByteArray &salt, int iterations, int keyLength);
+
+    static Kernel batchKernel();
+
+    static Kernel singleKernel();
+
+    static int laneCount(Kernel kernel);
+
+    static const char *kernelName(Kernel kernel);
+
+    static bool isSupported(Kernel kernel);
+
+    static QList<QByteArray> deriveKeysWith(Kernel kernel, const QByteArray &password, const QList<QByteArray> &salts,
+                                            int iterations, int keyLength);
+};
+
+#endif // PBKDF2BATCH_H
@@ -0,0 +1,243 @@
+#include "recordcodec.h"
+#include "core/trace.h"
+#include <QDebug>
+
+#ifdef ENIGMA_WITH_ZSTD
+#include <QFile>
+#include <memory>
+#include <zstd.h>
+#endif
+
+// Only fields worth a frame header are compressed; with a shared dictionary
+// embedded, much shorter fields pay off too, and those up to
+// DICTIONARY_MAX_FIELD_SIZE use it. A compressed field is kept only if it is
+// actually smaller. Secrets are never compressed, since their ciphertext
+// length would then depend on their content. Decoding uses the streaming API,
+// so it does not rely on the frame recording its size, and it gives up at a
+// fixed ceiling instead of trusting the input.
+static const int MIN_COMPRESS_SIZE = 64;
+static const int MIN_DICTIONARY_COMPRESS_SIZE = 16;
+static const int DICTIONARY_MAX_FIELD_SIZE = 16 * 1024;
+static const int COMPRESSION_LEVEL = 3;
+static const int MAX_DECODED_SIZE = 256 * 1024 * 1024;
+
+#ifdef ENIGMA_WITH_ZSTD
+
+#ifdef ENIGMA_ZSTD_DICTIONARY
+static void initDictionaryResource() {
+    Q_INIT_RESOURCE(zstddictionary);
+}
+#endif
+
+struct ZstdDictionary {
+    ZSTD_CDict *compress = nullptr;
+    ZSTD_DDict *decompress = nullptr;
+    unsigned id = 0;
+};
+
+static const ZstdDictionary &dictionary() {
+    static const ZstdDictionary dict = [] {
+        ZstdDictionary loaded;
+#ifdef ENIGMA_ZSTD_DICTIONARY
+        initDictionaryResource();
+        QFile file(":/zstd/fields.dict");
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to load the embedded zstd dictionary!";
+            return loaded;
+        }
+        const QByteArray data = file.readAll();
+        // Fields record the dictionary by ID, so one without an ID (raw
+        // content rather than a trained dictionary) could never be checked.
+        if (ZSTD_getDictID_fromDict(data.constData(), data.size()) == 0) {
+            qWarning() << "The embedded zstd dictionary has no dictionary ID; train it with enigma_zstdtrain!";
+            return loaded;
+        }
+        loaded.compress = ZSTD_createCDict(data.constData(), data.size(), COMPRESSION_LEVEL);
+        loaded.decompress = ZSTD_createDDict(data.constData(), data.size());
+        loaded.id = ZSTD_getDictID_fromDict(data.constData(), data.size());
+#endif
+        return loaded;
+    }();
+    return dict;
+}
+
+struct ZstdContextDeleter {
+    void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+
+    void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+static ZSTD_CCtx *compressionContext() {
+    thread_local std::unique_ptr<ZSTD_CCtx, ZstdContextDeleter> ctx(ZSTD_createCCtx());
+    return ctx.get();
+}
+
+static ZSTD_DCtx *decompressionContext() {
+    thread_local std::unique_ptr<ZSTD_DCtx, ZstdContextDeleter> ctx(ZSTD_createDCtx());
+    return ctx.get();
+}
+
+static QByteArray compressField(const QByteArray &data, const bool useDictionary) {
+    ENIGMA_TRACE_SCOPE("codec", "RecordCodec::compress");
+    QByteArray field(1 + static_cast<int>(ZSTD_compressBound(data.size())), Qt::Uninitialized);
+    ZSTD_CCtx *ctx = compressionContext();
+    const size_t written = useDictionary
+                               ? ZSTD_compress_usingCDict(ctx, field.data() + 1, field.size() - 1,
+                                                          data.constData(), data.size(), dictionary().compress)
+                               : ZSTD_compressCCtx(ctx, field.data() + 1, field.size() - 1,
+                                                   data.constData(), data.size(), COMPRESSION_LEVEL);
+    if (ZSTD_isError(written)) {
+        qWarning() << "zstd compression failed:" << ZSTD_getErrorName(written);
+        return QByteArray();
+    }
+    field[0] = static_cast<char>(useDictionary ? RecordCodec::ZstdDictionaryField : RecordCodec::ZstdField);
+    field.resize(1 + static_cast<int>(written));
+    return field;
+}
+
+static QByteArray decompressField(const char *data, const int size, const bool useDictionary, bool *ok) {
+    ENIGMA_TRACE_SCOPE("codec", "RecordCodec::decompress");
+    ZSTD_DCtx *ctx = decompressionContext();
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    if (useDictionary) {
+        const ZstdDictionary &dict = dictionary();
+        const unsigned frameId = ZSTD_getDictID_fromFrame(data, size);
+        if (!dict.decompress) {
+            qWarning() << "Field needs zstd dictionary" << frameId << "but this build embeds none!";
+            return QByteArray();
+        }
+        if (frameId != dict.id) {
+            qWarning() << "Field needs zstd dictionary" << frameId << "but this build embeds dictionary" << dict.id
+                    << "!";
+            return QByteArray();
+        }
+        ZSTD_DCtx_refDDict(ctx, dict.decompress);
+    }
+
+    QByteArray plain;
+    const unsigned long long contentSize = ZSTD_getFrameContentSize(data, size);
+    if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize != ZSTD_CONTENTSIZE_ERROR
+        && contentSize <= static_cast<unsigned long long>(MAX_DECODED_SIZE)) {
+        plain.reserve(static_cast<int>(contentSize));
+    }
+
+    QByteArray buffer(static_cast<int>(ZSTD_DStreamOutSize()), Qt::Uninitialized);
+    ZSTD_inBuffer input{data, static_cast<size_t>(size), 0};
+    while (true) {
+        ZSTD_outBuffer output{buffer.data(), static_cast<size_t>(buffer.size()), 0};
+        const size_t remaining = ZSTD_decompressStream(ctx, &output, &input);
+        if (ZSTD_isError(remaining)) {
+            qWarning() << "zstd decompression failed:" << ZSTD_getErrorName(remaining);
+            return QByteArray();
+        }
+        if (plain.size() + static_cast<qint64>(output.pos) > MAX_DECODED_SIZE) {
+            qWarning() << "Decompressed field exceeds" << MAX_DECODED_SIZE << "bytes!";
+            return QByteArray();
+        }
+        plain.append(buffer.constData(), static_cast<int>(output.pos));
+        if (remaining == 0) {
+            break;
+        }
+        if (input.pos == input.size && output.pos < output.size) {
+            qWarning() << "Truncated zstd frame!";
+            return QByteArray();
+        }
+    }
+    if (input.pos != input.size) {
+        qWarning() << "Unexpected data after zstd frame!";
+        return QByteArray();
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return plain;
+}
+
+#endif
+
+bool RecordCodec::isCompressionAvailable() {
+#ifdef ENIGMA_WITH_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool RecordCodec::hasDictionary() {
+#ifdef ENIGMA_WITH_ZSTD
+    return dictionary().compress != nullptr;
+#else
+    return false;
+#endif
+}
+
+QByteArray RecordCodec::encodeBytes(const QByteArray &data, const bool compress) {
+    if (data.isEmpty()) {
+        return QByteArray();
+    }
+
+#ifdef ENIGMA_WITH_ZSTD
+    const bool useDictionary = data.size() <= DICTIONARY_MAX_FIELD_SIZE && hasDictionary();
+    if (compress && data.size() >= (useDictionary ? MIN_DICTIONARY_COMPRESS_SIZE : MIN_COMPRESS_SIZE)) {
+        const QByteArray compressed = compressField(data, useDictionary);
+        if (!compressed.isEmpty() && compressed.size() <= data.size()) {
+            return compressed;
+        }
+    }
+#else
+    Q_UNUSED(compress);
+#endif
+
+    QByteArray field;
+    field.reserve(data.size() + 1);
+    field.append(static_cast<char>(RawField));
+    field.append(data);
+    return field;
+}
+
+QByteArray RecordCodec::decodeBytes(const QByteArray &field, bool *ok) {
+    if (ok) {
+        *ok = false;
+    }
+    if (field.isEmpty()) {
+        if (ok) {
+            *ok = true;
+        }
+        return QByteArray();
+    }
+
+    switch (static_cast<quint8>(field.at(0))) {
+        case RawField:
+            if (ok) {
+                *ok = true;
+            }
+            return field.mid(1);
+        case ZstdField:
+        case ZstdDictionaryField:
+#ifdef ENIGMA_WITH_ZSTD
+            return decompressField(field.constData() + 1, field.size() - 1,
+                                   static_cast<quint8>(field.at(0)) == ZstdDictionaryField, ok);
+#else
+            qWarning() << "This build cannot read zstd-compressed fields!";
+            return QByteArray();
+#endif
+        default:
+            qWarning() << "Unknown field format" << static_cast<quint8>(field.at(0));
+            return QByteArray();
+    }
+}
+
+QByteArray RecordCodec::encodeField(const QString &text, const bool compress) {
+    return encodeBytes(text.toUtf8(), compress);
+}
+
+QString RecordCodec::decodeField(const QByteArray &field, const int recordFormat, bool *ok) {
+    if (recordFormat == LegacyRecord) {
+        if (ok) {
+            *ok = true;
+        }
+        return QString::fromUtf8(field);
+    }
+    return QString::fromUtf8(decodeBytes(field, ok));
+}
@@ -0,0 +1,36 @@
+#ifndef RECORDCODEC_H
+#define RECORDCODEC_H
+
+#include <QString>
+#include <QByteArray>
+
+// Plaintext encoding applied before encryption. Rows written with
+// HeaderedRecord start every non-empty field with a format byte that says how
+// the rest of the field is stored; LegacyRecord rows hold bare UTF-8.
+class RecordCodec {
+public:
+    enum RecordFormat {
+        LegacyRecord = 0,
+        HeaderedRecord = 1
+    };
+
+    enum FieldFormat : quint8 {
+        RawField = 0,
+        ZstdField = 1,
+        ZstdDictionaryField = 2
+    };
+
+    static QByteArray encodeField(const QString &text, bool compress);
+
+    static QString decodeField(const QByteArray &field, int recordFormat, bool *ok = nullptr);
+
+    static QByteArray encodeBytes(const QByteArray &data, bool compress);
+
+    static QByteArray decodeBytes(const QByteArray &field, bool *ok = nullptr);
+
+    static bool isCompressionAvailable();
+
+    static bool hasDictionary();
+};
+
+#endif // RECORDCODEC_H
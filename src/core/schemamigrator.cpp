@@ -0,0 +1,490 @@
+#include "schemamigrator.h"
+#include "core/dbmanager.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+// Every step is written to be re-runnable: tables, columns and indexes are
+// only created when missing. On SQLite a step and its schema_migrations row
+// commit in one transaction, so a failure leaves neither behind. MySQL commits
+// DDL implicitly, so there a step that fails half way is simply applied again
+// on the next start, and a named lock keeps several instances starting at
+// once from racing.
+static const char *const MIGRATION_LOCK = "enigma_schema_migration";
+static const int MIGRATION_LOCK_TIMEOUT_SECONDS = 60;
+
+SchemaMigrator::SchemaMigrator(const QSqlDatabase &db)
+    : db(db) {
+}
+
+const QList<SchemaMigrator::Migration> &SchemaMigrator::migrations() {
+    static const QList<Migration> list = {
+        {1, "baseline tables and key hierarchy columns", &SchemaMigrator::createBaseline},
+        {2, "normalized username with unique index", &SchemaMigrator::addNormalizedUsername},
+        {3, "(user_id, id) indexes on passwords and notes", &SchemaMigrator::addUserIdIndexes},
+        {4, "revision columns on passwords and notes", &SchemaMigrator::addRevisionColumns},
+        {5, "chunked note content", &SchemaMigrator::addNoteChunks},
+        {6, "per-field record format headers", &SchemaMigrator::addRecordFormats},
+        {7, "note revision history", &SchemaMigrator::addNoteRevisions},
+        {8, "per-row key schedule", &SchemaMigrator::addKeySchedules},
+        {9, "password history", &SchemaMigrator::addPasswordHistory},
+        {10, "password fingerprints", &SchemaMigrator::addPasswordFingerprints},
+        {11, "file attachments", &SchemaMigrator::addAttachments},
+        {12, "content-addressed chunk store", &SchemaMigrator::addChunkStore},
+        {13, "note revision chunk lists", &SchemaMigrator::addRevisionChunkLists},
+        {14, "MEDIUMBLOB inline note content", &SchemaMigrator::widenNoteContent},
+    };
+    return list;
+}
+
+int SchemaMigrator::latestVersion() {
+    return migrations().last().version;
+}
+
+bool SchemaMigrator::migrate() {
+    if (!execute(R"(
+        CREATE TABLE IF NOT EXISTS schema_migrations (
+            version INT PRIMARY KEY,
+            description VARCHAR(255) NOT NULL,
+            applied_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+        )
+    )", "schema.create_migrations")) {
+        return false;
+    }
+
+    if (!acquireLock()) {
+        return false;
+    }
+
+    bool ok = true;
+    const int applied = currentVersion();
+    for (const Migration &migration: migrations()) {
+        if (migration.version <= applied) {
+            continue;
+        }
+        qDebug() << "Applying schema migration" << migration.version << migration.description;
+        const bool ownTransaction = !isMySql() && db.transaction();
+        if (!(this->*migration.apply)() || !recordVersion(migration)
+            || (ownTransaction && !db.commit())) {
+            qWarning() << "Schema migration" << migration.version << "failed!";
+            if (ownTransaction) {
+                db.rollback();
+            }
+            ok = false;
+            break;
+        }
+    }
+
+    releaseLock();
+    return ok;
+}
+
+int SchemaMigrator::currentVersion() {
+    QSqlQuery query(db);
+    query.prepare("SELECT MAX(version) FROM schema_migrations");
+    if (!DBManager::instance().exec(query, "schema.current_version") || !query.next()) {
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+bool SchemaMigrator::createBaseline() {
+    const QString id = idColumn();
+    return execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS users (
+            %1,
+            username VARCHAR(255) UNIQUE NOT NULL,
+            password VARCHAR(255) NOT NULL,
+            salt BINARY(16) NOT NULL
+        )
+    )").arg(id), "schema.create_users")
+           && execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS passwords (
+            %1,
+            user_id INT NOT NULL,
+            salt BINARY(16) NOT NULL,
+            encrypted_service BLOB NOT NULL,
+            encrypted_url BLOB,
+            encrypted_username BLOB,
+            encrypted_email BLOB,
+            encrypted_password BLOB NOT NULL,
+            encrypted_description BLOB,
+            encrypted_totp_secret BLOB,
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(id), "schema.create_passwords")
+           && execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS notes (
+            %1,
+            user_id INT NOT NULL,
+            salt BINARY(16) NOT NULL,
+            encrypted_title BLOB NOT NULL,
+            encrypted_content BLOB NOT NULL,
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(id), "schema.create_notes")
+           && execute(R"(
+        CREATE TABLE IF NOT EXISTS pending_rekeys (
+            user_id INT PRIMARY KEY,
+            target_epoch INT NOT NULL,
+            wrapped_key BLOB NOT NULL,
+            user_wrapped_key BLOB NOT NULL,
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )", "schema.create_pending_rekeys")
+           && addColumnIfMissing("users", "kdf_algorithm", "VARCHAR(16) NOT NULL DEFAULT 'pbkdf2-sha256'")
+           && addColumnIfMissing("users", "kdf_iterations", "INT NOT NULL DEFAULT 10000")
+           && addColumnIfMissing("users", "kdf_memory_kib", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("users", "kdf_parallelism", "INT NOT NULL DEFAULT 1")
+           && addColumnIfMissing("users", "wrapped_key", "BLOB NULL")
+           && addColumnIfMissing("users", "key_epoch", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("passwords", "key_epoch", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("notes", "key_epoch", "INT NOT NULL DEFAULT 0");
+}
+
+// Lookups used to wrap username in LOWER(), which no index can serve. The
+// normalized column is filled from C++ with the same QString::toLower() that
+// User::normalizeUsername() applies, so both sides always agree.
+bool SchemaMigrator::addNormalizedUsername() {
+    if (!addColumnIfMissing("users", "username_normalized", "VARCHAR(255) NULL")) {
+        return false;
+    }
+
+    QSqlQuery select(db);
+    select.prepare("SELECT id, username FROM users WHERE username_normalized IS NULL");
+    if (!DBManager::instance().exec(select, "schema.select_unnormalized_users")) {
+        qDebug() << "Schema Migration Error:" << select.lastError().text();
+        return false;
+    }
+
+    QVariantList names;
+    QVariantList ids;
+    while (select.next()) {
+        ids.append(select.value(0));
+        names.append(select.value(1).toString().toLower());
+    }
+
+    if (!ids.isEmpty()) {
+        QSqlQuery update(db);
+        update.prepare("UPDATE users SET username_normalized = ? WHERE id = ?");
+        update.addBindValue(names);
+        update.addBindValue(ids);
+        if (!DBManager::instance().execBatch(update, "schema.normalize_usernames")) {
+            qDebug() << "Schema Migration Error:" << update.lastError().text();
+            return false;
+        }
+    }
+
+    return createIndexIfMissing("users", "idx_users_username_normalized", "username_normalized", true);
+}
+
+bool SchemaMigrator::addUserIdIndexes() {
+    return createIndexIfMissing("passwords", "idx_passwords_user_id_id", "user_id, id", false)
+           && createIndexIfMissing("notes", "idx_notes_user_id_id", "user_id, id", false);
+}
+
+bool SchemaMigrator::addRevisionColumns() {
+    return addColumnIfMissing("passwords", "revision", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("notes", "revision", "INT NOT NULL DEFAULT 0");
+}
+
+// Chunks are sealed with a 28 byte GCM overhead and may reach 256 KiB, which
+// does not fit a MySQL BLOB.
+bool SchemaMigrator::addNoteChunks() {
+    return addColumnIfMissing("notes", "content_format", "INT NOT NULL DEFAULT 0")
+           && execute(R"(
+        CREATE TABLE IF NOT EXISTS note_chunks (
+            note_id INT NOT NULL,
+            chunk_mac BINARY(32) NOT NULL,
+            encrypted_chunk MEDIUMBLOB NOT NULL,
+            PRIMARY KEY (note_id, chunk_mac),
+            FOREIGN KEY (note_id) REFERENCES notes(id)
+        )
+    )", "schema.create_note_chunks");
+}
+
+bool SchemaMigrator::addRecordFormats() {
+    return addColumnIfMissing("passwords", "record_format", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("notes", "record_format", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("note_chunks", "chunk_format", "INT NOT NULL DEFAULT 0");
+}
+
+// Revisions carry user_id, salt and key_epoch like notes do, so a vault key
+// rotation re-encrypts them the same way.
+bool SchemaMigrator::addNoteRevisions() {
+    return execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS note_revisions (
+            %1,
+            note_id INT NOT NULL,
+            user_id INT NOT NULL,
+            revision_number INT NOT NULL,
+            keyframe INT NOT NULL DEFAULT 0,
+            salt BINARY(16) NOT NULL,
+            encrypted_delta MEDIUMBLOB NOT NULL,
+            key_epoch INT NOT NULL DEFAULT 0,
+            created_at BIGINT NOT NULL,
+            saved_at BIGINT NOT NULL,
+            FOREIGN KEY (note_id) REFERENCES notes(id),
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(idColumn()), "schema.create_note_revisions")
+           && createIndexIfMissing("note_revisions", "idx_note_revisions_note_number", "note_id, revision_number", true)
+           && createIndexIfMissing("note_revisions", "idx_note_revisions_user_id_id", "user_id, id", false);
+}
+
+// Existing rows keep their PBKDF2 row keys (schedule 0) until they are next
+// written or the background key schedule migration reaches them.
+bool SchemaMigrator::addKeySchedules() {
+    return addColumnIfMissing("passwords", "key_schedule", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("notes", "key_schedule", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("note_revisions", "key_schedule", "INT NOT NULL DEFAULT 0");
+}
+
+// History rows keep the ciphertext, salt and key schedule the password had
+// before it was replaced, so a vault key rotation re-encrypts them like any
+// other row.
+bool SchemaMigrator::addPasswordHistory() {
+    return execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS password_history (
+            %1,
+            password_id INT NOT NULL,
+            user_id INT NOT NULL,
+            salt BINARY(16) NOT NULL,
+            encrypted_password BLOB NOT NULL,
+            record_format INT NOT NULL DEFAULT 0,
+            key_schedule INT NOT NULL DEFAULT 0,
+            key_epoch INT NOT NULL DEFAULT 0,
+            changed_at BIGINT NOT NULL,
+            FOREIGN KEY (password_id) REFERENCES passwords(id),
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(idColumn()), "schema.create_password_history")
+           && createIndexIfMissing("password_history", "idx_password_history_password_id", "password_id, id", false)
+           && createIndexIfMissing("password_history", "idx_password_history_user_id_id", "user_id, id", false);
+}
+
+// Existing rows start without a fingerprint and are filled in by the
+// background password audit.
+bool SchemaMigrator::addPasswordFingerprints() {
+    return addColumnIfMissing("passwords", "password_fingerprint", "VARBINARY(32) NULL")
+           && createIndexIfMissing("passwords", "idx_passwords_user_fingerprint", "user_id, password_fingerprint", false);
+}
+
+// Only the name and per-file key are row-key encrypted, so attachments carry
+// salt, key_schedule and key_epoch for rotation while the chunks, sealed under
+// the per-file key, never need rewriting.
+bool SchemaMigrator::addAttachments() {
+    return execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS attachments (
+            %1,
+            user_id INT NOT NULL,
+            owner_type INT NOT NULL,
+            owner_id INT NOT NULL,
+            salt BINARY(16) NOT NULL,
+            encrypted_name BLOB NOT NULL,
+            encrypted_key BLOB NOT NULL,
+            record_format INT NOT NULL DEFAULT 0,
+            key_schedule INT NOT NULL DEFAULT 0,
+            key_epoch INT NOT NULL DEFAULT 0,
+            size BIGINT NOT NULL,
+            chunk_size INT NOT NULL,
+            complete INT NOT NULL DEFAULT 0,
+            created_at BIGINT NOT NULL,
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(idColumn()), "schema.create_attachments")
+           && createIndexIfMissing("attachments", "idx_attachments_owner", "user_id, owner_type, owner_id", false)
+           && execute(R"(
+        CREATE TABLE IF NOT EXISTS attachment_chunks (
+            attachment_id INT NOT NULL,
+            chunk_index INT NOT NULL,
+            encrypted_chunk MEDIUMBLOB NOT NULL,
+            PRIMARY KEY (attachment_id, chunk_index),
+            FOREIGN KEY (attachment_id) REFERENCES attachments(id)
+        )
+    )", "schema.create_attachment_chunks");
+}
+
+// Chunks are keyed by (user_id, keyed hash), so identical chunks are shared
+// within a vault and never across vaults. Attachments and notes keep their own
+// rows as references: attachment_chunks rows with a chunk_hash and note_chunks
+// rows written after this migration carry an empty encrypted_chunk. Existing
+// attachments (chunk_storage 0) and notes keep the chunks they already store.
+// The per-user store secret is a regular encrypted row, so vault rekeying and
+// the key schedule migration cover it.
+bool SchemaMigrator::addChunkStore() {
+    return execute(R"(
+        CREATE TABLE IF NOT EXISTS chunk_store (
+            user_id INT NOT NULL,
+            chunk_hash BINARY(32) NOT NULL,
+            encrypted_chunk MEDIUMBLOB NOT NULL,
+            ref_count INT NOT NULL DEFAULT 0,
+            PRIMARY KEY (user_id, chunk_hash),
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )", "schema.create_chunk_store")
+           && execute(QString(R"(
+        CREATE TABLE IF NOT EXISTS chunk_store_keys (
+            %1,
+            user_id INT NOT NULL,
+            salt BINARY(16) NOT NULL,
+            encrypted_key BLOB NOT NULL,
+            record_format INT NOT NULL DEFAULT 0,
+            key_schedule INT NOT NULL DEFAULT 0,
+            key_epoch INT NOT NULL DEFAULT 0,
+            FOREIGN KEY (user_id) REFERENCES users(id)
+        )
+    )").arg(idColumn()), "schema.create_chunk_store_keys")
+           && createIndexIfMissing("chunk_store_keys", "idx_chunk_store_keys_user_id", "user_id", true)
+           && addColumnIfMissing("attachments", "chunk_storage", "INT NOT NULL DEFAULT 0")
+           && addColumnIfMissing("attachment_chunks", "chunk_hash", "VARBINARY(32) NULL");
+}
+
+// The chunk MACs a revision lists, which note_chunks already holds in the
+// clear, so collecting unused chunks needs no decryption. Revisions that
+// predate this table have chunks_listed = 0 and are listed the next time their
+// note collects chunks.
+bool SchemaMigrator::addRevisionChunkLists() {
+    return execute(R"(
+        CREATE TABLE IF NOT EXISTS note_revision_chunks (
+            note_id INT NOT NULL,
+            revision_number INT NOT NULL,
+            chunk_mac VARBINARY(32) NOT NULL,
+            PRIMARY KEY (note_id, revision_number, chunk_mac),
+            FOREIGN KEY (note_id) REFERENCES notes(id)
+        )
+    )", "schema.create_note_revision_chunks")
+           && addColumnIfMissing("note_revisions", "chunks_listed", "INT NOT NULL DEFAULT 0");
+}
+
+// Notes stay inline up to 256K characters, far beyond the 65,535 bytes of a
+// MySQL BLOB. SQLite does not limit the column, so there is nothing to do.
+bool SchemaMigrator::widenNoteContent() {
+    if (!isMySql()) {
+        return true;
+    }
+    return execute("ALTER TABLE notes MODIFY encrypted_content MEDIUMBLOB NOT NULL", "schema.widen_note_content");
+}
+
+bool SchemaMigrator::isMySql() const {
+    return db.driverName() == "QMYSQL";
+}
+
+QString SchemaMigrator::idColumn() const {
+    return isMySql() ? "id INT AUTO_INCREMENT PRIMARY KEY" : "id INTEGER PRIMARY KEY AUTOINCREMENT";
+}
+
+bool SchemaMigrator::execute(const QString &sql, const char *statementId) {
+    QSqlQuery query(db);
+    query.prepare(sql);
+    if (!DBManager::instance().exec(query, statementId)) {
+        qDebug() << "Schema Migration Error:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool SchemaMigrator::tableExists(const QString &table) {
+    return db.tables().contains(table, Qt::CaseInsensitive);
+}
+
+bool SchemaMigrator::columnExists(const QString &table, const QString &column) {
+    QSqlQuery query(db);
+    if (isMySql()) {
+        query.prepare(R"(
+            SELECT COUNT(*)
+            FROM information_schema.COLUMNS
+            WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? AND COLUMN_NAME = ?
+        )");
+        query.addBindValue(table);
+        query.addBindValue(column);
+        return DBManager::instance().exec(query, "schema.column_exists") && query.next()
+               && query.value(0).toInt() > 0;
+    }
+
+    query.prepare(QString("PRAGMA table_info(%1)").arg(table));
+    if (!DBManager::instance().exec(query, "schema.column_exists")) {
+        return false;
+    }
+    while (query.next()) {
+        if (query.value(1).toString().compare(column, Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SchemaMigrator::indexExists(const QString &table, const QString &index) {
+    QSqlQuery query(db);
+    if (isMySql()) {
+        query.prepare(R"(
+            SELECT COUNT(*)
+            FROM information_schema.STATISTICS
+            WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? AND INDEX_NAME = ?
+        )");
+        query.addBindValue(table);
+    } else {
+        query.prepare("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND name = ?");
+    }
+    query.addBindValue(index);
+    return DBManager::instance().exec(query, "schema.index_exists") && query.next() && query.value(0).toInt() > 0;
+}
+
+bool SchemaMigrator::addColumnIfMissing(const QString &table, const QString &column, const QString &definition) {
+    if (!tableExists(table)) {
+        qWarning() << "Cannot add column" << column << "to missing table" << table;
+        return false;
+    }
+    if (columnExists(table, column)) {
+        return true;
+    }
+    return execute(QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, definition), "schema.add_column");
+}
+
+bool SchemaMigrator::createIndexIfMissing(const QString &table, const QString &index, const QString &columns,
+                                          const bool unique) {
+    if (indexExists(table, index)) {
+        return true;
+    }
+    return execute(QString("CREATE %1INDEX %2 ON %3 (%4)").arg(unique ? "UNIQUE " : "", index, table, columns),
+                   "schema.create_index");
+}
+
+bool SchemaMigrator::recordVersion(const Migration &migration) {
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO schema_migrations (version, description) VALUES (?, ?)");
+    query.addBindValue(migration.version);
+    query.addBindValue(QString::fromLatin1(migration.description));
+    if (!DBManager::instance().exec(query, "schema.record_version")) {
+        qDebug() << "Schema Migration Error:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool SchemaMigrator::acquireLock() {
+    if (!isMySql()) {
+        return true;
+    }
+    QSqlQuery query(db);
+    query.prepare("SELECT GET_LOCK(?, ?)");
+    query.addBindValue(QString::fromLatin1(MIGRATION_LOCK));
+    query.addBindValue(MIGRATION_LOCK_TIMEOUT_SECONDS);
+    if (!DBManager::instance().exec(query, "schema.get_lock") || !query.next() || query.value(0).toInt() != 1) {
+        qWarning() << "Timed out waiting for another instance to finish migrating the schema!";
+        return false;
+    }
+    return true;
+}
+
+void SchemaMigrator::releaseLock() {
+    if (!isMySql()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare("SELECT RELEASE_LOCK(?)");
+    query.addBindValue(QString::fromLatin1(MIGRATION_LOCK));
+    DBManager::instance().exec(query, "schema.release_lock");
+}
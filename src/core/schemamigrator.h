@@ -0,0 +1,82 @@
+#ifndef SCHEMAMIGRATOR_H
+#define SCHEMAMIGRATOR_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QList>
+
+class SchemaMigrator {
+public:
+    explicit SchemaMigrator(const QSqlDatabase &db);
+
+    bool migrate();
+
+    int currentVersion();
+
+    static int latestVersion();
+
+private:
+    typedef bool (SchemaMigrator::*MigrationStep)();
+
+    struct Migration {
+        int version;
+        const char *description;
+        MigrationStep apply;
+    };
+
+    static const QList<Migration> &migrations();
+
+    bool createBaseline();
+
+    bool addNormalizedUsername();
+
+    bool addUserIdIndexes();
+
+    bool addRevisionColumns();
+
+    bool addNoteChunks();
+
+    bool addRecordFormats();
+
+    bool addNoteRevisions();
+
+    bool addKeySchedules();
+
+    bool addPasswordHistory();
+
+    bool addPasswordFingerprints();
+
+    bool addAttachments();
+
+    bool addChunkStore();
+
+    bool addRevisionChunkLists();
+
+    bool widenNoteContent();
+
+    bool isMySql() const;
+
+    QString idColumn() const;
+
+    bool execute(const QString &sql, const char *statementId);
+
+    bool tableExists(const QString &table);
+
+    bool columnExists(const QString &table, const QString &column);
+
+    bool indexExists(const QString &table, const QString &index);
+
+    bool addColumnIfMissing(const QString &table, const QString &column, const QString &definition);
+
+    bool createIndexIfMissing(const QString &table, const QString &index, const QString &columns, bool unique);
+
+    bool recordVersion(const Migration &migration);
+
+    bool acquireLock();
+
+    void releaseLock();
+
+    QSqlDatabase db;
+};
+
+#endif // SCHEMAMIGRATOR_H
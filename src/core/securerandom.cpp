@@ -0,0 +1,49 @@
+#include "securerandom.h"
+
+#include <QDebug>
+#include <openssl/rand.h>
+
+// One RAND_bytes call covers a few hundred 16-character passwords.
+static const int RANDOM_BLOCK_SIZE = 16384;
+
+SecureRandom::SecureRandom()
+    : blockOffset(0) {
+}
+
+// Draws the smallest whole number of bytes that covers `bound`, so few draws
+// are rejected and `value % bound` is uniform. A zero bound has no index.
+bool SecureRandom::bounded(const quint32 bound, quint32 &index) {
+    if (bound == 0) {
+        qWarning() << "SecureRandom::bounded called with an empty range!";
+        return false;
+    }
+    const int width = bound <= 0x100 ? 1 : bound <= 0x10000 ? 2 : 4;
+    const quint64 range = Q_UINT64_C(1) << (8 * width);
+    const quint64 limit = range - range % bound;
+    forever {
+        if (blockOffset + width > block.size() && !refill()) {
+            return false;
+        }
+        const auto *bytes = reinterpret_cast<const uchar *>(block.constData()) + blockOffset;
+        blockOffset += width;
+        quint64 value = 0;
+        for (int i = 0; i < width; ++i) {
+            value = value << 8 | bytes[i];
+        }
+        if (value < limit) {
+            index = static_cast<quint32>(value % bound);
+            return true;
+        }
+    }
+}
+
+bool SecureRandom::refill() {
+    block.resize(RANDOM_BLOCK_SIZE);
+    blockOffset = 0;
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(block.data()), RANDOM_BLOCK_SIZE) != 1) {
+        qWarning() << "Failed to generate secure random bytes!";
+        block.clear();
+        return false;
+    }
+    return true;
+}
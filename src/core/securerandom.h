@@ -0,0 +1,22 @@
+#ifndef SECURERANDOM_H
+#define SECURERANDOM_H
+
+#include <QByteArray>
+
+// Uniform integers from OpenSSL's CSPRNG. Bytes are fetched in large blocks,
+// and values past the largest multiple of the bound are rejected, so every
+// index is equally likely. Not thread-safe; give each thread its own.
+class SecureRandom {
+public:
+    SecureRandom();
+
+    bool bounded(quint32 bound, quint32 &index);
+
+private:
+    bool refill();
+
+    QByteArray block;
+    int blockOffset;
+};
+
+#endif // SECURERANDOM_H
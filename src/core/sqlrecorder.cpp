@@ -0,0 +1,349 @@
+#include "sqlrecorder.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlQuery>
+#include <QtEndian>
+#include <QDebug>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+// Trace files start with a magic header, followed by records of two kinds:
+// a statement definition the first time a statement id and SQL template is
+// seen, and one record per execution. All integers are LEB128 varints, signed
+// ones zigzag-encoded. Integer binds are recorded as values because they are
+// ids, epochs and limits that replay needs; text and blob binds only ever
+// record their size, so a trace never contains vault contents or usernames.
+namespace {
+    const QByteArray MAGIC = "ENIGSQL1";
+
+    enum RecordType : quint8 {
+        StatementRecord = 1,
+        ExecutionRecord = 2
+    };
+
+    enum ExecutionFlag : quint8 {
+        ExecutionSucceeded = 1,
+        ExecutionBatched = 2
+    };
+
+    QMutex recorderMutex;
+    QFile traceFile;
+    QHash<QString, int> statementIndexes;
+    // Read by now() on every recorded statement while start() may reset it.
+    std::atomic<qint64> recordingEpoch{0};
+    bool stopRegistered = false;
+    std::atomic<int> threadCounter{0};
+    thread_local int recordingThread = -1;
+
+    void writeVarint(QByteArray &out, quint64 value) {
+        while (value >= 0x80) {
+            out.append(static_cast<char>(value & 0x7f | 0x80));
+            value >>= 7;
+        }
+        out.append(static_cast<char>(value));
+    }
+
+    void writeSigned(QByteArray &out, const qint64 value) {
+        writeVarint(out, static_cast<quint64>(value) << 1 ^ static_cast<quint64>(value >> 63));
+    }
+
+    void writeBytes(QByteArray &out, const QByteArray &bytes) {
+        writeVarint(out, bytes.size());
+        out.append(bytes);
+    }
+
+    SqlTraceParam describe(const QVariant &value) {
+        SqlTraceParam param;
+        if (value.isNull()) {
+            return param;
+        }
+        switch (value.userType()) {
+            case QMetaType::Int:
+            case QMetaType::UInt:
+            case QMetaType::LongLong:
+            case QMetaType::ULongLong:
+            case QMetaType::Bool:
+                param.type = SqlTraceParam::Integer;
+                param.value = value.toLongLong();
+                break;
+            case QMetaType::QByteArray:
+                param.type = SqlTraceParam::Bytes;
+                param.value = value.toByteArray().size();
+                break;
+            case QMetaType::QString:
+                param.type = SqlTraceParam::Text;
+                param.value = value.toString().toUtf8().size();
+                break;
+            default:
+                param.type = SqlTraceParam::Other;
+                param.value = value.toString().size();
+                break;
+        }
+        return param;
+    }
+
+    void writeParam(QByteArray &out, const SqlTraceParam &param) {
+        out.append(static_cast<char>(param.type));
+        if (param.type != SqlTraceParam::Null) {
+            writeSigned(out, param.value);
+        }
+    }
+
+    struct Reader {
+        const QByteArray &data;
+        qsizetype pos = 0;
+        bool ok = true;
+
+        quint64 varint() {
+            quint64 value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos >= data.size()) {
+                    ok = false;
+                    return 0;
+                }
+                const auto byte = static_cast<quint8>(data.at(pos++));
+                value |= static_cast<quint64>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+            ok = false;
+            return 0;
+        }
+
+        qint64 signedVarint() {
+            const quint64 raw = varint();
+            return static_cast<qint64>(raw >> 1) ^ -static_cast<qint64>(raw & 1);
+        }
+
+        quint8 byte() {
+            if (pos >= data.size()) {
+                ok = false;
+                return 0;
+            }
+            return static_cast<quint8>(data.at(pos++));
+        }
+
+        QByteArray bytes() {
+            const auto size = static_cast<qsizetype>(varint());
+            if (!ok || size < 0 || pos + size > data.size()) {
+                ok = false;
+                return QByteArray();
+            }
+            const QByteArray result = data.mid(pos, size);
+            pos += size;
+            return result;
+        }
+
+        SqlTraceParam param() {
+            SqlTraceParam result;
+            result.type = static_cast<SqlTraceParam::Type>(byte());
+            if (result.type != SqlTraceParam::Null) {
+                result.value = signedVarint();
+            }
+            return result;
+        }
+    };
+}
+
+std::atomic<bool> SqlRecorder::recording{false};
+
+static qint64 steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+qint64 SqlRecorder::now() {
+    return steadyNanoseconds() - recordingEpoch.load(std::memory_order_relaxed);
+}
+
+bool SqlRecorder::start(const QString &path) {
+    QMutexLocker locker(&recorderMutex);
+    if (traceFile.isOpen()) {
+        traceFile.close();
+    }
+    traceFile.setFileName(path);
+    if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open SQL trace" << path;
+        return false;
+    }
+    traceFile.write(MAGIC);
+    statementIndexes.clear();
+    recordingEpoch.store(steadyNanoseconds(), std::memory_order_relaxed);
+    recording.store(true, std::memory_order_relaxed);
+
+    // Whichever comes first, the application object going away or the
+    // process exiting, flushes the buffered tail of the trace.
+    if (!stopRegistered) {
+        stopRegistered = true;
+        if (QCoreApplication::instance()) {
+            qAddPostRoutine(stop);
+        }
+        std::atexit(stop);
+    }
+    return true;
+}
+
+void SqlRecorder::stop() {
+    recording.store(false, std::memory_order_relaxed);
+    QMutexLocker locker(&recorderMutex);
+    if (traceFile.isOpen()) {
+        traceFile.flush();
+        traceFile.close();
+    }
+}
+
+void SqlRecorder::initFromEnvironment() {
+    const QString path = qEnvironmentVariable("ENIGMA_SQL_RECORD");
+    if (!path.isEmpty()) {
+        start(path);
+    }
+}
+
+void SqlRecorder::record(const QSqlQuery &query, const char *statementId, const qint64 start, const qint64 duration,
+                         const bool ok, const bool batch) {
+    if (recordingThread < 0) {
+        recordingThread = threadCounter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const QString sql = query.lastQuery();
+    const int paramCount = static_cast<int>(query.boundValues().size());
+
+    QByteArray execution;
+    int batchRows = 0;
+    QList<QVariantList> columns;
+    if (batch) {
+        for (int i = 0; i < paramCount; ++i) {
+            columns.append(query.boundValue(i).toList());
+            batchRows = qMax(batchRows, static_cast<int>(columns.last().size()));
+        }
+    }
+    writeVarint(execution, recordingThread);
+    writeSigned(execution, start);
+    writeSigned(execution, duration);
+    execution.append(static_cast<char>((ok ? ExecutionSucceeded : 0) | (batch ? ExecutionBatched : 0)));
+    writeVarint(execution, batchRows);
+    writeVarint(execution, paramCount);
+    if (batch) {
+        for (int row = 0; row < batchRows; ++row) {
+            for (const QVariantList &column: columns) {
+                writeParam(execution, describe(row < column.size() ? column.at(row) : QVariant()));
+            }
+        }
+    } else {
+        for (int i = 0; i < paramCount; ++i) {
+            writeParam(execution, describe(query.boundValue(i)));
+        }
+    }
+
+    QMutexLocker locker(&recorderMutex);
+    if (!traceFile.isOpen()) {
+        return;
+    }
+
+    const QString key = QString::fromLatin1(statementId) + '\n' + sql;
+    auto it = statementIndexes.constFind(key);
+    if (it == statementIndexes.constEnd()) {
+        QByteArray definition;
+        definition.append(static_cast<char>(StatementRecord));
+        writeBytes(definition, QByteArray(statementId));
+        writeBytes(definition, sql.toUtf8());
+        traceFile.write(definition);
+        it = statementIndexes.insert(key, static_cast<int>(statementIndexes.size()));
+    }
+
+    QByteArray header;
+    header.append(static_cast<char>(ExecutionRecord));
+    writeVarint(header, it.value());
+    traceFile.write(header);
+    traceFile.write(execution);
+}
+
+bool SqlRecorder::readTrace(const QString &path, SqlTrace &trace) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open SQL trace" << path;
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (!data.startsWith(MAGIC)) {
+        qWarning() << "Not an Enigma SQL trace:" << path;
+        return false;
+    }
+
+    Reader reader{data, MAGIC.size()};
+    while (reader.ok && reader.pos < data.size()) {
+        const quint8 type = reader.byte();
+        if (type == StatementRecord) {
+            SqlTraceStatement statement;
+            statement.id = reader.bytes();
+            statement.sql = QString::fromUtf8(reader.bytes());
+            trace.statements.append(statement);
+        } else if (type == ExecutionRecord) {
+            SqlTraceExecution execution;
+            execution.statement = static_cast<int>(reader.varint());
+            execution.thread = static_cast<int>(reader.varint());
+            execution.start = reader.signedVarint();
+            execution.duration = reader.signedVarint();
+            const quint8 flags = reader.byte();
+            execution.ok = flags & ExecutionSucceeded;
+            execution.batched = flags & ExecutionBatched;
+            execution.batchRows = static_cast<int>(reader.varint());
+            execution.paramCount = static_cast<int>(reader.varint());
+            const int values = execution.paramCount * (execution.batched ? execution.batchRows : 1);
+            for (int i = 0; i < values && reader.ok; ++i) {
+                execution.params.append(reader.param());
+            }
+            if (execution.statement >= trace.statements.size()) {
+                reader.ok = false;
+                break;
+            }
+            trace.executions.append(execution);
+        } else {
+            reader.ok = false;
+        }
+    }
+
+    if (!reader.ok) {
+        qWarning() << "SQL trace is truncated or corrupt; replaying" << trace.executions.size() << "statements";
+    }
+    return true;
+}
+
+// Values keep their recorded size. Text and blobs of the same size are equal
+// within a session, so lookups still find what the session inserted, and the
+// session number is written into their first bytes so that sessions replayed
+// side by side do not share usernames, chunk hashes or MACs.
+QVariant SqlRecorder::replayValue(const SqlTraceParam &param, const int session) {
+    switch (param.type) {
+        case SqlTraceParam::Null:
+            return QVariant();
+        case SqlTraceParam::Integer:
+            return param.value;
+        case SqlTraceParam::Bytes: {
+            QByteArray bytes(static_cast<int>(param.value), '\xa5');
+            if (session > 0) {
+                char tag[4];
+                qToBigEndian<quint32>(session, tag);
+                const int tagged = qMin(4, static_cast<int>(bytes.size()));
+                bytes.replace(0, tagged, tag, tagged);
+            }
+            return bytes;
+        }
+        case SqlTraceParam::Text:
+        case SqlTraceParam::Other: {
+            QString text(static_cast<int>(param.value), QChar('x'));
+            if (session > 0) {
+                const QString tag = QString::number(session).left(text.size());
+                text.replace(0, tag.size(), tag);
+            }
+            return text;
+        }
+    }
+    return QVariant();
+}
@@ -0,0 +1,70 @@
+#ifndef SQLRECORDER_H
+#define SQLRECORDER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVariant>
+#include <atomic>
+
+class QSqlQuery;
+
+struct SqlTraceParam {
+    enum Type {
+        Null,
+        Integer,
+        Bytes,
+        Text,
+        Other
+    };
+
+    Type type = Null;
+    qint64 value = 0;
+};
+
+struct SqlTraceStatement {
+    QByteArray id;
+    QString sql;
+};
+
+struct SqlTraceExecution {
+    int statement = 0;
+    int thread = 0;
+    qint64 start = 0;
+    qint64 duration = 0;
+    bool ok = false;
+    bool batched = false;
+    int batchRows = 0;
+    int paramCount = 0;
+    QList<SqlTraceParam> params;
+};
+
+struct SqlTrace {
+    QList<SqlTraceStatement> statements;
+    QList<SqlTraceExecution> executions;
+};
+
+class SqlRecorder {
+public:
+    static bool isRecording() { return recording.load(std::memory_order_relaxed); }
+
+    static bool start(const QString &path);
+
+    static void stop();
+
+    static void initFromEnvironment();
+
+    static void record(const QSqlQuery &query, const char *statementId, qint64 start, qint64 duration, bool ok,
+                       bool batch);
+
+    static qint64 now();
+
+    static bool readTrace(const QString &path, SqlTrace &trace);
+
+    static QVariant replayValue(const SqlTraceParam &param, int session = 0);
+
+private:
+    static std::atomic<bool> recording;
+};
+
+#endif // SQLRECORDER_H
@@ -0,0 +1,32 @@
+#ifndef STRENGTHDICTIONARIES_H
+#define STRENGTHDICTIONARIES_H
+
+#include <cstdint>
+
+// The ranked word lists in src/core/dictionaries, compiled into tries by
+// enigma_dictgen at build time. Node 0 is the root; a node's edges are
+// contiguous and sorted by label. Words are lowercase ASCII.
+namespace StrengthDictionaries {
+    struct TrieNode {
+        uint32_t firstEdge;
+        uint32_t rank; // 0 when no word ends here
+        uint16_t edgeCount;
+    };
+
+    struct TrieEdge {
+        char label;
+        uint32_t child;
+    };
+
+    struct Dictionary {
+        const char *name;
+        const TrieNode *nodes;
+        const TrieEdge *edges;
+        uint32_t wordCount;
+    };
+
+    extern const Dictionary dictionaries[];
+    extern const int dictionaryCount;
+}
+
+#endif // STRENGTHDICTIONARIES_H
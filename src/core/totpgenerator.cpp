@@ -1,4 +1,5 @@
 #include "totpgenerator.h"
+#include "core/trace.h"
 
 #include <ctime>
 #include <cmath>
@@ -51,6 +52,7 @@ QString TOTPGenerator::generateTOTP(const QString &base32_secret,
                                     const int digits,
                                     const int time_step,
                                     const int t0) {
+    ENIGMA_TRACE_SCOPE("crypto", "TOTPGenerator::generateTOTP");
     const QByteArray key = base32Decode(base32_secret);
 
     const std::time_t current_time = std::time(nullptr);
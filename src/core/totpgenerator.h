@@ -10,7 +10,6 @@ public:
                                 int time_step = 30,
                                 int t0 = 0);
 
-private:
     static QByteArray base32Decode(const QString &base32);
 };
 
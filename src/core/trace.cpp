@@ -0,0 +1,188 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+    // Each thread appends to its own fixed-size ring, so recording a span is
+    // two clock reads and a few stores with no locking. The mutex is only
+    // taken when a thread acquires or releases its ring and when exporting.
+    // A thread that exits hands its ring to the next new thread rather than
+    // freeing it, so the spans it wrote stay exportable and the number of
+    // rings is bounded by the most threads alive at once, however often the
+    // pool replaces its threads. A recycled ring keeps its tid; its threads
+    // never run at the same time, so their spans cannot overlap.
+    const quint64 RING_CAPACITY = 16384;
+
+    struct Span {
+        const char *category;
+        const char *name;
+        qint64 start;
+        qint64 end;
+    };
+
+    // Slots are seqlocks: the writer makes the sequence odd, stores the span
+    // and then sets it to 2 * (index + 1), so the exporter can tell a
+    // finished span of the index it wants from a torn or newer one.
+    struct SpanSlot {
+        std::atomic<quint64> sequence{0};
+        std::atomic<const char *> category{nullptr};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<qint64> start{0};
+        std::atomic<qint64> end{0};
+    };
+
+    struct ThreadBuffer {
+        int threadId = 0;
+        QString threadName;
+        std::atomic<quint64> head{0};
+        SpanSlot spans[RING_CAPACITY];
+    };
+
+    QMutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+    std::vector<ThreadBuffer *> releasedBuffers;
+
+    // Returns the thread's ring to the free list when the thread exits.
+    struct BufferLease {
+        ThreadBuffer *buffer = nullptr;
+
+        ~BufferLease() {
+            if (buffer) {
+                QMutexLocker locker(&buffersMutex);
+                releasedBuffers.push_back(buffer);
+            }
+        }
+    };
+
+    thread_local BufferLease localLease;
+
+    ThreadBuffer *threadBuffer() {
+        if (!localLease.buffer) {
+            QMutexLocker locker(&buffersMutex);
+            ThreadBuffer *buffer = nullptr;
+            if (!releasedBuffers.empty()) {
+                buffer = releasedBuffers.back();
+                releasedBuffers.pop_back();
+            } else {
+                buffers.push_back(std::make_unique<ThreadBuffer>());
+                buffer = buffers.back().get();
+                buffer->threadId = static_cast<int>(buffers.size());
+            }
+            const QCoreApplication *app = QCoreApplication::instance();
+            buffer->threadName = app && QThread::currentThread() == app->thread()
+                                     ? QString("main")
+                                     : QString("worker %1").arg(buffer->threadId);
+            localLease.buffer = buffer;
+        }
+        return localLease.buffer;
+    }
+
+    bool readSpan(const SpanSlot &slot, const quint64 index, Span &span) {
+        const quint64 expected = 2 * (index + 1);
+        if (slot.sequence.load(std::memory_order_acquire) != expected) {
+            return false;
+        }
+        span.category = slot.category.load(std::memory_order_relaxed);
+        span.name = slot.name.load(std::memory_order_relaxed);
+        span.start = slot.start.load(std::memory_order_relaxed);
+        span.end = slot.end.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+
+    const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+    QString exportPathFromEnvironment;
+}
+
+std::atomic<bool> Trace::enabled{false};
+
+void Trace::setEnabled(const bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+qint64 Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void Trace::record(const char *category, const char *name, const qint64 start, const qint64 end) {
+    ThreadBuffer *buffer = threadBuffer();
+    const quint64 head = buffer->head.load(std::memory_order_relaxed);
+    SpanSlot &slot = buffer->spans[head % RING_CAPACITY];
+    slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.sequence.store(2 * head + 2, std::memory_order_release);
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// Threads keep recording while the export runs; spans being written or
+// already overwritten are skipped rather than copied torn.
+bool Trace::exportChromeTrace(const QString &path) {
+    QJsonArray events;
+    {
+        QMutexLocker locker(&buffersMutex);
+        for (const auto &buffer: buffers) {
+            events.append(QJsonObject{
+                {"name", "thread_name"},
+                {"ph", "M"},
+                {"pid", 1},
+                {"tid", buffer->threadId},
+                {"args", QJsonObject{{"name", buffer->threadName}}}
+            });
+
+            const quint64 head = buffer->head.load(std::memory_order_acquire);
+            const quint64 first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+            for (quint64 i = first; i < head; ++i) {
+                Span span;
+                if (!readSpan(buffer->spans[i % RING_CAPACITY], i, span)) {
+                    continue;
+                }
+                events.append(QJsonObject{
+                    {"name", span.name},
+                    {"cat", span.category},
+                    {"ph", "X"},
+                    {"ts", span.start / 1000.0},
+                    {"dur", (span.end - span.start) / 1000.0},
+                    {"pid", 1},
+                    {"tid", buffer->threadId}
+                });
+            }
+        }
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write trace to" << path;
+        return false;
+    }
+    file.write(QJsonDocument(QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}}).toJson(
+        QJsonDocument::Compact));
+    return true;
+}
+
+void Trace::initFromEnvironment() {
+    exportPathFromEnvironment = qEnvironmentVariable("ENIGMA_TRACE");
+    if (exportPathFromEnvironment.isEmpty()) {
+        return;
+    }
+
+    setEnabled(true);
+    qAddPostRoutine([] {
+        exportChromeTrace(exportPathFromEnvironment);
+    });
+}
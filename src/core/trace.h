@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+class Trace {
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool on);
+
+    static qint64 now();
+
+    static void record(const char *category, const char *name, qint64 start, qint64 end);
+
+    static bool exportChromeTrace(const QString &path);
+
+    static void initFromEnvironment();
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope {
+public:
+    TraceScope(const char *category, const char *name)
+        : category(category)
+          , name(name)
+          , start(Trace::isEnabled() ? Trace::now() : -1) {
+    }
+
+    ~TraceScope() {
+        if (start >= 0) {
+            Trace::record(category, name, start, Trace::now());
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *category;
+    const char *name;
+    qint64 start;
+};
+
+#define ENIGMA_TRACE_CONCAT_INNER(a, b) a##b
+#define ENIGMA_TRACE_CONCAT(a, b) ENIGMA_TRACE_CONCAT_INNER(a, b)
+#define ENIGMA_TRACE_SCOPE(category, name) \
+    const TraceScope ENIGMA_TRACE_CONCAT(traceScope_, __LINE__)(category, name)
+
+#endif // TRACE_H
@@ -1,11 +1,37 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <cstdio>
 #include "core/dbmanager.h"
+#include "core/schemamigrator.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/sqlrecorder.h"
+#include "core/keyderivation.h"
 #include "ui/logindialog.h"
 #include "ui/mainwindow.h"
 #include "models/user.h"
 
+static QString metricsDumpFormat;
+
+static void dumpMetrics() {
+    const QByteArray dump = metricsDumpFormat == "json" ? Metrics::toJson() : Metrics::toText().toUtf8();
+    std::fwrite(dump.constData(), 1, dump.size(), stdout);
+    std::fflush(stdout);
+}
+
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
+    Trace::initFromEnvironment();
+    SqlRecorder::initFromEnvironment();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"dump-metrics", "Print metrics to stdout on exit, as <format> (text or json).", "format"});
+    parser.process(a);
+    if (parser.isSet("dump-metrics")) {
+        metricsDumpFormat = parser.value("dump-metrics");
+        qAddPostRoutine(dumpMetrics);
+    }
 
     const QString globalStyle = R"(
         QMainWindow {
@@ -89,6 +115,15 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    if (SchemaMigrator migrator(DBManager::instance().getDatabase()); !migrator.migrate()) {
+        return -1;
+    }
+
+    // Registering or changing the master password needs the calibrated KDF
+    // parameters; measuring them takes a second or so, which must not happen
+    // on the GUI thread once the dialog is up.
+    KeyDerivation::calibrateInBackground();
+
     LoginDialog loginDialog;
 
     if (const int result = loginDialog.exec(); result != QDialog::Accepted) {
@@ -96,14 +131,13 @@ int main(int argc, char *argv[]) {
     }
 
     User *user = loginDialog.getLoggedInUser();
-    const QString passwordUsed = loginDialog.getLoggedInPassword();
 
     if (!user) {
         return 0;
     }
 
     MainWindow w;
-    w.setCurrentUser(user, passwordUsed);
+    w.setCurrentUser(user, loginDialog.getLoginPipeline());
     w.show();
 
     return a.exec();
@@ -0,0 +1,858 @@
+#include "attachmentmanager.h"
+#include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/recordcodec.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QVariant>
+#include <QDebug>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QHash>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <memory>
+
+// Files are cut into fixed 1 MiB chunks, so chunk i always starts at byte
+// i * chunk size and a reader can seek without an index. attachment_chunks
+// lists each chunk's hash in order, and the row's encrypted digest covers the
+// file size, the chunk size and that list, so chunks cannot be reordered,
+// swapped for other chunks of the vault or dropped from the end unnoticed.
+//
+// Uploads hash, look up, seal and insert in batches: while one batch is
+// inserted the next is sealed on the thread pool, so at most two batches of
+// plaintext and two of ciphertext are held. Only chunks the store does not
+// hold yet are sealed and written; the others just gain a reference. Each
+// batch commits on its own; the row is only marked complete after the last
+// one, and uploads abandoned half way are purged a day later.
+static const int ATTACHMENT_CHUNK_SIZE = 1024 * 1024;
+static const int ATTACHMENT_BATCH_CHUNKS = 8;
+static const int ATTACHMENT_READ_AHEAD_CHUNKS = 4;
+static const int ATTACHMENT_KEY_SIZE = 32;
+static const qint64 INCOMPLETE_UPLOAD_SECONDS = 24 * 60 * 60;
+
+// Store-backed chunk rows only reference the store.
+static const QByteArray EMPTY_CHUNK("", 0);
+
+enum ChunkStorage {
+    InlineChunks = 0,
+    StoredChunks = 1
+};
+
+namespace {
+    struct PendingChunk {
+        int index;
+        QByteArray data;
+        QByteArray hash;
+    };
+}
+
+static QByteArray chunkAssociatedData(const qint64 fileSize, const int chunkSize, const int index) {
+    QByteArray ad(16, 0);
+    qToBigEndian<quint64>(fileSize, ad.data());
+    qToBigEndian<quint32>(chunkSize, ad.data() + 8);
+    qToBigEndian<quint32>(index, ad.data() + 12);
+    return ad;
+}
+
+// What the attachment digest covers: the file size, the chunk size and the
+// ordered chunk hashes.
+static QByteArray manifestHeader(const qint64 fileSize, const int chunkSize) {
+    QByteArray header(12, 0);
+    qToBigEndian<quint64>(fileSize, header.data());
+    qToBigEndian<quint32>(chunkSize, header.data() + 8);
+    return header;
+}
+
+static int chunkCountFor(const qint64 fileSize, const int chunkSize) {
+    return static_cast<int>((fileSize + chunkSize - 1) / chunkSize);
+}
+
+static qint64 chunkLength(const qint64 fileSize, const int chunkSize, const int index) {
+    return qMin<qint64>(chunkSize, fileSize - static_cast<qint64>(index) * chunkSize);
+}
+
+namespace {
+    // Functors rather than lambdas, since QtConcurrent::mapped reads the
+    // result type from result_type.
+    struct ChunkHasher {
+        typedef QByteArray result_type;
+
+        ChunkStore store;
+
+        QByteArray operator()(const PendingChunk &chunk) const {
+            return store.hash(chunk.data);
+        }
+    };
+
+    struct ChunkSealer {
+        typedef QByteArray result_type;
+
+        ChunkStore store;
+
+        QByteArray operator()(const PendingChunk &chunk) const {
+            return store.seal(chunk.data, chunk.hash);
+        }
+    };
+
+    // Chunks with a hash come from the store, the others are inline chunks
+    // sealed under the file key. A missing or undecryptable chunk, or any
+    // chunk once the window is cancelled, comes back as a null array.
+    struct ChunkOpener {
+        typedef QByteArray result_type;
+
+        QByteArray key;
+        ChunkStore store;
+        qint64 fileSize;
+        int chunkSize;
+        std::shared_ptr<std::atomic<bool> > cancelled;
+
+        QByteArray operator()(const PendingChunk &chunk) const {
+            if (*cancelled) {
+                return QByteArray();
+            }
+            bool ok = false;
+            QByteArray plain;
+            if (!chunk.hash.isEmpty()) {
+                plain = store.open(chunk.data, chunk.hash, &ok);
+            } else {
+                plain = Encryption::aeadDecrypt(chunk.data, key,
+                                                chunkAssociatedData(fileSize, chunkSize, chunk.index), &ok);
+                if (ok) {
+                    plain = RecordCodec::decodeBytes(plain, &ok);
+                }
+            }
+            return ok && plain.size() == chunkLength(fileSize, chunkSize, chunk.index) ? plain : QByteArray();
+        }
+    };
+
+    // Selects one window of sealed chunks and decrypts them. Runs on a pool
+    // thread, so the select goes through that thread's own connection, and the
+    // chunks are decrypted in parallel with this thread taking part.
+    struct WindowLoader {
+        int attachmentId;
+        int userId;
+        QList<QByteArray> hashes;
+        int firstChunk;
+        int chunkCount;
+        ChunkOpener opener;
+
+        QList<QByteArray> operator()() const {
+            ENIGMA_TRACE_SCOPE("model", "AttachmentReader::fetchWindow");
+            if (*opener.cancelled) {
+                return QList<QByteArray>();
+            }
+            QList<PendingChunk> sealed;
+            for (int i = 0; i < chunkCount; ++i) {
+                sealed.append(PendingChunk{firstChunk + i, QByteArray(), hashes.value(i)});
+            }
+
+            QSqlDatabase db = DBManager::instance().getDatabase();
+            QSqlQuery query(db);
+            if (!hashes.isEmpty()) {
+                QStringList placeholders;
+                for (int i = 0; i < chunkCount; ++i) {
+                    placeholders.append("?");
+                }
+                query.prepare(QString("SELECT chunk_hash, encrypted_chunk FROM chunk_store WHERE user_id = ? "
+                                      "AND chunk_hash IN (%1)").arg(placeholders.join(", ")));
+                query.addBindValue(userId);
+                for (const PendingChunk &chunk: sealed) {
+                    query.addBindValue(chunk.hash);
+                }
+                if (!DBManager::instance().exec(query, "chunk_store.select_window")) {
+                    qDebug() << "Read Attachment Error:" << query.lastError().text();
+                }
+                QHash<QByteArray, QByteArray> byHash;
+                while (query.next()) {
+                    byHash.insert(query.value(0).toByteArray(), query.value(1).toByteArray());
+                }
+                for (PendingChunk &chunk: sealed) {
+                    chunk.data = byHash.value(chunk.hash);
+                }
+            } else {
+                query.prepare(R"(
+                    SELECT
+                        c.chunk_index,
+                        c.encrypted_chunk
+                    FROM attachment_chunks c
+                    JOIN attachments a ON a.id = c.attachment_id
+                    WHERE c.attachment_id = ? AND a.user_id = ? AND c.chunk_index >= ? AND c.chunk_index < ?
+                    ORDER BY c.chunk_index
+                )");
+                query.addBindValue(attachmentId);
+                query.addBindValue(userId);
+                query.addBindValue(firstChunk);
+                query.addBindValue(firstChunk + chunkCount);
+                if (!DBManager::instance().exec(query, "attachment_chunks.select_window")) {
+                    qDebug() << "Read Attachment Error:" << query.lastError().text();
+                }
+                while (query.next()) {
+                    const int offset = query.value(0).toInt() - firstChunk;
+                    if (offset >= 0 && offset < sealed.size()) {
+                        sealed[offset].data = query.value(1).toByteArray();
+                    }
+                }
+            }
+
+            return QtConcurrent::blockingMapped<QList<QByteArray> >(sealed, opener);
+        }
+    };
+}
+
+static QByteArray generateRandomBytes(const int length) {
+    QByteArray bytes;
+    bytes.resize(length);
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(bytes.data()), length) != 1) {
+        qWarning() << "Failed to generate random bytes!";
+        return QByteArray();
+    }
+    return bytes;
+}
+
+AttachmentReader::AttachmentReader(const int attachmentId, const int userId, const QByteArray &contentKey,
+                                   const ChunkStore &store, const QList<QByteArray> &hashes,
+                                   const qint64 fileSize, const int chunkSize)
+    : attachmentId(attachmentId)
+      , userId(userId)
+      , contentKey(contentKey)
+      , store(store)
+      , hashes(hashes)
+      , fileSize(fileSize)
+      , chunkSize(chunkSize)
+      , chunkCount(chunkCountFor(fileSize, chunkSize))
+      , position(0)
+      , loadedChunk(-1) {
+    // Start on the first window right away, so the first read only waits
+    // for its first chunk.
+    if (chunkCount > 0) {
+        current = fetchWindow(0);
+    }
+}
+
+AttachmentReader::~AttachmentReader() {
+    current.cancel();
+    next.cancel();
+    current.chunks.waitForFinished();
+    next.chunks.waitForFinished();
+}
+
+bool AttachmentReader::isSequential() const {
+    return false;
+}
+
+qint64 AttachmentReader::size() const {
+    return fileSize;
+}
+
+bool AttachmentReader::seek(const qint64 pos) {
+    if (pos < 0 || pos > fileSize || !QIODevice::seek(pos)) {
+        return false;
+    }
+    position = pos;
+    return true;
+}
+
+qint64 AttachmentReader::readData(char *data, const qint64 maxSize) {
+    qint64 done = 0;
+    while (done < maxSize && position < fileSize) {
+        const int index = static_cast<int>(position / chunkSize);
+        if (index != loadedChunk && !loadChunk(index)) {
+            setErrorString(QString("Failed to read chunk %1 of attachment %2").arg(index).arg(attachmentId));
+            return done > 0 ? done : -1;
+        }
+        const qint64 offset = position - static_cast<qint64>(index) * chunkSize;
+        const qint64 length = qMin(maxSize - done, loaded.size() - offset);
+        memcpy(data + done, loaded.constData() + offset, length);
+        done += length;
+        position += length;
+    }
+    return done;
+}
+
+qint64 AttachmentReader::writeData(const char *, qint64) {
+    return -1;
+}
+
+// Both the select and the decryption run on the thread pool, so opening a
+// window never blocks the reader's thread on the database.
+AttachmentReader::Window AttachmentReader::fetchWindow(const int firstChunk) const {
+    Window window;
+    window.firstChunk = firstChunk;
+    window.chunkCount = qMin(ATTACHMENT_READ_AHEAD_CHUNKS, chunkCount - firstChunk);
+    window.cancelled = std::make_shared<std::atomic<bool> >(false);
+    window.chunks = QtConcurrent::run(WindowLoader{
+        attachmentId, userId, hashes.mid(firstChunk, window.chunkCount), firstChunk, window.chunkCount,
+        ChunkOpener{contentKey, store, fileSize, chunkSize, window.cancelled}
+    });
+    return window;
+}
+
+// Moving into the next window starts fetching the one after it, so reading
+// straight through never waits on the database.
+bool AttachmentReader::loadChunk(const int index) {
+    if (index < 0 || index >= chunkCount) {
+        return false;
+    }
+    const auto contains = [index](const Window &window) {
+        return window.firstChunk >= 0 && index >= window.firstChunk && index < window.firstChunk + window.chunkCount;
+    };
+    if (!contains(current)) {
+        current.cancel();
+        if (contains(next)) {
+            current = next;
+        } else {
+            next.cancel();
+            current = fetchWindow(index - index % ATTACHMENT_READ_AHEAD_CHUNKS);
+        }
+        next = Window();
+    }
+    const int following = current.firstChunk + current.chunkCount;
+    if (next.firstChunk != following && following < chunkCount) {
+        next = fetchWindow(following);
+    }
+
+    loaded = current.chunks.result().value(index - current.firstChunk);
+    if (loaded.isNull()) {
+        qWarning() << "Failed to decrypt chunk" << index << "of attachment" << attachmentId;
+        loadedChunk = -1;
+        return false;
+    }
+    loadedChunk = index;
+    return true;
+}
+
+AttachmentManager::AttachmentManager(const int userId, const Encryption &encryption)
+    : userId(userId), encryption(encryption) {
+}
+
+int AttachmentManager::chunkSize() {
+    return ATTACHMENT_CHUNK_SIZE;
+}
+
+QList<AttachmentEntry> AttachmentManager::getAttachments(const OwnerType ownerType, const int ownerId) const {
+    ENIGMA_TRACE_SCOPE("model", "AttachmentManager::getAttachments");
+    const MetricsOperation operation("getAttachments");
+    QList<AttachmentEntry> list;
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            id,
+            salt,
+            encrypted_name,
+            record_format,
+            key_schedule,
+            size,
+            created_at
+        FROM attachments
+        WHERE user_id = ? AND owner_type = ? AND owner_id = ? AND complete = 1
+        ORDER BY id
+    )");
+    query.addBindValue(userId);
+    query.addBindValue(ownerType);
+    query.addBindValue(ownerId);
+    if (!DBManager::instance().exec(query, "attachments.select_owner")) {
+        qDebug() << "Fetch Attachments Error:" << query.lastError().text();
+        return list;
+    }
+
+    while (query.next()) {
+        const QList<QByteArray> fields = encryption.decryptBytesWithSalt({query.value(2).toByteArray()},
+                                                                        query.value(1).toByteArray(),
+                                                                        query.value(4).toInt());
+        list.append(AttachmentEntry{
+            query.value(0).toInt(),
+            RecordCodec::decodeField(fields.at(0), query.value(3).toInt()),
+            query.value(5).toLongLong(),
+            query.value(6).toLongLong()
+        });
+    }
+    return list;
+}
+
+// Attachments are listed and deleted by owner, so a row pointing at another
+// user's entry would show up under it once the ids line up.
+bool AttachmentManager::ownerBelongsToUser(const OwnerType ownerType, const int ownerId) const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(ownerType == NoteOwner
+                      ? "SELECT 1 FROM notes WHERE id = ? AND user_id = ?"
+                      : "SELECT 1 FROM passwords WHERE id = ? AND user_id = ?");
+    query.addBindValue(ownerId);
+    query.addBindValue(userId);
+    if (!DBManager::instance().exec(query, ownerType == NoteOwner ? "notes.select_owner" : "passwords.select_owner")) {
+        qDebug() << "Check Attachment Owner Error:" << query.lastError().text();
+        return false;
+    }
+    return query.next();
+}
+
+bool AttachmentManager::addAttachment(const OwnerType ownerType, const int ownerId, const QString &path,
+                                      const Progress &progress) const {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open" << path << "for attaching:" << file.errorString();
+        return false;
+    }
+    return addAttachment(ownerType, ownerId, QFileInfo(path).fileName(), file, progress);
+}
+
+bool AttachmentManager::addAttachment(const OwnerType ownerType, const int ownerId, const QString &name,
+                                      QIODevice &source, const Progress &progress, int *attachmentId) const {
+    ENIGMA_TRACE_SCOPE("model", "AttachmentManager::addAttachment");
+    const MetricsOperation operation("addAttachment");
+    if (source.isSequential()) {
+        qWarning() << "Attachments need a source of known size!";
+        return false;
+    }
+    if (!ownerBelongsToUser(ownerType, ownerId)) {
+        qWarning() << "Refusing to attach to" << ownerId << "which is not an entry of user" << userId;
+        return false;
+    }
+    purgeIncomplete();
+
+    ChunkStore store(userId);
+    if (!store.load(encryption, true)) {
+        qWarning() << "Failed to open the chunk store of user" << userId;
+        return false;
+    }
+
+    const qint64 fileSize = source.size() - source.pos();
+    const int chunkCount = chunkCountFor(fileSize, ATTACHMENT_CHUNK_SIZE);
+    const QByteArray salt = generateRandomBytes(16);
+    if (salt.isEmpty()) {
+        return false;
+    }
+    // The digest is only known at the end; the row stays incomplete until then.
+    const QList<QByteArray> encrypted = encryption.encryptBytesWithSalt({
+        RecordCodec::encodeField(name, false),
+        RecordCodec::encodeBytes(EMPTY_CHUNK, false)
+    }, salt);
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery insert(db);
+    insert.prepare(R"(
+        INSERT INTO attachments (
+            user_id,
+            owner_type,
+            owner_id,
+            salt,
+            encrypted_name,
+            encrypted_key,
+            record_format,
+            key_schedule,
+            size,
+            chunk_size,
+            chunk_storage,
+            created_at
+        ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    )");
+    insert.addBindValue(userId);
+    insert.addBindValue(ownerType);
+    insert.addBindValue(ownerId);
+    insert.addBindValue(salt);
+    insert.addBindValue(encrypted.at(0));
+    insert.addBindValue(encrypted.at(1));
+    insert.addBindValue(RecordCodec::HeaderedRecord);
+    insert.addBindValue(Encryption::CurrentKeySchedule);
+    insert.addBindValue(fileSize);
+    insert.addBindValue(ATTACHMENT_CHUNK_SIZE);
+    insert.addBindValue(StoredChunks);
+    insert.addBindValue(QDateTime::currentSecsSinceEpoch());
+    if (!DBManager::instance().exec(insert, "attachments.insert")) {
+        qDebug() << "Add Attachment Error:" << insert.lastError().text();
+        return false;
+    }
+    const int id = insert.lastInsertId().toInt();
+
+    struct Batch {
+        QList<PendingChunk> chunks;
+        QList<QByteArray> hashes;
+        QList<QByteArray> newHashes;
+        QFuture<QByteArray> sealing;
+    };
+
+    int nextIndex = 0;
+    bool readFailed = false;
+    QSet<QByteArray> scheduled;
+    const auto readBatch = [&]() {
+        Batch batch;
+        while (batch.chunks.size() < ATTACHMENT_BATCH_CHUNKS && nextIndex < chunkCount) {
+            const qint64 length = chunkLength(fileSize, ATTACHMENT_CHUNK_SIZE, nextIndex);
+            QByteArray data = source.read(length);
+            if (data.size() != length) {
+                qWarning() << "Short read while attaching" << name << ":" << source.errorString();
+                readFailed = true;
+                return Batch();
+            }
+            batch.chunks.append(PendingChunk{nextIndex++, data, QByteArray()});
+        }
+        if (batch.chunks.isEmpty()) {
+            return batch;
+        }
+
+        // Chunks already in the store, or already sealed by this upload, are
+        // only referenced.
+        batch.hashes = QtConcurrent::mapped(batch.chunks, ChunkHasher{store}).results();
+        const QSet<QByteArray> stored = store.stored(batch.hashes);
+        QList<PendingChunk> missing;
+        for (int i = 0; i < batch.chunks.size(); ++i) {
+            const QByteArray &hash = batch.hashes.at(i);
+            if (stored.contains(hash) || scheduled.contains(hash)) {
+                continue;
+            }
+            scheduled.insert(hash);
+            batch.newHashes.append(hash);
+            missing.append(PendingChunk{batch.chunks.at(i).index, batch.chunks.at(i).data, hash});
+        }
+        batch.sealing = QtConcurrent::mapped(missing, ChunkSealer{store});
+        return batch;
+    };
+    const auto fail = [this, id](const QString &error) {
+        qDebug() << "Add Attachment Error:" << error;
+        deleteAttachment(id);
+        return false;
+    };
+
+    QByteArray manifest = manifestHeader(fileSize, ATTACHMENT_CHUNK_SIZE);
+    Batch batch = readBatch();
+    qint64 written = 0;
+    while (!batch.chunks.isEmpty()) {
+        Batch following = readBatch();
+        QList<QByteArray> sealed = batch.sealing.results();
+        for (const QByteArray &chunk: sealed) {
+            if (chunk.isEmpty()) {
+                following.sealing.waitForFinished();
+                return fail("failed to seal a chunk");
+            }
+        }
+
+        QVariantList ids;
+        QVariantList indexes;
+        QVariantList chunks;
+        QVariantList hashes;
+        for (int i = 0; i < batch.chunks.size(); ++i) {
+            ids.append(id);
+            indexes.append(batch.chunks.at(i).index);
+            chunks.append(EMPTY_CHUNK);
+            hashes.append(batch.hashes.at(i));
+            manifest.append(batch.hashes.at(i));
+        }
+
+        QSqlQuery chunkInsert(db);
+        chunkInsert.prepare(R"(
+            INSERT INTO attachment_chunks (
+                attachment_id,
+                chunk_index,
+                encrypted_chunk,
+                chunk_hash
+            ) VALUES (?, ?, ?, ?)
+        )");
+        chunkInsert.addBindValue(ids);
+        chunkInsert.addBindValue(indexes);
+        chunkInsert.addBindValue(chunks);
+        chunkInsert.addBindValue(hashes);
+        const bool ownTransaction = db.transaction();
+        // Another session may have released a chunk since the lookup; seal
+        // those again rather than referencing a chunk that is gone.
+        const QSet<QByteArray> present = store.stored(batch.hashes);
+        bool resealed = true;
+        for (int i = 0; i < batch.chunks.size() && resealed; ++i) {
+            const QByteArray &hash = batch.hashes.at(i);
+            if (!present.contains(hash) && !batch.newHashes.contains(hash)) {
+                batch.newHashes.append(hash);
+                sealed.append(store.seal(batch.chunks.at(i).data, hash));
+                resealed = !sealed.last().isEmpty();
+            }
+        }
+        if (!resealed) {
+            if (ownTransaction) {
+                db.rollback();
+            }
+            following.sealing.waitForFinished();
+            return fail("failed to seal a chunk");
+        }
+        if (!store.insert(db, batch.newHashes, sealed)
+            || !store.addReferences(db, batch.hashes)
+            || !DBManager::instance().execBatch(chunkInsert, "attachment_chunks.insert_reference")
+            || (ownTransaction && !db.commit())) {
+            if (ownTransaction) {
+                db.rollback();
+            }
+            following.sealing.waitForFinished();
+            return fail(chunkInsert.lastError().text());
+        }
+
+        for (const PendingChunk &chunk: batch.chunks) {
+            written += chunk.data.size();
+        }
+        if (progress) {
+            progress(written, fileSize);
+        }
+        batch = following;
+    }
+    if (readFailed) {
+        return fail("the source ended early");
+    }
+
+    const QByteArray completedSalt = generateRandomBytes(16);
+    if (completedSalt.isEmpty()) {
+        return fail("failed to generate a salt");
+    }
+    const QList<QByteArray> completed = encryption.encryptBytesWithSalt({
+        RecordCodec::encodeField(name, false),
+        RecordCodec::encodeBytes(store.digest(manifest), false)
+    }, completedSalt);
+
+    QSqlQuery complete(db);
+    complete.prepare(R"(
+        UPDATE attachments
+        SET
+            salt = ?,
+            encrypted_name = ?,
+            encrypted_key = ?,
+            key_schedule = ?,
+            complete = 1
+        WHERE id = ? AND user_id = ?
+    )");
+    complete.addBindValue(completedSalt);
+    complete.addBindValue(completed.at(0));
+    complete.addBindValue(completed.at(1));
+    complete.addBindValue(Encryption::CurrentKeySchedule);
+    complete.addBindValue(id);
+    complete.addBindValue(userId);
+    if (!DBManager::instance().exec(complete, "attachments.complete")) {
+        return fail(complete.lastError().text());
+    }
+    if (attachmentId) {
+        *attachmentId = id;
+    }
+    return true;
+}
+
+// The reader is opened unbuffered; it keeps whole chunks itself. For
+// store-backed attachments the chunk hashes are read and checked against the
+// digest up front, so the reader only fetches by hash.
+AttachmentReader *AttachmentManager::openAttachment(const int id) const {
+    ENIGMA_TRACE_SCOPE("model", "AttachmentManager::openAttachment");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            salt,
+            encrypted_key,
+            key_schedule,
+            size,
+            chunk_size,
+            chunk_storage
+        FROM attachments
+        WHERE id = ? AND user_id = ? AND complete = 1
+    )");
+    query.addBindValue(id);
+    query.addBindValue(userId);
+    if (!DBManager::instance().exec(query, "attachments.select") || !query.next()) {
+        qDebug() << "Open Attachment Error:" << query.lastError().text();
+        return nullptr;
+    }
+
+    const QList<QByteArray> fields = encryption.decryptBytesWithSalt({query.value(1).toByteArray()},
+                                                                    query.value(0).toByteArray(),
+                                                                    query.value(2).toInt());
+    bool ok = false;
+    const QByteArray secret = RecordCodec::decodeBytes(fields.at(0), &ok);
+    const qint64 fileSize = query.value(3).toLongLong();
+    const int chunkSize = query.value(4).toInt();
+    const bool storedChunks = query.value(5).toInt() == StoredChunks;
+    if (!ok || fileSize < 0 || chunkSize <= 0 || (!storedChunks && secret.size() != ATTACHMENT_KEY_SIZE)) {
+        qWarning() << "Failed to decrypt the key of attachment" << id;
+        return nullptr;
+    }
+    if (!storedChunks) {
+        const auto reader = new AttachmentReader(id, userId, secret, ChunkStore(userId), QList<QByteArray>(),
+                                                 fileSize, chunkSize);
+        reader->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        return reader;
+    }
+
+    ChunkStore store(userId);
+    if (!store.load(encryption, false)) {
+        qWarning() << "Failed to open the chunk store of user" << userId;
+        return nullptr;
+    }
+    QSqlQuery chunks(db);
+    chunks.prepare(R"(
+        SELECT
+            c.chunk_index,
+            c.chunk_hash
+        FROM attachment_chunks c
+        JOIN attachments a ON a.id = c.attachment_id
+        WHERE c.attachment_id = ? AND a.user_id = ?
+        ORDER BY c.chunk_index
+    )");
+    chunks.addBindValue(id);
+    chunks.addBindValue(userId);
+    if (!DBManager::instance().exec(chunks, "attachment_chunks.select_hashes")) {
+        qDebug() << "Open Attachment Error:" << chunks.lastError().text();
+        return nullptr;
+    }
+    QList<QByteArray> hashes;
+    QByteArray manifest = manifestHeader(fileSize, chunkSize);
+    while (chunks.next()) {
+        if (chunks.value(0).toInt() != hashes.size()) {
+            break;
+        }
+        hashes.append(chunks.value(1).toByteArray());
+        manifest.append(hashes.last());
+    }
+    const QByteArray digest = store.digest(manifest);
+    if (hashes.size() != chunkCountFor(fileSize, chunkSize) || digest.size() != secret.size()
+        || CRYPTO_memcmp(digest.constData(), secret.constData(), digest.size()) != 0) {
+        qWarning() << "The chunk list of attachment" << id << "does not match its digest";
+        return nullptr;
+    }
+
+    const auto reader = new AttachmentReader(id, userId, QByteArray(), store, hashes, fileSize, chunkSize);
+    reader->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    return reader;
+}
+
+// Written through QSaveFile, so a failed download never leaves a truncated
+// file behind.
+bool AttachmentManager::saveAttachment(const int id, const QString &path, const Progress &progress) const {
+    ENIGMA_TRACE_SCOPE("model", "AttachmentManager::saveAttachment");
+    const MetricsOperation operation("saveAttachment");
+    const std::unique_ptr<AttachmentReader> reader(openAttachment(id));
+    if (!reader) {
+        return false;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open" << path << "for writing:" << file.errorString();
+        return false;
+    }
+    while (!reader->atEnd()) {
+        const QByteArray data = reader->read(ATTACHMENT_CHUNK_SIZE);
+        if (data.isEmpty() || file.write(data) != data.size()) {
+            qWarning() << "Failed to save attachment" << id << ":" << reader->errorString() << file.errorString();
+            file.cancelWriting();
+            return false;
+        }
+        if (progress) {
+            progress(reader->pos(), reader->size());
+        }
+    }
+    return file.commit();
+}
+
+bool AttachmentManager::deleteAttachment(const int id) const {
+    ENIGMA_TRACE_SCOPE("model", "AttachmentManager::deleteAttachment");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
+    bool removed = false;
+    if (!removeAttachment(db, userId, id, &removed) || (ownTransaction && !db.commit())) {
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+    return removed;
+}
+
+// Runs inside the caller's delete of the entry or note.
+bool AttachmentManager::deleteOwnerAttachments(QSqlDatabase &db, const int userId, const OwnerType ownerType,
+                                               const int ownerId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT id FROM attachments WHERE user_id = ? AND owner_type = ? AND owner_id = ?");
+    query.addBindValue(userId);
+    query.addBindValue(ownerType);
+    query.addBindValue(ownerId);
+    if (!DBManager::instance().exec(query, "attachments.select_owner_ids")) {
+        qDebug() << "Delete Attachments Error:" << query.lastError().text();
+        return false;
+    }
+    QList<int> ids;
+    while (query.next()) {
+        ids.append(query.value(0).toInt());
+    }
+    for (const int id: ids) {
+        if (!removeAttachment(db, userId, id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Deletes one attachment with its chunk rows and releases the store chunks
+// those rows referenced. Runs inside the caller's transaction.
+bool AttachmentManager::removeAttachment(QSqlDatabase &db, const int userId, const int id, bool *removed) {
+    QSqlQuery select(db);
+    select.prepare(R"(
+        SELECT c.chunk_hash
+        FROM attachment_chunks c
+        JOIN attachments a ON a.id = c.attachment_id
+        WHERE c.attachment_id = ? AND a.user_id = ? AND c.chunk_hash IS NOT NULL
+    )");
+    select.addBindValue(id);
+    select.addBindValue(userId);
+    if (!DBManager::instance().exec(select, "attachment_chunks.select_references")) {
+        qDebug() << "Delete Attachment Error:" << select.lastError().text();
+        return false;
+    }
+    QList<QByteArray> hashes;
+    while (select.next()) {
+        hashes.append(select.value(0).toByteArray());
+    }
+
+    QSqlQuery chunks(db);
+    chunks.prepare("DELETE FROM attachment_chunks WHERE attachment_id IN "
+        "(SELECT id FROM attachments WHERE id = ? AND user_id = ?)");
+    chunks.addBindValue(id);
+    chunks.addBindValue(userId);
+
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM attachments WHERE id = ? AND user_id = ?");
+    query.addBindValue(id);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(chunks, "attachment_chunks.delete_attachment")
+        || !DBManager::instance().exec(query, "attachments.delete")
+        || !ChunkStore::release(db, userId, hashes)) {
+        qDebug() << "Delete Attachment Error:" << query.lastError().text() << chunks.lastError().text();
+        return false;
+    }
+    if (removed) {
+        *removed = query.numRowsAffected() > 0;
+    }
+    return true;
+}
+
+bool AttachmentManager::purgeIncomplete() const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare("SELECT id FROM attachments WHERE user_id = ? AND complete = 0 AND created_at < ?");
+    query.addBindValue(userId);
+    query.addBindValue(QDateTime::currentSecsSinceEpoch() - INCOMPLETE_UPLOAD_SECONDS);
+    if (!DBManager::instance().exec(query, "attachments.select_incomplete")) {
+        qDebug() << "Purge Attachments Error:" << query.lastError().text();
+        return false;
+    }
+    QList<int> ids;
+    while (query.next()) {
+        ids.append(query.value(0).toInt());
+    }
+
+    for (const int id: ids) {
+        deleteAttachment(id);
+    }
+    return true;
+}
@@ -0,0 +1,140 @@
+#ifndef ATTACHMENTMANAGER_H
+#define ATTACHMENTMANAGER_H
+
+#include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QFuture>
+#include <QIODevice>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "core/encryption.h"
+#include "models/chunkstore.h"
+
+class QSqlDatabase;
+
+struct AttachmentEntry {
+    int id;
+    QString name;
+    qint64 size;
+    qint64 createdAt;
+};
+
+// Streams an attachment out of the chunk store, or out of attachment_chunks
+// for attachments stored before it. Opening it starts fetching the first
+// window of chunks, and each window is selected and decrypted on the thread
+// pool while the one before it is read, so the first bytes are available after
+// a single chunk and memory stays at two windows whatever the file size. Seeking is
+// supported; a seek outside the current window drops the read-ahead.
+class AttachmentReader final : public QIODevice {
+    Q_OBJECT
+
+public:
+    ~AttachmentReader() override;
+
+    bool isSequential() const override;
+
+    qint64 size() const override;
+
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    friend class AttachmentManager;
+
+    // QFuture::cancel() does nothing for QtConcurrent::run, so a window that
+    // is no longer needed is stopped through its own flag, which the loader
+    // checks before the select and before each chunk.
+    struct Window {
+        int firstChunk = -1;
+        int chunkCount = 0;
+        QFuture<QList<QByteArray> > chunks;
+        std::shared_ptr<std::atomic<bool> > cancelled;
+
+        void cancel() const {
+            if (cancelled) {
+                *cancelled = true;
+            }
+        }
+    };
+
+    AttachmentReader(int attachmentId, int userId, const QByteArray &contentKey, const ChunkStore &store,
+                     const QList<QByteArray> &hashes, qint64 fileSize, int chunkSize);
+
+    Window fetchWindow(int firstChunk) const;
+
+    bool loadChunk(int index);
+
+    int attachmentId;
+    int userId;
+    QByteArray contentKey;
+    ChunkStore store;
+    QList<QByteArray> hashes;
+    qint64 fileSize;
+    int chunkSize;
+    int chunkCount;
+    qint64 position;
+
+    Window current;
+    Window next;
+    int loadedChunk;
+    QByteArray loaded;
+};
+
+// Files attached to a password entry or a note. Each file is cut into
+// fixed-size chunks kept in the vault's content-addressed ChunkStore, so a
+// file attached to several entries, or a chunk shared between files, is stored
+// once; uploading a file whose chunks are all stored writes only metadata.
+// The file name and a keyed digest of the ordered chunk hashes are the only
+// row-key encrypted fields, so a vault key rotation rewrites the attachments
+// row and leaves the chunks alone. Attachments stored before the chunk store
+// keep their chunks in attachment_chunks under a random per-file key.
+// Holds its own copy of the vault key, so a transfer running in the background
+// survives the vault being reopened.
+class AttachmentManager {
+public:
+    enum OwnerType {
+        PasswordOwner = 0,
+        NoteOwner = 1
+    };
+
+    // Called with the bytes transferred so far and the file size.
+    typedef std::function<void(qint64, qint64)> Progress;
+
+    AttachmentManager(int userId, const Encryption &encryption);
+
+    QList<AttachmentEntry> getAttachments(OwnerType ownerType, int ownerId) const;
+
+    bool addAttachment(OwnerType ownerType, int ownerId, const QString &path,
+                       const Progress &progress = Progress()) const;
+
+    bool addAttachment(OwnerType ownerType, int ownerId, const QString &name, QIODevice &source,
+                       const Progress &progress = Progress(), int *attachmentId = nullptr) const;
+
+    AttachmentReader *openAttachment(int id) const;
+
+    bool saveAttachment(int id, const QString &path, const Progress &progress = Progress()) const;
+
+    bool deleteAttachment(int id) const;
+
+    static bool deleteOwnerAttachments(QSqlDatabase &db, int userId, OwnerType ownerType, int ownerId);
+
+    static int chunkSize();
+
+private:
+    static bool removeAttachment(QSqlDatabase &db, int userId, int id, bool *removed = nullptr);
+
+    bool purgeIncomplete() const;
+
+    bool ownerBelongsToUser(OwnerType ownerType, int ownerId) const;
+
+    int userId;
+    Encryption encryption;
+};
+
+#endif // ATTACHMENTMANAGER_H
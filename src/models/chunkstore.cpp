@@ -0,0 +1,276 @@
+#include "chunkstore.h"
+#include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/recordcodec.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QVariant>
+#include <QDebug>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+
+static const int CHUNK_STORE_SECRET_SIZE = 32;
+static const QByteArray HASH_KEY_LABEL = "enigma-chunk-hash";
+static const QByteArray SEAL_KEY_LABEL = "enigma-chunk-seal";
+static const QByteArray DIGEST_KEY_LABEL = "enigma-chunk-digest";
+
+// Lookups bind one parameter per hash; this keeps them under SQLite's limit.
+static const int LOOKUP_BATCH_SIZE = 256;
+
+static QByteArray hmacSha256(const QByteArray &key, const QByteArray &data) {
+    QByteArray mac(EVP_MAX_MD_SIZE, 0);
+    unsigned int len = 0;
+    if (!HMAC(EVP_sha256(), key.constData(), key.size(),
+              reinterpret_cast<const unsigned char *>(data.constData()), data.size(),
+              reinterpret_cast<unsigned char *>(mac.data()), &len)) {
+        return QByteArray();
+    }
+    mac.resize(static_cast<int>(len));
+    return mac;
+}
+
+static QByteArray generateRandomBytes(const int length) {
+    QByteArray bytes;
+    bytes.resize(length);
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(bytes.data()), length) != 1) {
+        qWarning() << "Failed to generate random bytes!";
+        return QByteArray();
+    }
+    return bytes;
+}
+
+ChunkStore::ChunkStore(const int userId)
+    : userId(userId) {
+}
+
+// Two sessions creating the secret at once race on the unique user_id index;
+// the loser reads the winner's secret.
+bool ChunkStore::load(const Encryption &encryption, const bool create) {
+    ENIGMA_TRACE_SCOPE("model", "ChunkStore::load");
+    QByteArray secret;
+    if (!readSecret(encryption, secret)) {
+        return false;
+    }
+    if (secret.isEmpty() && create) {
+        secret = generateRandomBytes(CHUNK_STORE_SECRET_SIZE);
+        const QByteArray salt = generateRandomBytes(16);
+        if (secret.isEmpty() || salt.isEmpty()) {
+            return false;
+        }
+        const QList<QByteArray> encrypted = encryption.encryptBytesWithSalt({
+            RecordCodec::encodeBytes(secret, false)
+        }, salt);
+
+        QSqlDatabase db = DBManager::instance().getDatabase();
+        QSqlQuery insert(db);
+        insert.prepare(R"(
+            INSERT INTO chunk_store_keys (
+                user_id,
+                salt,
+                encrypted_key,
+                record_format,
+                key_schedule
+            ) VALUES (?, ?, ?, ?, ?)
+        )");
+        insert.addBindValue(userId);
+        insert.addBindValue(salt);
+        insert.addBindValue(encrypted.at(0));
+        insert.addBindValue(RecordCodec::HeaderedRecord);
+        insert.addBindValue(Encryption::CurrentKeySchedule);
+        if (!DBManager::instance().exec(insert, "chunk_store_keys.insert")) {
+            qDebug() << "Create Chunk Store Key Error:" << insert.lastError().text();
+            if (!readSecret(encryption, secret)) {
+                return false;
+            }
+        }
+    }
+    if (secret.size() != CHUNK_STORE_SECRET_SIZE) {
+        hashKey.clear();
+        sealKey.clear();
+        digestKey.clear();
+        return false;
+    }
+
+    hashKey = hmacSha256(secret, HASH_KEY_LABEL);
+    sealKey = hmacSha256(secret, SEAL_KEY_LABEL);
+    digestKey = hmacSha256(secret, DIGEST_KEY_LABEL);
+    return isLoaded();
+}
+
+// A missing row leaves `secret` empty and still succeeds.
+bool ChunkStore::readSecret(const Encryption &encryption, QByteArray &secret) const {
+    secret.clear();
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare("SELECT salt, encrypted_key, key_schedule FROM chunk_store_keys WHERE user_id = ?");
+    query.addBindValue(userId);
+    if (!DBManager::instance().exec(query, "chunk_store_keys.select")) {
+        qDebug() << "Read Chunk Store Key Error:" << query.lastError().text();
+        return false;
+    }
+    if (!query.next()) {
+        return true;
+    }
+
+    const QList<QByteArray> fields = encryption.decryptBytesWithSalt({query.value(1).toByteArray()},
+                                                                    query.value(0).toByteArray(),
+                                                                    query.value(2).toInt());
+    bool ok = false;
+    secret = RecordCodec::decodeBytes(fields.at(0), &ok);
+    if (!ok || secret.size() != CHUNK_STORE_SECRET_SIZE) {
+        qWarning() << "Failed to decrypt the chunk store key of user" << userId;
+        secret.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::isLoaded() const {
+    return !hashKey.isEmpty() && !sealKey.isEmpty() && !digestKey.isEmpty();
+}
+
+QByteArray ChunkStore::hash(const QByteArray &chunk) const {
+    return hmacSha256(hashKey, chunk);
+}
+
+QByteArray ChunkStore::seal(const QByteArray &chunk, const QByteArray &hash) const {
+    return Encryption::aeadEncrypt(RecordCodec::encodeBytes(chunk, true), sealKey, hash);
+}
+
+QByteArray ChunkStore::open(const QByteArray &sealed, const QByteArray &hash, bool *ok) const {
+    bool decrypted = false;
+    QByteArray plain = Encryption::aeadDecrypt(sealed, sealKey, hash, &decrypted);
+    if (decrypted) {
+        plain = RecordCodec::decodeBytes(plain, &decrypted);
+    }
+    if (ok) {
+        *ok = decrypted;
+    }
+    return decrypted ? plain : QByteArray();
+}
+
+QByteArray ChunkStore::digest(const QByteArray &data) const {
+    return hmacSha256(digestKey, data);
+}
+
+QSet<QByteArray> ChunkStore::stored(const QList<QByteArray> &hashes) const {
+    ENIGMA_TRACE_SCOPE("db", "ChunkStore::stored");
+    QSet<QByteArray> found;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    for (int first = 0; first < hashes.size(); first += LOOKUP_BATCH_SIZE) {
+        const QList<QByteArray> batch = hashes.mid(first, LOOKUP_BATCH_SIZE);
+        QStringList placeholders;
+        for (int i = 0; i < batch.size(); ++i) {
+            placeholders.append("?");
+        }
+
+        QSqlQuery query(db);
+        query.prepare(QString("SELECT chunk_hash FROM chunk_store WHERE user_id = ? AND chunk_hash IN (%1)")
+            .arg(placeholders.join(", ")));
+        query.addBindValue(userId);
+        for (const QByteArray &hash: batch) {
+            query.addBindValue(hash);
+        }
+        if (!DBManager::instance().exec(query, "chunk_store.select_hashes")) {
+            qDebug() << "Chunk Store Lookup Error:" << query.lastError().text();
+            continue;
+        }
+        while (query.next()) {
+            found.insert(query.value(0).toByteArray());
+        }
+    }
+    return found;
+}
+
+// New chunks start unreferenced; the caller adds its references in the same
+// transaction. A chunk another session stored in the meantime is left as it
+// is, since equal hashes seal equal plaintext.
+bool ChunkStore::insert(QSqlDatabase &db, const QList<QByteArray> &hashes, const QList<QByteArray> &sealed) const {
+    if (hashes.isEmpty()) {
+        return true;
+    }
+    QVariantList userIds;
+    QVariantList hashValues;
+    QVariantList chunks;
+    for (int i = 0; i < hashes.size(); ++i) {
+        userIds.append(userId);
+        hashValues.append(hashes.at(i));
+        chunks.append(sealed.at(i));
+    }
+
+    QSqlQuery query(db);
+    query.prepare(QString(R"(
+        INSERT INTO chunk_store (
+            user_id,
+            chunk_hash,
+            encrypted_chunk,
+            ref_count
+        ) VALUES (?, ?, ?, 0)
+        %1
+    )").arg(db.driverName() == "QMYSQL" ? "ON DUPLICATE KEY UPDATE ref_count = ref_count"
+                                         : "ON CONFLICT(user_id, chunk_hash) DO NOTHING"));
+    query.addBindValue(userIds);
+    query.addBindValue(hashValues);
+    query.addBindValue(chunks);
+    if (!DBManager::instance().execBatch(query, "chunk_store.insert")) {
+        qDebug() << "Chunk Store Insert Error:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+// One increment per reference row, so a hash listed twice counts twice. The
+// updates run one at a time because batched row counts are not reliable
+// across drivers, and a hash that matches no row means the chunk was
+// released since the caller looked it up, which must fail the write.
+bool ChunkStore::addReferences(QSqlDatabase &db, const QList<QByteArray> &hashes) const {
+    ENIGMA_TRACE_SCOPE("db", "ChunkStore::addReferences");
+    QSqlQuery query(db);
+    query.prepare("UPDATE chunk_store SET ref_count = ref_count + 1 WHERE user_id = ? AND chunk_hash = ?");
+    for (const QByteArray &hash: hashes) {
+        query.bindValue(0, userId);
+        query.bindValue(1, hash);
+        if (!DBManager::instance().exec(query, "chunk_store.add_reference")) {
+            qDebug() << "Chunk Store Reference Error:" << query.lastError().text();
+            return false;
+        }
+        if (query.numRowsAffected() != 1) {
+            qWarning() << "Chunk" << hash.toHex() << "is no longer stored for user" << userId;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hashes that are not in the store, such as the MACs of notes chunked before
+// the store existed, match no row and are ignored.
+bool ChunkStore::release(QSqlDatabase &db, const int userId, const QList<QByteArray> &hashes) {
+    ENIGMA_TRACE_SCOPE("db", "ChunkStore::release");
+    if (hashes.isEmpty()) {
+        return true;
+    }
+    QVariantList userIds;
+    QVariantList hashValues;
+    for (const QByteArray &hash: hashes) {
+        userIds.append(userId);
+        hashValues.append(hash);
+    }
+
+    QSqlQuery release(db);
+    release.prepare("UPDATE chunk_store SET ref_count = ref_count - 1 WHERE user_id = ? AND chunk_hash = ?");
+    release.addBindValue(userIds);
+    release.addBindValue(hashValues);
+
+    QSqlQuery collect(db);
+    collect.prepare("DELETE FROM chunk_store WHERE user_id = ? AND chunk_hash = ? AND ref_count <= 0");
+    collect.addBindValue(userIds);
+    collect.addBindValue(hashValues);
+
+    if (!DBManager::instance().execBatch(release, "chunk_store.release")
+        || !DBManager::instance().execBatch(collect, "chunk_store.delete_unreferenced")) {
+        qDebug() << "Chunk Store Release Error:" << release.lastError().text() << collect.lastError().text();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include "core/encryption.h"
+
+class QSqlDatabase;
+
+// Content-addressed chunk storage shared by attachments and large notes
+// within one vault. A chunk is addressed by a keyed hash (HMAC-SHA256) of its
+// plaintext and sealed with AES-256-GCM, the hash being the associated data,
+// so identical chunks are stored once per user however many files or notes
+// list them. Both keys derive from a random per-user secret kept in
+// chunk_store_keys, encrypted under the vault key like any other row, so a
+// vault key rotation rewrites that one row and none of the chunks.
+//
+// Owners keep one reference row per chunk they list (attachment_chunks,
+// note_chunks), and chunk_store.ref_count counts those rows. Whoever deletes
+// reference rows passes their hashes to release(), which drops chunks that
+// are no longer referenced.
+//
+// Loaded stores are plain values and thread-safe; only load() and the
+// static helpers touch the database.
+class ChunkStore {
+public:
+    explicit ChunkStore(int userId);
+
+    // Reads the store secret, creating it first if `create` is set.
+    bool load(const Encryption &encryption, bool create);
+
+    bool isLoaded() const;
+
+    QByteArray hash(const QByteArray &chunk) const;
+
+    QByteArray seal(const QByteArray &chunk, const QByteArray &hash) const;
+
+    QByteArray open(const QByteArray &sealed, const QByteArray &hash, bool *ok = nullptr) const;
+
+    QByteArray digest(const QByteArray &data) const;
+
+    QSet<QByteArray> stored(const QList<QByteArray> &hashes) const;
+
+    bool insert(QSqlDatabase &db, const QList<QByteArray> &hashes, const QList<QByteArray> &sealed) const;
+
+    bool addReferences(QSqlDatabase &db, const QList<QByteArray> &hashes) const;
+
+    static bool release(QSqlDatabase &db, int userId, const QList<QByteArray> &hashes);
+
+private:
+    bool readSecret(const Encryption &encryption, QByteArray &secret) const;
+
+    int userId;
+    QByteArray hashKey;
+    QByteArray sealKey;
+    QByteArray digestKey;
+};
+
+#endif // CHUNKSTORE_H
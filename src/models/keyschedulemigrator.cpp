@@ -0,0 +1,156 @@
+#include "keyschedulemigrator.h"
+#include "vaultrekeyer.h"
+#include "core/dbmanager.h"
+#include "core/trace.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+static const int MIGRATION_BATCH_SIZE = 256;
+
+KeyScheduleMigrator::KeyScheduleMigrator(const int userId, const QByteArray &vaultKey)
+    : userId(userId), encryption(vaultKey), cancelled(0) {
+}
+
+bool KeyScheduleMigrator::hasPendingRows(const int userId) {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    for (const auto &table: VaultRekeyer::encryptedTables()) {
+        QSqlQuery query(db);
+        query.prepare(QString("SELECT 1 FROM %1 WHERE user_id = ? AND key_schedule < ? LIMIT 1").arg(table.first));
+        query.addBindValue(userId);
+        query.addBindValue(Encryption::CurrentKeySchedule);
+        if (!DBManager::instance().exec(query, "key_schedule.pending")) {
+            qDebug() << "Key Schedule Check Error:" << query.lastError().text();
+            return false;
+        }
+        if (query.next()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool KeyScheduleMigrator::run() {
+    ENIGMA_TRACE_SCOPE("model", "KeyScheduleMigrator::run");
+    for (const auto &table: VaultRekeyer::encryptedTables()) {
+        if (!migrateTable(table.first, table.second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KeyScheduleMigrator::cancel() {
+    cancelled.storeRelease(1);
+}
+
+// The update only matches rows still carrying the salt and schedule that were
+// read, so a save or vault key rotation that got there first wins. Rows that
+// fail to decrypt are left alone and skipped.
+bool KeyScheduleMigrator::migrateTable(const QString &table, const QStringList &columns) {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QStringList assignments;
+    for (const QString &column: columns) {
+        assignments.append(column + " = ?");
+    }
+    const QString selectSql = QString("SELECT id, salt, key_schedule, %1 FROM %2 "
+                                      "WHERE user_id = ? AND key_schedule < ? AND id > ? ORDER BY id LIMIT %3")
+            .arg(columns.join(", "), table).arg(MIGRATION_BATCH_SIZE);
+    const QString updateSql = QString("UPDATE %1 SET %2, key_schedule = ? "
+                                      "WHERE id = ? AND user_id = ? AND salt = ? AND key_schedule = ?")
+            .arg(table, assignments.join(", "));
+
+    int lastId = 0;
+    while (!cancelled.loadAcquire()) {
+        QList<int> ids;
+        QList<QByteArray> salts;
+        QList<int> schedules;
+        QList<QList<QByteArray> > fields; {
+            QSqlQuery select(db);
+            select.prepare(selectSql);
+            select.addBindValue(userId);
+            select.addBindValue(Encryption::CurrentKeySchedule);
+            select.addBindValue(lastId);
+            if (!DBManager::instance().exec(select, "key_schedule.select_batch")) {
+                qDebug() << "Key Schedule Fetch Error:" << select.lastError().text();
+                return false;
+            }
+            while (select.next()) {
+                ids.append(select.value(0).toInt());
+                salts.append(select.value(1).toByteArray());
+                schedules.append(select.value(2).toInt());
+                QList<QByteArray> row;
+                for (int i = 0; i < columns.size(); ++i) {
+                    row.append(select.value(3 + i).toByteArray());
+                }
+                fields.append(row);
+            }
+        }
+        if (ids.isEmpty()) {
+            return true;
+        }
+        lastId = ids.last();
+
+        const QList<QByteArray> oldKeys = encryption.deriveEntryKeys(salts, schedules);
+        const QList<QByteArray> newKeys = encryption.deriveEntryKeys(
+            salts, QList<int>(salts.size(), Encryption::CurrentKeySchedule));
+
+        QList<QVariantList> fieldValues;
+        for (int i = 0; i < columns.size(); ++i) {
+            fieldValues.append(QVariantList());
+        }
+        QVariantList newSchedules;
+        QVariantList rowIds;
+        QVariantList userIds;
+        QVariantList rowSalts;
+        QVariantList oldSchedules;
+        for (int r = 0; r < ids.size(); ++r) {
+            const QList<QByteArray> plaintexts = Encryption::decryptBytesWithKey(fields.at(r), oldKeys.at(r));
+            bool ok = true;
+            for (int i = 0; i < columns.size(); ++i) {
+                ok = ok && (fields.at(r).at(i).isEmpty() || !plaintexts.at(i).isEmpty());
+            }
+            if (!ok) {
+                qWarning() << "Failed to decrypt" << table << "row" << ids.at(r) << "for key schedule migration!";
+                continue;
+            }
+
+            const QList<QByteArray> ciphertexts = Encryption::encryptBytesWithKey(plaintexts, newKeys.at(r));
+            for (int i = 0; i < columns.size(); ++i) {
+                fieldValues[i].append(ciphertexts.at(i));
+            }
+            newSchedules.append(Encryption::CurrentKeySchedule);
+            rowIds.append(ids.at(r));
+            userIds.append(userId);
+            rowSalts.append(salts.at(r));
+            oldSchedules.append(schedules.at(r));
+        }
+        if (rowIds.isEmpty()) {
+            continue;
+        }
+
+        if (!db.transaction()) {
+            qDebug() << "Key Schedule Transaction Error:" << db.lastError().text();
+            return false;
+        }
+        QSqlQuery update(db);
+        update.prepare(updateSql);
+        for (const QVariantList &values: fieldValues) {
+            update.addBindValue(values);
+        }
+        update.addBindValue(newSchedules);
+        update.addBindValue(rowIds);
+        update.addBindValue(userIds);
+        update.addBindValue(rowSalts);
+        update.addBindValue(oldSchedules);
+
+        if (!DBManager::instance().execBatch(update, "key_schedule.update_batch") || !db.commit()) {
+            qDebug() << "Key Schedule Update Error:" << update.lastError().text();
+            db.rollback();
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef KEYSCHEDULEMIGRATOR_H
+#define KEYSCHEDULEMIGRATOR_H
+
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QStringList>
+#include "core/encryption.h"
+
+// Re-encrypts rows that are still on an older key schedule under the current
+// one, keeping their salt and key epoch. Rows move over on their own whenever
+// they are saved; this finishes the rest in the background after login, one
+// batch per transaction, so an interrupted run simply continues next time.
+class KeyScheduleMigrator {
+public:
+    KeyScheduleMigrator(int userId, const QByteArray &vaultKey);
+
+    static bool hasPendingRows(int userId);
+
+    bool run();
+
+    void cancel();
+
+private:
+    bool migrateTable(const QString &table, const QStringList &columns);
+
+    int userId;
+    Encryption encryption;
+    QAtomicInt cancelled;
+};
+
+#endif // KEYSCHEDULEMIGRATOR_H
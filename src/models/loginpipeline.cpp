@@ -0,0 +1,151 @@
+#include "loginpipeline.h"
+#include "core/encryption.h"
+#include "core/metrics.h"
+
+#include <QtConcurrent>
+
+// Stages only block on stages submitted before them and the pool has a thread
+// for every stage of a single login, so it can never starve itself.
+static const int PIPELINE_THREADS = 8;
+
+LoginPipeline::LoginPipeline() {
+    pool.setMaxThreadCount(PIPELINE_THREADS);
+}
+
+LoginPipeline::~LoginPipeline() {
+    pool.waitForDone();
+}
+
+void LoginPipeline::prefetchUser(const QString &username) {
+    if (username.isEmpty()) {
+        return;
+    }
+    if (username.compare(prefetchedUsername, Qt::CaseInsensitive) == 0
+        && !(recordFuture.isFinished() && !recordFuture.result().isValid())) {
+        return;
+    }
+
+    prefetchedUsername = username;
+    recordFuture = QtConcurrent::run(&pool, [username] {
+        const MetricsOperation operation("login.fetchUser");
+        return User::fetchRecord(username);
+    });
+}
+
+void LoginPipeline::start(const QString &username, const QString &password) {
+    clock.start();
+    const QFuture<UserRecord> prefetched = recordFuture;
+    prefetchUser(username);
+    Metrics::increment(recordFuture == prefetched ? Metrics::PrefetchHits : Metrics::PrefetchMisses);
+
+    const QFuture<UserRecord> record = recordFuture;
+
+    const QFuture<QByteArray> keyEncryptionKey = QtConcurrent::run(&pool, [record, password] {
+        const UserRecord user = record.result();
+        if (!user.isValid()) {
+            return QByteArray();
+        }
+        return Encryption::deriveKeyFromPassword(password, user.salt, user.kdfParams);
+    });
+
+    // Legacy hashes are checked against the password directly, concurrently
+    // with the KDF; current hashes are verified against the derived key.
+    verifyFuture = QtConcurrent::run(&pool, [record, keyEncryptionKey, password] {
+        const UserRecord user = record.result();
+        if (!user.isValid()) {
+            return false;
+        }
+        if (user.hasLegacyHash()) {
+            return User::verifyLegacyPassword(user, password);
+        }
+        return User::verifyPassword(user, keyEncryptionKey.result());
+    });
+
+    const QFuture<bool> verified = verifyFuture;
+
+    // Accounts without a wrapped vault key are migrated on their first login.
+    // The migration costs one extra KDF run, once, and must finish before the
+    // session can change credentials or rotate the vault key.
+    keyFuture = QtConcurrent::run(&pool, [record, verified, keyEncryptionKey, password] {
+        if (!verified.result()) {
+            return QByteArray();
+        }
+        const MetricsOperation operation("login.unlockVault");
+        const UserRecord user = record.result();
+        const QByteArray vaultKey = User::unwrapVaultKey(user, keyEncryptionKey.result());
+        User::upgradeKeyHierarchy(user, password, keyEncryptionKey.result());
+        return vaultKey;
+    });
+
+    passwordRowsFuture = QtConcurrent::run(&pool, [record] {
+        const UserRecord user = record.result();
+        if (!user.isValid()) {
+            return QList<EncryptedPasswordRow>();
+        }
+        const MetricsOperation operation("login.fetchPasswords");
+        return PasswordManager::fetchEncryptedRows(user.id);
+    });
+
+    noteRowsFuture = QtConcurrent::run(&pool, [record] {
+        const UserRecord user = record.result();
+        if (!user.isValid()) {
+            return QList<EncryptedNoteRow>();
+        }
+        const MetricsOperation operation("login.fetchNotes");
+        return NoteManager::fetchEncryptedRows(user.id);
+    });
+
+    const QFuture<QByteArray> key = keyFuture;
+    const QFuture<QList<EncryptedPasswordRow> > passwordRows = passwordRowsFuture;
+    const QFuture<QList<EncryptedNoteRow> > noteRows = noteRowsFuture;
+
+    passwordsFuture = QtConcurrent::run(&pool, [record, verified, key, passwordRows] {
+        if (!verified.result()) {
+            return QList<PasswordEntry>();
+        }
+        Encryption encryption(key.result());
+        const PasswordManager manager(record.result().id, &encryption);
+        return manager.decryptRows(passwordRows.result());
+    });
+
+    notesFuture = QtConcurrent::run(&pool, [record, verified, key, noteRows] {
+        if (!verified.result()) {
+            return QList<NoteEntry>();
+        }
+        Encryption encryption(key.result());
+        const NoteManager manager(record.result().id, &encryption);
+        return manager.decryptRows(noteRows.result());
+    });
+}
+
+QFuture<bool> LoginPipeline::verification() const {
+    return verifyFuture;
+}
+
+void LoginPipeline::markUnlocked() {
+    unlockedAfter = clock.nsecsElapsed();
+}
+
+qint64 LoginPipeline::unlockNanoseconds() const {
+    return unlockedAfter;
+}
+
+User *LoginPipeline::takeUser() const {
+    if (!verifyFuture.result()) {
+        return nullptr;
+    }
+    const UserRecord record = recordFuture.result();
+    return new User(record.id, record.username, record.salt, record.kdfParams);
+}
+
+QByteArray LoginPipeline::vaultKey() const {
+    return keyFuture.result();
+}
+
+QList<PasswordEntry> LoginPipeline::passwords() const {
+    return passwordsFuture.result();
+}
+
+QList<NoteEntry> LoginPipeline::notes() const {
+    return notesFuture.result();
+}
@@ -0,0 +1,53 @@
+#ifndef LOGINPIPELINE_H
+#define LOGINPIPELINE_H
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QThreadPool>
+#include "models/user.h"
+#include "models/passwordmanager.h"
+#include "models/notemanager.h"
+
+class LoginPipeline {
+public:
+    LoginPipeline();
+
+    ~LoginPipeline();
+
+    void prefetchUser(const QString &username);
+
+    void start(const QString &username, const QString &password);
+
+    QFuture<bool> verification() const;
+
+    // Stops the login clock once verification has been handled; the main
+    // window adds the time it takes to open the vault.
+    void markUnlocked();
+
+    qint64 unlockNanoseconds() const;
+
+    User *takeUser() const;
+
+    QByteArray vaultKey() const;
+
+    QList<PasswordEntry> passwords() const;
+
+    QList<NoteEntry> notes() const;
+
+private:
+    QThreadPool pool;
+    QElapsedTimer clock;
+    qint64 unlockedAfter = 0;
+
+    QString prefetchedUsername;
+    QFuture<UserRecord> recordFuture;
+
+    QFuture<bool> verifyFuture;
+    QFuture<QByteArray> keyFuture;
+    QFuture<QList<EncryptedPasswordRow> > passwordRowsFuture;
+    QFuture<QList<EncryptedNoteRow> > noteRowsFuture;
+    QFuture<QList<PasswordEntry> > passwordsFuture;
+    QFuture<QList<NoteEntry> > notesFuture;
+};
+
+#endif // LOGINPIPELINE_H
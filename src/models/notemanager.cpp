@@ -1,10 +1,112 @@
 #include "notemanager.h"
+#include "attachmentmanager.h"
+#include "chunkstore.h"
 #include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/contentchunker.h"
+#include "core/recordcodec.h"
+#include "core/deltacodec.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
+#include <QSet>
+#include <QHash>
 #include <QDebug>
+#include <QDateTime>
+#include <QtEndian>
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <limits>
 #include <openssl/rand.h>
+#include <openssl/hmac.h>
+
+// Notes above the threshold keep their content in the vault's ChunkStore, cut
+// with content-defined chunking, so a chunk shared with another note, an older
+// revision or an attachment is stored once. Each chunk is identified by its
+// keyed hash, and the ordered hash list forms the manifest, which is stored in
+// notes.encrypted_content like any other field. note_chunks holds one row per
+// hash the note or its revisions list, which is the note's reference to the
+// stored chunk. Opening a note decrypts only the chunks on screen, and saving
+// seals and writes only chunks the store does not hold yet. A vault key
+// rotation re-encrypts the manifest; the chunks stay untouched.
+//
+// Notes chunked before the store existed have a version 1 manifest, which also
+// holds a random per-note content key; their chunks are sealed under it and
+// kept inline in note_chunks. They keep that layout until the note is stored
+// inline again.
+static const int CHUNKED_NOTE_THRESHOLD = 256 * 1024;
+static const int NOTE_CHUNK_MIN_SIZE = 16 * 1024;
+static const int NOTE_CHUNK_AVERAGE_SIZE = 64 * 1024;
+static const int NOTE_CHUNK_MAX_SIZE = 256 * 1024;
+static const int NOTE_CONTENT_KEY_SIZE = 32;
+static const QString MANIFEST_HEADER = "enigma-note-chunks 1";
+static const QString STORE_MANIFEST_HEADER = "enigma-note-chunks 2";
+static const QByteArray EMPTY_CHUNK("", 0);
+static const QByteArray CHUNK_MAC_LABEL = "enigma-note-chunk-mac";
+
+// Every save is also recorded in note_revisions as an encrypted snapshot of
+// the title and content (the manifest, for chunked notes). A revision stores
+// a binary delta against the one before it, except every sixteenth, which is
+// a keyframe holding the whole snapshot, so reading any revision replays at
+// most one keyframe and fifteen deltas. Saves within a few minutes of the
+// latest revision replace it rather than adding one, and the oldest keyframe
+// groups are dropped beyond the retention limit. Chunks stay stored while any
+// kept revision still lists them; note_revision_chunks records which chunks
+// each revision lists, so finding unused chunks needs no decryption.
+static const int REVISION_KEYFRAME_INTERVAL = 16;
+static const int MAX_NOTE_REVISIONS = 100;
+static const qint64 REVISION_COALESCE_SECONDS = 5 * 60;
+static const int REVISION_TIP_CACHE_BYTES = 16 * 1024 * 1024;
+
+namespace {
+    // The latest revision of recently saved notes, so the next save can delta
+    // against it without replaying the keyframe group. A tip is only used
+    // while its salt matches the stored latest revision: another session's
+    // save or a rolled back transaction leaves a different salt there.
+    struct RevisionTip {
+        int number;
+        QByteArray salt;
+        int keyframe;
+        QByteArray snapshot;
+        // The revision before `number`, valid when it is not a keyframe.
+        QByteArray previous;
+    };
+
+    QMutex revisionTipsMutex;
+    QCache<QPair<int, int>, RevisionTip> revisionTips(REVISION_TIP_CACHE_BYTES);
+
+    bool cachedRevisionTip(const int userId, const int noteId, const int number, const QByteArray &salt,
+                           RevisionTip &tip) {
+        QMutexLocker locker(&revisionTipsMutex);
+        const RevisionTip *cached = revisionTips.object(qMakePair(userId, noteId));
+        if (!cached || cached->number != number || cached->salt != salt) {
+            return false;
+        }
+        tip = *cached;
+        return true;
+    }
+
+    void cacheRevisionTip(const int userId, const int noteId, const RevisionTip &tip) {
+        QMutexLocker locker(&revisionTipsMutex);
+        revisionTips.insert(qMakePair(userId, noteId), new RevisionTip(tip),
+                            qMax(1, tip.snapshot.size() + tip.previous.size()));
+    }
+}
+
+enum NoteContentFormat {
+    InlineContent = 0,
+    ChunkedContent = 1
+};
+
+qint64 NoteEntry::chunkedSize() const {
+    qint64 size = 0;
+    for (const NoteChunk &chunk: chunks) {
+        size += chunk.length;
+    }
+    return size;
+}
 
 NoteManager::NoteManager(int userId, Encryption *encryption)
     : userId(userId), encryption(encryption) {
@@ -20,17 +122,95 @@ QByteArray NoteManager::generateRandomSalt(int length) {
     return salt;
 }
 
+bool NoteManager::shouldChunk(const QString &content) {
+    return content.size() >= CHUNKED_NOTE_THRESHOLD;
+}
+
+QList<QByteArray> NoteManager::splitContent(const QByteArray &utf8) {
+    static const ContentChunker chunker(NOTE_CHUNK_MIN_SIZE, NOTE_CHUNK_AVERAGE_SIZE, NOTE_CHUNK_MAX_SIZE);
+    QList<QByteArray> chunks;
+    int offset = 0;
+    while (offset < utf8.size()) {
+        int length = chunker.nextBoundary(utf8.constData() + offset, utf8.size() - offset);
+        // Never cut inside a UTF-8 sequence, so every chunk decodes on its own.
+        while (offset + length < utf8.size() && (static_cast<uchar>(utf8.at(offset + length)) & 0xC0) == 0x80) {
+            ++length;
+        }
+        chunks.append(utf8.mid(offset, length));
+        offset += length;
+    }
+    return chunks;
+}
+
+QByteArray NoteManager::chunkMacKey(const QByteArray &contentKey) {
+    return chunkMac(contentKey, CHUNK_MAC_LABEL);
+}
+
+QByteArray NoteManager::chunkMac(const QByteArray &macKey, const QByteArray &chunk) {
+    QByteArray mac(EVP_MAX_MD_SIZE, 0);
+    unsigned int len = 0;
+    HMAC(EVP_sha256(), macKey.constData(), macKey.size(),
+         reinterpret_cast<const unsigned char *>(chunk.constData()), chunk.size(),
+         reinterpret_cast<unsigned char *>(mac.data()), &len);
+    mac.resize(static_cast<int>(len));
+    return mac;
+}
+
+QString NoteManager::encodeManifest(const QByteArray &contentKey, const QList<NoteChunk> &chunks) {
+    QStringList lines;
+    lines.reserve(chunks.size() + 2);
+    lines.append(contentKey.isEmpty() ? STORE_MANIFEST_HEADER : MANIFEST_HEADER);
+    lines.append(QString::fromLatin1(contentKey.toBase64()));
+    for (const NoteChunk &chunk: chunks) {
+        lines.append(QString::fromLatin1(chunk.mac.toHex()) + ' ' + QString::number(chunk.length));
+    }
+    return lines.join('\n');
+}
+
+bool NoteManager::decodeManifest(const QString &manifest, NoteEntry &entry) {
+    const QStringList lines = manifest.split('\n');
+    if (lines.size() < 2 || (lines.at(0) != MANIFEST_HEADER && lines.at(0) != STORE_MANIFEST_HEADER)) {
+        return false;
+    }
+
+    entry.contentKey = QByteArray::fromBase64(lines.at(1).toLatin1());
+    entry.chunks.clear();
+    entry.chunks.reserve(lines.size() - 2);
+    for (int i = 2; i < lines.size(); ++i) {
+        const QStringList parts = lines.at(i).split(' ');
+        bool ok = false;
+        const int length = parts.value(1).toInt(&ok);
+        if (parts.size() != 2 || !ok) {
+            return false;
+        }
+        entry.chunks.append(NoteChunk{QByteArray::fromHex(parts.at(0).toLatin1()), length});
+    }
+    return lines.at(0) == STORE_MANIFEST_HEADER ? entry.contentKey.isEmpty()
+                                                 : entry.contentKey.size() == NOTE_CONTENT_KEY_SIZE;
+}
+
 bool NoteManager::addNote(const NoteEntry &entry) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::addNote");
+    const MetricsOperation operation("addNote");
     if (!encryption) {
         qWarning() << "No encryption object available!";
         return false;
     }
+    if (shouldChunk(entry.content)) {
+        NoteEntry chunked = entry;
+        chunked.chunked = false;
+        chunked.chunks.clear();
+        return writeChunked(-1, chunked, 0, 0);
+    }
 
     QByteArray entrySalt = generateRandomSalt(16);
-    QByteArray encTitle = encryption->encryptWithSalt(entry.title, entrySalt);
-    QByteArray encContent = encryption->encryptWithSalt(entry.content, entrySalt);
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt({
+        RecordCodec::encodeField(entry.title, false),
+        RecordCodec::encodeField(entry.content, true)
+    }, entrySalt);
 
     QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
     QSqlQuery query(db);
 
     query.prepare(R"(
@@ -38,60 +218,458 @@ bool NoteManager::addNote(const NoteEntry &entry) const {
             user_id,
             salt,
             encrypted_title,
-            encrypted_content
-        ) VALUES (?, ?, ?, ?)
+            encrypted_content,
+            record_format,
+            key_schedule
+        ) VALUES (?, ?, ?, ?, ?, ?)
     )");
     query.addBindValue(userId);
     query.addBindValue(entrySalt);
-    query.addBindValue(encTitle);
-    query.addBindValue(encContent);
+    query.addBindValue(encrypted.at(0));
+    query.addBindValue(encrypted.at(1));
+    query.addBindValue(RecordCodec::HeaderedRecord);
+    query.addBindValue(Encryption::CurrentKeySchedule);
 
-    if (!query.exec()) {
+    if (!DBManager::instance().exec(query, "notes.insert")
+        || !recordRevision(query.lastInsertId().toInt(), entry)
+        || (ownTransaction && !db.commit())) {
         qDebug() << "Add Note Error:" << query.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
         return false;
     }
     return true;
 }
 
 bool NoteManager::updateNote(int id, const NoteEntry &entry) const {
-    if (!encryption) {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::updateNote");
+    const MetricsOperation operation("updateNote");
+    if (!encryption || entry.readOnly) {
         return false;
     }
+    if (entry.chunked || shouldChunk(entry.content)) {
+        NoteEntry chunked = entry;
+        return writeChunked(id, chunked, 0, entry.chunked ? entry.loadedChunks : 0);
+    }
+    return writeInline(id, entry, true);
+}
 
+bool NoteManager::writeInline(const int id, const NoteEntry &entry, const bool coalesce) const {
     QByteArray entrySalt = generateRandomSalt(16);
-    QByteArray encTitle = encryption->encryptWithSalt(entry.title, entrySalt);
-    QByteArray encContent = encryption->encryptWithSalt(entry.content, entrySalt);
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt({
+        RecordCodec::encodeField(entry.title, false),
+        RecordCodec::encodeField(entry.content, true)
+    }, entrySalt);
 
     QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
     QSqlQuery query(db);
     query.prepare(R"(
         UPDATE notes
         SET
             salt = ?,
             encrypted_title = ?,
-            encrypted_content = ?
+            encrypted_content = ?,
+            content_format = 0,
+            record_format = ?,
+            key_schedule = ?,
+            revision = revision + 1
         WHERE id = ? AND user_id = ?
     )");
 
     query.addBindValue(entrySalt);
-    query.addBindValue(encTitle);
-    query.addBindValue(encContent);
+    query.addBindValue(encrypted.at(0));
+    query.addBindValue(encrypted.at(1));
+    query.addBindValue(RecordCodec::HeaderedRecord);
+    query.addBindValue(Encryption::CurrentKeySchedule);
     query.addBindValue(id);
     query.addBindValue(userId);
 
-    if (!query.exec()) {
+    if (!DBManager::instance().exec(query, "notes.update") || query.numRowsAffected() <= 0
+        || !recordRevision(id, entry, coalesce) || (ownTransaction && !db.commit())) {
         qDebug() << "Update Note Error:" << query.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
         return false;
     }
-    return (query.numRowsAffected() > 0);
+    return true;
+}
+
+bool NoteManager::saveEdit(const int id, NoteEntry &entry, const NoteEdit &edit, QList<int> *chunkChars) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::saveEdit");
+    const MetricsOperation operation("saveNoteEdit");
+    if (!encryption || entry.readOnly) {
+        return false;
+    }
+    if (edit.contentChanged && (entry.chunked || shouldChunk(entry.content))) {
+        return writeChunked(id, entry, entry.chunked ? edit.firstChunk : 0, entry.chunked ? edit.chunkCount : 0,
+                            chunkChars);
+    }
+
+    // Unchanged fields keep their ciphertext; the salt stays so that they
+    // still decrypt. Legacy rows are rewritten whole so every field carries
+    // a format header and the current key schedule afterwards.
+    const bool legacy = entry.recordFormat == RecordCodec::LegacyRecord
+                        || entry.keySchedule != Encryption::CurrentKeySchedule;
+    QStringList assignments;
+    QList<QByteArray> fields;
+    if (edit.titleChanged || legacy) {
+        assignments.append("encrypted_title = ?");
+        fields.append(RecordCodec::encodeField(entry.title, false));
+    }
+    if (edit.contentChanged || legacy) {
+        assignments.append("encrypted_content = ?");
+        fields.append(RecordCodec::encodeField(entry.chunked ? encodeManifest(entry.contentKey, entry.chunks)
+                                                             : entry.content, true));
+    }
+    if (fields.isEmpty()) {
+        return true;
+    }
+
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt(fields, entry.salt);
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
+    QSqlQuery query(db);
+    query.prepare(QString(R"(
+        UPDATE notes
+        SET
+            %1,
+            record_format = ?,
+            key_schedule = ?,
+            revision = revision + 1
+        WHERE id = ? AND user_id = ?
+    )").arg(assignments.join(", ")));
+    for (const QByteArray &field: encrypted) {
+        query.addBindValue(field);
+    }
+    query.addBindValue(RecordCodec::HeaderedRecord);
+    query.addBindValue(Encryption::CurrentKeySchedule);
+    query.addBindValue(id);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "notes.update_fields") || query.numRowsAffected() <= 0
+        || !recordRevision(id, entry) || (ownTransaction && !db.commit())) {
+        qDebug() << "Save Note Error:" << query.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+    entry.recordFormat = RecordCodec::HeaderedRecord;
+    entry.keySchedule = Encryption::CurrentKeySchedule;
+    return true;
+}
+
+bool NoteManager::writeChunked(const int noteId, NoteEntry &entry, const int firstChunk, const int chunkCount,
+                               QList<int> *chunkChars, const bool coalesce) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::writeChunked");
+    const bool converting = !entry.chunked;
+    // Notes being chunked now go to the chunk store, which an empty content
+    // key stands for; version 1 notes keep their own key.
+    const QByteArray contentKey = converting ? QByteArray() : entry.contentKey;
+    ChunkStore store(userId);
+    if (contentKey.isEmpty() && !store.load(*encryption, true)) {
+        qWarning() << "Failed to open the chunk store of user" << userId;
+        return false;
+    }
+    // Chunks dropped from the manifest may still be stored for older
+    // revisions, so ask the table rather than the entry what is there.
+    const QSet<QByteArray> stored = noteId < 0 ? QSet<QByteArray>() : storedChunkMacs(noteId);
+
+    const QByteArray macKey = contentKey.isEmpty() ? QByteArray() : chunkMacKey(contentKey);
+    QList<NoteChunk> region;
+    QList<int> regionChars;
+    QVariantList newMacs;
+    QVariantList newChunks;
+    QList<QByteArray> newReferences;
+    QList<QByteArray> newPlaintexts;
+    QSet<QByteArray> written;
+    for (const QByteArray &chunk: splitContent(entry.content.toUtf8())) {
+        const QByteArray mac = contentKey.isEmpty() ? store.hash(chunk) : chunkMac(macKey, chunk);
+        region.append(NoteChunk{mac, static_cast<int>(chunk.size())});
+        regionChars.append(QString::fromUtf8(chunk).size());
+        if (stored.contains(mac) || written.contains(mac)) {
+            continue;
+        }
+        written.insert(mac);
+        newMacs.append(mac);
+        if (contentKey.isEmpty()) {
+            newReferences.append(mac);
+            newPlaintexts.append(chunk);
+            newChunks.append(EMPTY_CHUNK);
+            continue;
+        }
+        const QByteArray sealed = Encryption::aeadEncrypt(RecordCodec::encodeBytes(chunk, true), contentKey, mac);
+        if (sealed.isEmpty()) {
+            return false;
+        }
+        newChunks.append(sealed);
+    }
+
+    // Of the chunks this note does not reference yet, only those no other
+    // note, revision or attachment stored are sealed.
+    const QSet<QByteArray> inStore = store.stored(newReferences);
+    QList<QByteArray> storeHashes;
+    QList<QByteArray> storeChunks;
+    for (int i = 0; i < newReferences.size(); ++i) {
+        if (inStore.contains(newReferences.at(i))) {
+            continue;
+        }
+        const QByteArray sealed = store.seal(newPlaintexts.at(i), newReferences.at(i));
+        if (sealed.isEmpty()) {
+            return false;
+        }
+        storeHashes.append(newReferences.at(i));
+        storeChunks.append(sealed);
+    }
+    const QList<NoteChunk> manifest = entry.chunks.mid(0, firstChunk) + region
+                                      + entry.chunks.mid(firstChunk + chunkCount);
+
+    const QByteArray entrySalt = noteId < 0 || entry.salt.isEmpty() ? generateRandomSalt(16) : entry.salt;
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt({
+        RecordCodec::encodeField(entry.title, false),
+        RecordCodec::encodeField(encodeManifest(contentKey, manifest), true)
+    }, entrySalt);
+
+    // Callers that batch several writes may already hold a transaction.
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
+    const auto fail = [&db, ownTransaction](const QSqlQuery &query) {
+        qDebug() << "Write Note Chunks Error:" << query.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    };
+
+    QSqlQuery note(db);
+    if (noteId < 0) {
+        note.prepare(R"(
+            INSERT INTO notes (
+                user_id,
+                salt,
+                encrypted_title,
+                encrypted_content,
+                content_format,
+                record_format,
+                key_schedule
+            ) VALUES (?, ?, ?, ?, 1, ?, ?)
+        )");
+        note.addBindValue(userId);
+        note.addBindValue(entrySalt);
+        note.addBindValue(encrypted.at(0));
+        note.addBindValue(encrypted.at(1));
+        note.addBindValue(RecordCodec::HeaderedRecord);
+        note.addBindValue(Encryption::CurrentKeySchedule);
+        if (!DBManager::instance().exec(note, "notes.insert_chunked")) {
+            return fail(note);
+        }
+    } else {
+        note.prepare(R"(
+            UPDATE notes
+            SET
+                salt = ?,
+                encrypted_title = ?,
+                encrypted_content = ?,
+                content_format = 1,
+                record_format = ?,
+                key_schedule = ?,
+                revision = revision + 1
+            WHERE id = ? AND user_id = ?
+        )");
+        note.addBindValue(entrySalt);
+        note.addBindValue(encrypted.at(0));
+        note.addBindValue(encrypted.at(1));
+        note.addBindValue(RecordCodec::HeaderedRecord);
+        note.addBindValue(Encryption::CurrentKeySchedule);
+        note.addBindValue(noteId);
+        note.addBindValue(userId);
+        if (!DBManager::instance().exec(note, "notes.update_chunked") || note.numRowsAffected() <= 0) {
+            return fail(note);
+        }
+    }
+    const int id = noteId < 0 ? note.lastInsertId().toInt() : noteId;
+
+    if (!newMacs.isEmpty()) {
+        QVariantList noteIds;
+        for (int i = 0; i < newMacs.size(); ++i) {
+            noteIds.append(id);
+        }
+        QSqlQuery insert(db);
+        QVariantList formats;
+        for (int i = 0; i < newMacs.size(); ++i) {
+            formats.append(RecordCodec::HeaderedRecord);
+        }
+        insert.prepare(R"(
+            INSERT INTO note_chunks (
+                note_id,
+                chunk_mac,
+                encrypted_chunk,
+                chunk_format
+            ) VALUES (?, ?, ?, ?)
+        )");
+        insert.addBindValue(noteIds);
+        insert.addBindValue(newMacs);
+        insert.addBindValue(newChunks);
+        insert.addBindValue(formats);
+        if (!DBManager::instance().execBatch(insert, "note_chunks.insert")) {
+            return fail(insert);
+        }
+        // Another session may have released a chunk since the lookup; seal
+        // those again rather than referencing a chunk that is gone.
+        const QSet<QByteArray> present = store.stored(newReferences);
+        for (int i = 0; i < newReferences.size(); ++i) {
+            const QByteArray &hash = newReferences.at(i);
+            if (present.contains(hash) || storeHashes.contains(hash)) {
+                continue;
+            }
+            const QByteArray sealed = store.seal(newPlaintexts.at(i), hash);
+            if (sealed.isEmpty()) {
+                return fail(insert);
+            }
+            storeHashes.append(hash);
+            storeChunks.append(sealed);
+        }
+        if (!store.insert(db, storeHashes, storeChunks) || !store.addReferences(db, newReferences)) {
+            return fail(insert);
+        }
+    }
+
+    NoteEntry saved = entry;
+    saved.id = id;
+    saved.salt = entrySalt;
+    saved.chunked = true;
+    saved.contentKey = contentKey;
+    saved.chunks = manifest;
+    saved.loadedChunks = converting ? region.size() : entry.loadedChunks + region.size() - chunkCount;
+    saved.recordFormat = RecordCodec::HeaderedRecord;
+    saved.keySchedule = Encryption::CurrentKeySchedule;
+    if (!recordRevision(id, saved, coalesce)) {
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+
+    if (ownTransaction && !db.commit()) {
+        qDebug() << "Write Note Chunks Error:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    entry = saved;
+    if (chunkChars) {
+        *chunkChars = regionChars;
+    }
+    return true;
+}
+
+QStringList NoteManager::readChunks(const NoteEntry &entry, const int first, const int count, bool *ok) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::readChunks");
+    const MetricsOperation operation("readNoteChunks");
+    if (ok) {
+        *ok = false;
+    }
+    const QList<NoteChunk> wanted = entry.chunks.mid(first, count);
+    if (wanted.isEmpty()) {
+        if (ok) {
+            *ok = true;
+        }
+        return QStringList();
+    }
+
+    QStringList placeholders;
+    for (int i = 0; i < wanted.size(); ++i) {
+        placeholders.append("?");
+    }
+
+    ChunkStore store(userId);
+    const bool storeBacked = entry.contentKey.isEmpty();
+    if (storeBacked && !store.load(*encryption, false)) {
+        qWarning() << "Failed to open the chunk store of user" << userId;
+        return QStringList();
+    }
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    if (storeBacked) {
+        query.prepare(QString(R"(
+            SELECT
+                chunk_hash,
+                encrypted_chunk
+            FROM chunk_store
+            WHERE user_id = ? AND chunk_hash IN (%1)
+        )").arg(placeholders.join(", ")));
+        query.addBindValue(userId);
+    } else {
+        query.prepare(QString(R"(
+            SELECT
+                c.chunk_mac,
+                c.encrypted_chunk,
+                c.chunk_format
+            FROM note_chunks c
+            JOIN notes n ON n.id = c.note_id
+            WHERE c.note_id = ? AND n.user_id = ? AND c.chunk_mac IN (%1)
+        )").arg(placeholders.join(", ")));
+        query.addBindValue(entry.id);
+        query.addBindValue(userId);
+    }
+    for (const NoteChunk &chunk: wanted) {
+        query.addBindValue(chunk.mac);
+    }
+
+    if (!DBManager::instance().exec(query, storeBacked ? "chunk_store.select_note_chunks" : "note_chunks.select")) {
+        qDebug() << "Read Note Chunks Error:" << query.lastError().text();
+        return QStringList();
+    }
+    QHash<QByteArray, QPair<QByteArray, int> > sealedByMac;
+    while (query.next()) {
+        sealedByMac.insert(query.value(0).toByteArray(), {
+                               query.value(1).toByteArray(),
+                               storeBacked ? RecordCodec::HeaderedRecord : query.value(2).toInt()
+                           });
+    }
+
+    QStringList texts;
+    texts.reserve(wanted.size());
+    for (const NoteChunk &chunk: wanted) {
+        const QPair<QByteArray, int> sealed = sealedByMac.value(chunk.mac);
+        bool decrypted = false;
+        QByteArray plain;
+        if (storeBacked) {
+            plain = store.open(sealed.first, chunk.mac, &decrypted);
+        } else {
+            plain = Encryption::aeadDecrypt(sealed.first, entry.contentKey, chunk.mac, &decrypted);
+            if (decrypted && sealed.second != RecordCodec::LegacyRecord) {
+                plain = RecordCodec::decodeBytes(plain, &decrypted);
+            }
+        }
+        if (!decrypted) {
+            qWarning() << "Failed to decrypt a chunk of note" << entry.id;
+            return QStringList();
+        }
+        texts.append(QString::fromUtf8(plain));
+    }
+    if (ok) {
+        *ok = true;
+    }
+    return texts;
 }
 
 QList<NoteEntry> NoteManager::getNotes() const {
-    QList<NoteEntry> list;
+    const MetricsOperation operation("getNotes");
     if (!encryption) {
-        return list;
+        return QList<NoteEntry>();
     }
+    return decryptRows(fetchEncryptedRows(userId));
+}
 
+QList<EncryptedNoteRow> NoteManager::fetchEncryptedRows(const int userId) {
+    ENIGMA_TRACE_SCOPE("db", "NoteManager::fetchEncryptedRows");
+    QList<EncryptedNoteRow> rows;
     QSqlDatabase db = DBManager::instance().getDatabase();
     QSqlQuery query(db);
 
@@ -100,43 +678,664 @@ QList<NoteEntry> NoteManager::getNotes() const {
             id,
             salt,
             encrypted_title,
-            encrypted_content
+            encrypted_content,
+            content_format,
+            record_format,
+            key_schedule
         FROM notes
         WHERE user_id = ?
+        ORDER BY id
     )");
     query.addBindValue(userId);
 
-    if (query.exec()) {
+    if (DBManager::instance().exec(query, "notes.select")) {
         while (query.next()) {
-            NoteEntry entry;
-            entry.id = query.value(0).toInt();
-            entry.salt = query.value(1).toByteArray();
+            EncryptedNoteRow row;
+            row.id = query.value(0).toInt();
+            row.salt = query.value(1).toByteArray();
+            row.title = query.value(2).toByteArray();
+            row.content = query.value(3).toByteArray();
+            row.contentFormat = query.value(4).toInt();
+            row.recordFormat = query.value(5).toInt();
+            row.keySchedule = query.value(6).toInt();
+            rows.append(row);
+        }
+    } else {
+        qDebug() << "Get Notes Error:" << query.lastError().text();
+    }
+    return rows;
+}
 
-            QByteArray encTitle = query.value(2).toByteArray();
-            QByteArray encContent = query.value(3).toByteArray();
+QList<NoteEntry> NoteManager::decryptRows(const QList<EncryptedNoteRow> &rows) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::decryptRows");
+    QList<NoteEntry> list;
+    if (!encryption) {
+        return list;
+    }
+    list.reserve(rows.size());
 
-            entry.title = encryption->decryptWithSalt(encTitle, entry.salt);
-            entry.content = encryption->decryptWithSalt(encContent, entry.salt);
+    QList<QByteArray> salts;
+    QList<int> schedules;
+    salts.reserve(rows.size());
+    schedules.reserve(rows.size());
+    for (const EncryptedNoteRow &row: rows) {
+        salts.append(row.salt);
+        schedules.append(row.keySchedule);
+    }
+    const QList<QByteArray> keys = encryption->deriveEntryKeys(salts, schedules);
 
-            list.append(entry);
+    for (int i = 0; i < rows.size(); ++i) {
+        const EncryptedNoteRow &row = rows.at(i);
+        NoteEntry entry;
+        entry.id = row.id;
+        entry.salt = row.salt;
+        entry.recordFormat = row.recordFormat;
+        entry.keySchedule = row.keySchedule;
+        const QList<QByteArray> fields = Encryption::decryptBytesWithKey({row.title, row.content}, keys.at(i));
+        bool titleOk = false;
+        bool contentOk = false;
+        entry.title = RecordCodec::decodeField(fields.at(0), row.recordFormat, &titleOk);
+        const QString content = RecordCodec::decodeField(fields.at(1), row.recordFormat, &contentOk);
+        if ((fields.at(0).isEmpty() && !row.title.isEmpty()) || (fields.at(1).isEmpty() && !row.content.isEmpty())) {
+            qWarning() << "Failed to decrypt note" << row.id << "!";
+            entry.readOnly = true;
+        } else if (!titleOk || !contentOk) {
+            qWarning() << "Failed to decode note" << row.id << "!";
+            entry.readOnly = true;
         }
-    } else {
-        qDebug() << "Get Notes Error:" << query.lastError().text();
+        if (row.contentFormat == ChunkedContent) {
+            entry.chunked = true;
+            if (!entry.readOnly && !decodeManifest(content, entry)) {
+                qWarning() << "Failed to read the chunk manifest of note" << row.id;
+                entry.readOnly = true;
+            }
+        } else {
+            entry.content = content;
+        }
+        list.append(entry);
     }
     return list;
 }
 
 bool NoteManager::deleteNote(int id) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::deleteNote");
+    const MetricsOperation operation("deleteNote");
     QSqlDatabase db = DBManager::instance().getDatabase();
-    QSqlQuery query(db);
+    const bool ownTransaction = db.transaction();
+    const QList<QByteArray> references = storedChunkMacs(id).values();
+
+    QSqlQuery revisionChunks(db);
+    revisionChunks.prepare(
+        "DELETE FROM note_revision_chunks WHERE note_id IN (SELECT id FROM notes WHERE id = ? AND user_id = ?)");
+    revisionChunks.addBindValue(id);
+    revisionChunks.addBindValue(userId);
 
+    QSqlQuery revisions(db);
+    revisions.prepare("DELETE FROM note_revisions WHERE note_id = ? AND user_id = ?");
+    revisions.addBindValue(id);
+    revisions.addBindValue(userId);
+
+    QSqlQuery chunks(db);
+    chunks.prepare("DELETE FROM note_chunks WHERE note_id IN (SELECT id FROM notes WHERE id = ? AND user_id = ?)");
+    chunks.addBindValue(id);
+    chunks.addBindValue(userId);
+
+    QSqlQuery query(db);
     query.prepare("DELETE FROM notes WHERE id = ? AND user_id = ?");
     query.addBindValue(id);
     query.addBindValue(userId);
 
-    if (!query.exec()) {
-        qDebug() << "Delete Note Error:" << query.lastError().text();
+    if (!DBManager::instance().exec(revisionChunks, "note_revision_chunks.delete_note")
+        || !DBManager::instance().exec(revisions, "note_revisions.delete_note")
+        || !DBManager::instance().exec(chunks, "note_chunks.delete_note")
+        || !ChunkStore::release(db, userId, references)
+        || !AttachmentManager::deleteOwnerAttachments(db, userId, AttachmentManager::NoteOwner, id)
+        || !DBManager::instance().exec(query, "notes.delete")
+        || (ownTransaction && !db.commit())) {
+        qDebug() << "Delete Note Error:" << query.lastError().text() << chunks.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
         return false;
     }
     return (query.numRowsAffected() > 0);
 }
+
+QSet<QByteArray> NoteManager::storedChunkMacs(const int noteId) const {
+    QSet<QByteArray> macs;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT c.chunk_mac
+        FROM note_chunks c
+        JOIN notes n ON n.id = c.note_id
+        WHERE c.note_id = ? AND n.user_id = ?
+    )");
+    query.addBindValue(noteId);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "note_chunks.select_macs")) {
+        qDebug() << "Read Note Chunks Error:" << query.lastError().text();
+        return macs;
+    }
+    while (query.next()) {
+        macs.insert(query.value(0).toByteArray());
+    }
+    return macs;
+}
+
+// A snapshot is the content format byte, the UTF-8 title length as a 32-bit
+// big-endian integer, the title, then the content or chunk manifest.
+QByteArray NoteManager::encodeSnapshot(const NoteEntry &entry) {
+    const QByteArray title = entry.title.toUtf8();
+    const QByteArray body = (entry.chunked ? encodeManifest(entry.contentKey, entry.chunks) : entry.content).toUtf8();
+    QByteArray snapshot;
+    snapshot.reserve(5 + title.size() + body.size());
+    snapshot.append(static_cast<char>(entry.chunked ? ChunkedContent : InlineContent));
+    const quint32 titleSize = qToBigEndian(static_cast<quint32>(title.size()));
+    snapshot.append(reinterpret_cast<const char *>(&titleSize), sizeof(titleSize));
+    snapshot.append(title);
+    snapshot.append(body);
+    return snapshot;
+}
+
+bool NoteManager::decodeSnapshot(const QByteArray &snapshot, NoteEntry &entry) {
+    if (snapshot.size() < 5) {
+        return false;
+    }
+    const quint32 titleSize = qFromBigEndian<quint32>(snapshot.constData() + 1);
+    if (titleSize > static_cast<quint32>(snapshot.size() - 5)) {
+        return false;
+    }
+
+    entry.title = QString::fromUtf8(snapshot.constData() + 5, static_cast<int>(titleSize));
+    const QString body = QString::fromUtf8(snapshot.mid(5 + static_cast<int>(titleSize)));
+    entry.chunked = snapshot.at(0) == ChunkedContent;
+    entry.content.clear();
+    entry.contentKey.clear();
+    entry.chunks.clear();
+    entry.loadedChunks = 0;
+    if (entry.chunked) {
+        return decodeManifest(body, entry);
+    }
+    entry.content = body;
+    return true;
+}
+
+int NoteManager::keyframeAtOrBefore(const int noteId, const int number) const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT MAX(revision_number)
+        FROM note_revisions
+        WHERE note_id = ? AND user_id = ? AND keyframe = 1 AND revision_number <= ?
+    )");
+    query.addBindValue(noteId);
+    query.addBindValue(userId);
+    query.addBindValue(number);
+
+    if (!DBManager::instance().exec(query, "note_revisions.select_keyframe") || !query.next()) {
+        qDebug() << "Read Note Revisions Error:" << query.lastError().text();
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+// `first` must be a keyframe; every revision after it applies to the one
+// before.
+bool NoteManager::replayRevisions(const int noteId, const int first, const int last,
+                                  QList<QPair<int, QByteArray> > &snapshots) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::replayRevisions");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            revision_number,
+            keyframe,
+            salt,
+            encrypted_delta,
+            key_schedule
+        FROM note_revisions
+        WHERE note_id = ? AND user_id = ? AND revision_number BETWEEN ? AND ?
+        ORDER BY revision_number
+    )");
+    query.addBindValue(noteId);
+    query.addBindValue(userId);
+    query.addBindValue(first);
+    query.addBindValue(last);
+
+    if (!DBManager::instance().exec(query, "note_revisions.select_range")) {
+        qDebug() << "Read Note Revisions Error:" << query.lastError().text();
+        return false;
+    }
+
+    QList<int> numbers;
+    QList<bool> keyframes;
+    QList<QByteArray> salts;
+    QList<QByteArray> sealedPayloads;
+    QList<int> schedules;
+    while (query.next()) {
+        numbers.append(query.value(0).toInt());
+        keyframes.append(query.value(1).toInt() != 0);
+        salts.append(query.value(2).toByteArray());
+        sealedPayloads.append(query.value(3).toByteArray());
+        schedules.append(query.value(4).toInt());
+    }
+    const QList<QByteArray> keys = encryption->deriveEntryKeys(salts, schedules);
+
+    snapshots.clear();
+    for (int i = 0; i < numbers.size(); ++i) {
+        const int number = numbers.at(i);
+        const bool keyframe = keyframes.at(i);
+        const QByteArray &sealed = sealedPayloads.at(i);
+        const QByteArray payload = Encryption::decryptBytesWithKey({sealed}, keys.at(i)).at(0);
+        bool ok = !payload.isEmpty() || sealed.isEmpty();
+        const QByteArray decoded = ok ? RecordCodec::decodeBytes(payload, &ok) : QByteArray();
+        if (ok && !keyframe && snapshots.isEmpty()) {
+            ok = false;
+        }
+        if (!ok) {
+            qWarning() << "Failed to read revision" << number << "of note" << noteId;
+            return false;
+        }
+
+        snapshots.append({number, keyframe ? decoded : DeltaCodec::apply(snapshots.last().second, decoded, &ok)});
+        if (!ok) {
+            qWarning() << "Failed to apply revision" << number << "of note" << noteId;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs inside the caller's note write, so a failure here rolls the save back.
+// Callers have already written the note row in this transaction, which holds
+// off other saves of the note until it commits; on MySQL the latest revision
+// is also read with a locking read, so the number allocated here cannot be
+// taken by a concurrent save.
+bool NoteManager::recordRevision(const int noteId, const NoteEntry &entry, const bool coalesce) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::recordRevision");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    const QByteArray snapshot = encodeSnapshot(entry);
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+
+    int latest = 0;
+    qint64 latestCreatedAt = 0;
+    QByteArray latestSalt; {
+        QSqlQuery query(db);
+        query.prepare(QString(R"(
+            SELECT
+                revision_number,
+                created_at,
+                salt
+            FROM note_revisions
+            WHERE note_id = ? AND user_id = ?
+            ORDER BY revision_number DESC
+            LIMIT 1
+            %1
+        )").arg(db.driverName() == "QMYSQL" ? "FOR UPDATE" : ""));
+        query.addBindValue(noteId);
+        query.addBindValue(userId);
+        if (!DBManager::instance().exec(query, "note_revisions.select_latest")) {
+            qDebug() << "Record Note Revision Error:" << query.lastError().text();
+            return false;
+        }
+        if (query.next()) {
+            latest = query.value(0).toInt();
+            latestCreatedAt = query.value(1).toLongLong();
+            latestSalt = query.value(2).toByteArray();
+        }
+    }
+
+    // Without a cached tip, the latest revision and the one before it come
+    // from replaying its keyframe group.
+    RevisionTip tip{0, QByteArray(), 0, QByteArray(), QByteArray()};
+    bool hasHistory = latest > 0 && cachedRevisionTip(userId, noteId, latest, latestSalt, tip);
+    if (latest > 0 && !hasHistory) {
+        Metrics::increment(Metrics::NoteRevisionReplays);
+        const int keyframe = keyframeAtOrBefore(noteId, latest);
+        QList<QPair<int, QByteArray> > history;
+        if (keyframe <= 0 || !replayRevisions(noteId, keyframe, latest, history)
+            || history.isEmpty() || history.last().first != latest) {
+            qWarning() << "Revision history of note" << noteId << "is unreadable; starting a new keyframe.";
+        } else {
+            tip = RevisionTip{latest, latestSalt, keyframe, history.last().second,
+                              history.size() > 1 ? history.at(history.size() - 2).second : QByteArray()};
+            hasHistory = true;
+        }
+    }
+    if (hasHistory && tip.snapshot == snapshot) {
+        return true;
+    }
+
+    // Replacing the latest revision deltas against the one before it.
+    const bool replace = coalesce && hasHistory && now - latestCreatedAt < REVISION_COALESCE_SECONDS;
+    const int number = replace ? latest : latest + 1;
+    const bool hasBase = hasHistory && (!replace || tip.number != tip.keyframe);
+    bool isKeyframe = !hasBase || number - tip.keyframe >= REVISION_KEYFRAME_INTERVAL;
+    QByteArray payload = snapshot;
+    if (!isKeyframe) {
+        const QByteArray delta = DeltaCodec::encode(replace ? tip.previous : tip.snapshot, snapshot);
+        if (delta.size() < snapshot.size() / 2) {
+            payload = delta;
+        } else {
+            isKeyframe = true;
+        }
+    }
+
+    const QByteArray salt = generateRandomSalt(16);
+    const QByteArray sealed = encryption->encryptBytesWithSalt({RecordCodec::encodeBytes(payload, true)}, salt).at(0);
+
+    QSqlQuery write(db);
+    if (replace) {
+        write.prepare(R"(
+            UPDATE note_revisions
+            SET
+                keyframe = ?,
+                salt = ?,
+                encrypted_delta = ?,
+                key_schedule = ?,
+                chunks_listed = 1,
+                saved_at = ?
+            WHERE note_id = ? AND user_id = ? AND revision_number = ?
+        )");
+        write.addBindValue(isKeyframe ? 1 : 0);
+        write.addBindValue(salt);
+        write.addBindValue(sealed);
+        write.addBindValue(Encryption::CurrentKeySchedule);
+        write.addBindValue(now);
+        write.addBindValue(noteId);
+        write.addBindValue(userId);
+        write.addBindValue(number);
+    } else {
+        write.prepare(R"(
+            INSERT INTO note_revisions (
+                note_id,
+                user_id,
+                revision_number,
+                keyframe,
+                salt,
+                encrypted_delta,
+                key_schedule,
+                chunks_listed,
+                created_at,
+                saved_at
+            ) VALUES (?, ?, ?, ?, ?, ?, ?, 1, ?, ?)
+        )");
+        write.addBindValue(noteId);
+        write.addBindValue(userId);
+        write.addBindValue(number);
+        write.addBindValue(isKeyframe ? 1 : 0);
+        write.addBindValue(salt);
+        write.addBindValue(sealed);
+        write.addBindValue(Encryption::CurrentKeySchedule);
+        write.addBindValue(now);
+        write.addBindValue(now);
+    }
+    if (!DBManager::instance().exec(write, "note_revisions.write")
+        || !listRevisionChunks(noteId, number, entry)) {
+        qDebug() << "Record Note Revision Error:" << write.lastError().text();
+        return false;
+    }
+    cacheRevisionTip(userId, noteId, RevisionTip{number, salt, isKeyframe ? number : tip.keyframe, snapshot,
+                                                 replace ? tip.previous : tip.snapshot});
+
+    // Whole keyframe groups are dropped, so the oldest kept revision is
+    // always a keyframe.
+    if (number > MAX_NOTE_REVISIONS) {
+        const int cutoff = keyframeAtOrBefore(noteId, number - MAX_NOTE_REVISIONS + 1);
+        if (cutoff > 0) {
+            QSqlQuery pruneChunks(db);
+            pruneChunks.prepare("DELETE FROM note_revision_chunks WHERE note_id = ? AND revision_number < ?");
+            pruneChunks.addBindValue(noteId);
+            pruneChunks.addBindValue(cutoff);
+
+            QSqlQuery prune(db);
+            prune.prepare("DELETE FROM note_revisions WHERE note_id = ? AND user_id = ? AND revision_number < ?");
+            prune.addBindValue(noteId);
+            prune.addBindValue(userId);
+            prune.addBindValue(cutoff);
+            if (!DBManager::instance().exec(pruneChunks, "note_revision_chunks.prune")
+                || !DBManager::instance().exec(prune, "note_revisions.prune")) {
+                qDebug() << "Prune Note Revisions Error:" << prune.lastError().text();
+                return false;
+            }
+        }
+    }
+    return collectChunks(noteId, entry);
+}
+
+// Replaces the chunk list of one revision with the chunks `snapshot` lists.
+bool NoteManager::listRevisionChunks(const int noteId, const int number, const NoteEntry &snapshot) const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery clear(db);
+    clear.prepare("DELETE FROM note_revision_chunks WHERE note_id = ? AND revision_number = ?");
+    clear.addBindValue(noteId);
+    clear.addBindValue(number);
+    if (!DBManager::instance().exec(clear, "note_revision_chunks.delete_revision")) {
+        qDebug() << "List Revision Chunks Error:" << clear.lastError().text();
+        return false;
+    }
+    if (!snapshot.chunked || snapshot.chunks.isEmpty()) {
+        return true;
+    }
+
+    QSet<QByteArray> seen;
+    QVariantList noteIds;
+    QVariantList numbers;
+    QVariantList macs;
+    for (const NoteChunk &chunk: snapshot.chunks) {
+        if (seen.contains(chunk.mac)) {
+            continue;
+        }
+        seen.insert(chunk.mac);
+        noteIds.append(noteId);
+        numbers.append(number);
+        macs.append(chunk.mac);
+    }
+    QSqlQuery insert(db);
+    insert.prepare("INSERT INTO note_revision_chunks (note_id, revision_number, chunk_mac) VALUES (?, ?, ?)");
+    insert.addBindValue(noteIds);
+    insert.addBindValue(numbers);
+    insert.addBindValue(macs);
+    if (!DBManager::instance().execBatch(insert, "note_revision_chunks.insert")) {
+        qDebug() << "List Revision Chunks Error:" << insert.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+// Revisions written before chunk lists were kept are replayed once and
+// listed, after which the note never needs replaying to collect chunks.
+bool NoteManager::listUnlistedRevisions(const int noteId) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::listUnlistedRevisions");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSet<int> unlisted; {
+        QSqlQuery query(db);
+        query.prepare(R"(
+            SELECT revision_number
+            FROM note_revisions
+            WHERE note_id = ? AND user_id = ? AND chunks_listed = 0
+        )");
+        query.addBindValue(noteId);
+        query.addBindValue(userId);
+        if (!DBManager::instance().exec(query, "note_revisions.select_unlisted")) {
+            qDebug() << "Read Note Revisions Error:" << query.lastError().text();
+            return false;
+        }
+        while (query.next()) {
+            unlisted.insert(query.value(0).toInt());
+        }
+    }
+    if (unlisted.isEmpty()) {
+        return true;
+    }
+
+    Metrics::increment(Metrics::NoteRevisionReplays);
+    int first = std::numeric_limits<int>::max();
+    int last = 0;
+    for (const int number: unlisted) {
+        first = qMin(first, number);
+        last = qMax(last, number);
+    }
+    const int keyframe = keyframeAtOrBefore(noteId, first);
+    QList<QPair<int, QByteArray> > history;
+    if (keyframe <= 0 || !replayRevisions(noteId, keyframe, last, history)) {
+        return false;
+    }
+    for (const QPair<int, QByteArray> &revision: history) {
+        if (!unlisted.contains(revision.first)) {
+            continue;
+        }
+        NoteEntry snapshot;
+        if (!decodeSnapshot(revision.second, snapshot)) {
+            qWarning() << "Could not read revision" << revision.first << "of note" << noteId;
+            return false;
+        }
+        if (!listRevisionChunks(noteId, revision.first, snapshot)) {
+            return false;
+        }
+    }
+
+    QSqlQuery mark(db);
+    mark.prepare(R"(
+        UPDATE note_revisions
+        SET chunks_listed = 1
+        WHERE note_id = ? AND user_id = ? AND chunks_listed = 0 AND revision_number <= ?
+    )");
+    mark.addBindValue(noteId);
+    mark.addBindValue(userId);
+    mark.addBindValue(last);
+    if (!DBManager::instance().exec(mark, "note_revisions.mark_listed")) {
+        qDebug() << "List Revision Chunks Error:" << mark.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+// Deletes chunks that neither the note nor any kept revision lists, releasing
+// them in the chunk store. The revisions' chunk lists answer this without
+// decrypting anything.
+bool NoteManager::collectChunks(const int noteId, const NoteEntry &entry) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::collectChunks");
+    QSet<QByteArray> unused = storedChunkMacs(noteId);
+    if (entry.chunked) {
+        for (const NoteChunk &chunk: entry.chunks) {
+            unused.remove(chunk.mac);
+        }
+    }
+    if (unused.isEmpty()) {
+        return true;
+    }
+
+    QSqlDatabase db = DBManager::instance().getDatabase(); {
+        // Keeping a few unreferenced chunks is harmless; dropping a
+        // referenced one is not.
+        if (!listUnlistedRevisions(noteId)) {
+            qWarning() << "Could not list the revisions of note" << noteId << "; keeping its chunks.";
+            return true;
+        }
+        QSqlQuery query(db);
+        query.prepare("SELECT DISTINCT chunk_mac FROM note_revision_chunks WHERE note_id = ?");
+        query.addBindValue(noteId);
+        if (!DBManager::instance().exec(query, "note_revision_chunks.select_macs")) {
+            qWarning() << "Could not read the revisions of note" << noteId << "; keeping its chunks.";
+            return true;
+        }
+        while (query.next()) {
+            unused.remove(query.value(0).toByteArray());
+        }
+    }
+    if (unused.isEmpty()) {
+        return true;
+    }
+
+    QVariantList noteIds;
+    QVariantList macs;
+    for (const QByteArray &mac: unused) {
+        noteIds.append(noteId);
+        macs.append(mac);
+    }
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM note_chunks WHERE note_id = ? AND chunk_mac = ?");
+    remove.addBindValue(noteIds);
+    remove.addBindValue(macs);
+    if (!DBManager::instance().execBatch(remove, "note_chunks.delete_orphans")
+        || !ChunkStore::release(db, userId, unused.values())) {
+        qDebug() << "Delete Note Chunks Error:" << remove.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QList<NoteRevision> NoteManager::getRevisions(const int noteId) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::getRevisions");
+    const MetricsOperation operation("getNoteRevisions");
+    QList<NoteRevision> revisions;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            revision_number,
+            keyframe,
+            created_at,
+            saved_at,
+            LENGTH(encrypted_delta)
+        FROM note_revisions
+        WHERE note_id = ? AND user_id = ?
+        ORDER BY revision_number DESC
+    )");
+    query.addBindValue(noteId);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "note_revisions.select")) {
+        qDebug() << "Get Note Revisions Error:" << query.lastError().text();
+        return revisions;
+    }
+    while (query.next()) {
+        NoteRevision revision;
+        revision.number = query.value(0).toInt();
+        revision.keyframe = query.value(1).toInt() != 0;
+        revision.createdAt = query.value(2).toLongLong();
+        revision.savedAt = query.value(3).toLongLong();
+        revision.storedSize = query.value(4).toInt();
+        revisions.append(revision);
+    }
+    return revisions;
+}
+
+bool NoteManager::loadRevision(const int noteId, const int number, NoteEntry &entry) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::loadRevision");
+    const MetricsOperation operation("loadNoteRevision");
+    if (!encryption) {
+        return false;
+    }
+
+    const int keyframe = keyframeAtOrBefore(noteId, number);
+    QList<QPair<int, QByteArray> > snapshots;
+    if (keyframe <= 0 || !replayRevisions(noteId, keyframe, number, snapshots) || snapshots.isEmpty()
+        || snapshots.last().first != number || !decodeSnapshot(snapshots.last().second, entry)) {
+        qWarning() << "Failed to load revision" << number << "of note" << noteId;
+        return false;
+    }
+    entry.id = noteId;
+    entry.salt.clear();
+    entry.recordFormat = RecordCodec::HeaderedRecord;
+    return true;
+}
+
+// Restoring always adds a revision, even within the coalescing window, so the
+// text it replaces stays in the history. A chunked revision only needs its
+// manifest back; its chunks are still stored because the revision lists them.
+bool NoteManager::restoreRevision(const int noteId, const int number) const {
+    ENIGMA_TRACE_SCOPE("model", "NoteManager::restoreRevision");
+    const MetricsOperation operation("restoreNoteRevision");
+    NoteEntry entry;
+    if (!loadRevision(noteId, number, entry)) {
+        return false;
+    }
+    if (entry.chunked) {
+        return writeChunked(noteId, entry, 0, 0, nullptr, false);
+    }
+    return writeInline(noteId, entry, false);
+}
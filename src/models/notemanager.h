@@ -2,13 +2,64 @@
 #define NOTEMANAGER_H
 
 #include <QList>
+#include <QSet>
 #include "core/encryption.h"
+#include "core/recordcodec.h"
 
+struct NoteChunk {
+    QByteArray mac;
+    int length;
+};
+
+// Large notes keep their content in note_chunks, and `content` then only holds
+// the first `loadedChunks` chunks. Saving replaces those with the new content
+// and keeps the rest of the manifest as it was.
 struct NoteEntry {
     int id;
     QByteArray salt;
     QString title;
     QString content;
+    bool chunked = false;
+    QByteArray contentKey;
+    QList<NoteChunk> chunks;
+    int loadedChunks = 0;
+    int recordFormat = RecordCodec::HeaderedRecord;
+    int keySchedule = Encryption::CurrentKeySchedule;
+    // Set when a field failed to decrypt or decode. Such entries are shown
+    // but never written back, so the stored ciphertext survives.
+    bool readOnly = false;
+
+    qint64 chunkedSize() const;
+};
+
+// What an autosave writes. For chunked notes the entry content replaces
+// chunks [firstChunk, firstChunk + chunkCount); otherwise it is the whole
+// content.
+struct NoteEdit {
+    bool titleChanged = false;
+    bool contentChanged = false;
+    int firstChunk = 0;
+    int chunkCount = 0;
+};
+
+// One stored version of a note. Most revisions hold only a delta against the
+// one before; keyframes hold the whole note.
+struct NoteRevision {
+    int number;
+    bool keyframe;
+    qint64 createdAt;
+    qint64 savedAt;
+    int storedSize;
+};
+
+struct EncryptedNoteRow {
+    int id;
+    QByteArray salt;
+    QByteArray title;
+    QByteArray content;
+    int contentFormat;
+    int recordFormat;
+    int keySchedule;
 };
 
 class NoteManager {
@@ -21,13 +72,62 @@ public:
 
     QList<NoteEntry> getNotes() const;
 
+    QList<NoteEntry> decryptRows(const QList<EncryptedNoteRow> &rows) const;
+
+    static QList<EncryptedNoteRow> fetchEncryptedRows(int userId);
+
+    bool saveEdit(int id, NoteEntry &entry, const NoteEdit &edit, QList<int> *chunkChars = nullptr) const;
+
+    QStringList readChunks(const NoteEntry &entry, int first, int count, bool *ok = nullptr) const;
+
     bool deleteNote(int id) const;
 
+    QList<NoteRevision> getRevisions(int noteId) const;
+
+    bool loadRevision(int noteId, int number, NoteEntry &entry) const;
+
+    bool restoreRevision(int noteId, int number) const;
+
+    static bool shouldChunk(const QString &content);
+
 private:
     int userId;
     Encryption *encryption;
 
     static QByteArray generateRandomSalt(int length = 16);
+
+    static QList<QByteArray> splitContent(const QByteArray &utf8);
+
+    static QByteArray chunkMacKey(const QByteArray &contentKey);
+
+    static QByteArray chunkMac(const QByteArray &macKey, const QByteArray &chunk);
+
+    static QString encodeManifest(const QByteArray &contentKey, const QList<NoteChunk> &chunks);
+
+    static bool decodeManifest(const QString &manifest, NoteEntry &entry);
+
+    bool writeInline(int id, const NoteEntry &entry, bool coalesce) const;
+
+    bool writeChunked(int noteId, NoteEntry &entry, int firstChunk, int chunkCount,
+                      QList<int> *chunkChars = nullptr, bool coalesce = true) const;
+
+    QSet<QByteArray> storedChunkMacs(int noteId) const;
+
+    static QByteArray encodeSnapshot(const NoteEntry &entry);
+
+    static bool decodeSnapshot(const QByteArray &snapshot, NoteEntry &entry);
+
+    int keyframeAtOrBefore(int noteId, int number) const;
+
+    bool replayRevisions(int noteId, int first, int last, QList<QPair<int, QByteArray> > &snapshots) const;
+
+    bool recordRevision(int noteId, const NoteEntry &entry, bool coalesce = true) const;
+
+    bool listRevisionChunks(int noteId, int number, const NoteEntry &snapshot) const;
+
+    bool listUnlistedRevisions(int noteId) const;
+
+    bool collectChunks(int noteId, const NoteEntry &entry) const;
 };
 
 #endif // NOTEMANAGER_H
@@ -0,0 +1,151 @@
+#include "passwordaudit.h"
+#include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/recordcodec.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+static const int BACKFILL_BATCH_SIZE = 256;
+
+PasswordAudit::PasswordAudit(const int userId, const Encryption &encryption)
+    : userId(userId), encryption(encryption) {
+}
+
+// The update only matches rows that still have the salt that was read and no
+// fingerprint, so an entry saved in the meantime keeps the one its save wrote.
+// Rows that fail to decrypt are skipped and tried again on the next audit.
+bool PasswordAudit::backfillFingerprints() const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordAudit::backfillFingerprints");
+    QSqlDatabase db = DBManager::instance().getDatabase();
+
+    int lastId = 0;
+    while (true) {
+        QList<int> ids;
+        QList<QByteArray> salts;
+        QList<int> schedules;
+        QList<QByteArray> sealedPasswords;
+        QList<int> formats; {
+            QSqlQuery select(db);
+            select.prepare(QString(R"(
+                SELECT
+                    id,
+                    salt,
+                    encrypted_password,
+                    record_format,
+                    key_schedule
+                FROM passwords
+                WHERE user_id = ? AND password_fingerprint IS NULL AND id > ?
+                ORDER BY id
+                LIMIT %1
+            )").arg(BACKFILL_BATCH_SIZE));
+            select.addBindValue(userId);
+            select.addBindValue(lastId);
+            if (!DBManager::instance().exec(select, "passwords.select_unfingerprinted")) {
+                qDebug() << "Fingerprint Backfill Error:" << select.lastError().text();
+                return false;
+            }
+            while (select.next()) {
+                ids.append(select.value(0).toInt());
+                salts.append(select.value(1).toByteArray());
+                sealedPasswords.append(select.value(2).toByteArray());
+                formats.append(select.value(3).toInt());
+                schedules.append(select.value(4).toInt());
+            }
+        }
+        if (ids.isEmpty()) {
+            return true;
+        }
+        lastId = ids.last();
+
+        const QList<QByteArray> keys = encryption.deriveEntryKeys(salts, schedules);
+        QVariantList fingerprints;
+        QVariantList rowIds;
+        QVariantList userIds;
+        QVariantList rowSalts;
+        for (int i = 0; i < ids.size(); ++i) {
+            const QByteArray plain = Encryption::decryptBytesWithKey({sealedPasswords.at(i)}, keys.at(i)).at(0);
+            if (!sealedPasswords.at(i).isEmpty() && plain.isEmpty()) {
+                qWarning() << "Failed to decrypt password" << ids.at(i) << "for its fingerprint!";
+                continue;
+            }
+            const QByteArray fingerprint = encryption.passwordFingerprint(RecordCodec::decodeField(plain, formats.at(i)));
+            if (fingerprint.isNull()) {
+                return false;
+            }
+            fingerprints.append(fingerprint);
+            rowIds.append(ids.at(i));
+            userIds.append(userId);
+            rowSalts.append(salts.at(i));
+        }
+        if (rowIds.isEmpty()) {
+            continue;
+        }
+
+        QSqlQuery update(db);
+        update.prepare(R"(
+            UPDATE passwords
+            SET password_fingerprint = ?
+            WHERE id = ? AND user_id = ? AND salt = ? AND password_fingerprint IS NULL
+        )");
+        update.addBindValue(fingerprints);
+        update.addBindValue(rowIds);
+        update.addBindValue(userIds);
+        update.addBindValue(rowSalts);
+        if (!DBManager::instance().execBatch(update, "passwords.update_fingerprints")) {
+            qDebug() << "Fingerprint Backfill Error:" << update.lastError().text();
+            return false;
+        }
+    }
+}
+
+// Groups are returned in fingerprint order, with ids ascending in each group.
+// Empty passwords have an empty fingerprint and are not counted as reuse.
+QList<QList<int> > PasswordAudit::findReusedPasswords(const int userId, bool *ok) {
+    ENIGMA_TRACE_SCOPE("db", "PasswordAudit::findReusedPasswords");
+    const MetricsOperation operation("findReusedPasswords");
+    QList<QList<int> > groups;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            id,
+            password_fingerprint
+        FROM passwords
+        WHERE user_id = ? AND password_fingerprint IN (
+            SELECT password_fingerprint
+            FROM passwords
+            WHERE user_id = ? AND password_fingerprint IS NOT NULL
+            GROUP BY password_fingerprint
+            HAVING COUNT(*) > 1 AND LENGTH(password_fingerprint) > 0
+        )
+        ORDER BY password_fingerprint, id
+    )");
+    query.addBindValue(userId);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "passwords.select_reused")) {
+        qDebug() << "Find Reused Passwords Error:" << query.lastError().text();
+        if (ok) {
+            *ok = false;
+        }
+        return groups;
+    }
+
+    QByteArray previous;
+    while (query.next()) {
+        const QByteArray fingerprint = query.value(1).toByteArray();
+        if (groups.isEmpty() || fingerprint != previous) {
+            groups.append(QList<int>());
+            previous = fingerprint;
+        }
+        groups.last().append(query.value(0).toInt());
+    }
+    if (ok) {
+        *ok = true;
+    }
+    return groups;
+}
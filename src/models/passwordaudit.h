@@ -0,0 +1,26 @@
+#ifndef PASSWORDAUDIT_H
+#define PASSWORDAUDIT_H
+
+#include <QByteArray>
+#include <QList>
+#include "core/encryption.h"
+
+// Finds entries that share a password without decrypting the vault. Every
+// entry stores a keyed fingerprint of its password, written on add and update,
+// so reuse is one grouped query over the (user_id, password_fingerprint)
+// index. Rows without a fingerprint yet (older rows, or all of them after a
+// vault key rotation) are filled in first, decrypting only their password.
+class PasswordAudit {
+public:
+    PasswordAudit(int userId, const Encryption &encryption);
+
+    bool backfillFingerprints() const;
+
+    static QList<QList<int> > findReusedPasswords(int userId, bool *ok = nullptr);
+
+private:
+    int userId;
+    Encryption encryption;
+};
+
+#endif // PASSWORDAUDIT_H
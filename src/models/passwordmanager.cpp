@@ -1,12 +1,23 @@
 #include "passwordmanager.h"
+#include "attachmentmanager.h"
 #include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/metrics.h"
+#include "core/recordcodec.h"
 
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 #include <QDebug>
+#include <QDateTime>
 #include <openssl/rand.h>
 
+// Changing an entry's password first copies the old ciphertext, with its salt
+// and key schedule, into password_history in the same transaction. Nothing is
+// re-encrypted, and history is only read and decrypted when it is shown. Each
+// entry keeps its most recent MAX_PASSWORD_HISTORY passwords.
+static const int MAX_PASSWORD_HISTORY = 20;
+
 static QByteArray generateRandomSalt(int length = 16) {
     QByteArray salt;
     salt.resize(length);
@@ -17,6 +28,19 @@ static QByteArray generateRandomSalt(int length = 16) {
     return salt;
 }
 
+// Only the free-form description is worth compressing.
+static QList<QByteArray> encodedFields(const PasswordEntry &entry) {
+    return {
+        RecordCodec::encodeField(entry.service, false),
+        RecordCodec::encodeField(entry.url, false),
+        RecordCodec::encodeField(entry.username, false),
+        RecordCodec::encodeField(entry.email, false),
+        RecordCodec::encodeField(entry.password, false),
+        RecordCodec::encodeField(entry.description, true),
+        RecordCodec::encodeField(entry.totpSecret, false)
+    };
+}
+
 PasswordManager::PasswordManager(int userId, Encryption *encryption)
     : userId(userId), encryption(encryption) {
 }
@@ -25,7 +49,13 @@ Encryption *PasswordManager::getEncryption() const {
     return encryption;
 }
 
+int PasswordManager::getUserId() const {
+    return userId;
+}
+
 bool PasswordManager::addPassword(const PasswordEntry &entry) const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordManager::addPassword");
+    const MetricsOperation operation("addPassword", Metrics::AddPasswordLatency);
     if (!encryption) {
         qWarning() << "No encryption object available!";
         return false;
@@ -33,13 +63,7 @@ bool PasswordManager::addPassword(const PasswordEntry &entry) const {
 
     QByteArray entrySalt = generateRandomSalt(16);
 
-    QByteArray encService = encryption->encryptWithSalt(entry.service, entrySalt);
-    QByteArray encUrl = encryption->encryptWithSalt(entry.url, entrySalt);
-    QByteArray encUsername = encryption->encryptWithSalt(entry.username, entrySalt);
-    QByteArray encEmail = encryption->encryptWithSalt(entry.email, entrySalt);
-    QByteArray encPassword = encryption->encryptWithSalt(entry.password, entrySalt);
-    QByteArray encDescription = encryption->encryptWithSalt(entry.description, entrySalt);
-    QByteArray encTotp = encryption->encryptWithSalt(entry.totpSecret, entrySalt);
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt(encodedFields(entry), entrySalt);
 
     QSqlDatabase db = DBManager::instance().getDatabase();
     QSqlQuery query(db);
@@ -53,20 +77,22 @@ bool PasswordManager::addPassword(const PasswordEntry &entry) const {
             encrypted_email,
             encrypted_password,
             encrypted_description,
-            encrypted_totp_secret
-        ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+            encrypted_totp_secret,
+            record_format,
+            key_schedule,
+            password_fingerprint
+        ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
     )");
     query.addBindValue(userId);
     query.addBindValue(entrySalt);
-    query.addBindValue(encService);
-    query.addBindValue(encUrl);
-    query.addBindValue(encUsername);
-    query.addBindValue(encEmail);
-    query.addBindValue(encPassword);
-    query.addBindValue(encDescription);
-    query.addBindValue(encTotp);
-
-    if (!query.exec()) {
+    for (const QByteArray &field: encrypted) {
+        query.addBindValue(field);
+    }
+    query.addBindValue(RecordCodec::HeaderedRecord);
+    query.addBindValue(Encryption::CurrentKeySchedule);
+    query.addBindValue(encryption->passwordFingerprint(entry.password));
+
+    if (!DBManager::instance().exec(query, "passwords.insert")) {
         qDebug() << "Add Password Error:" << query.lastError().text();
         return false;
     }
@@ -74,21 +100,26 @@ bool PasswordManager::addPassword(const PasswordEntry &entry) const {
 }
 
 bool PasswordManager::updatePassword(int id, const PasswordEntry &entry) const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordManager::updatePassword");
+    const MetricsOperation operation("updatePassword", Metrics::UpdatePasswordLatency);
     if (!encryption) {
         return false;
     }
 
     QByteArray entrySalt = generateRandomSalt(16);
 
-    QByteArray encService = encryption->encryptWithSalt(entry.service, entrySalt);
-    QByteArray encUrl = encryption->encryptWithSalt(entry.url, entrySalt);
-    QByteArray encUsername = encryption->encryptWithSalt(entry.username, entrySalt);
-    QByteArray encEmail = encryption->encryptWithSalt(entry.email, entrySalt);
-    QByteArray encPassword = encryption->encryptWithSalt(entry.password, entrySalt);
-    QByteArray encDescription = encryption->encryptWithSalt(entry.description, entrySalt);
-    QByteArray encTotp = encryption->encryptWithSalt(entry.totpSecret, entrySalt);
+    const QList<QByteArray> encrypted = encryption->encryptBytesWithSalt(encodedFields(entry), entrySalt);
 
     QSqlDatabase db = DBManager::instance().getDatabase();
+    const bool ownTransaction = db.transaction();
+    bool archived = false;
+    if (!archivePassword(id, entry.password, &archived)) {
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+
     QSqlQuery query(db);
     query.prepare(R"(
         UPDATE passwords
@@ -100,34 +131,202 @@ bool PasswordManager::updatePassword(int id, const PasswordEntry &entry) const {
             encrypted_email = ?,
             encrypted_password = ?,
             encrypted_description = ?,
-            encrypted_totp_secret = ?
+            encrypted_totp_secret = ?,
+            record_format = ?,
+            key_schedule = ?,
+            password_fingerprint = ?,
+            revision = revision + 1
         WHERE id = ? AND user_id = ?
     )");
 
     query.addBindValue(entrySalt);
-    query.addBindValue(encService);
-    query.addBindValue(encUrl);
-    query.addBindValue(encUsername);
-    query.addBindValue(encEmail);
-    query.addBindValue(encPassword);
-    query.addBindValue(encDescription);
-    query.addBindValue(encTotp);
+    for (const QByteArray &field: encrypted) {
+        query.addBindValue(field);
+    }
+    query.addBindValue(RecordCodec::HeaderedRecord);
+    query.addBindValue(Encryption::CurrentKeySchedule);
+    query.addBindValue(encryption->passwordFingerprint(entry.password));
 
     query.addBindValue(id);
     query.addBindValue(userId);
 
-    if (!query.exec()) {
+    if (!DBManager::instance().exec(query, "passwords.update") || query.numRowsAffected() <= 0
+        || (archived && !prunePasswordHistory(id)) || (ownTransaction && !db.commit())) {
         qDebug() << "Update Password Error:" << query.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
         return false;
     }
-    return (query.numRowsAffected() > 0);
+    return true;
+}
+
+// Archives the stored password if the update replaces it with a different one.
+bool PasswordManager::archivePassword(const int id, const QString &newPassword, bool *archived) const {
+    *archived = false;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery current(db);
+    current.prepare(R"(
+        SELECT
+            salt,
+            encrypted_password,
+            record_format,
+            key_schedule
+        FROM passwords
+        WHERE id = ? AND user_id = ?
+    )");
+    current.addBindValue(id);
+    current.addBindValue(userId);
+
+    if (!DBManager::instance().exec(current, "passwords.select_current") || !current.next()) {
+        qDebug() << "Archive Password Error:" << current.lastError().text();
+        return false;
+    }
+    const QByteArray sealed = current.value(1).toByteArray();
+    const QByteArray plain = encryption->decryptBytesWithSalt({sealed}, current.value(0).toByteArray(),
+                                                              current.value(3).toInt()).at(0);
+    if (sealed.isEmpty() || plain.isEmpty()) {
+        return true;
+    }
+    if (RecordCodec::decodeField(plain, current.value(2).toInt()) == newPassword) {
+        return true;
+    }
+
+    QSqlQuery insert(db);
+    insert.prepare(R"(
+        INSERT INTO password_history (
+            password_id,
+            user_id,
+            salt,
+            encrypted_password,
+            record_format,
+            key_schedule,
+            key_epoch,
+            changed_at
+        )
+        SELECT
+            id,
+            user_id,
+            salt,
+            encrypted_password,
+            record_format,
+            key_schedule,
+            key_epoch,
+            ?
+        FROM passwords
+        WHERE id = ? AND user_id = ?
+    )");
+    insert.addBindValue(QDateTime::currentSecsSinceEpoch());
+    insert.addBindValue(id);
+    insert.addBindValue(userId);
+
+    if (!DBManager::instance().exec(insert, "password_history.insert")) {
+        qDebug() << "Archive Password Error:" << insert.lastError().text();
+        return false;
+    }
+    *archived = true;
+    return true;
+}
+
+bool PasswordManager::prunePasswordHistory(const int id) const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery oldest(db);
+    oldest.prepare(QString(R"(
+        SELECT id
+        FROM password_history
+        WHERE password_id = ? AND user_id = ?
+        ORDER BY id DESC
+        LIMIT 1 OFFSET %1
+    )").arg(MAX_PASSWORD_HISTORY - 1));
+    oldest.addBindValue(id);
+    oldest.addBindValue(userId);
+
+    if (!DBManager::instance().exec(oldest, "password_history.select_cutoff")) {
+        qDebug() << "Prune Password History Error:" << oldest.lastError().text();
+        return false;
+    }
+    if (!oldest.next()) {
+        return true;
+    }
+
+    QSqlQuery prune(db);
+    prune.prepare("DELETE FROM password_history WHERE password_id = ? AND user_id = ? AND id < ?");
+    prune.addBindValue(id);
+    prune.addBindValue(userId);
+    prune.addBindValue(oldest.value(0).toInt());
+
+    if (!DBManager::instance().exec(prune, "password_history.prune")) {
+        qDebug() << "Prune Password History Error:" << prune.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QList<PasswordHistoryEntry> PasswordManager::getPasswordHistory(const int id) const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordManager::getPasswordHistory");
+    const MetricsOperation operation("getPasswordHistory");
+    QList<PasswordHistoryEntry> history;
+    if (!encryption) {
+        return history;
+    }
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        SELECT
+            salt,
+            encrypted_password,
+            record_format,
+            key_schedule,
+            changed_at
+        FROM password_history
+        WHERE password_id = ? AND user_id = ?
+        ORDER BY id DESC
+    )");
+    query.addBindValue(id);
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "password_history.select")) {
+        qDebug() << "Get Password History Error:" << query.lastError().text();
+        return history;
+    }
+
+    QList<QByteArray> salts;
+    QList<int> schedules;
+    QList<QByteArray> sealedPasswords;
+    QList<int> formats;
+    QList<qint64> changedAt;
+    while (query.next()) {
+        salts.append(query.value(0).toByteArray());
+        sealedPasswords.append(query.value(1).toByteArray());
+        formats.append(query.value(2).toInt());
+        schedules.append(query.value(3).toInt());
+        changedAt.append(query.value(4).toLongLong());
+    }
+
+    const QList<QByteArray> keys = encryption->deriveEntryKeys(salts, schedules);
+    for (int i = 0; i < sealedPasswords.size(); ++i) {
+        const QByteArray plain = Encryption::decryptBytesWithKey({sealedPasswords.at(i)}, keys.at(i)).at(0);
+        if (plain.isEmpty()) {
+            qWarning() << "Failed to decrypt a previous password of entry" << id;
+            continue;
+        }
+        history.append(PasswordHistoryEntry{RecordCodec::decodeField(plain, formats.at(i)), changedAt.at(i)});
+    }
+    return history;
 }
 
 QList<PasswordEntry> PasswordManager::getPasswords() const {
-    QList<PasswordEntry> list;
+    const MetricsOperation operation("getPasswords", Metrics::GetPasswordsLatency);
     if (!encryption) {
-        return list;
+        return QList<PasswordEntry>();
     }
+    return decryptRows(fetchEncryptedRows(userId));
+}
+
+QList<EncryptedPasswordRow> PasswordManager::fetchEncryptedRows(const int userId) {
+    ENIGMA_TRACE_SCOPE("db", "PasswordManager::fetchEncryptedRows");
+    QList<EncryptedPasswordRow> rows;
     QSqlDatabase db = DBManager::instance().getDatabase();
     QSqlQuery query(db);
 
@@ -141,52 +340,106 @@ QList<PasswordEntry> PasswordManager::getPasswords() const {
             encrypted_email,
             encrypted_password,
             encrypted_description,
-            encrypted_totp_secret
+            encrypted_totp_secret,
+            record_format,
+            key_schedule
         FROM passwords
         WHERE user_id = ?
+        ORDER BY id
     )");
     query.addBindValue(userId);
 
-    if (query.exec()) {
+    if (DBManager::instance().exec(query, "passwords.select")) {
         while (query.next()) {
-            PasswordEntry entry;
-            entry.id = query.value(0).toInt();
-            entry.salt = query.value(1).toByteArray();
-
-            QByteArray encService = query.value(2).toByteArray();
-            QByteArray encUrl = query.value(3).toByteArray();
-            QByteArray encUsername = query.value(4).toByteArray();
-            QByteArray encEmail = query.value(5).toByteArray();
-            QByteArray encPassword = query.value(6).toByteArray();
-            QByteArray encDescription = query.value(7).toByteArray();
-            QByteArray encTotp = query.value(8).toByteArray();
-
-            entry.service = encryption->decryptWithSalt(encService, entry.salt);
-            entry.url = encryption->decryptWithSalt(encUrl, entry.salt);
-            entry.username = encryption->decryptWithSalt(encUsername, entry.salt);
-            entry.email = encryption->decryptWithSalt(encEmail, entry.salt);
-            entry.password = encryption->decryptWithSalt(encPassword, entry.salt);
-            entry.description = encryption->decryptWithSalt(encDescription, entry.salt);
-            entry.totpSecret = encryption->decryptWithSalt(encTotp, entry.salt);
-
-            list.append(entry);
+            EncryptedPasswordRow row;
+            row.id = query.value(0).toInt();
+            row.salt = query.value(1).toByteArray();
+            row.service = query.value(2).toByteArray();
+            row.url = query.value(3).toByteArray();
+            row.username = query.value(4).toByteArray();
+            row.email = query.value(5).toByteArray();
+            row.password = query.value(6).toByteArray();
+            row.description = query.value(7).toByteArray();
+            row.totpSecret = query.value(8).toByteArray();
+            row.recordFormat = query.value(9).toInt();
+            row.keySchedule = query.value(10).toInt();
+            rows.append(row);
         }
     } else {
         qDebug() << "Get Passwords Error:" << query.lastError().text();
     }
+    return rows;
+}
+
+QList<PasswordEntry> PasswordManager::decryptRows(const QList<EncryptedPasswordRow> &rows) const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordManager::decryptRows");
+    QList<PasswordEntry> list;
+    if (!encryption) {
+        return list;
+    }
+    list.reserve(rows.size());
+
+    // Every row has its own salt, so the row keys are derived as one batch.
+    QList<QByteArray> salts;
+    QList<int> schedules;
+    salts.reserve(rows.size());
+    schedules.reserve(rows.size());
+    for (const EncryptedPasswordRow &row: rows) {
+        salts.append(row.salt);
+        schedules.append(row.keySchedule);
+    }
+    const QList<QByteArray> keys = encryption->deriveEntryKeys(salts, schedules);
+
+    for (int i = 0; i < rows.size(); ++i) {
+        const EncryptedPasswordRow &row = rows.at(i);
+        PasswordEntry entry;
+        entry.id = row.id;
+        entry.salt = row.salt;
+        const QList<QByteArray> fields = Encryption::decryptBytesWithKey({
+            row.service,
+            row.url,
+            row.username,
+            row.email,
+            row.password,
+            row.description,
+            row.totpSecret
+        }, keys.at(i));
+        entry.service = RecordCodec::decodeField(fields.at(0), row.recordFormat);
+        entry.url = RecordCodec::decodeField(fields.at(1), row.recordFormat);
+        entry.username = RecordCodec::decodeField(fields.at(2), row.recordFormat);
+        entry.email = RecordCodec::decodeField(fields.at(3), row.recordFormat);
+        entry.password = RecordCodec::decodeField(fields.at(4), row.recordFormat);
+        entry.description = RecordCodec::decodeField(fields.at(5), row.recordFormat);
+        entry.totpSecret = RecordCodec::decodeField(fields.at(6), row.recordFormat);
+        list.append(entry);
+    }
     return list;
 }
 
 bool PasswordManager::deletePassword(int id) const {
+    ENIGMA_TRACE_SCOPE("model", "PasswordManager::deletePassword");
+    const MetricsOperation operation("deletePassword");
     QSqlDatabase db = DBManager::instance().getDatabase();
-    QSqlQuery query(db);
+    const bool ownTransaction = db.transaction();
 
+    QSqlQuery history(db);
+    history.prepare("DELETE FROM password_history WHERE password_id = ? AND user_id = ?");
+    history.addBindValue(id);
+    history.addBindValue(userId);
+
+    QSqlQuery query(db);
     query.prepare("DELETE FROM passwords WHERE id = ? AND user_id = ?");
     query.addBindValue(id);
     query.addBindValue(userId);
 
-    if (!query.exec()) {
-        qDebug() << "Delete Password Error:" << query.lastError().text();
+    if (!DBManager::instance().exec(history, "password_history.delete_entry")
+        || !AttachmentManager::deleteOwnerAttachments(db, userId, AttachmentManager::PasswordOwner, id)
+        || !DBManager::instance().exec(query, "passwords.delete")
+        || (ownTransaction && !db.commit())) {
+        qDebug() << "Delete Password Error:" << query.lastError().text() << history.lastError().text();
+        if (ownTransaction) {
+            db.rollback();
+        }
         return false;
     }
     return (query.numRowsAffected() > 0);
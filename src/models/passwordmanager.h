@@ -17,6 +17,26 @@ struct PasswordEntry {
     QString totpSecret;
 };
 
+// A password an entry had before it was changed, and when it was replaced.
+struct PasswordHistoryEntry {
+    QString password;
+    qint64 changedAt;
+};
+
+struct EncryptedPasswordRow {
+    int id;
+    QByteArray salt;
+    QByteArray service;
+    QByteArray url;
+    QByteArray username;
+    QByteArray email;
+    QByteArray password;
+    QByteArray description;
+    QByteArray totpSecret;
+    int recordFormat;
+    int keySchedule;
+};
+
 class PasswordManager {
 public:
     PasswordManager(int userId, Encryption *encryption);
@@ -27,13 +47,25 @@ public:
 
     QList<PasswordEntry> getPasswords() const;
 
+    QList<PasswordEntry> decryptRows(const QList<EncryptedPasswordRow> &rows) const;
+
+    static QList<EncryptedPasswordRow> fetchEncryptedRows(int userId);
+
     bool deletePassword(int id) const;
 
+    QList<PasswordHistoryEntry> getPasswordHistory(int id) const;
+
     Encryption *getEncryption() const;
 
+    int getUserId() const;
+
 private:
     int userId;
     Encryption *encryption;
+
+    bool archivePassword(int id, const QString &newPassword, bool *archived) const;
+
+    bool prunePasswordHistory(int id) const;
 };
 
 #endif // PASSWORDMANAGER_H
@@ -1,15 +1,50 @@
 #include "user.h"
 #include "core/dbmanager.h"
+#include "core/trace.h"
+#include "core/encryption.h"
 
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 #include <QCryptographicHash>
 #include <QDebug>
+#include <QMessageAuthenticationCode>
 #include <openssl/rand.h>
+#include <openssl/crypto.h>
 
-User::User(int id, const QString &username, const QByteArray &salt)
-    : id(id), username(username), salt(salt) {
+// Hashes written before per-user KDF parameters were a single salted SHA-256.
+// Current hashes are an HMAC of the password-derived key encryption key, so
+// verifying a password costs exactly one run of the user's KDF.
+//
+// The key encryption key only wraps the random vault key that encrypts the
+// entries (users.wrapped_key). Accounts created before the vault key existed
+// have no wrapped key; their vault key is the password-derived key itself
+// until the first login wraps it.
+static const QString VERIFIER_PREFIX = "v2$";
+static const int VAULT_KEY_SIZE = 32;
+static const QByteArray VERIFIER_LABEL = "enigma-password-verifier";
+
+static bool constantTimeEquals(const QString &a, const QString &b) {
+    const QByteArray left = a.toLatin1();
+    const QByteArray right = b.toLatin1();
+    return left.size() == right.size() && CRYPTO_memcmp(left.constData(), right.constData(), left.size()) == 0;
+}
+
+static QByteArray generateVaultKey() {
+    QByteArray key(VAULT_KEY_SIZE, '\0');
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(key.data()), VAULT_KEY_SIZE) != 1) {
+        qWarning() << "Failed to generate vault key!";
+        return QByteArray();
+    }
+    return key;
+}
+
+bool UserRecord::hasLegacyHash() const {
+    return !passwordHash.startsWith(VERIFIER_PREFIX);
+}
+
+User::User(int id, const QString &username, const QByteArray &salt, const KdfParams &kdfParams)
+    : id(id), username(username), salt(salt), kdfParams(kdfParams) {
 }
 
 int User::getId() const {
@@ -24,6 +59,10 @@ QByteArray User::getSalt() const {
     return salt;
 }
 
+KdfParams User::getKdfParams() const {
+    return kdfParams;
+}
+
 QByteArray User::generateRandomSalt(int length) {
     QByteArray salt;
     salt.resize(length);
@@ -41,6 +80,12 @@ QString User::hashPassword(const QString &password, const QByteArray &salt) {
     return hasher.result().toHex();
 }
 
+QString User::computeVerifier(const QByteArray &keyEncryptionKey) {
+    const QByteArray mac = QMessageAuthenticationCode::hash(VERIFIER_LABEL, keyEncryptionKey,
+                                                            QCryptographicHash::Sha256);
+    return VERIFIER_PREFIX + QString::fromLatin1(mac.toHex());
+}
+
 bool User::registerUser(const QString &username, const QString &password) {
     if (username.isEmpty() || password.isEmpty()) {
         return false;
@@ -48,9 +93,9 @@ bool User::registerUser(const QString &username, const QString &password) {
 
     QSqlDatabase db = DBManager::instance().getDatabase(); {
         QSqlQuery checkQuery(db);
-        checkQuery.prepare("SELECT COUNT(*) FROM users WHERE LOWER(username) = LOWER(?)");
-        checkQuery.addBindValue(username);
-        if (!checkQuery.exec() || !checkQuery.next()) {
+        checkQuery.prepare("SELECT COUNT(*) FROM users WHERE username_normalized = ?");
+        checkQuery.addBindValue(normalizeUsername(username));
+        if (!DBManager::instance().exec(checkQuery, "users.count_by_name") || !checkQuery.next()) {
             qDebug() << "Error checking username:" << checkQuery.lastError().text();
             return false;
         }
@@ -60,14 +105,38 @@ bool User::registerUser(const QString &username, const QString &password) {
     }
 
     QByteArray salt = generateRandomSalt(16);
-    QString saltedHash = hashPassword(password, salt);
+    const KdfParams params = KeyDerivation::recommended();
+    const QByteArray keyEncryptionKey = KeyDerivation::deriveKey(password, salt, params);
+    const QByteArray vaultKey = generateVaultKey();
+    const QByteArray wrappedKey = Encryption::wrapKey(vaultKey, keyEncryptionKey);
+    if (keyEncryptionKey.isEmpty() || vaultKey.isEmpty() || wrappedKey.isEmpty()) {
+        return false;
+    }
 
     QSqlQuery query(db);
-    query.prepare("INSERT INTO users (username, password, salt) VALUES (?, ?, ?)");
+    query.prepare(R"(
+        INSERT INTO users (
+            username,
+            username_normalized,
+            password,
+            salt,
+            kdf_algorithm,
+            kdf_iterations,
+            kdf_memory_kib,
+            kdf_parallelism,
+            wrapped_key
+        ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+    )");
     query.addBindValue(username.toLower());
-    query.addBindValue(saltedHash);
+    query.addBindValue(normalizeUsername(username));
+    query.addBindValue(computeVerifier(keyEncryptionKey));
     query.addBindValue(salt);
-    if (!query.exec()) {
+    query.addBindValue(params.algorithmName());
+    query.addBindValue(params.iterations);
+    query.addBindValue(params.memoryKiB);
+    query.addBindValue(params.parallelism);
+    query.addBindValue(wrappedKey);
+    if (!DBManager::instance().exec(query, "users.insert")) {
         qDebug() << "Register Error:" << query.lastError().text();
         return false;
     }
@@ -79,30 +148,208 @@ User *User::login(const QString &username, const QString &password) {
         return nullptr;
     }
 
+    const UserRecord record = fetchRecord(username);
+    if (!record.isValid()) {
+        return nullptr;
+    }
+
+    const QByteArray keyEncryptionKey = KeyDerivation::deriveKey(password, record.salt, record.kdfParams);
+    if (record.hasLegacyHash() ? !verifyLegacyPassword(record, password) : !verifyPassword(record, keyEncryptionKey)) {
+        return nullptr;
+    }
+    upgradeKeyHierarchy(record, password, keyEncryptionKey);
+    return new User(record.id, record.username, record.salt, record.kdfParams);
+}
+
+QString User::normalizeUsername(const QString &username) {
+    return username.toLower();
+}
+
+UserRecord User::fetchRecord(const QString &username) {
+    ENIGMA_TRACE_SCOPE("db", "User::fetchRecord");
+    UserRecord record;
+    if (username.isEmpty()) {
+        return record;
+    }
+
     QSqlDatabase db = DBManager::instance().getDatabase();
     QSqlQuery query(db);
 
-    query.prepare("SELECT id, username, password, salt FROM users WHERE LOWER(username) = LOWER(?)");
-    query.addBindValue(username);
+    query.prepare(R"(
+        SELECT
+            id,
+            username,
+            password,
+            salt,
+            kdf_algorithm,
+            kdf_iterations,
+            kdf_memory_kib,
+            kdf_parallelism,
+            wrapped_key
+        FROM users
+        WHERE username_normalized = ?
+    )");
+    query.addBindValue(normalizeUsername(username));
 
-    if (!query.exec()) {
+    if (!DBManager::instance().exec(query, "users.select_by_name")) {
         qDebug() << "Login Error (exec fail):" << query.lastError().text();
-        return nullptr;
+        return record;
     }
 
     if (!query.next()) {
-        return nullptr;
+        return record;
+    }
+
+    bool knownAlgorithm = false;
+    record.kdfParams.algorithm = KdfParams::algorithmFromName(query.value(4).toString(), &knownAlgorithm);
+    record.kdfParams.iterations = query.value(5).toInt();
+    record.kdfParams.memoryKiB = query.value(6).toInt();
+    record.kdfParams.parallelism = query.value(7).toInt();
+    if (!knownAlgorithm || !record.kdfParams.isValid()) {
+        qWarning() << "Unsupported key derivation parameters for user" << query.value(1).toString();
+        return record;
+    }
+
+    record.id = query.value(0).toInt();
+    record.username = query.value(1).toString();
+    record.passwordHash = query.value(2).toString();
+    record.salt = query.value(3).toByteArray();
+    record.wrappedKey = query.value(8).toByteArray();
+    return record;
+}
+
+bool User::verifyLegacyPassword(const UserRecord &record, const QString &password) {
+    if (!record.isValid() || !record.hasLegacyHash() || password.isEmpty()) {
+        return false;
+    }
+    return constantTimeEquals(hashPassword(password, record.salt), record.passwordHash);
+}
+
+bool User::verifyPassword(const UserRecord &record, const QByteArray &keyEncryptionKey) {
+    ENIGMA_TRACE_SCOPE("crypto", "User::verifyPassword");
+    if (!record.isValid() || record.hasLegacyHash() || keyEncryptionKey.isEmpty()) {
+        return false;
+    }
+    return constantTimeEquals(computeVerifier(keyEncryptionKey), record.passwordHash);
+}
+
+QByteArray User::unwrapVaultKey(const UserRecord &record, const QByteArray &keyEncryptionKey) {
+    ENIGMA_TRACE_SCOPE("crypto", "User::unwrapVaultKey");
+    if (keyEncryptionKey.isEmpty()) {
+        return QByteArray();
+    }
+    if (record.wrappedKey.isEmpty()) {
+        return keyEncryptionKey;
+    }
+
+    QByteArray vaultKey = Encryption::unwrapKey(record.wrappedKey, keyEncryptionKey);
+    if (vaultKey.isEmpty()) {
+        qWarning() << "Failed to unwrap the vault key!";
+    }
+    return vaultKey;
+}
+
+bool User::upgradeKeyHierarchy(const UserRecord &record, const QString &password,
+                               const QByteArray &keyEncryptionKey) {
+    ENIGMA_TRACE_SCOPE("crypto", "User::upgradeKeyHierarchy");
+    if (!record.wrappedKey.isEmpty() && !record.hasLegacyHash()) {
+        return true;
+    }
+
+    const QByteArray vaultKey = unwrapVaultKey(record, keyEncryptionKey);
+    if (vaultKey.isEmpty()) {
+        return false;
+    }
+    return storeCredentials(record, password, vaultKey);
+}
+
+QByteArray User::unlockKeyEncryptionKey(const QString &username, const QString &password) {
+    return unlockKeyEncryptionKey(fetchRecord(username), password);
+}
+
+QByteArray User::unlockKeyEncryptionKey(const UserRecord &record, const QString &password) {
+    if (!record.isValid() || password.isEmpty()) {
+        return QByteArray();
     }
 
-    int id = query.value(0).toInt();
-    QString uname = query.value(1).toString();
-    QString storedHash = query.value(2).toString();
-    QByteArray storedSalt = query.value(3).toByteArray();
+    const QByteArray keyEncryptionKey = KeyDerivation::deriveKey(password, record.salt, record.kdfParams);
+    if (record.hasLegacyHash() ? !verifyLegacyPassword(record, password) : !verifyPassword(record, keyEncryptionKey)) {
+        return QByteArray();
+    }
+    return keyEncryptionKey;
+}
 
-    QString inputHash = hashPassword(password, storedSalt);
-    if (inputHash == storedHash) {
-        return new User(id, uname, storedSalt);
+// On success *updated holds the record as written, so the caller can pick up
+// the new salt and KDF parameters without reading the row again.
+bool User::changePassword(const QString &username, const QString &currentPassword, const QString &newPassword,
+                          UserRecord *updated) {
+    if (newPassword.isEmpty()) {
+        return false;
     }
 
-    return nullptr;
+    const UserRecord record = fetchRecord(username);
+    const QByteArray keyEncryptionKey = unlockKeyEncryptionKey(record, currentPassword);
+    if (keyEncryptionKey.isEmpty()) {
+        return false;
+    }
+
+    const QByteArray vaultKey = unwrapVaultKey(record, keyEncryptionKey);
+    if (vaultKey.isEmpty()) {
+        return false;
+    }
+    return storeCredentials(record, newPassword, vaultKey, updated);
+}
+
+// Only replaces the credentials the record was read with, so a concurrent
+// change wins instead of being overwritten.
+bool User::storeCredentials(const UserRecord &record, const QString &password, const QByteArray &vaultKey,
+                            UserRecord *stored) {
+    const QByteArray salt = generateRandomSalt(16);
+    const KdfParams params = KeyDerivation::recommended();
+    const QByteArray keyEncryptionKey = KeyDerivation::deriveKey(password, salt, params);
+    const QByteArray wrappedKey = Encryption::wrapKey(vaultKey, keyEncryptionKey);
+    if (keyEncryptionKey.isEmpty() || wrappedKey.isEmpty()) {
+        return false;
+    }
+    const QString verifier = computeVerifier(keyEncryptionKey);
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(R"(
+        UPDATE users
+        SET
+            password = ?,
+            salt = ?,
+            kdf_algorithm = ?,
+            kdf_iterations = ?,
+            kdf_memory_kib = ?,
+            kdf_parallelism = ?,
+            wrapped_key = ?
+        WHERE id = ? AND password = ?
+    )");
+    query.addBindValue(verifier);
+    query.addBindValue(salt);
+    query.addBindValue(params.algorithmName());
+    query.addBindValue(params.iterations);
+    query.addBindValue(params.memoryKiB);
+    query.addBindValue(params.parallelism);
+    query.addBindValue(wrappedKey);
+    query.addBindValue(record.id);
+    query.addBindValue(record.passwordHash);
+
+    if (!DBManager::instance().exec(query, "users.update_credentials")) {
+        qDebug() << "Store Credentials Error:" << query.lastError().text();
+        return false;
+    }
+    if (query.numRowsAffected() <= 0) {
+        return false;
+    }
+    if (stored) {
+        *stored = record;
+        stored->passwordHash = verifier;
+        stored->salt = salt;
+        stored->kdfParams = params;
+        stored->wrappedKey = wrappedKey;
+    }
+    return true;
 }
@@ -3,10 +3,24 @@
 
 #include <QString>
 #include <QByteArray>
+#include "core/keyderivation.h"
+
+struct UserRecord {
+    int id = -1;
+    QString username;
+    QString passwordHash;
+    QByteArray salt;
+    KdfParams kdfParams;
+    QByteArray wrappedKey;
+
+    bool isValid() const { return id >= 0; }
+
+    bool hasLegacyHash() const;
+};
 
 class User {
 public:
-    User(int id, const QString &username, const QByteArray &salt);
+    User(int id, const QString &username, const QByteArray &salt, const KdfParams &kdfParams = KdfParams());
 
     int getId() const;
 
@@ -14,18 +28,46 @@ public:
 
     QByteArray getSalt() const;
 
+    KdfParams getKdfParams() const;
+
     static bool registerUser(const QString &username, const QString &password);
 
     static User *login(const QString &username, const QString &password);
 
+    static QString normalizeUsername(const QString &username);
+
+    static UserRecord fetchRecord(const QString &username);
+
+    static bool verifyLegacyPassword(const UserRecord &record, const QString &password);
+
+    static bool verifyPassword(const UserRecord &record, const QByteArray &keyEncryptionKey);
+
+    static QByteArray unwrapVaultKey(const UserRecord &record, const QByteArray &keyEncryptionKey);
+
+    static bool upgradeKeyHierarchy(const UserRecord &record, const QString &password,
+                                    const QByteArray &keyEncryptionKey);
+
+    static QByteArray unlockKeyEncryptionKey(const QString &username, const QString &password);
+
+    static QByteArray unlockKeyEncryptionKey(const UserRecord &record, const QString &password);
+
+    static bool changePassword(const QString &username, const QString &currentPassword, const QString &newPassword,
+                               UserRecord *updated = nullptr);
+
+    static QString computeVerifier(const QByteArray &keyEncryptionKey);
+
 private:
     int id;
     QString username;
     QByteArray salt;
+    KdfParams kdfParams;
 
     static QByteArray generateRandomSalt(int length = 16);
 
     static QString hashPassword(const QString &password, const QByteArray &salt);
+
+    static bool storeCredentials(const UserRecord &record, const QString &password, const QByteArray &vaultKey,
+                                 UserRecord *stored = nullptr);
 };
 
 #endif // USER_H
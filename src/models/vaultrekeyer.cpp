@@ -0,0 +1,382 @@
+#include "vaultrekeyer.h"
+#include "core/dbmanager.h"
+#include "core/encryption.h"
+#include "core/pbkdf2batch.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <QtConcurrent>
+#include <openssl/rand.h>
+
+// Rotating the vault key rewrites every row under a fresh random key. Rows are
+// rewritten in batches, each committed in its own transaction and stamped with
+// the target key epoch. The new key is stored wrapped under the old one before
+// the first batch, so an interrupted run resumes from the first row that still
+// carries an older epoch on the next login. Master password changes do not
+// come through here; they only rewrap the vault key.
+static const int REKEY_BATCH_SIZE = 256;
+
+static const QStringList PASSWORD_COLUMNS = {
+    "encrypted_service",
+    "encrypted_url",
+    "encrypted_username",
+    "encrypted_email",
+    "encrypted_password",
+    "encrypted_description",
+    "encrypted_totp_secret"
+};
+
+static const QStringList NOTE_COLUMNS = {
+    "encrypted_title",
+    "encrypted_content"
+};
+
+static const QStringList NOTE_REVISION_COLUMNS = {
+    "encrypted_delta"
+};
+
+static const QStringList PASSWORD_HISTORY_COLUMNS = {
+    "encrypted_password"
+};
+
+static const QStringList ATTACHMENT_COLUMNS = {
+    "encrypted_name",
+    "encrypted_key"
+};
+
+static const QStringList CHUNK_STORE_KEY_COLUMNS = {
+    "encrypted_key"
+};
+
+static const int VAULT_KEY_SIZE = 32;
+
+const QList<QPair<QString, QStringList> > &VaultRekeyer::encryptedTables() {
+    static const QList<QPair<QString, QStringList> > tables = {
+        {"passwords", PASSWORD_COLUMNS},
+        {"notes", NOTE_COLUMNS},
+        {"note_revisions", NOTE_REVISION_COLUMNS},
+        {"password_history", PASSWORD_HISTORY_COLUMNS},
+        {"attachments", ATTACHMENT_COLUMNS},
+        {"chunk_store_keys", CHUNK_STORE_KEY_COLUMNS}
+    };
+    return tables;
+}
+
+static QByteArray generateRandomSalt(int length = 16) {
+    QByteArray salt;
+    salt.resize(length);
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(salt.data()), length) != 1) {
+        qWarning() << "Failed to generate random salt!";
+        salt.fill(0);
+    }
+    return salt;
+}
+
+VaultRekeyer::VaultRekeyer(int userId, const QByteArray &currentKey, QObject *parent)
+    : QObject(parent), userId(userId), currentKey(currentKey), targetEpoch(-1) {
+}
+
+bool VaultRekeyer::hasPendingJob(const int userId) {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare("SELECT COUNT(*) FROM pending_rekeys WHERE user_id = ?");
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "pending_rekeys.count") || !query.next()) {
+        qDebug() << "Pending Rekey Error:" << query.lastError().text();
+        return false;
+    }
+    return query.value(0).toInt() > 0;
+}
+
+bool VaultRekeyer::begin(const QByteArray &keyEncryptionKey) {
+    if (keyEncryptionKey.isEmpty() || currentKey.isEmpty()) {
+        return false;
+    }
+    if (hasPendingJob(userId)) {
+        qWarning() << "A vault key rotation is already in progress!";
+        return false;
+    }
+
+    QSqlDatabase db = DBManager::instance().getDatabase(); {
+        QSqlQuery epochQuery(db);
+        epochQuery.prepare("SELECT key_epoch FROM users WHERE id = ?");
+        epochQuery.addBindValue(userId);
+        if (!DBManager::instance().exec(epochQuery, "users.select_epoch") || !epochQuery.next()) {
+            qDebug() << "Rekey Epoch Error:" << epochQuery.lastError().text();
+            return false;
+        }
+        targetEpoch = epochQuery.value(0).toInt() + 1;
+    }
+
+    targetKey.resize(VAULT_KEY_SIZE);
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(targetKey.data()), VAULT_KEY_SIZE) != 1) {
+        qWarning() << "Failed to generate vault key!";
+        targetKey.clear();
+        return false;
+    }
+    const QByteArray wrappedKey = Encryption::wrapKey(targetKey, currentKey);
+    const QByteArray userWrappedKey = Encryption::wrapKey(targetKey, keyEncryptionKey);
+    if (wrappedKey.isEmpty() || userWrappedKey.isEmpty()) {
+        return false;
+    }
+
+    QSqlQuery query(db);
+    query.prepare(R"(
+        INSERT INTO pending_rekeys (
+            user_id,
+            target_epoch,
+            wrapped_key,
+            user_wrapped_key
+        ) VALUES (?, ?, ?, ?)
+    )");
+    query.addBindValue(userId);
+    query.addBindValue(targetEpoch);
+    query.addBindValue(wrappedKey);
+    query.addBindValue(userWrappedKey);
+
+    if (!DBManager::instance().exec(query, "pending_rekeys.insert")) {
+        qDebug() << "Begin Rekey Error:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool VaultRekeyer::resume() {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare("SELECT target_epoch, wrapped_key FROM pending_rekeys WHERE user_id = ?");
+    query.addBindValue(userId);
+
+    if (!DBManager::instance().exec(query, "pending_rekeys.select") || !query.next()) {
+        qDebug() << "Resume Rekey Error:" << query.lastError().text();
+        return false;
+    }
+
+    targetEpoch = query.value(0).toInt();
+    targetKey = Encryption::unwrapKey(query.value(1).toByteArray(), currentKey);
+
+    if (targetKey.isEmpty()) {
+        qWarning() << "Failed to unwrap the pending vault key!";
+        return false;
+    }
+    return true;
+}
+
+bool VaultRekeyer::run() {
+    if (targetKey.isEmpty() || targetEpoch < 0) {
+        return false;
+    }
+
+    int total = 0;
+    for (const auto &table: encryptedTables()) {
+        total += countRemaining(table.first);
+    }
+    int processed = 0;
+    emit progress(processed, total);
+
+    for (const auto &table: encryptedTables()) {
+        if (!rekeyTable(table.first, table.second, processed, total)) {
+            return false;
+        }
+    }
+    return commit();
+}
+
+int VaultRekeyer::countRemaining(const QString &table) const {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+    query.prepare(QString("SELECT COUNT(*) FROM %1 WHERE user_id = ? AND key_epoch < ?").arg(table));
+    query.addBindValue(userId);
+    query.addBindValue(targetEpoch);
+
+    if (!DBManager::instance().exec(query, "rekey.count_remaining") || !query.next()) {
+        qDebug() << "Rekey Count Error:" << query.lastError().text();
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+bool VaultRekeyer::rekeyTable(const QString &table, const QStringList &columns, int &processed, const int total) {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+
+    const Encryption oldEncryption(currentKey);
+    const Encryption newEncryption(targetKey);
+    // Rows are mapped in groups as wide as the key derivation kernel, so each
+    // worker derives a group's old and new row keys in one batch.
+    const auto reencrypt = [&oldEncryption, &newEncryption](const QList<Row> &group) {
+        QList<QByteArray> oldSalts;
+        QList<int> oldSchedules;
+        QList<QByteArray> newSalts;
+        QList<int> newSchedules;
+        for (const Row &row: group) {
+            oldSalts.append(row.salt);
+            oldSchedules.append(row.keySchedule);
+            newSalts.append(generateRandomSalt(16));
+            newSchedules.append(Encryption::CurrentKeySchedule);
+        }
+        const QList<QByteArray> oldKeys = oldEncryption.deriveEntryKeys(oldSalts, oldSchedules);
+        const QList<QByteArray> newKeys = newEncryption.deriveEntryKeys(newSalts, newSchedules);
+
+        QList<Row> out;
+        out.reserve(group.size());
+        for (int r = 0; r < group.size(); ++r) {
+            const Row &row = group.at(r);
+            Row rewritten{row.id, newSalts.at(r), Encryption::CurrentKeySchedule, QList<QByteArray>(), true};
+            // Tagged fields that fail their check under the current key come
+            // back empty, which fails the row and aborts the rotation before
+            // anything is rewritten. Only fields written before tags existed
+            // still rely on the padding check; the rotation tags them.
+            const QList<QByteArray> plaintexts = Encryption::decryptBytesWithKey(row.fields, oldKeys.at(r));
+            for (int i = 0; i < row.fields.size(); ++i) {
+                if (!row.fields.at(i).isEmpty() && plaintexts.at(i).isEmpty()) {
+                    rewritten.ok = false;
+                }
+            }
+            if (rewritten.ok) {
+                rewritten.fields = Encryption::encryptBytesWithKey(plaintexts, newKeys.at(r));
+            }
+            out.append(rewritten);
+        }
+        return out;
+    };
+    const int groupSize = Pbkdf2Batch::laneCount(Pbkdf2Batch::batchKernel());
+
+    QStringList assignments;
+    for (const QString &column: columns) {
+        assignments.append(column + " = ?");
+    }
+    const QString selectSql = QString("SELECT id, salt, key_schedule, %1 FROM %2 WHERE user_id = ? AND key_epoch < ? "
+                                      "ORDER BY id LIMIT %3")
+            .arg(columns.join(", "), table).arg(REKEY_BATCH_SIZE);
+    const QString updateSql = QString("UPDATE %1 SET salt = ?, key_schedule = ?, %2, key_epoch = ? "
+                                      "WHERE id = ? AND user_id = ?")
+            .arg(table, assignments.join(", "));
+
+    while (true) {
+        QList<Row> batch; {
+            QSqlQuery select(db);
+            select.prepare(selectSql);
+            select.addBindValue(userId);
+            select.addBindValue(targetEpoch);
+            if (!DBManager::instance().exec(select, "rekey.select_batch")) {
+                qDebug() << "Rekey Fetch Error:" << select.lastError().text();
+                return false;
+            }
+            while (select.next()) {
+                Row row{select.value(0).toInt(), select.value(1).toByteArray(), select.value(2).toInt(),
+                        QList<QByteArray>(), true};
+                for (int i = 0; i < columns.size(); ++i) {
+                    row.fields.append(select.value(3 + i).toByteArray());
+                }
+                batch.append(row);
+            }
+        }
+        if (batch.isEmpty()) {
+            return true;
+        }
+
+        QList<QList<Row> > groups;
+        for (int first = 0; first < batch.size(); first += groupSize) {
+            groups.append(batch.mid(first, groupSize));
+        }
+        QList<Row> rewritten;
+        rewritten.reserve(batch.size());
+        for (const QList<Row> &group: QtConcurrent::blockingMapped<QList<QList<Row> > >(groups, reencrypt)) {
+            rewritten.append(group);
+        }
+
+        QVariantList salts;
+        QVariantList schedules;
+        QList<QVariantList> fieldValues;
+        fieldValues.reserve(columns.size());
+        for (int i = 0; i < columns.size(); ++i) {
+            fieldValues.append(QVariantList());
+        }
+        QVariantList epochs;
+        QVariantList ids;
+        QVariantList userIds;
+        for (const Row &row: rewritten) {
+            if (!row.ok) {
+                qWarning() << "Failed to decrypt" << table << "row" << row.id << "with the current vault key!";
+                return false;
+            }
+            salts.append(row.salt);
+            schedules.append(row.keySchedule);
+            for (int i = 0; i < columns.size(); ++i) {
+                fieldValues[i].append(row.fields.at(i));
+            }
+            epochs.append(targetEpoch);
+            ids.append(row.id);
+            userIds.append(userId);
+        }
+
+        if (!db.transaction()) {
+            qDebug() << "Rekey Transaction Error:" << db.lastError().text();
+            return false;
+        }
+        QSqlQuery update(db);
+        update.prepare(updateSql);
+        update.addBindValue(salts);
+        update.addBindValue(schedules);
+        for (const QVariantList &values: fieldValues) {
+            update.addBindValue(values);
+        }
+        update.addBindValue(epochs);
+        update.addBindValue(ids);
+        update.addBindValue(userIds);
+
+        if (!DBManager::instance().execBatch(update, "rekey.update_batch") || !db.commit()) {
+            qDebug() << "Rekey Update Error:" << update.lastError().text();
+            db.rollback();
+            return false;
+        }
+
+        processed += rewritten.size();
+        emit progress(processed, total);
+    }
+}
+
+bool VaultRekeyer::commit() {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    if (!db.transaction()) {
+        qDebug() << "Rekey Transaction Error:" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery update(db);
+    update.prepare(R"(
+        UPDATE users
+        SET
+            wrapped_key = (SELECT user_wrapped_key FROM pending_rekeys WHERE user_id = ?),
+            key_epoch = ?
+        WHERE id = ?
+    )");
+    update.addBindValue(userId);
+    update.addBindValue(targetEpoch);
+    update.addBindValue(userId);
+
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM pending_rekeys WHERE user_id = ?");
+    remove.addBindValue(userId);
+
+    // Fingerprints are keyed by the vault key; the password audit recomputes
+    // them under the new one.
+    QSqlQuery fingerprints(db);
+    fingerprints.prepare("UPDATE passwords SET password_fingerprint = NULL WHERE user_id = ?");
+    fingerprints.addBindValue(userId);
+
+    if (!DBManager::instance().exec(update, "users.commit_rekey") || !DBManager::instance().exec(remove, "pending_rekeys.delete")
+        || !DBManager::instance().exec(fingerprints, "passwords.clear_fingerprints") || !db.commit()) {
+        qDebug() << "Rekey Commit Error:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+QByteArray VaultRekeyer::getTargetKey() const {
+    return targetKey;
+}
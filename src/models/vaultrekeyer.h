@@ -0,0 +1,53 @@
+#ifndef VAULTREKEYER_H
+#define VAULTREKEYER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QStringList>
+#include <QPair>
+
+class VaultRekeyer final : public QObject {
+    Q_OBJECT
+
+public:
+    VaultRekeyer(int userId, const QByteArray &currentKey, QObject *parent = nullptr);
+
+    static bool hasPendingJob(int userId);
+
+    // Every table whose rows are encrypted under the vault key, with its
+    // encrypted columns. Each has id, user_id, salt, key_schedule and key_epoch.
+    static const QList<QPair<QString, QStringList> > &encryptedTables();
+
+    bool begin(const QByteArray &keyEncryptionKey);
+
+    bool resume();
+
+    bool run();
+
+    QByteArray getTargetKey() const;
+
+signals:
+    void progress(int processed, int total);
+
+private:
+    struct Row {
+        int id;
+        QByteArray salt;
+        int keySchedule;
+        QList<QByteArray> fields;
+        bool ok;
+    };
+
+    int countRemaining(const QString &table) const;
+
+    bool rekeyTable(const QString &table, const QStringList &columns, int &processed, int total);
+
+    bool commit();
+
+    int userId;
+    QByteArray currentKey;
+    QByteArray targetKey;
+    int targetEpoch;
+};
+
+#endif // VAULTREKEYER_H
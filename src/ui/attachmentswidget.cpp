@@ -0,0 +1,206 @@
+#include "attachmentswidget.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QPushButton>
+#include <QProgressBar>
+#include <QLabel>
+#include <QMessageBox>
+#include <QFileDialog>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QLocale>
+#include <QFileInfo>
+
+#include "core/trace.h"
+
+static const int PROGRESS_STEPS = 1000;
+
+AttachmentsWidget::AttachmentsWidget(QWidget *parent)
+    : QWidget(parent)
+      , attachmentManager(nullptr)
+      , ownerType(AttachmentManager::PasswordOwner)
+      , ownerId(-1)
+      , transferWatcher(nullptr)
+      , transferOwnerType(AttachmentManager::PasswordOwner)
+      , transferOwnerId(-1) {
+    setupUI();
+
+    transferWatcher = new QFutureWatcher<bool>(this);
+    connect(transferWatcher, &QFutureWatcher<bool>::finished, this, &AttachmentsWidget::onTransferFinished);
+}
+
+AttachmentsWidget::~AttachmentsWidget() {
+    transferWatcher->waitForFinished();
+    delete attachmentManager;
+}
+
+void AttachmentsWidget::setupUI() {
+    const auto mainLayout = new QVBoxLayout(this);
+    mainLayout->setContentsMargins(0, 0, 0, 0);
+
+    mainLayout->addWidget(new QLabel("Attachments:", this));
+
+    attachmentList = new QListWidget(this);
+    attachmentList->setMaximumHeight(120);
+    mainLayout->addWidget(attachmentList);
+
+    attachButton = new QPushButton("Attach...", this);
+    saveButton = new QPushButton("Save As...", this);
+    removeButton = new QPushButton("Remove", this); {
+        const auto row = new QHBoxLayout();
+        row->addWidget(attachButton);
+        row->addWidget(saveButton);
+        row->addWidget(removeButton);
+        mainLayout->addLayout(row);
+    }
+
+    progressBar = new QProgressBar(this);
+    progressBar->setRange(0, PROGRESS_STEPS);
+    progressBar->hide();
+    mainLayout->addWidget(progressBar);
+
+    statusLabel = new QLabel(this);
+    statusLabel->setStyleSheet("color: #AAAAAA;");
+    mainLayout->addWidget(statusLabel);
+
+    connect(attachButton, &QPushButton::clicked, this, &AttachmentsWidget::onAttachClicked);
+    connect(saveButton, &QPushButton::clicked, this, &AttachmentsWidget::onSaveClicked);
+    connect(removeButton, &QPushButton::clicked, this, &AttachmentsWidget::onRemoveClicked);
+    connect(attachmentList, &QListWidget::currentRowChanged, this, &AttachmentsWidget::updateButtons);
+
+    setLayout(mainLayout);
+    updateButtons();
+}
+
+// A transfer already running keeps the copy it started with.
+void AttachmentsWidget::setAttachmentManager(const AttachmentManager &manager) {
+    delete attachmentManager;
+    attachmentManager = new AttachmentManager(manager);
+    ownerId = -1;
+    loadAttachments();
+}
+
+void AttachmentsWidget::setOwner(const AttachmentManager::OwnerType type, const int id) {
+    if (type == ownerType && id == ownerId) {
+        return;
+    }
+    ownerType = type;
+    ownerId = id;
+    loadAttachments();
+}
+
+void AttachmentsWidget::loadAttachments() {
+    ENIGMA_TRACE_SCOPE("ui", "AttachmentsWidget::loadAttachments");
+    attachmentList->clear();
+    cachedAttachments.clear();
+    if (attachmentManager && ownerId >= 0) {
+        cachedAttachments = attachmentManager->getAttachments(ownerType, ownerId);
+    }
+
+    const QLocale locale;
+    for (const AttachmentEntry &attachment: cachedAttachments) {
+        attachmentList->addItem(QString("%1 (%2)").arg(attachment.name, locale.formattedDataSize(attachment.size)));
+    }
+    if (!transferWatcher || !transferWatcher->isRunning()) {
+        statusLabel->setText(ownerId < 0 ? "Save the entry to attach files." : QString());
+    }
+    updateButtons();
+}
+
+void AttachmentsWidget::updateButtons() const {
+    const bool idle = !transferWatcher || !transferWatcher->isRunning();
+    const bool selected = attachmentList->currentRow() >= 0;
+    attachButton->setEnabled(idle && attachmentManager && ownerId >= 0);
+    saveButton->setEnabled(idle && selected);
+    removeButton->setEnabled(idle && selected);
+}
+
+// Progress arrives on the worker thread and is forwarded through the event
+// loop. The destructor waits for the transfer, so the widget outlives it.
+void AttachmentsWidget::startTransfer(const QString &status,
+                                      const std::function<bool(const AttachmentManager::Progress &)> &job) {
+    transferOwnerType = ownerType;
+    transferOwnerId = ownerId;
+    progressBar->setValue(0);
+    progressBar->show();
+    statusLabel->setText(status);
+
+    const AttachmentManager::Progress progress = [this](const qint64 done, const qint64 total) {
+        QMetaObject::invokeMethod(this, "onTransferProgress", Qt::QueuedConnection,
+                                  Q_ARG(qint64, done), Q_ARG(qint64, total));
+    };
+    transferWatcher->setFuture(QtConcurrent::run([job, progress] { return job(progress); }));
+    updateButtons();
+}
+
+void AttachmentsWidget::onTransferProgress(const qint64 done, const qint64 total) const {
+    progressBar->setValue(total > 0 ? static_cast<int>(done * PROGRESS_STEPS / total) : PROGRESS_STEPS);
+}
+
+void AttachmentsWidget::onTransferFinished() {
+    progressBar->hide();
+    statusLabel->clear();
+    if (!transferWatcher->result()) {
+        QMessageBox::warning(this, "Attachments", transferError);
+    }
+    if (transferOwnerType == ownerType && transferOwnerId == ownerId) {
+        loadAttachments();
+    }
+    updateButtons();
+}
+
+void AttachmentsWidget::onAttachClicked() {
+    if (!attachmentManager || ownerId < 0) {
+        return;
+    }
+    const QString path = QFileDialog::getOpenFileName(this, "Attach File");
+    if (path.isEmpty()) {
+        return;
+    }
+
+    const AttachmentManager manager = *attachmentManager;
+    const AttachmentManager::OwnerType type = ownerType;
+    const int id = ownerId;
+    transferError = "Failed to attach the file.";
+    startTransfer(QString("Encrypting %1...").arg(QFileInfo(path).fileName()),
+                  [manager, type, id, path](const AttachmentManager::Progress &progress) {
+                      return manager.addAttachment(type, id, path, progress);
+                  });
+}
+
+void AttachmentsWidget::onSaveClicked() {
+    const int row = attachmentList->currentRow();
+    if (!attachmentManager || row < 0 || row >= cachedAttachments.size()) {
+        return;
+    }
+    const AttachmentEntry attachment = cachedAttachments.at(row);
+    const QString path = QFileDialog::getSaveFileName(this, "Save Attachment", attachment.name);
+    if (path.isEmpty()) {
+        return;
+    }
+
+    const AttachmentManager manager = *attachmentManager;
+    transferError = "Failed to save the attachment.";
+    startTransfer(QString("Decrypting %1...").arg(attachment.name),
+                  [manager, attachment, path](const AttachmentManager::Progress &progress) {
+                      return manager.saveAttachment(attachment.id, path, progress);
+                  });
+}
+
+void AttachmentsWidget::onRemoveClicked() {
+    const int row = attachmentList->currentRow();
+    if (!attachmentManager || row < 0 || row >= cachedAttachments.size()) {
+        return;
+    }
+    const AttachmentEntry attachment = cachedAttachments.at(row);
+    const auto reply = QMessageBox::question(this, "Confirm Remove",
+                                             QString("Remove the attachment %1?").arg(attachment.name));
+    if (reply != QMessageBox::Yes) {
+        return;
+    }
+    if (!attachmentManager->deleteAttachment(attachment.id)) {
+        QMessageBox::warning(this, "Error", "Failed to remove the attachment.");
+    }
+    loadAttachments();
+}
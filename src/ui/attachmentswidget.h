@@ -0,0 +1,71 @@
+#ifndef ATTACHMENTSWIDGET_H
+#define ATTACHMENTSWIDGET_H
+
+#include <QWidget>
+#include <QList>
+
+#include "models/attachmentmanager.h"
+
+class QListWidget;
+class QPushButton;
+class QProgressBar;
+class QLabel;
+
+template<typename T>
+class QFutureWatcher;
+
+// Lists the files attached to one password entry or note. Uploads and
+// downloads run on a worker thread against a copy of the attachment manager,
+// so the entry can be left, or the vault reopened, while a transfer runs.
+class AttachmentsWidget final : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit AttachmentsWidget(QWidget *parent = nullptr);
+
+    ~AttachmentsWidget() override;
+
+    void setAttachmentManager(const AttachmentManager &manager);
+
+    void setOwner(AttachmentManager::OwnerType type, int id);
+
+private slots:
+    void onAttachClicked();
+
+    void onSaveClicked();
+
+    void onRemoveClicked();
+
+    void onTransferFinished();
+
+    void onTransferProgress(qint64 done, qint64 total) const;
+
+private:
+    void setupUI();
+
+    void loadAttachments();
+
+    void updateButtons() const;
+
+    void startTransfer(const QString &status, const std::function<bool(const AttachmentManager::Progress &)> &job);
+
+    QListWidget *attachmentList;
+    QPushButton *attachButton;
+    QPushButton *saveButton;
+    QPushButton *removeButton;
+    QProgressBar *progressBar;
+    QLabel *statusLabel;
+
+    AttachmentManager *attachmentManager;
+    AttachmentManager::OwnerType ownerType;
+    int ownerId;
+
+    QFutureWatcher<bool> *transferWatcher;
+    QString transferError;
+    AttachmentManager::OwnerType transferOwnerType;
+    int transferOwnerId;
+
+    QList<AttachmentEntry> cachedAttachments;
+};
+
+#endif // ATTACHMENTSWIDGET_H
@@ -0,0 +1,55 @@
+#include "diagnosticsdialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QApplication>
+#include <QClipboard>
+#include <QFontDatabase>
+
+#include "core/metrics.h"
+
+DiagnosticsDialog::DiagnosticsDialog(QWidget *parent)
+    : QDialog(parent) {
+    setupUI();
+    refresh();
+}
+
+void DiagnosticsDialog::setupUI() {
+    setWindowTitle("Diagnostics");
+    resize(640, 480);
+
+    const auto mainLayout = new QVBoxLayout(this);
+
+    metricsEdit = new QPlainTextEdit(this);
+    metricsEdit->setReadOnly(true);
+    metricsEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    mainLayout->addWidget(metricsEdit);
+
+    const auto buttonLayout = new QHBoxLayout();
+    refreshButton = new QPushButton("Refresh", this);
+    copyJsonButton = new QPushButton("Copy JSON", this);
+    resetButton = new QPushButton("Reset", this);
+    buttonLayout->addWidget(refreshButton);
+    buttonLayout->addWidget(copyJsonButton);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(resetButton);
+    mainLayout->addLayout(buttonLayout);
+
+    connect(refreshButton, &QPushButton::clicked, this, &DiagnosticsDialog::refresh);
+    connect(copyJsonButton, &QPushButton::clicked, this, &DiagnosticsDialog::copyJson);
+    connect(resetButton, &QPushButton::clicked, this, &DiagnosticsDialog::resetMetrics);
+}
+
+void DiagnosticsDialog::refresh() const {
+    metricsEdit->setPlainText(Metrics::toText());
+}
+
+void DiagnosticsDialog::copyJson() const {
+    QApplication::clipboard()->setText(QString::fromUtf8(Metrics::toJson()));
+}
+
+void DiagnosticsDialog::resetMetrics() const {
+    Metrics::reset();
+    refresh();
+}
@@ -0,0 +1,31 @@
+#ifndef DIAGNOSTICSDIALOG_H
+#define DIAGNOSTICSDIALOG_H
+
+#include <QDialog>
+
+class QPlainTextEdit;
+class QPushButton;
+
+class DiagnosticsDialog final : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDialog(QWidget *parent = nullptr);
+
+private slots:
+    void refresh() const;
+
+    void copyJson() const;
+
+    void resetMetrics() const;
+
+private:
+    void setupUI();
+
+    QPlainTextEdit *metricsEdit;
+    QPushButton *refreshButton;
+    QPushButton *copyJsonButton;
+    QPushButton *resetButton;
+};
+
+#endif // DIAGNOSTICSDIALOG_H
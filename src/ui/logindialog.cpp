@@ -4,18 +4,24 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QMessageBox>
+#include <QFutureWatcher>
 
 #include "models/user.h"
+#include "models/loginpipeline.h"
 
 LoginDialog::LoginDialog(QWidget *parent)
     : QDialog(parent)
-      , loggedInUser(nullptr) {
+      , loggedInUser(nullptr)
+      , loginPipeline(new LoginPipeline)
+      , verificationWatcher(new QFutureWatcher<bool>(this)) {
     setupUI();
     setModal(true);
     setWindowTitle("Login / Register");
 }
 
 LoginDialog::~LoginDialog() {
+    verificationWatcher->waitForFinished();
+    delete loginPipeline;
 }
 
 void LoginDialog::setupUI() {
@@ -71,10 +77,16 @@ void LoginDialog::setupUI() {
     buttonLayout->addWidget(registerButton);
     mainLayout->addLayout(buttonLayout);
 
+    connect(usernameEdit, &QLineEdit::editingFinished, this, &LoginDialog::onUsernameEditingFinished);
+    connect(verificationWatcher, &QFutureWatcher<bool>::finished, this, &LoginDialog::onVerificationFinished);
     connect(loginButton, &QPushButton::clicked, this, &LoginDialog::onLoginClicked);
     connect(registerButton, &QPushButton::clicked, this, &LoginDialog::onRegisterClicked);
 }
 
+void LoginDialog::onUsernameEditingFinished() const {
+    loginPipeline->prefetchUser(usernameEdit->text().trimmed());
+}
+
 void LoginDialog::onLoginClicked() {
     const QString username = usernameEdit->text().trimmed();
     const QString password = passwordEdit->text();
@@ -84,9 +96,22 @@ void LoginDialog::onLoginClicked() {
         return;
     }
 
-    if (User *user = User::login(username, password)) {
+    loginButton->setEnabled(false);
+    registerButton->setEnabled(false);
+    messageLabel->setText("Unlocking vault...");
+
+    loginPipeline->start(username, password);
+    verificationWatcher->setFuture(loginPipeline->verification());
+}
+
+void LoginDialog::onVerificationFinished() {
+    loginPipeline->markUnlocked();
+    loginButton->setEnabled(true);
+    registerButton->setEnabled(true);
+    messageLabel->setText("Enter your username and password.");
+
+    if (User *user = loginPipeline->takeUser()) {
         loggedInUser = user;
-        loggedInPassword = password;
         QMessageBox::information(this, "Success", "Logged in successfully.");
         accept();
     } else {
@@ -114,6 +139,6 @@ User *LoginDialog::getLoggedInUser() const {
     return loggedInUser;
 }
 
-QString LoginDialog::getLoggedInPassword() const {
-    return loggedInPassword;
+LoginPipeline &LoginDialog::getLoginPipeline() const {
+    return *loginPipeline;
 }
@@ -7,6 +7,10 @@ class QLineEdit;
 class QPushButton;
 class QLabel;
 class User;
+class LoginPipeline;
+
+template<typename T>
+class QFutureWatcher;
 
 class LoginDialog : public QDialog {
     Q_OBJECT
@@ -18,11 +22,15 @@ public:
 
     User *getLoggedInUser() const;
 
-    QString getLoggedInPassword() const;
+    LoginPipeline &getLoginPipeline() const;
 
 private slots:
+    void onUsernameEditingFinished() const;
+
     void onLoginClicked();
 
+    void onVerificationFinished();
+
     void onRegisterClicked();
 
 private:
@@ -35,7 +43,8 @@ private:
     QLabel *messageLabel;
 
     User *loggedInUser;
-    QString loggedInPassword;
+    LoginPipeline *loginPipeline;
+    QFutureWatcher<bool> *verificationWatcher;
 };
 
 #endif // LOGINDIALOG_H
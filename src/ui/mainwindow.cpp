@@ -2,25 +2,48 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QStackedWidget>
+#include <QMenuBar>
+#include <QLineEdit>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QFileDialog>
+#include <QShortcut>
+#include <QFutureWatcher>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <memory>
 
 #include "models/user.h"
 #include "core/encryption.h"
 #include "models/passwordmanager.h"
 #include "models/notemanager.h"
+#include "models/attachmentmanager.h"
+#include "models/loginpipeline.h"
+#include "models/vaultrekeyer.h"
+#include "models/keyschedulemigrator.h"
+#include "core/trace.h"
+#include "core/metrics.h"
 #include "ui/passwordmanagerwidget.h"
 #include "ui/passwordgeneratorwidget.h"
 #include "ui/notepadwidget.h"
+#include "ui/diagnosticsdialog.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
       , currentUser(nullptr)
       , encryption(nullptr)
       , passwordManager(nullptr)
-      , noteManager(nullptr) {
+      , noteManager(nullptr)
+      , keyScheduleMigrator(nullptr) {
     setupUI();
 }
 
 MainWindow::~MainWindow() {
+    // The note editor may still have an autosave pending against noteManager.
+    notepadWidget->flushAutosave();
+    stopKeyScheduleMigration();
     delete currentUser;
     delete encryption;
     delete passwordManager;
@@ -74,6 +97,23 @@ void MainWindow::setupUI() {
         }
     )");
 
+    const auto vaultMenu = menuBar()->addMenu("Vault");
+    const auto changePasswordAction = vaultMenu->addAction("Change Master Password...");
+    connect(changePasswordAction, &QAction::triggered, this, &MainWindow::changeMasterPassword);
+    const auto rotateKeyAction = vaultMenu->addAction("Rotate Vault Key...");
+    connect(rotateKeyAction, &QAction::triggered, this, &MainWindow::rotateVaultKey);
+
+    const auto diagnosticsMenu = menuBar()->addMenu("Diagnostics");
+    const auto recordTraceAction = diagnosticsMenu->addAction("Record Trace");
+    recordTraceAction->setCheckable(true);
+    recordTraceAction->setChecked(Trace::isEnabled());
+    connect(recordTraceAction, &QAction::toggled, this, &MainWindow::setTraceRecording);
+    const auto exportTraceAction = diagnosticsMenu->addAction("Export Trace...");
+    connect(exportTraceAction, &QAction::triggered, this, &MainWindow::exportTrace);
+
+    const auto diagnosticsShortcut = new QShortcut(QKeySequence("Ctrl+Shift+D"), this);
+    connect(diagnosticsShortcut, &QShortcut::activated, this, &MainWindow::showDiagnostics);
+
     centralWidget = new QWidget(this);
     setCentralWidget(centralWidget);
 
@@ -120,31 +160,236 @@ void MainWindow::setupUI() {
     connect(notepadButton, &QPushButton::clicked, this, &MainWindow::switchFeature);
 }
 
-void MainWindow::setCurrentUser(User *user, const QString &password) {
+void MainWindow::setCurrentUser(User *user, const LoginPipeline &pipeline) {
+    ENIGMA_TRACE_SCOPE("ui", "MainWindow::setCurrentUser");
     delete currentUser;
-    delete encryption;
-    delete passwordManager;
-    delete noteManager;
 
     currentUser = user;
     if (!currentUser) {
         return;
     }
 
-    QByteArray userSalt = currentUser->getSalt();
+    // Login latency runs from the login click to an open, populated vault;
+    // the time the success message sits on screen is left out.
+    QElapsedTimer opening;
+    opening.start();
+    openVault(pipeline.vaultKey());
+
+    if (VaultRekeyer::hasPendingJob(currentUser->getId())) {
+        Metrics::recordLatency(Metrics::LoginLatency, pipeline.unlockNanoseconds() + opening.nsecsElapsed());
+        resumePendingRekey();
+        return;
+    }
+
+    passwordManagerWidget->showPasswords(pipeline.passwords());
+    notepadWidget->showNotes(pipeline.notes());
+    Metrics::recordLatency(Metrics::LoginLatency, pipeline.unlockNanoseconds() + opening.nsecsElapsed());
+    startKeyScheduleMigration();
+}
 
-    QByteArray baseKey = Encryption::deriveKeyFromPassword(password, userSalt);
+void MainWindow::openVault(const QByteArray &key) {
+    ENIGMA_TRACE_SCOPE("ui", "MainWindow::openVault");
+    notepadWidget->flushAutosave();
+    stopKeyScheduleMigration();
+    delete encryption;
+    delete passwordManager;
+    delete noteManager;
 
-    encryption = new Encryption(baseKey);
+    vaultKey = key;
+    encryption = new Encryption(vaultKey);
 
     passwordManager = new PasswordManager(currentUser->getId(), encryption);
     noteManager = new NoteManager(currentUser->getId(), encryption);
 
     passwordManagerWidget->setPasswordManager(passwordManager);
-    passwordManagerWidget->loadPasswords();
-
     notepadWidget->setNoteManager(noteManager);
+
+    const AttachmentManager attachmentManager(currentUser->getId(), *encryption);
+    passwordManagerWidget->setAttachmentManager(attachmentManager);
+    notepadWidget->setAttachmentManager(attachmentManager);
+}
+
+// Keeps the GUI responsive while the job runs. Unless the caller already shows
+// a modal progress dialog, a window-modal busy dialog blocks the menus, so a
+// second credential change or rotation cannot start underneath this one.
+bool MainWindow::runInBackground(const std::function<bool()> &job, const QString &label) {
+    std::unique_ptr<QProgressDialog> busyDialog;
+    if (!label.isEmpty()) {
+        busyDialog = std::make_unique<QProgressDialog>(label, QString(), 0, 0, this);
+        busyDialog->setWindowModality(Qt::WindowModal);
+        busyDialog->setMinimumDuration(0);
+        busyDialog->setValue(0);
+    }
+
+    QFutureWatcher<bool> watcher;
+    QEventLoop loop;
+    connect(&watcher, &QFutureWatcher<bool>::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(QtConcurrent::run(job));
+    loop.exec();
+    return watcher.result();
+}
+
+bool MainWindow::runRekey(VaultRekeyer &rekeyer) {
+    notepadWidget->flushAutosave();
+    stopKeyScheduleMigration();
+    QProgressDialog progressDialog("Re-encrypting vault...", QString(), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    connect(&rekeyer, &VaultRekeyer::progress, &progressDialog, [&progressDialog](const int processed, const int total) {
+        progressDialog.setMaximum(total);
+        progressDialog.setValue(processed);
+    });
+
+    if (!runInBackground([&rekeyer] { return rekeyer.run(); })) {
+        return false;
+    }
+
+    openVault(rekeyer.getTargetKey());
+    passwordManagerWidget->loadPasswords();
     notepadWidget->loadNotes();
+    return true;
+}
+
+// Rows still on the old PBKDF2 key schedule decrypt fine but slowly, so they
+// are moved to the current schedule in the background while the vault is open.
+// The migrator holds its own copy of the vault key and is stopped before the
+// key changes or a rotation starts.
+void MainWindow::startKeyScheduleMigration() {
+    stopKeyScheduleMigration();
+    if (!currentUser || !KeyScheduleMigrator::hasPendingRows(currentUser->getId())) {
+        return;
+    }
+    keyScheduleMigrator = new KeyScheduleMigrator(currentUser->getId(), vaultKey);
+    KeyScheduleMigrator *migrator = keyScheduleMigrator;
+    keyScheduleMigration = QtConcurrent::run([migrator] { return migrator->run(); });
+}
+
+void MainWindow::stopKeyScheduleMigration() {
+    if (!keyScheduleMigrator) {
+        return;
+    }
+    keyScheduleMigrator->cancel();
+    keyScheduleMigration.waitForFinished();
+    delete keyScheduleMigrator;
+    keyScheduleMigrator = nullptr;
+}
+
+void MainWindow::resumePendingRekey() {
+    QMessageBox::information(this, "Vault Key",
+                             "A previous vault key rotation was interrupted. It will be completed now.");
+
+    VaultRekeyer rekeyer(currentUser->getId(), vaultKey);
+    if (!rekeyer.resume() || !runRekey(rekeyer)) {
+        QMessageBox::critical(this, "Error", "Failed to complete the vault key rotation.");
+        passwordManagerWidget->loadPasswords();
+        notepadWidget->loadNotes();
+        return;
+    }
+    QMessageBox::information(this, "Vault Key", "Vault key rotated successfully.");
+}
+
+void MainWindow::changeMasterPassword() {
+    if (!currentUser) {
+        return;
+    }
+    if (VaultRekeyer::hasPendingJob(currentUser->getId())) {
+        QMessageBox::warning(this, "Change Master Password",
+                             "A vault key rotation is still pending. Log in again to complete it first.");
+        return;
+    }
+
+    bool ok = false;
+    const QString currentPassword = QInputDialog::getText(this, "Change Master Password", "Current password:",
+                                                          QLineEdit::Password, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+    const QString newPassword = QInputDialog::getText(this, "Change Master Password", "New password:",
+                                                      QLineEdit::Password, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+    const QString confirmation = QInputDialog::getText(this, "Change Master Password", "Confirm new password:",
+                                                       QLineEdit::Password, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+    if (newPassword.isEmpty() || newPassword != confirmation) {
+        QMessageBox::warning(this, "Change Master Password", "The new passwords are empty or do not match.");
+        return;
+    }
+
+    const QString username = currentUser->getUsername();
+    UserRecord updated;
+    if (!runInBackground([username, currentPassword, newPassword, &updated] {
+        return User::changePassword(username, currentPassword, newPassword, &updated);
+    }, "Changing master password...")) {
+        QMessageBox::warning(this, "Change Master Password",
+                             "The current password is incorrect or the password could not be changed.");
+        return;
+    }
+    // The salt and KDF parameters changed with the password.
+    *currentUser = User(updated.id, updated.username, updated.salt, updated.kdfParams);
+    QMessageBox::information(this, "Master Password", "Master password changed successfully.");
+}
+
+void MainWindow::rotateVaultKey() {
+    if (!currentUser) {
+        return;
+    }
+
+    bool ok = false;
+    const QString password = QInputDialog::getText(this, "Rotate Vault Key",
+                                                   "Re-encrypts every entry under a new vault key.\n\nPassword:",
+                                                   QLineEdit::Password, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+
+    const QString username = currentUser->getUsername();
+    QByteArray keyEncryptionKey;
+    if (!runInBackground([username, password, &keyEncryptionKey] {
+        keyEncryptionKey = User::unlockKeyEncryptionKey(username, password);
+        return !keyEncryptionKey.isEmpty();
+    }, "Checking password...")) {
+        QMessageBox::warning(this, "Rotate Vault Key", "The password is incorrect.");
+        return;
+    }
+
+    VaultRekeyer rekeyer(currentUser->getId(), vaultKey);
+    if (!rekeyer.begin(keyEncryptionKey)) {
+        QMessageBox::critical(this, "Error", "Failed to start the vault key rotation.");
+        return;
+    }
+    if (!runRekey(rekeyer)) {
+        QMessageBox::critical(this, "Error",
+                              "The vault key rotation was interrupted. It will resume on your next login.");
+        return;
+    }
+    QMessageBox::information(this, "Vault Key", "Vault key rotated successfully.");
+}
+
+void MainWindow::setTraceRecording(const bool enabled) {
+    Trace::setEnabled(enabled);
+}
+
+void MainWindow::exportTrace() {
+    const QString path = QFileDialog::getSaveFileName(this, "Export Trace", "enigma-trace.json",
+                                                      "Chrome Trace (*.json)");
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!Trace::exportChromeTrace(path)) {
+        QMessageBox::critical(this, "Error", "Failed to export the trace.");
+        return;
+    }
+    QMessageBox::information(this, "Trace Exported",
+                             "Open the file in Perfetto (ui.perfetto.dev) or chrome://tracing.");
+}
+
+void MainWindow::showDiagnostics() {
+    DiagnosticsDialog dialog(this);
+    dialog.exec();
 }
 
 void MainWindow::switchFeature() const {
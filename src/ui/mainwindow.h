@@ -2,6 +2,8 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QFuture>
+#include <functional>
 
 class QPushButton;
 class QStackedWidget;
@@ -9,6 +11,9 @@ class User;
 class Encryption;
 class PasswordManager;
 class NoteManager;
+class LoginPipeline;
+class VaultRekeyer;
+class KeyScheduleMigrator;
 
 class PasswordManagerWidget;
 class PasswordGeneratorWidget;
@@ -22,18 +27,43 @@ public:
 
     ~MainWindow() override;
 
-    void setCurrentUser(User *user, const QString &password);
+    void setCurrentUser(User *user, const LoginPipeline &pipeline);
 
 private slots:
     void switchFeature() const;
 
+    void changeMasterPassword();
+
+    void rotateVaultKey();
+
+    void setTraceRecording(bool enabled);
+
+    void exportTrace();
+
+    void showDiagnostics();
+
 private:
     void setupUI();
 
+    void openVault(const QByteArray &key);
+
+    bool runInBackground(const std::function<bool()> &job, const QString &label = QString());
+
+    bool runRekey(VaultRekeyer &rekeyer);
+
+    void resumePendingRekey();
+
+    void startKeyScheduleMigration();
+
+    void stopKeyScheduleMigration();
+
     User *currentUser;
+    QByteArray vaultKey;
     Encryption *encryption;
     PasswordManager *passwordManager;
     NoteManager *noteManager;
+    KeyScheduleMigrator *keyScheduleMigrator;
+    QFuture<bool> keyScheduleMigration;
 
     QWidget *centralWidget;
     QWidget *sidebar;
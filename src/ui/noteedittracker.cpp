@@ -0,0 +1,160 @@
+#include "noteedittracker.h"
+
+void NoteEditTracker::reset() {
+    segments.clear();
+    savingChunks = 0;
+}
+
+void NoteEditTracker::appendChunks(const QList<int> &chunkChars) {
+    for (const int chars: chunkChars) {
+        segments.append({1, chars, false, false});
+    }
+}
+
+// True while the last chunks are still exactly what appendChunks(chunkChars)
+// put there, so the stored chunks match that text.
+bool NoteEditTracker::endsWithCleanChunks(const QList<int> &chunkChars) const {
+    const int first = segments.size() - chunkChars.size();
+    if (first < 0) {
+        return false;
+    }
+    for (int i = 0; i < chunkChars.size(); ++i) {
+        const Segment &segment = segments.at(first + i);
+        if (segment.chunks != 1 || segment.chars != chunkChars.at(i) || segment.dirty || segment.saving) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Drops the trailing segments covering exactly the last chars characters,
+// pending edits included, and returns how many chunks they held. Fails with -1
+// if that span does not start on a segment boundary or is being saved.
+int NoteEditTracker::removeTrailingChars(const int chars) {
+    int first = segments.size();
+    int covered = 0;
+    int chunks = 0;
+    while (covered < chars && first > 0) {
+        --first;
+        if (segments.at(first).saving) {
+            return -1;
+        }
+        covered += segments.at(first).chars;
+        chunks += segments.at(first).chunks;
+    }
+    if (covered != chars) {
+        return -1;
+    }
+    segments.erase(segments.begin() + first, segments.end());
+    return chunks;
+}
+
+// Insertions on a boundary go to the segment before it. Within a dirty
+// segment only the total length matters, since it is saved as one span.
+void NoteEditTracker::recordEdit(const int position, const int removed, const int added) {
+    if (segments.isEmpty()) {
+        segments.append({0, added, true, false});
+        return;
+    }
+
+    int start = 0;
+    int first = -1;
+    int last = segments.size() - 1;
+    for (int i = 0; i < segments.size(); ++i) {
+        const int end = start + segments.at(i).chars;
+        if (first < 0 && position <= end) {
+            first = i;
+        }
+        if (first >= 0 && position + removed <= end) {
+            last = i;
+            break;
+        }
+        start = end;
+    }
+    if (first < 0) {
+        first = last;
+    }
+
+    Segment merged{0, 0, true, false};
+    for (int i = first; i <= last; ++i) {
+        merged.chunks += segments.at(i).chunks;
+        merged.chars += segments.at(i).chars;
+        merged.saving = merged.saving || segments.at(i).saving;
+    }
+    merged.chars += added - removed;
+
+    segments.erase(segments.begin() + first, segments.begin() + last + 1);
+    segments.insert(first, merged);
+}
+
+bool NoteEditTracker::isDirty() const {
+    for (const Segment &segment: segments) {
+        if (segment.dirty) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Everything between the first and last dirty segment is saved as one span;
+// the chunks in between are rewritten only if their bytes really changed.
+NoteEditTracker::Region NoteEditTracker::beginSave() {
+    Region region;
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < segments.size(); ++i) {
+        if (segments.at(i).dirty) {
+            if (first < 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first < 0) {
+        return region;
+    }
+
+    Segment merged{0, 0, false, true};
+    for (int i = 0; i < segments.size(); ++i) {
+        if (i < first) {
+            region.firstChunk += segments.at(i).chunks;
+            region.position += segments.at(i).chars;
+        } else if (i <= last) {
+            merged.chunks += segments.at(i).chunks;
+            merged.chars += segments.at(i).chars;
+        }
+    }
+    region.chunkCount = merged.chunks;
+    region.length = merged.chars;
+    savingChunks = merged.chunks;
+
+    segments.erase(segments.begin() + first, segments.begin() + last + 1);
+    segments.insert(first, merged);
+    return region;
+}
+
+// Edits made while the save ran may have merged the saving segment into a
+// dirty one; it then keeps covering the replacement chunks and stays dirty.
+void NoteEditTracker::finishSave(const bool ok, const QList<int> &chunkChars) {
+    for (int i = 0; i < segments.size(); ++i) {
+        Segment &segment = segments[i];
+        if (!segment.saving) {
+            continue;
+        }
+        segment.saving = false;
+        if (!ok) {
+            segment.dirty = true;
+            return;
+        }
+        if (segment.dirty) {
+            segment.chunks += chunkChars.size() - savingChunks;
+            return;
+        }
+
+        segments.removeAt(i);
+        for (int j = 0; j < chunkChars.size(); ++j) {
+            segments.insert(i + j, {1, chunkChars.at(j), false, false});
+        }
+        return;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef NOTEEDITTRACKER_H
+#define NOTEEDITTRACKER_H
+
+#include <QList>
+
+// Maps edits in the loaded part of a chunked note back to the chunks they
+// touched. The document is covered by segments of whole chunks; an edit merges
+// the segments it overlaps into one dirty segment, so a save only needs the
+// text of the dirty span and never the whole document.
+class NoteEditTracker {
+public:
+    struct Region {
+        int firstChunk = 0;
+        int chunkCount = 0;
+        int position = 0;
+        int length = 0;
+    };
+
+    void reset();
+
+    void appendChunks(const QList<int> &chunkChars);
+
+    bool endsWithCleanChunks(const QList<int> &chunkChars) const;
+
+    int removeTrailingChars(int chars);
+
+    void recordEdit(int position, int removed, int added);
+
+    bool isDirty() const;
+
+    Region beginSave();
+
+    void finishSave(bool ok, const QList<int> &chunkChars);
+
+private:
+    struct Segment {
+        int chunks;
+        int chars;
+        bool dirty;
+        bool saving;
+    };
+
+    QList<Segment> segments;
+    int savingChunks = 0;
+};
+
+#endif // NOTEEDITTRACKER_H
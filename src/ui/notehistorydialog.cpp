@@ -0,0 +1,141 @@
+#include "notehistorydialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QLabel>
+#include <QMessageBox>
+#include <QDateTime>
+#include <QLocale>
+
+#include "core/trace.h"
+
+// Previews of chunked revisions decrypt only the first chunks, like the editor.
+static const qint64 PREVIEW_BYTES = 256 * 1024;
+
+NoteHistoryDialog::NoteHistoryDialog(const NoteManager *manager, const int noteId, QWidget *parent)
+    : QDialog(parent)
+      , noteManager(manager)
+      , noteId(noteId) {
+    setupUI();
+    loadRevisions();
+}
+
+void NoteHistoryDialog::setupUI() {
+    setWindowTitle("Note History");
+    resize(800, 520);
+
+    const auto mainLayout = new QHBoxLayout(this);
+
+    revisionList = new QListWidget(this);
+    mainLayout->addWidget(revisionList, 1);
+
+    const auto previewLayout = new QVBoxLayout();
+    titleLabel = new QLabel(this);
+    titleLabel->setWordWrap(true);
+    previewEdit = new QPlainTextEdit(this);
+    previewEdit->setReadOnly(true);
+    statusLabel = new QLabel(this);
+    statusLabel->setStyleSheet("color: #AAAAAA;");
+    statusLabel->hide();
+    previewLayout->addWidget(titleLabel);
+    previewLayout->addWidget(previewEdit, 1);
+    previewLayout->addWidget(statusLabel);
+
+    const auto buttonLayout = new QHBoxLayout();
+    restoreButton = new QPushButton("Restore This Version", this);
+    restoreButton->setEnabled(false);
+    closeButton = new QPushButton("Close", this);
+    buttonLayout->addWidget(restoreButton);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(closeButton);
+    previewLayout->addLayout(buttonLayout);
+
+    mainLayout->addLayout(previewLayout, 2);
+
+    connect(revisionList, &QListWidget::currentRowChanged, this, &NoteHistoryDialog::onRevisionSelected);
+    connect(restoreButton, &QPushButton::clicked, this, &NoteHistoryDialog::onRestoreClicked);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::reject);
+}
+
+// Listing reads only revision metadata; nothing is decrypted until one is picked.
+void NoteHistoryDialog::loadRevisions() {
+    revisions = noteManager->getRevisions(noteId);
+    const QLocale locale;
+    for (const NoteRevision &revision: revisions) {
+        revisionList->addItem(QString("Version %1 - %2 (%3)")
+            .arg(revision.number)
+            .arg(QDateTime::fromSecsSinceEpoch(revision.savedAt).toString("yyyy-MM-dd HH:mm"),
+                 locale.formattedDataSize(revision.storedSize)));
+    }
+
+    if (revisions.isEmpty()) {
+        titleLabel->setText("This note has no saved versions yet.");
+        return;
+    }
+    revisionList->setCurrentRow(0);
+}
+
+void NoteHistoryDialog::onRevisionSelected(const int row) {
+    ENIGMA_TRACE_SCOPE("ui", "NoteHistoryDialog::onRevisionSelected");
+    previewEdit->clear();
+    statusLabel->hide();
+    restoreButton->setEnabled(false);
+    if (row < 0 || row >= revisions.size()) {
+        return;
+    }
+
+    NoteEntry entry;
+    if (!noteManager->loadRevision(noteId, revisions.at(row).number, entry)) {
+        titleLabel->setText("This version could not be read.");
+        return;
+    }
+    titleLabel->setText(entry.title);
+    restoreButton->setEnabled(row > 0);
+
+    if (!entry.chunked) {
+        previewEdit->setPlainText(entry.content);
+        return;
+    }
+
+    int count = 0;
+    qint64 bytes = 0;
+    while (count < entry.chunks.size() && bytes < PREVIEW_BYTES) {
+        bytes += entry.chunks.at(count++).length;
+    }
+    bool ok = false;
+    const QStringList texts = noteManager->readChunks(entry, 0, count, &ok);
+    if (!ok) {
+        statusLabel->setText("The content of this version could not be read.");
+        statusLabel->show();
+        restoreButton->setEnabled(false);
+        return;
+    }
+    previewEdit->setPlainText(texts.join(QString()));
+    if (count < entry.chunks.size()) {
+        const QLocale locale;
+        statusLabel->setText(QString("Showing the first %1 of %2.")
+            .arg(locale.formattedDataSize(bytes), locale.formattedDataSize(entry.chunkedSize())));
+        statusLabel->show();
+    }
+}
+
+void NoteHistoryDialog::onRestoreClicked() {
+    const int row = revisionList->currentRow();
+    if (row < 0 || row >= revisions.size()) {
+        return;
+    }
+
+    const auto reply = QMessageBox::question(this, "Restore Version",
+                                             QString("Replace the note with version %1? The current text stays "
+                                                 "in the history.").arg(revisions.at(row).number));
+    if (reply != QMessageBox::Yes) {
+        return;
+    }
+    if (!noteManager->restoreRevision(noteId, revisions.at(row).number)) {
+        QMessageBox::warning(this, "Error", "Failed to restore this version.");
+        return;
+    }
+    accept();
+}
@@ -0,0 +1,41 @@
+#ifndef NOTEHISTORYDIALOG_H
+#define NOTEHISTORYDIALOG_H
+
+#include <QDialog>
+#include <QList>
+#include "models/notemanager.h"
+
+class QListWidget;
+class QPlainTextEdit;
+class QLabel;
+class QPushButton;
+
+class NoteHistoryDialog final : public QDialog {
+    Q_OBJECT
+
+public:
+    NoteHistoryDialog(const NoteManager *manager, int noteId, QWidget *parent = nullptr);
+
+private slots:
+    void onRevisionSelected(int row);
+
+    void onRestoreClicked();
+
+private:
+    void setupUI();
+
+    void loadRevisions();
+
+    const NoteManager *noteManager;
+    int noteId;
+    QList<NoteRevision> revisions;
+
+    QListWidget *revisionList;
+    QLabel *titleLabel;
+    QLabel *statusLabel;
+    QPlainTextEdit *previewEdit;
+    QPushButton *restoreButton;
+    QPushButton *closeButton;
+};
+
+#endif // NOTEHISTORYDIALOG_H
@@ -7,18 +7,45 @@
 #include <QPushButton>
 #include <QMessageBox>
 #include <QLabel>
+#include <QScrollBar>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QLocale>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include "models/notemanager.h"
+#include "ui/notehistorydialog.h"
+#include "core/trace.h"
+#include "ui/attachmentswidget.h"
+
+// Chunked notes are decrypted as they scroll into view: enough chunks to fill
+// the first screens on open, then more whenever the view nears the end.
+static const qint64 NOTE_PRELOAD_BYTES = 256 * 1024;
+static const qint64 NOTE_PAGE_BYTES = 128 * 1024;
+
+// Edits are saved once typing pauses. Saves run on a worker thread and only
+// one is in flight at a time; edits made meanwhile are picked up by the next
+// one. Only changed fields are written, and for chunked notes only the text
+// of the chunks that were edited is read back from the document.
+static const int AUTOSAVE_DELAY_MS = 1500;
 
 NotepadWidget::NotepadWidget(QWidget *parent)
     : QWidget(parent)
       , noteManager(nullptr)
       , isAddingNew(false)
-      , selectedNoteId(-1) {
+      , selectedNoteId(-1)
+      , savingNoteId(-1)
+      , titleDirty(false)
+      , contentDirty(false)
+      , loadingContent(false)
+      , saveInFlight(false)
+      , contentEditedDuringSave(false) {
     setupUI();
 }
 
 NotepadWidget::~NotepadWidget() {
+    saveWatcher->waitForFinished();
 }
 
 void NotepadWidget::setupUI() {
@@ -69,8 +96,28 @@ void NotepadWidget::setupUI() {
         detailLayout->addLayout(row);
     }
 
+    chunkStatusLabel = new QLabel();
+    chunkStatusLabel->setStyleSheet("color: #AAAAAA;");
+    chunkStatusLabel->hide();
+    detailLayout->addWidget(chunkStatusLabel);
+
     saveButton = new QPushButton("Save");
-    detailLayout->addWidget(saveButton);
+    historyButton = new QPushButton("History");
+    saveStatusLabel = new QLabel();
+    saveStatusLabel->setStyleSheet("color: #AAAAAA;");
+    const auto saveRow = new QHBoxLayout();
+    saveRow->addWidget(saveButton);
+    saveRow->addWidget(historyButton);
+    saveRow->addWidget(saveStatusLabel, 1);
+    detailLayout->addLayout(saveRow);
+
+    attachmentsWidget = new AttachmentsWidget(this);
+    detailLayout->addWidget(attachmentsWidget);
+
+    autosaveTimer = new QTimer(this);
+    autosaveTimer->setSingleShot(true);
+    autosaveTimer->setInterval(AUTOSAVE_DELAY_MS);
+    saveWatcher = new QFutureWatcher<NoteSaveResult>(this);
 
     detailGroup->setLayout(detailLayout);
     rightPanelLayout->addWidget(detailGroup);
@@ -82,6 +129,12 @@ void NotepadWidget::setupUI() {
     connect(addButton, &QPushButton::clicked, this, &NotepadWidget::onAddClicked);
     connect(deleteButton, &QPushButton::clicked, this, &NotepadWidget::onDeleteClicked);
     connect(saveButton, &QPushButton::clicked, this, &NotepadWidget::onSaveClicked);
+    connect(historyButton, &QPushButton::clicked, this, &NotepadWidget::onHistoryClicked);
+    connect(contentEdit->verticalScrollBar(), &QScrollBar::valueChanged, this, &NotepadWidget::onContentScrolled);
+    connect(titleEdit, &QLineEdit::textEdited, this, &NotepadWidget::onTitleEdited);
+    connect(contentEdit->document(), &QTextDocument::contentsChange, this, &NotepadWidget::onContentsChange);
+    connect(autosaveTimer, &QTimer::timeout, this, &NotepadWidget::startAutosave);
+    connect(saveWatcher, &QFutureWatcher<NoteSaveResult>::finished, this, &NotepadWidget::onAutosaveFinished);
 
     setLayout(mainLayout);
 }
@@ -90,12 +143,25 @@ void NotepadWidget::setNoteManager(NoteManager *manager) {
     noteManager = manager;
 }
 
+void NotepadWidget::setAttachmentManager(const AttachmentManager &manager) const {
+    attachmentsWidget->setAttachmentManager(manager);
+    attachmentsWidget->setOwner(AttachmentManager::NoteOwner, selectedNoteId);
+}
+
 void NotepadWidget::loadNotes() {
+    ENIGMA_TRACE_SCOPE("ui", "NotepadWidget::loadNotes");
     if (!noteManager) {
         return;
     }
 
+    showNotes(noteManager->getNotes());
+}
+
+void NotepadWidget::showNotes(const QList<NoteEntry> &notes) {
+    ENIGMA_TRACE_SCOPE("ui", "NotepadWidget::showNotes");
+    flushAutosave();
     cachedNotes.clear();
+    noteButtons.clear();
     QLayoutItem *child;
     while ((child = scrollAreaLayout->takeAt(0)) != nullptr) {
         if (child->widget()) {
@@ -104,7 +170,7 @@ void NotepadWidget::loadNotes() {
         delete child;
     }
 
-    cachedNotes = noteManager->getNotes();
+    cachedNotes = notes;
 
     for (const NoteEntry &note: cachedNotes) {
         const auto noteButton = new QPushButton(note.title, this);
@@ -114,6 +180,7 @@ void NotepadWidget::loadNotes() {
         });
 
         scrollAreaLayout->addWidget(noteButton);
+        noteButtons.insert(note.id, noteButton);
     }
 
     scrollAreaLayout->addStretch();
@@ -124,9 +191,11 @@ void NotepadWidget::loadNotes() {
 }
 
 void NotepadWidget::onAddClicked() {
+    flushAutosave();
     clearFields();
     isAddingNew = true;
     selectedNoteId = -1;
+    attachmentsWidget->setOwner(AttachmentManager::NoteOwner, -1);
 }
 
 void NotepadWidget::onSaveClicked() {
@@ -141,29 +210,20 @@ void NotepadWidget::onSaveClicked() {
         return;
     }
 
-    if (isAddingNew) {
+    if (isAddingNew || currentSelectedId() < 0) {
         if (noteManager->addNote(entry)) {
             QMessageBox::information(this, "Success", "Note added successfully.");
-            loadNotes();
             isAddingNew = false;
-        } else {
-            QMessageBox::warning(this, "Error", "Failed to add note.");
-        }
-    } else {
-        const int id = currentSelectedId();
-        if (id < 0) {
-            if (noteManager->addNote(entry)) {
-                QMessageBox::information(this, "Success", "Note added successfully.");
-                loadNotes();
-            }
-            return;
-        }
-        if (noteManager->updateNote(id, entry)) {
-            QMessageBox::information(this, "Success", "Note updated successfully.");
             loadNotes();
         } else {
-            QMessageBox::warning(this, "Error", "Failed to update note.");
+            QMessageBox::warning(this, "Error", "Failed to add note.");
         }
+        return;
+    }
+
+    flushAutosave();
+    if (hasUnsavedChanges()) {
+        QMessageBox::warning(this, "Error", "Failed to update note.");
     }
 }
 
@@ -181,46 +241,427 @@ void NotepadWidget::onDeleteClicked() {
     const auto reply = QMessageBox::question(this, "Confirm Delete",
                                              "Are you sure you want to delete this note?");
     if (reply == QMessageBox::Yes) {
+        flushAutosave();
         if (noteManager->deleteNote(id)) {
             QMessageBox::information(this, "Deleted", "Note deleted successfully.");
             loadNotes();
             clearFields();
             selectedNoteId = -1;
+            attachmentsWidget->setOwner(AttachmentManager::NoteOwner, -1);
         } else {
             QMessageBox::warning(this, "Error", "Failed to delete note.");
         }
     }
 }
 
+void NotepadWidget::onHistoryClicked() {
+    const int id = currentSelectedId();
+    if (!noteManager || isAddingNew || id < 0) {
+        QMessageBox::warning(this, "History", "No note is selected.");
+        return;
+    }
+
+    flushAutosave();
+    NoteHistoryDialog dialog(noteManager, id, this);
+    if (dialog.exec() == QDialog::Accepted) {
+        loadNotes();
+        onNoteClicked(id);
+    }
+}
+
 void NotepadWidget::onNoteClicked(const int id) {
+    flushAutosave();
     selectedNoteId = id;
     isAddingNew = false;
+    attachmentsWidget->setOwner(AttachmentManager::NoteOwner, id);
 
-    for (const auto &note: cachedNotes) {
-        if (note.id == id) {
-            populateFields(note);
-            break;
+    const int index = selectedIndex();
+    if (index < 0) {
+        return;
+    }
+
+    NoteEntry &note = cachedNotes[index];
+    if (note.chunked) {
+        note.loadedChunks = 0;
+    }
+    populateFields(note);
+    saveStatusLabel->setText(note.readOnly ? "This note could not be read and is shown read-only." : QString());
+    if (note.chunked) {
+        loadMoreChunks(NOTE_PRELOAD_BYTES);
+    }
+    updateChunkStatus();
+}
+
+void NotepadWidget::onContentScrolled(const int value) {
+    const QScrollBar *scrollBar = contentEdit->verticalScrollBar();
+    if (value >= scrollBar->maximum() - scrollBar->pageStep()) {
+        loadMoreChunks(NOTE_PAGE_BYTES);
+    }
+}
+
+void NotepadWidget::loadMoreChunks(const qint64 byteBudget) {
+    ENIGMA_TRACE_SCOPE("ui", "NotepadWidget::loadMoreChunks");
+    const int index = selectedIndex();
+    if (!noteManager || isAddingNew || index < 0 || !cachedNotes.at(index).chunked) {
+        return;
+    }
+
+    NoteEntry &note = cachedNotes[index];
+    int count = 0;
+    qint64 bytes = 0;
+    while (note.loadedChunks + count < note.chunks.size() && (count == 0 || bytes < byteBudget)) {
+        bytes += note.chunks.at(note.loadedChunks + count).length;
+        ++count;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    bool ok = false;
+    QStringList texts = noteManager->readChunks(note, note.loadedChunks, count, &ok);
+    if (!ok) {
+        QMessageBox::warning(this, "Error", "Failed to load the rest of the note.");
+        return;
+    }
+    note.loadedChunks += count;
+
+    // The document turns every line break into a single block separator, so
+    // normalise them first to keep chunk lengths equal to document positions.
+    QList<int> chunkChars;
+    chunkChars.reserve(texts.size());
+    for (QString &text: texts) {
+        text.replace("\r\n", "\n").replace('\r', '\n');
+        chunkChars.append(text.size());
+    }
+    contentTracker.appendChunks(chunkChars);
+
+    // Appending through a separate cursor leaves the user's cursor and scroll
+    // position alone. The load is one undo step of its own; toggling undo off
+    // around it would wipe the user's undo history on every scroll.
+    const QString text = texts.join(QString());
+    QTextCursor cursor(contentEdit->document());
+    cursor.movePosition(QTextCursor::End);
+    loadingContent = true;
+    cursor.beginEditBlock();
+    cursor.insertText(text);
+    cursor.endEditBlock();
+    loadingContent = false;
+    chunkLoads.append({static_cast<int>(text.size()), chunkChars, qHash(text)});
+    undoneChunkLoads.clear();
+
+    updateChunkStatus();
+}
+
+// Undo steps are strictly ordered, so a load can only be undone once every
+// later edit has been, and its text is then exactly what was loaded; it shows
+// up as a removal of that many characters from the end of the document. If
+// saves went through in between, the stored chunks may no longer match that
+// text, so the load is dropped without a redo step rather than re-inserted.
+bool NotepadWidget::undoOrRedoChunkLoad(NoteEntry &note, const int position, const int removed, const int added) {
+    QTextDocument *document = contentEdit->document();
+    const int end = document->characterCount() - 1;
+
+    if (!chunkLoads.isEmpty() && added == 0 && position == end && removed == chunkLoads.last().length) {
+        const ChunkLoad load = chunkLoads.takeLast();
+        if (contentTracker.endsWithCleanChunks(load.chunkChars)) {
+            contentTracker.removeTrailingChars(load.length);
+            note.loadedChunks -= load.chunkChars.size();
+            undoneChunkLoads.append(load);
+            updateChunkStatus();
+            return true;
+        }
+        const int chunks = contentTracker.removeTrailingChars(load.length);
+        if (chunks >= 0) {
+            note.loadedChunks -= chunks;
+            undoneChunkLoads.clear();
+            // The redo stack cannot be touched while the undo is running.
+            QTimer::singleShot(0, document, [document]() {
+                document->clearUndoRedoStacks(QTextDocument::RedoStack);
+            });
+            updateChunkStatus();
+            return true;
+        }
+        chunkLoads.clear();
+    }
+
+    if (!undoneChunkLoads.isEmpty() && removed == 0 && position + added == end
+        && added == undoneChunkLoads.last().length) {
+        QTextCursor cursor(document);
+        cursor.setPosition(position);
+        cursor.setPosition(position + added, QTextCursor::KeepAnchor);
+        if (qHash(cursor.selectedText().replace(QChar::ParagraphSeparator, '\n'))
+            == undoneChunkLoads.last().textHash) {
+            const ChunkLoad load = undoneChunkLoads.takeLast();
+            contentTracker.appendChunks(load.chunkChars);
+            note.loadedChunks += load.chunkChars.size();
+            chunkLoads.append(load);
+            updateChunkStatus();
+            return true;
         }
     }
+    undoneChunkLoads.clear();
+    return false;
+}
+
+void NotepadWidget::updateChunkStatus() const {
+    const int index = selectedIndex();
+    if (isAddingNew || index < 0 || !cachedNotes.at(index).chunked) {
+        chunkStatusLabel->hide();
+        return;
+    }
+
+    const NoteEntry &note = cachedNotes.at(index);
+    if (note.loadedChunks >= note.chunks.size()) {
+        chunkStatusLabel->hide();
+        return;
+    }
+
+    qint64 loaded = 0;
+    for (int i = 0; i < note.loadedChunks; ++i) {
+        loaded += note.chunks.at(i).length;
+    }
+    const QLocale locale;
+    chunkStatusLabel->setText(QString("Showing %1 of %2. Scroll down to load more.")
+        .arg(locale.formattedDataSize(loaded), locale.formattedDataSize(note.chunkedSize())));
+    chunkStatusLabel->show();
 }
 
-void NotepadWidget::clearFields() const {
+void NotepadWidget::clearFields() {
+    loadingContent = true;
     titleEdit->clear();
     contentEdit->clear();
+    titleEdit->setReadOnly(false);
+    contentEdit->setReadOnly(false);
+    loadingContent = false;
+    chunkStatusLabel->hide();
+    saveStatusLabel->clear();
+    resetEditState();
 }
 
-void NotepadWidget::populateFields(const NoteEntry &entry) const {
+void NotepadWidget::populateFields(const NoteEntry &entry) {
+    loadingContent = true;
     titleEdit->setText(entry.title);
     contentEdit->setPlainText(entry.content);
+    titleEdit->setReadOnly(entry.readOnly);
+    contentEdit->setReadOnly(entry.readOnly);
+    loadingContent = false;
+    resetEditState();
+}
+
+void NotepadWidget::resetEditState() {
+    contentTracker.reset();
+    chunkLoads.clear();
+    undoneChunkLoads.clear();
+    titleDirty = false;
+    contentDirty = false;
+}
+
+void NotepadWidget::onTitleEdited() {
+    titleDirty = true;
+    scheduleAutosave();
+}
+
+void NotepadWidget::onContentsChange(const int position, const int removed, const int added) {
+    const int index = selectedIndex();
+    if (loadingContent || isAddingNew || index < 0) {
+        return;
+    }
+
+    if (cachedNotes.at(index).chunked) {
+        if (undoOrRedoChunkLoad(cachedNotes[index], position, removed, added)) {
+            return;
+        }
+        contentTracker.recordEdit(position, removed, added);
+    } else {
+        contentDirty = true;
+    }
+    if (saveInFlight) {
+        contentEditedDuringSave = true;
+    }
+    scheduleAutosave();
+}
+
+void NotepadWidget::scheduleAutosave() {
+    if (!noteManager || isAddingNew || selectedNoteId < 0) {
+        return;
+    }
+    saveStatusLabel->setText("Unsaved changes");
+    autosaveTimer->start();
+}
+
+bool NotepadWidget::hasUnsavedChanges() const {
+    return titleDirty || contentDirty || contentTracker.isDirty();
+}
+
+void NotepadWidget::startAutosave() {
+    const int index = selectedIndex();
+    if (saveInFlight || !noteManager || isAddingNew || index < 0 || !hasUnsavedChanges()
+        || cachedNotes.at(index).readOnly) {
+        return;
+    }
+
+    NoteEntry entry = cachedNotes.at(index);
+    entry.title = titleEdit->text().trimmed();
+    if (entry.title.isEmpty()) {
+        saveStatusLabel->setText("Title cannot be empty");
+        return;
+    }
+
+    NoteEdit edit;
+    edit.titleChanged = titleDirty;
+    if (entry.chunked) {
+        if (contentTracker.isDirty()) {
+            const NoteEditTracker::Region region = contentTracker.beginSave();
+            QTextDocument *document = contentEdit->document();
+            QTextCursor cursor(document);
+            cursor.setPosition(region.position);
+            cursor.setPosition(qMin(region.position + region.length, document->characterCount() - 1),
+                               QTextCursor::KeepAnchor);
+            entry.content = cursor.selectedText().replace(QChar::ParagraphSeparator, '\n');
+            edit.contentChanged = true;
+            edit.firstChunk = region.firstChunk;
+            edit.chunkCount = region.chunkCount;
+        }
+    } else if (contentDirty) {
+        entry.content = contentEdit->toPlainText();
+        edit.contentChanged = true;
+    }
+
+    titleDirty = false;
+    contentDirty = false;
+    contentEditedDuringSave = false;
+    saveInFlight = true;
+    savingNoteId = entry.id;
+    pendingEdit = edit;
+    saveStatusLabel->setText("Saving...");
+
+    const NoteManager *manager = noteManager;
+    saveWatcher->setFuture(QtConcurrent::run([manager, entry, edit] {
+        NoteSaveResult result;
+        result.entry = entry;
+        result.ok = manager->saveEdit(entry.id, result.entry, edit, &result.chunkChars);
+        return result;
+    }));
+}
+
+void NotepadWidget::onAutosaveFinished() {
+    if (!saveInFlight) {
+        return;
+    }
+    saveInFlight = false;
+
+    const NoteSaveResult result = saveWatcher->result();
+    const NoteEdit edit = pendingEdit;
+    int index = -1;
+    for (int i = 0; i < cachedNotes.size(); ++i) {
+        if (cachedNotes.at(i).id == savingNoteId) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        return;
+    }
+
+    NoteEntry &note = cachedNotes[index];
+    const bool wasChunked = note.chunked;
+    if (!result.ok) {
+        titleDirty = titleDirty || edit.titleChanged;
+        if (wasChunked) {
+            contentTracker.finishSave(false, QList<int>());
+        } else {
+            contentDirty = contentDirty || edit.contentChanged;
+        }
+        saveStatusLabel->setText("Save failed; retrying after the next change");
+        return;
+    }
+
+    note.title = result.entry.title;
+    note.salt = result.entry.salt;
+    note.recordFormat = result.entry.recordFormat;
+    if (edit.contentChanged) {
+        if (wasChunked) {
+            note.chunks = result.entry.chunks;
+            note.loadedChunks += result.chunkChars.size() - edit.chunkCount;
+            contentTracker.finishSave(true, result.chunkChars);
+        } else if (result.entry.chunked) {
+            // The note outgrew inline storage and is now tracked by chunk.
+            note.chunked = true;
+            note.contentKey = result.entry.contentKey;
+            note.chunks = result.entry.chunks;
+            note.loadedChunks = result.chunkChars.size();
+            note.content.clear();
+            contentTracker.reset();
+            contentTracker.appendChunks(result.chunkChars);
+            chunkLoads.clear();
+            undoneChunkLoads.clear();
+            if (contentEditedDuringSave) {
+                int savedChars = 0;
+                for (const int chars: result.chunkChars) {
+                    savedChars += chars;
+                }
+                contentDirty = false;
+                contentTracker.recordEdit(0, savedChars, contentEdit->document()->characterCount() - 1);
+            }
+        } else {
+            note.content = result.entry.content;
+        }
+    }
+    if (edit.titleChanged && noteButtons.contains(note.id)) {
+        noteButtons.value(note.id)->setText(note.title);
+    }
+
+    if (hasUnsavedChanges()) {
+        saveStatusLabel->setText("Unsaved changes");
+        autosaveTimer->start();
+    } else {
+        saveStatusLabel->setText("Saved");
+    }
+}
+
+void NotepadWidget::flushAutosave() {
+    autosaveTimer->stop();
+    if (saveInFlight) {
+        saveWatcher->waitForFinished();
+        onAutosaveFinished();
+    }
+    if (hasUnsavedChanges()) {
+        startAutosave();
+        if (saveInFlight) {
+            saveWatcher->waitForFinished();
+            onAutosaveFinished();
+        }
+    }
+    autosaveTimer->stop();
 }
 
 NoteEntry NotepadWidget::gatherFields() const {
     NoteEntry e;
+    const int index = selectedIndex();
+    if (!isAddingNew && index >= 0 && cachedNotes.at(index).chunked) {
+        // The editor holds only the loaded chunks; NoteManager keeps the rest.
+        e = cachedNotes.at(index);
+        e.title = titleEdit->text().trimmed();
+        e.content = contentEdit->toPlainText();
+        return e;
+    }
+
+    // Content is kept verbatim, as autosave stores it; only the title is
+    // trimmed, so Save and autosave never disagree about the same text.
     e.title = titleEdit->text().trimmed();
-    e.content = contentEdit->toPlainText().trimmed();
+    e.content = contentEdit->toPlainText();
     return e;
 }
 
 int NotepadWidget::currentSelectedId() const {
     return selectedNoteId;
 }
+
+int NotepadWidget::selectedIndex() const {
+    for (int i = 0; i < cachedNotes.size(); ++i) {
+        if (cachedNotes.at(i).id == selectedNoteId) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -3,6 +3,10 @@
 
 #include <QWidget>
 #include <QList>
+#include <QHash>
+#include <QFutureWatcher>
+#include "models/notemanager.h"
+#include "ui/noteedittracker.h"
 
 class QLineEdit;
 class QPlainTextEdit;
@@ -11,9 +15,14 @@ class QVBoxLayout;
 class QScrollArea;
 class QLabel;
 class QTimer;
+class AttachmentsWidget;
+class AttachmentManager;
 
-struct NoteEntry;
-class NoteManager;
+struct NoteSaveResult {
+    bool ok = false;
+    NoteEntry entry;
+    QList<int> chunkChars;
+};
 
 class NotepadWidget final : public QWidget {
     Q_OBJECT
@@ -25,8 +34,14 @@ public:
 
     void setNoteManager(NoteManager *manager);
 
+    void setAttachmentManager(const AttachmentManager &manager) const;
+
     void loadNotes();
 
+    void showNotes(const QList<NoteEntry> &notes);
+
+    void flushAutosave();
+
 private slots:
     void onAddClicked();
 
@@ -34,19 +49,45 @@ private slots:
 
     void onDeleteClicked();
 
+    void onHistoryClicked();
+
     void onNoteClicked(int id);
 
+    void onContentScrolled(int value);
+
+    void onTitleEdited();
+
+    void onContentsChange(int position, int removed, int added);
+
+    void startAutosave();
+
+    void onAutosaveFinished();
+
 private:
     void setupUI();
 
-    void clearFields() const;
+    void clearFields();
+
+    void populateFields(const NoteEntry &entry);
+
+    void scheduleAutosave();
 
-    void populateFields(const NoteEntry &entry) const;
+    bool hasUnsavedChanges() const;
+
+    void resetEditState();
 
     NoteEntry gatherFields() const;
 
     int currentSelectedId() const;
 
+    int selectedIndex() const;
+
+    void loadMoreChunks(qint64 byteBudget);
+
+    void updateChunkStatus() const;
+
+    bool undoOrRedoChunkLoad(NoteEntry &note, int position, int removed, int added);
+
     QWidget *leftPanel;
     QScrollArea *scrollArea;
     QVBoxLayout *scrollAreaLayout;
@@ -56,12 +97,39 @@ private:
 
     QLineEdit *titleEdit;
     QPlainTextEdit *contentEdit;
+    QLabel *chunkStatusLabel;
     QPushButton *saveButton;
+    QPushButton *historyButton;
+    QLabel *saveStatusLabel;
+
+    AttachmentsWidget *attachmentsWidget;
 
     NoteManager *noteManager;
     bool isAddingNew;
     int selectedNoteId;
     QList<NoteEntry> cachedNotes;
+    QHash<int, QPushButton *> noteButtons;
+
+    QTimer *autosaveTimer;
+    QFutureWatcher<NoteSaveResult> *saveWatcher;
+    NoteEditTracker contentTracker;
+    // Lazy chunk loads are undoable edits, so scrolling keeps the undo stack.
+    // Undoing a load unloads its chunks rather than deleting them, and redoing
+    // it loads them again.
+    struct ChunkLoad {
+        int length;
+        QList<int> chunkChars;
+        size_t textHash;
+    };
+    QList<ChunkLoad> chunkLoads;
+    QList<ChunkLoad> undoneChunkLoads;
+    NoteEdit pendingEdit;
+    int savingNoteId;
+    bool titleDirty;
+    bool contentDirty;
+    bool loadingContent;
+    bool saveInFlight;
+    bool contentEditedDuringSave;
 };
 
 #endif // NOTEPADWIDGET_H
@@ -11,10 +11,14 @@
 #include <QClipboard>
 #include <QApplication>
 #include <QGroupBox>
+#include <QComboBox>
+#include <QFormLayout>
+#include <cmath>
 
-#include <QRandomGenerator>
-#include <openssl/rand.h>
-#include <random>
+#include "core/breachindex.h"
+#include "core/passwordstrength.h"
+#include "core/passwordgenerator.h"
+#include "core/passphrasegenerator.h"
 
 PasswordGeneratorWidget::PasswordGeneratorWidget(QWidget *parent)
     : QWidget(parent) {
@@ -30,53 +34,95 @@ void PasswordGeneratorWidget::setupUI() {
     const auto passwordGenGroupBox = new QGroupBox("Password Generator", this);
     const auto pgGroupLayout = new QVBoxLayout(passwordGenGroupBox);
 
+    const auto modeLayout = new QHBoxLayout();
+    const auto modeLabel = new QLabel("Type:", passwordGenGroupBox);
+    modeComboBox = new QComboBox(passwordGenGroupBox);
+    modeComboBox->addItems({"Password", "Passphrase"});
+    modeLayout->addWidget(modeLabel);
+    modeLayout->addWidget(modeComboBox);
+    pgGroupLayout->addLayout(modeLayout);
+
+    passwordOptions = new QWidget(passwordGenGroupBox);
+    const auto passwordOptionsLayout = new QVBoxLayout(passwordOptions);
+    passwordOptionsLayout->setContentsMargins(0, 0, 0, 0);
+    pgGroupLayout->addWidget(passwordOptions);
+
     includeUppercaseCheckBox = new QCheckBox("Include Uppercase");
     includeUppercaseCheckBox->setChecked(true);
-    pgGroupLayout->addWidget(includeUppercaseCheckBox);
+    passwordOptionsLayout->addWidget(includeUppercaseCheckBox);
 
     includeLowercaseCheckBox = new QCheckBox("Include Lowercase");
     includeLowercaseCheckBox->setChecked(true);
-    pgGroupLayout->addWidget(includeLowercaseCheckBox);
+    passwordOptionsLayout->addWidget(includeLowercaseCheckBox);
 
     includeNumbersCheckBox = new QCheckBox("Include Numbers");
     includeNumbersCheckBox->setChecked(true);
-    pgGroupLayout->addWidget(includeNumbersCheckBox);
+    passwordOptionsLayout->addWidget(includeNumbersCheckBox);
 
     includeSymbolsCheckBox = new QCheckBox("Include Symbols");
     includeSymbolsCheckBox->setChecked(true);
-    pgGroupLayout->addWidget(includeSymbolsCheckBox);
+    passwordOptionsLayout->addWidget(includeSymbolsCheckBox);
 
     includeCustomCheckBox = new QCheckBox("Include Custom Characters");
-    pgGroupLayout->addWidget(includeCustomCheckBox);
+    passwordOptionsLayout->addWidget(includeCustomCheckBox);
 
     const auto customCharsLayout = new QHBoxLayout();
-    const auto customCharsLabel = new QLabel("Custom Characters:", passwordGenGroupBox);
-    customCharsLineEdit = new QLineEdit(passwordGenGroupBox);
+    const auto customCharsLabel = new QLabel("Custom Characters:", passwordOptions);
+    customCharsLineEdit = new QLineEdit(passwordOptions);
     customCharsLineEdit->setPlaceholderText("e.g., @#$%");
     customCharsLineEdit->setEnabled(false);
     customCharsLayout->addWidget(customCharsLabel);
     customCharsLayout->addWidget(customCharsLineEdit);
-    pgGroupLayout->addLayout(customCharsLayout);
+    passwordOptionsLayout->addLayout(customCharsLayout);
 
     connect(includeCustomCheckBox, &QCheckBox::toggled, customCharsLineEdit, &QLineEdit::setEnabled);
 
     const auto lengthLayout = new QHBoxLayout();
-    const auto lengthLabel = new QLabel("Length:", passwordGenGroupBox);
-    lengthSlider = new QSlider(Qt::Horizontal, passwordGenGroupBox);
+    const auto lengthLabel = new QLabel("Length:", passwordOptions);
+    lengthSlider = new QSlider(Qt::Horizontal, passwordOptions);
     lengthSlider->setRange(6, 32);
     lengthSlider->setValue(12);
-    lengthSpinBox = new QSpinBox(passwordGenGroupBox);
+    lengthSpinBox = new QSpinBox(passwordOptions);
+    lengthSpinBox->setObjectName("lengthSpinBox");
     lengthSpinBox->setRange(6, 32);
     lengthSpinBox->setValue(12);
 
     lengthLayout->addWidget(lengthLabel);
     lengthLayout->addWidget(lengthSlider);
     lengthLayout->addWidget(lengthSpinBox);
-    pgGroupLayout->addLayout(lengthLayout);
+    passwordOptionsLayout->addLayout(lengthLayout);
 
     connect(lengthSlider, &QSlider::valueChanged, lengthSpinBox, &QSpinBox::setValue);
     connect(lengthSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), lengthSlider, &QSlider::setValue);
 
+    passphraseOptions = new QWidget(passwordGenGroupBox);
+    const auto passphraseOptionsLayout = new QFormLayout(passphraseOptions);
+    passphraseOptionsLayout->setContentsMargins(0, 0, 0, 0);
+    passphraseOptions->hide();
+    pgGroupLayout->addWidget(passphraseOptions);
+
+    wordCountSpinBox = new QSpinBox(passphraseOptions);
+    wordCountSpinBox->setObjectName("wordCountSpinBox");
+    wordCountSpinBox->setRange(3, 20);
+    wordCountSpinBox->setValue(6);
+    passphraseOptionsLayout->addRow("Words:", wordCountSpinBox);
+
+    separatorLineEdit = new QLineEdit("-", passphraseOptions);
+    separatorLineEdit->setMaxLength(3);
+    passphraseOptionsLayout->addRow("Separator:", separatorLineEdit);
+
+    capitalizationComboBox = new QComboBox(passphraseOptions);
+    capitalizationComboBox->addItems({"lowercase", "Capitalized", "Randomly Capitalized"});
+    passphraseOptionsLayout->addRow("Capitalization:", capitalizationComboBox);
+
+    insertDigitCheckBox = new QCheckBox("Add a Digit", passphraseOptions);
+    passphraseOptionsLayout->addRow(insertDigitCheckBox);
+
+    connect(modeComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](const int mode) {
+        passwordOptions->setVisible(mode == 0);
+        passphraseOptions->setVisible(mode == 1);
+    });
+
     generateButton = new QPushButton("Generate Password", passwordGenGroupBox);
     pgGroupLayout->addWidget(generateButton);
 
@@ -92,6 +138,11 @@ void PasswordGeneratorWidget::setupUI() {
     strengthLabel = new QLabel("Strength: ", passwordGenGroupBox);
     pgGroupLayout->addWidget(strengthLabel);
 
+    breachLabel = new QLabel("This password appears in known data breaches. Generate another one.", passwordGenGroupBox);
+    breachLabel->setStyleSheet("color: #E05050;");
+    breachLabel->hide();
+    pgGroupLayout->addWidget(breachLabel);
+
     passwordGenGroupBox->setLayout(pgGroupLayout);
     mainLayout->addWidget(passwordGenGroupBox);
     mainLayout->addStretch();
@@ -101,89 +152,66 @@ void PasswordGeneratorWidget::setupUI() {
 }
 
 void PasswordGeneratorWidget::generatePassword() {
-    const QString uppercase = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const QString lowercase = "abcdefghijklmnopqrstuvwxyz";
-    const QString numbers = "0123456789";
-    const QString symbols = "!@#$%^&*()-_=+[]{}|;:,.<>?";
-
-    QString characterPool;
-    QString requiredCharacters;
+    QString password;
+    if (modeComboBox->currentIndex() == 1) {
+        PassphrasePolicy policy;
+        policy.wordCount = wordCountSpinBox->value();
+        policy.separator = separatorLineEdit->text();
+        policy.capitalization = static_cast<PassphrasePolicy::Capitalization>(capitalizationComboBox->currentIndex());
+        policy.insertDigit = insertDigitCheckBox->isChecked();
+
+        PassphraseGenerator generator(policy);
+        if (!generator.generate(password)) {
+            QMessageBox::critical(this, "Error", "Failed to generate a passphrase.");
+            return;
+        }
 
-    if (includeUppercaseCheckBox->isChecked()) {
-        characterPool += uppercase;
-        requiredCharacters += uppercase.at(QRandomGenerator::global()->bounded(uppercase.size()));
-    }
-    if (includeLowercaseCheckBox->isChecked()) {
-        characterPool += lowercase;
-        requiredCharacters += lowercase.at(QRandomGenerator::global()->bounded(lowercase.size()));
-    }
-    if (includeNumbersCheckBox->isChecked()) {
-        characterPool += numbers;
-        requiredCharacters += numbers.at(QRandomGenerator::global()->bounded(numbers.size()));
-    }
-    if (includeSymbolsCheckBox->isChecked()) {
-        characterPool += symbols;
-        requiredCharacters += symbols.at(QRandomGenerator::global()->bounded(symbols.size()));
+        // Every choice is uniform, so the entropy beats any pattern-based
+        // estimate; with a word-like separator it is only an upper bound.
+        const double bits = generator.entropyBits();
+        generatedPasswordLineEdit->setText(password);
+        strengthLabel->setText(QString("Strength: %1 (%2%3 bits)")
+            .arg(PasswordStrength::scoreName(PasswordStrength::scoreForGuesses(std::exp2(bits))))
+            .arg(generator.isEntropyExact() ? "" : "at most ")
+            .arg(bits, 0, 'f', 1));
+        breachLabel->setVisible(BreachIndex::instance().contains(password));
+        return;
     }
+
+    PasswordPolicy policy;
+    policy.length = lengthSpinBox->value();
+    policy.uppercase = includeUppercaseCheckBox->isChecked();
+    policy.lowercase = includeLowercaseCheckBox->isChecked();
+    policy.numbers = includeNumbersCheckBox->isChecked();
+    policy.symbols = includeSymbolsCheckBox->isChecked();
     if (includeCustomCheckBox->isChecked()) {
-        if (const QString custom = customCharsLineEdit->text(); !custom.isEmpty()) {
-            characterPool += custom;
-            requiredCharacters += custom.at(QRandomGenerator::global()->bounded(custom.size()));
-        }
+        policy.custom = customCharsLineEdit->text();
     }
 
-    if (characterPool.isEmpty()) {
+    PasswordGenerator generator(policy);
+
+    if (policy.characterSets().isEmpty()) {
         QMessageBox::warning(this, "Input Error", "Please select at least one character set.");
         return;
     }
 
-    const int length = lengthSpinBox->value();
-
-    if (length < requiredCharacters.length()) {
+    if (!generator.isValid()) {
         QMessageBox::warning(this, "Input Error",
                              QString("Password length must be at least %1 to include all selected character sets.")
-                             .arg(requiredCharacters.length()));
+                             .arg(generator.requiredLength()));
         return;
     }
 
-    QString password = requiredCharacters;
-
-    const int remainingLength = length - requiredCharacters.length();
-
-    QByteArray buffer;
-    buffer.resize(remainingLength);
-    if (RAND_bytes(reinterpret_cast<unsigned char *>(buffer.data()), remainingLength) != 1) {
+    if (!generator.generate(password)) {
         QMessageBox::critical(this, "Error", "Failed to generate secure random bytes.");
         return;
     }
 
-    for (int i = 0; i < remainingLength; ++i) {
-        const int index = static_cast<unsigned char>(buffer[i]) % characterPool.size();
-        password.append(characterPool.at(index));
-    }
-
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::ranges::shuffle(password, g);
-
     generatedPasswordLineEdit->setText(password);
 
-    const double entropy = length * std::log2(static_cast<double>(characterPool.size()));
-    QString strength;
-
-    if (entropy >= 80) {
-        strength = "Very Strong";
-    } else if (entropy >= 60) {
-        strength = "Strong";
-    } else if (entropy >= 40) {
-        strength = "Moderate";
-    } else if (entropy >= 20) {
-        strength = "Weak";
-    } else {
-        strength = "Very Weak";
-    }
-
-    strengthLabel->setText("Strength: " + strength);
+    const StrengthResult strength = PasswordStrength::estimate(password);
+    strengthLabel->setText("Strength: " + PasswordStrength::scoreName(strength.score));
+    breachLabel->setVisible(BreachIndex::instance().contains(password));
 }
 
 void PasswordGeneratorWidget::copyPassword() {
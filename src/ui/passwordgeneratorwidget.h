@@ -9,6 +9,7 @@ class QSlider;
 class QSpinBox;
 class QPushButton;
 class QLabel;
+class QComboBox;
 
 class PasswordGeneratorWidget final : public QWidget {
     Q_OBJECT
@@ -26,6 +27,10 @@ private slots:
 private:
     void setupUI();
 
+    QComboBox *modeComboBox;
+    QWidget *passwordOptions;
+    QWidget *passphraseOptions;
+
     QCheckBox *includeUppercaseCheckBox;
     QCheckBox *includeLowercaseCheckBox;
     QCheckBox *includeNumbersCheckBox;
@@ -34,10 +39,17 @@ private:
     QLineEdit *customCharsLineEdit;
     QSlider *lengthSlider;
     QSpinBox *lengthSpinBox;
+
+    QSpinBox *wordCountSpinBox;
+    QLineEdit *separatorLineEdit;
+    QComboBox *capitalizationComboBox;
+    QCheckBox *insertDigitCheckBox;
+
     QPushButton *generateButton;
     QLineEdit *generatedPasswordLineEdit;
     QPushButton *copyButton;
     QLabel *strengthLabel;
+    QLabel *breachLabel;
 };
 
 #endif // PASSWORDGENERATORWIDGET_H
@@ -13,24 +13,48 @@
 #include <QLineEdit>
 #include <QScrollArea>
 #include <QPlainTextEdit>
+#include <QRegularExpression>
 #include <QHBoxLayout>
+#include <QListWidget>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
 #include "models/passwordmanager.h"
+#include "models/passwordaudit.h"
 #include "core/totpgenerator.h"
+#include "core/breachindex.h"
+#include "core/passwordstrength.h"
+#include "core/trace.h"
+#include "ui/attachmentswidget.h"
+
+// The reuse audit runs after every list load and then on this interval, so
+// changes made from another session show up too.
+static const int AUDIT_INTERVAL_MS = 60000;
 
 PasswordManagerWidget::PasswordManagerWidget(QWidget *parent)
     : QWidget(parent)
       , passwordManager(nullptr)
       , isAddingNew(false)
-      , selectedEntryId(-1) {
+      , selectedEntryId(-1)
+      , strengthMeter(new PasswordStrength())
+      , auditQueued(false) {
     setupUI();
 
     totpTimer = new QTimer(this);
     connect(totpTimer, &QTimer::timeout, this, &PasswordManagerWidget::updateTOTPDisplay);
     totpTimer->start(100);
+
+    auditWatcher = new QFutureWatcher<QList<QList<int> > >(this);
+    connect(auditWatcher, &QFutureWatcher<QList<QList<int> > >::finished, this, &PasswordManagerWidget::onAuditFinished);
+
+    auditTimer = new QTimer(this);
+    auditTimer->setInterval(AUDIT_INTERVAL_MS);
+    connect(auditTimer, &QTimer::timeout, this, &PasswordManagerWidget::startAudit);
 }
 
 PasswordManagerWidget::~PasswordManagerWidget() {
+    auditWatcher->waitForFinished();
+    delete strengthMeter;
 }
 
 void PasswordManagerWidget::setupUI() {
@@ -47,6 +71,12 @@ void PasswordManagerWidget::setupUI() {
         leftPanelLayout->addLayout(topRowLayout);
     }
 
+    auditLabel = new QLabel(this);
+    auditLabel->setWordWrap(true);
+    auditLabel->setStyleSheet("color: #E0A040;");
+    auditLabel->hide();
+    leftPanelLayout->addWidget(auditLabel);
+
     scrollArea = new QScrollArea(this);
     scrollArea->setWidgetResizable(true);
 
@@ -121,6 +151,23 @@ void PasswordManagerWidget::setupUI() {
         detailLayout->addLayout(row);
 
         connect(copyPasswordButton, &QPushButton::clicked, this, &PasswordManagerWidget::copyPassword);
+
+        breachLabel = new QLabel("This password appears in known data breaches.");
+        breachLabel->setStyleSheet("color: #E05050;");
+        breachLabel->hide();
+        detailLayout->addWidget(breachLabel);
+
+        strengthLabel = new QLabel();
+        strengthLabel->hide();
+        detailLayout->addWidget(strengthLabel);
+
+        strengthFeedbackLabel = new QLabel();
+        strengthFeedbackLabel->setWordWrap(true);
+        strengthFeedbackLabel->hide();
+        detailLayout->addWidget(strengthFeedbackLabel);
+
+        connect(passwordEdit, &QLineEdit::textChanged, this, &PasswordManagerWidget::updateBreachWarning);
+        connect(passwordEdit, &QLineEdit::textChanged, this, &PasswordManagerWidget::updateStrength);
     } {
         const auto row = new QHBoxLayout();
         const auto lbl = new QLabel("TOTP Secret:");
@@ -162,6 +209,23 @@ void PasswordManagerWidget::setupUI() {
     saveButton = new QPushButton("Save");
     detailLayout->addWidget(saveButton);
 
+    // Previous passwords are only fetched and decrypted while this is open.
+    historyButton = new QPushButton("Show Password History");
+    historyButton->setCheckable(true);
+    historyList = new QListWidget();
+    historyList->hide();
+    copyHistoryButton = new QPushButton("Copy Selected Password");
+    copyHistoryButton->hide();
+    detailLayout->addWidget(historyButton);
+    detailLayout->addWidget(historyList);
+    detailLayout->addWidget(copyHistoryButton);
+
+    attachmentsWidget = new AttachmentsWidget(this);
+    detailLayout->addWidget(attachmentsWidget);
+
+    connect(historyButton, &QPushButton::toggled, this, &PasswordManagerWidget::onHistoryToggled);
+    connect(copyHistoryButton, &QPushButton::clicked, this, &PasswordManagerWidget::copyHistoryPassword);
+
     detailGroup->setLayout(detailLayout);
     rightPanelLayout->addWidget(detailGroup);
     rightPanelLayout->addStretch();
@@ -180,12 +244,25 @@ void PasswordManagerWidget::setPasswordManager(PasswordManager *pm) {
     passwordManager = pm;
 }
 
+void PasswordManagerWidget::setAttachmentManager(const AttachmentManager &manager) const {
+    attachmentsWidget->setAttachmentManager(manager);
+    attachmentsWidget->setOwner(AttachmentManager::PasswordOwner, selectedEntryId);
+}
+
 void PasswordManagerWidget::loadPasswords() {
+    ENIGMA_TRACE_SCOPE("ui", "PasswordManagerWidget::loadPasswords");
     if (!passwordManager) {
         return;
     }
 
+    showPasswords(passwordManager->getPasswords());
+}
+
+void PasswordManagerWidget::showPasswords(const QList<PasswordEntry> &entries) {
+    ENIGMA_TRACE_SCOPE("ui", "PasswordManagerWidget::showPasswords");
     cachedEntries.clear();
+    entryButtons.clear();
+    entryLabels.clear();
 
     QLayoutItem *child;
     while ((child = scrollAreaLayout->takeAt(0)) != nullptr) {
@@ -195,15 +272,21 @@ void PasswordManagerWidget::loadPasswords() {
         delete child;
     }
 
-    cachedEntries = passwordManager->getPasswords();
+    cachedEntries = entries;
 
+    const BreachIndex &breaches = BreachIndex::instance();
     for (const PasswordEntry &entry: cachedEntries) {
         QString btnText = QString("%1\n%2")
                 .arg(entry.service)
                 .arg(entry.username);
+        if (breaches.contains(entry.password)) {
+            btnText += "\nFound in a data breach";
+        }
 
         const auto entryButton = new QPushButton(btnText, this);
         scrollAreaLayout->addWidget(entryButton);
+        entryButtons.insert(entry.id, entryButton);
+        entryLabels.insert(entry.id, btnText);
 
         connect(entryButton, &QPushButton::clicked, this, [=] {
             onEntryClicked(entry.id);
@@ -215,12 +298,123 @@ void PasswordManagerWidget::loadPasswords() {
     if (!cachedEntries.isEmpty()) {
         onEntryClicked(cachedEntries.first().id);
     }
+
+    startAudit();
+}
+
+// The audit works on its own copy of the vault key, so a vault key rotation
+// in the meantime cannot pull it out from under the worker.
+void PasswordManagerWidget::startAudit() {
+    if (!passwordManager || !passwordManager->getEncryption()) {
+        return;
+    }
+    if (auditWatcher->isRunning()) {
+        auditQueued = true;
+        return;
+    }
+    auditQueued = false;
+
+    const PasswordAudit audit(passwordManager->getUserId(), *passwordManager->getEncryption());
+    const int userId = passwordManager->getUserId();
+    auditWatcher->setFuture(QtConcurrent::run([audit, userId] {
+        audit.backfillFingerprints();
+        return PasswordAudit::findReusedPasswords(userId);
+    }));
+    auditTimer->start();
+}
+
+void PasswordManagerWidget::onAuditFinished() {
+    if (auditQueued) {
+        startAudit();
+        return;
+    }
+
+    // Labels are rebuilt from the ones showPasswords set, so markers do not
+    // pile up across audits and disappear once the reuse is fixed.
+    const QList<QList<int> > groups = auditWatcher->result();
+    QHash<int, QString> labels = entryLabels;
+    int reusedEntries = 0;
+    for (const QList<int> &group: groups) {
+        const int others = group.size() - 1;
+        for (const int id: group) {
+            if (!labels.contains(id)) {
+                continue;
+            }
+            labels[id] += others == 1 ? QString("\nReused by 1 other entry")
+                                      : QString("\nReused by %1 other entries").arg(others);
+            ++reusedEntries;
+        }
+    }
+    for (auto it = labels.cbegin(); it != labels.cend(); ++it) {
+        QPushButton *button = entryButtons.value(it.key());
+        if (button && button->text() != it.value()) {
+            button->setText(it.value());
+        }
+    }
+
+    if (reusedEntries == 0) {
+        auditLabel->hide();
+        return;
+    }
+    auditLabel->setText(QString("%1 entries share a password with another entry.").arg(reusedEntries));
+    auditLabel->show();
+}
+
+void PasswordManagerWidget::updateBreachWarning(const QString &password) const {
+    breachLabel->setVisible(BreachIndex::instance().contains(password));
+}
+
+// Runs on every keystroke; the meter keeps its work per position, so only the
+// characters after the edit are re-analysed.
+void PasswordManagerWidget::updateStrength(const QString &password) const {
+    ENIGMA_TRACE_SCOPE("ui", "PasswordManagerWidget::updateStrength");
+
+    if (password.isEmpty()) {
+        strengthMeter->update(password);
+        strengthLabel->hide();
+        strengthFeedbackLabel->hide();
+        return;
+    }
+
+    const StrengthResult strength = strengthMeter->update(password);
+    strengthLabel->setText("Strength: " + PasswordStrength::scoreName(strength.score));
+    strengthLabel->show();
+
+    QStringList feedback;
+    for (const PasswordEntry &entry: cachedEntries) {
+        if (entry.id != selectedEntryId && entry.password == password) {
+            feedback.append(QString("This password is already used for %1.").arg(entry.service));
+            break;
+        }
+    }
+    if (!strength.warning.isEmpty()) {
+        feedback.append(strength.warning);
+    }
+    feedback.append(strength.suggestions);
+
+    strengthFeedbackLabel->setText(feedback.join("\n"));
+    strengthFeedbackLabel->setVisible(!feedback.isEmpty());
+}
+
+// A password built from the entry's own service or account name is guessable
+// by anyone who knows what it is for.
+void PasswordManagerWidget::setStrengthInputs(const PasswordEntry &entry) const {
+    static const QRegularExpression separators("[^\\p{L}\\p{N}]+");
+
+    QStringList inputs;
+    for (const QString &field: {entry.service, entry.url, entry.username, entry.email}) {
+        inputs.append(field.split(separators, Qt::SkipEmptyParts));
+    }
+    strengthMeter->setUserInputs(inputs);
+    updateStrength(passwordEdit->text());
 }
 
 void PasswordManagerWidget::onAddClicked() {
     clearDetailFields();
+    resetHistoryView();
     isAddingNew = true;
     selectedEntryId = -1;
+    attachmentsWidget->setOwner(AttachmentManager::PasswordOwner, -1);
 }
 
 void PasswordManagerWidget::onDeleteClicked() {
@@ -239,9 +433,11 @@ void PasswordManagerWidget::onDeleteClicked() {
     if (reply == QMessageBox::Yes) {
         if (passwordManager->deletePassword(id)) {
             QMessageBox::information(this, "Deleted", "Password entry deleted successfully.");
+            resetHistoryView();
             loadPasswords();
             clearDetailFields();
             selectedEntryId = -1;
+            attachmentsWidget->setOwner(AttachmentManager::PasswordOwner, -1);
         } else {
             QMessageBox::warning(this, "Error", "Failed to delete password entry.");
         }
@@ -280,6 +476,7 @@ void PasswordManagerWidget::onSaveClicked() {
         }
         if (passwordManager->updatePassword(id, entry)) {
             QMessageBox::information(this, "Success", "Password entry updated successfully.");
+            resetHistoryView();
             loadPasswords();
         } else {
             QMessageBox::warning(this, "Error", "Failed to update password entry.");
@@ -288,8 +485,12 @@ void PasswordManagerWidget::onSaveClicked() {
 }
 
 void PasswordManagerWidget::onEntryClicked(const int id) {
+    if (id != selectedEntryId) {
+        resetHistoryView();
+    }
     selectedEntryId = id;
     isAddingNew = false;
+    attachmentsWidget->setOwner(AttachmentManager::PasswordOwner, id);
 
     for (const auto &e: cachedEntries) {
         if (e.id == id) {
@@ -329,6 +530,7 @@ void PasswordManagerWidget::updateTOTPDisplay() const {
 }
 
 void PasswordManagerWidget::clearDetailFields() const {
+    setStrengthInputs(PasswordEntry());
     serviceEdit->clear();
     urlEdit->clear();
     usernameEdit->clear();
@@ -341,6 +543,7 @@ void PasswordManagerWidget::clearDetailFields() const {
 }
 
 void PasswordManagerWidget::populateDetailFields(const PasswordEntry &entry) const {
+    setStrengthInputs(entry);
     serviceEdit->setText(entry.service);
     urlEdit->setText(entry.url);
     usernameEdit->setText(entry.username);
@@ -366,6 +569,44 @@ int PasswordManagerWidget::currentSelectedId() const {
     return selectedEntryId;
 }
 
+void PasswordManagerWidget::onHistoryToggled(const bool shown) {
+    ENIGMA_TRACE_SCOPE("ui", "PasswordManagerWidget::onHistoryToggled");
+    historyList->clear();
+    cachedHistory.clear();
+    historyList->setVisible(shown);
+    copyHistoryButton->setVisible(shown);
+    historyButton->setText(shown ? "Hide Password History" : "Show Password History");
+    const int id = currentSelectedId();
+    if (!shown || id < 0 || !passwordManager) {
+        return;
+    }
+
+    cachedHistory = passwordManager->getPasswordHistory(id);
+    for (const PasswordHistoryEntry &previous: cachedHistory) {
+        historyList->addItem(QString("Replaced %1")
+            .arg(QDateTime::fromSecsSinceEpoch(previous.changedAt).toString("yyyy-MM-dd HH:mm")));
+    }
+    if (cachedHistory.isEmpty()) {
+        historyList->addItem("No previous passwords.");
+    }
+}
+
+void PasswordManagerWidget::copyHistoryPassword() const {
+    const int row = historyList->currentRow();
+    if (row >= 0 && row < cachedHistory.size()) {
+        QApplication::clipboard()->setText(cachedHistory.at(row).password);
+    }
+}
+
+// Collapsing the view drops the decrypted passwords it held.
+void PasswordManagerWidget::resetHistoryView() {
+    if (historyButton->isChecked()) {
+        historyButton->setChecked(false);
+    } else {
+        onHistoryToggled(false);
+    }
+}
+
 void PasswordManagerWidget::copyService() const {
     QApplication::clipboard()->setText(serviceEdit->text());
 }
@@ -3,6 +3,7 @@
 
 #include <QWidget>
 #include <QList>
+#include <QHash>
 
 class QLineEdit;
 class QPushButton;
@@ -12,9 +13,17 @@ class QTimer;
 class QLabel;
 class QScrollArea;
 class QPlainTextEdit;
+class QListWidget;
+
+template<typename T>
+class QFutureWatcher;
 
 class PasswordManager;
+class PasswordStrength;
+class AttachmentsWidget;
+class AttachmentManager;
 struct PasswordEntry;
+struct PasswordHistoryEntry;
 
 class PasswordManagerWidget final : public QWidget {
     Q_OBJECT
@@ -26,8 +35,12 @@ public:
 
     void setPasswordManager(PasswordManager *pm);
 
+    void setAttachmentManager(const AttachmentManager &manager) const;
+
     void loadPasswords();
 
+    void showPasswords(const QList<PasswordEntry> &entries);
+
 private slots:
     void onAddClicked();
 
@@ -53,6 +66,18 @@ private slots:
 
     void copyTotpCode() const;
 
+    void onHistoryToggled(bool shown);
+
+    void copyHistoryPassword() const;
+
+    void updateBreachWarning(const QString &password) const;
+
+    void updateStrength(const QString &password) const;
+
+    void startAudit();
+
+    void onAuditFinished();
+
 private:
     void setupUI();
 
@@ -64,7 +89,12 @@ private:
 
     int currentSelectedId() const;
 
+    void resetHistoryView();
+
+    void setStrengthInputs(const PasswordEntry &entry) const;
+
     QWidget *leftPanel;
+    QLabel *auditLabel;
     QScrollArea *scrollArea;
     QVBoxLayout *scrollAreaLayout;
 
@@ -85,6 +115,9 @@ private:
 
     QLineEdit *passwordEdit;
     QPushButton *copyPasswordButton;
+    QLabel *breachLabel;
+    QLabel *strengthLabel;
+    QLabel *strengthFeedbackLabel;
 
     QPlainTextEdit *descriptionEdit;
 
@@ -98,13 +131,28 @@ private:
 
     QPushButton *saveButton;
 
+    QPushButton *historyButton;
+    QListWidget *historyList;
+    QPushButton *copyHistoryButton;
+
+    AttachmentsWidget *attachmentsWidget;
+
     PasswordManager *passwordManager;
     bool isAddingNew;
     int selectedEntryId;
 
     QTimer *totpTimer;
 
+    PasswordStrength *strengthMeter;
+
+    QHash<int, QPushButton *> entryButtons;
+    QHash<int, QString> entryLabels;
+    QFutureWatcher<QList<QList<int> > > *auditWatcher;
+    QTimer *auditTimer;
+    bool auditQueued;
+
     QList<PasswordEntry> cachedEntries;
+    QList<PasswordHistoryEntry> cachedHistory;
 };
 
 #endif // PASSWORDMANAGERWIDGET_H
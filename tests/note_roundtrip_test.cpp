@@ -0,0 +1,75 @@
+#include "syntheticvault.h"
+#include "core/dbmanager.h"
+#include "core/encryption.h"
+#include "core/schemamigrator.h"
+#include "models/notemanager.h"
+#include "models/user.h"
+
+#include <QCoreApplication>
+#include <QRandomGenerator>
+#include <cstdio>
+
+// Saves a note of about 100 KB of random text, which neither compression nor
+// chunking shrinks below the 64 KiB of a MySQL BLOB, and reads it back. Runs on
+// an in-memory SQLite store; set ENIGMA_TEST_MYSQL_HOST (and _DB, _USER,
+// _PASSWORD) to run it against a MySQL server instead.
+static const int NOTE_CHARACTERS = 100 * 1024;
+
+static bool openStore() {
+    const QString host = qEnvironmentVariable("ENIGMA_TEST_MYSQL_HOST");
+    if (host.isEmpty()) {
+        return SyntheticVault::openInMemoryStore();
+    }
+    return DBManager::instance().openConnection(host, qEnvironmentVariable("ENIGMA_TEST_MYSQL_DB", "enigma_db"),
+                                                qEnvironmentVariable("ENIGMA_TEST_MYSQL_USER"),
+                                                qEnvironmentVariable("ENIGMA_TEST_MYSQL_PASSWORD"))
+           && SchemaMigrator(DBManager::instance().getDatabase()).migrate();
+}
+
+static int fail(const char *message) {
+    std::fprintf(stderr, "note_roundtrip: %s\n", message);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    if (!openStore()) {
+        return fail("cannot open the store");
+    }
+
+    const QString username = QString("roundtrip-%1").arg(QRandomGenerator::global()->generate64(), 0, 16);
+    if (!User::registerUser(username, "roundtrip-password")) {
+        return fail("cannot register the test user");
+    }
+    int userId = -1;
+    const QByteArray vaultKey = SyntheticVault::unlockVault(username, "roundtrip-password", &userId);
+    if (vaultKey.isEmpty()) {
+        return fail("cannot unlock the test vault");
+    }
+
+    QRandomGenerator random(NOTE_CHARACTERS);
+    QString content;
+    content.reserve(NOTE_CHARACTERS);
+    for (int i = 0; i < NOTE_CHARACTERS; ++i) {
+        content.append(QChar(static_cast<char16_t>(random.bounded(0x21, 0x7f))));
+    }
+
+    Encryption encryption(vaultKey);
+    const NoteManager manager(userId, &encryption);
+    NoteEntry note;
+    note.id = -1;
+    note.title = "random text";
+    note.content = content;
+    if (!manager.addNote(note)) {
+        return fail("saving the note failed");
+    }
+
+    const QList<NoteEntry> notes = manager.getNotes();
+    if (notes.size() != 1) {
+        return fail("the note did not come back");
+    }
+    if (notes.first().readOnly || notes.first().title != note.title || notes.first().content != content) {
+        return fail("the note came back different");
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "core/breachindex.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
+
+// Converts the Pwned Passwords SHA-1 corpus into the index BreachIndex maps.
+// Accepts either a directory of range files as written by the official
+// downloader (00000.txt ... FFFFF.txt, lines of "SUFFIX:COUNT") or a single
+// file of "HASH:COUNT" lines ordered by hash.
+
+// Lines are "HEX" or "HEX:COUNT"; `prefix` is prepended to the hex.
+static bool addFile(BreachIndexWriter &writer, const QString &path, const QByteArray &prefix, qint64 *lines) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QTextStream(stderr) << "Failed to open " << path << ": " << file.errorString() << Qt::endl;
+        return false;
+    }
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        const int colon = line.indexOf(':');
+        const QByteArray hash = QByteArray::fromHex(prefix + (colon < 0 ? line : line.left(colon)));
+        if (hash.size() != 20) {
+            QTextStream(stderr) << path << ": not a SHA-1 hash: " << line << Qt::endl;
+            return false;
+        }
+        if (!writer.add(hash)) {
+            QTextStream(stderr) << path << ": " << writer.errorString() << Qt::endl;
+            return false;
+        }
+        ++*lines;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("enigma_breachindex");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Builds the offline breached password index from the Pwned Passwords SHA-1 corpus.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("source", "Directory of range files, or one file of hashes ordered by hash.");
+    parser.addOption({"output", "Where to write the index.", "path", "pwned-passwords.idx"});
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    const QString source = parser.positionalArguments().first();
+
+    QTextStream out(stdout);
+    BreachIndexWriter writer(parser.value("output"));
+    if (!writer.open()) {
+        out << "Failed to create " << parser.value("output") << ": " << writer.errorString() << Qt::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 lines = 0;
+    bool ok = true;
+    if (QFileInfo(source).isDir()) {
+        static const QRegularExpression rangeName("^[0-9A-Fa-f]{5}$");
+        const QDir dir(source);
+        const QFileInfoList files = dir.entryInfoList(QDir::Files, QDir::Name);
+        int done = 0;
+        for (const QFileInfo &info: files) {
+            ++done;
+            if (!rangeName.match(info.completeBaseName()).hasMatch()) {
+                continue;
+            }
+            ok = addFile(writer, info.filePath(), info.completeBaseName().toLatin1(), &lines);
+            if (!ok) {
+                break;
+            }
+            if (done % 4096 == 0) {
+                out << "\r" << done << " / " << files.size() << " range files" << Qt::flush;
+            }
+        }
+        out << Qt::endl;
+    } else {
+        ok = addFile(writer, source, QByteArray(), &lines);
+    }
+
+    if (!ok || !writer.finish()) {
+        out << "Building the index failed. " << writer.errorString() << Qt::endl;
+        return 1;
+    }
+    out << "Indexed " << writer.hashCount() << " of " << lines << " hashes in " << timer.elapsed() / 1000.0 << " s"
+        << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include "storeoptions.h"
+#include "syntheticvault.h"
+#include "core/dbmanager.h"
+#include "core/encryption.h"
+#include "models/user.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+// Simulates many users sharing one database. Every simulated user runs on
+// its own thread, which gives it its own connection through DBManager, and
+// drives the real User, PasswordManager and NoteManager code with a weighted
+// mix of operations until the run duration is over.
+
+enum Operation {
+    Login,
+    ListPasswords,
+    AddPassword,
+    UpdatePassword,
+    DeletePassword,
+    ListNotes,
+    AddNote,
+    UpdateNote,
+    DeleteNote,
+    OperationCount
+};
+
+static const char *const OPERATION_NAMES[OperationCount] = {
+    "login",
+    "list_passwords",
+    "add_password",
+    "update_password",
+    "delete_password",
+    "list_notes",
+    "add_note",
+    "update_note",
+    "delete_note"
+};
+
+struct OperationResults {
+    QList<qint64> nanoseconds[OperationCount];
+    int failures[OperationCount] = {};
+};
+
+struct Workload {
+    QString password;
+    int weights[OperationCount] = {};
+    int totalWeight = 0;
+    int maxNoteBytes = 64 * 1024;
+    qint64 durationNanoseconds = 0;
+};
+
+static bool parseMix(const QString &text, Workload &workload) {
+    for (const QString &item: text.split(',', Qt::SkipEmptyParts)) {
+        const QStringList pair = item.split('=');
+        const auto name = pair.value(0).trimmed().toLatin1();
+        const auto found = std::find_if(std::begin(OPERATION_NAMES), std::end(OPERATION_NAMES),
+                                        [&name](const char *candidate) { return name == candidate; });
+        bool ok = false;
+        const int weight = pair.value(1).toInt(&ok);
+        if (pair.size() != 2 || found == std::end(OPERATION_NAMES) || !ok || weight < 0) {
+            qWarning() << "Invalid mix entry" << item;
+            return false;
+        }
+        workload.weights[found - std::begin(OPERATION_NAMES)] = weight;
+    }
+    workload.totalWeight = std::accumulate(std::begin(workload.weights), std::end(workload.weights), 0);
+    return workload.totalWeight > 0;
+}
+
+static Operation pickOperation(const Workload &workload, QRandomGenerator &random) {
+    int roll = random.bounded(workload.totalWeight);
+    for (int i = 0; i < OperationCount; ++i) {
+        roll -= workload.weights[i];
+        if (roll < 0) {
+            return static_cast<Operation>(i);
+        }
+    }
+    return ListPasswords;
+}
+
+// Returns -1 once the pool is used up; the caller counts that as a failed
+// operation rather than letting it pass as a cheap success.
+static int takeRandomId(QList<int> &ids, QRandomGenerator &random, const bool remove) {
+    if (ids.isEmpty()) {
+        return -1;
+    }
+    const int index = random.bounded(static_cast<int>(ids.size()));
+    const int id = ids.at(index);
+    if (remove) {
+        ids.removeAt(index);
+    }
+    return id;
+}
+
+static OperationResults simulateUser(const QString &username, const Workload &workload, const quint32 seed) {
+    OperationResults results;
+    QRandomGenerator random(seed);
+
+    int userId = -1;
+    const QByteArray vaultKey = SyntheticVault::unlockVault(username, workload.password, &userId);
+    if (vaultKey.isEmpty()) {
+        qWarning() << "Failed to unlock" << username;
+        return results;
+    }
+
+    Encryption encryption(vaultKey);
+    const PasswordManager passwordManager(userId, &encryption);
+    const NoteManager noteManager(userId, &encryption);
+
+    QList<int> passwordIds;
+    for (const PasswordEntry &entry: passwordManager.getPasswords()) {
+        passwordIds.append(entry.id);
+    }
+    QList<int> noteIds;
+    for (const NoteEntry &entry: noteManager.getNotes()) {
+        noteIds.append(entry.id);
+    }
+
+    QElapsedTimer runClock;
+    runClock.start();
+    while (runClock.nsecsElapsed() < workload.durationNanoseconds) {
+        const Operation operation = pickOperation(workload, random);
+        bool ok = true;
+
+        QElapsedTimer timer;
+        timer.start();
+        switch (operation) {
+            case Login: {
+                const User *user = User::login(username, workload.password);
+                ok = user != nullptr;
+                delete user;
+                break;
+            }
+            case ListPasswords: {
+                passwordIds.clear();
+                for (const PasswordEntry &entry: passwordManager.getPasswords()) {
+                    passwordIds.append(entry.id);
+                }
+                break;
+            }
+            case AddPassword:
+                ok = passwordManager.addPassword(SyntheticVault::randomPasswordEntry(random));
+                break;
+            case UpdatePassword: {
+                const int id = takeRandomId(passwordIds, random, false);
+                ok = id >= 0 && passwordManager.updatePassword(id, SyntheticVault::randomPasswordEntry(random));
+                break;
+            }
+            case DeletePassword: {
+                const int id = takeRandomId(passwordIds, random, true);
+                ok = id >= 0 && passwordManager.deletePassword(id);
+                break;
+            }
+            case ListNotes: {
+                noteIds.clear();
+                for (const NoteEntry &entry: noteManager.getNotes()) {
+                    noteIds.append(entry.id);
+                }
+                break;
+            }
+            case AddNote:
+                ok = noteManager.addNote(SyntheticVault::randomNoteEntry(random, workload.maxNoteBytes));
+                break;
+            case UpdateNote: {
+                const int id = takeRandomId(noteIds, random, false);
+                ok = id >= 0 && noteManager.updateNote(id, SyntheticVault::randomNoteEntry(random,
+                                                                                           workload.maxNoteBytes));
+                break;
+            }
+            case DeleteNote: {
+                const int id = takeRandomId(noteIds, random, true);
+                ok = id >= 0 && noteManager.deleteNote(id);
+                break;
+            }
+            case OperationCount:
+                break;
+        }
+        results.nanoseconds[operation].append(timer.nsecsElapsed());
+        results.failures[operation] += ok ? 0 : 1;
+    }
+    return results;
+}
+
+// InnoDB counts row lock waits server-wide; the difference across the run is
+// what this load added, assuming nothing else is using the server.
+static QHash<QString, qint64> lockStatistics() {
+    QHash<QString, qint64> statistics;
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    if (db.driverName() != "QMYSQL") {
+        return statistics;
+    }
+
+    QSqlQuery query(db);
+    if (!query.exec("SHOW GLOBAL STATUS WHERE Variable_name IN ("
+                    "'Innodb_row_lock_waits', 'Innodb_row_lock_time', 'Innodb_row_lock_time_max', "
+                    "'Innodb_deadlocks', 'Table_locks_waited')")) {
+        return statistics;
+    }
+    while (query.next()) {
+        statistics.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    return statistics;
+}
+
+static double percentileMillis(const QList<qint64> &sorted, const double p) {
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    return sorted.at(qBound(0, static_cast<int>(p * (sorted.size() - 1) + 0.5),
+                            static_cast<int>(sorted.size()) - 1)) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("enigma_loadtest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs many simulated Enigma users against one database.");
+    parser.addHelpOption();
+    StoreOptions::addOptions(parser, "loadtest.sqlite");
+    parser.addOption({"users", "Number of simulated users, one thread each.", "count", "50"});
+    parser.addOption({"passwords", "Passwords in each user's starting vault.", "count", "100"});
+    parser.addOption({"notes", "Notes in each user's starting vault.", "count", "10"});
+    parser.addOption({"duration", "Run time in seconds.", "seconds", "60"});
+    parser.addOption({
+        "mix", "Operation weights, e.g. login=1,list_passwords=40,add_password=20.", "weights",
+        "login=2,list_passwords=40,add_password=15,update_password=15,delete_password=8,"
+        "list_notes=10,add_note=4,update_note=4,delete_note=2"
+    });
+    parser.addOption({"seed", "Random seed.", "seed", "1"});
+    parser.addOption({"report", "Write the report as JSON to <file>.", "file"});
+    parser.process(app);
+
+    Workload workload;
+    workload.password = "loadtest-password";
+    workload.durationNanoseconds = static_cast<qint64>(parser.value("duration").toDouble() * 1e9);
+    if (!parseMix(parser.value("mix"), workload) || !StoreOptions::open(parser)) {
+        return 1;
+    }
+
+    const int users = qMax(1, parser.value("users").toInt());
+    const quint32 seed = parser.value("seed").toUInt();
+    const QString runId = QString::number(QDateTime::currentSecsSinceEpoch());
+
+    QTextStream out(stdout);
+    out << "Provisioning " << users << " users..." << Qt::endl;
+
+    SyntheticVaultSpec spec;
+    spec.passwordsPerUser = parser.value("passwords").toInt();
+    spec.notesPerUser = parser.value("notes").toInt();
+    spec.maxNoteBytes = workload.maxNoteBytes;
+    spec.password = workload.password;
+
+    QRandomGenerator provisioning(seed);
+    QStringList usernames;
+    for (int i = 0; i < users; ++i) {
+        const QString username = QString("loadtest%1_%2").arg(runId).arg(i);
+        if (!SyntheticVault::generateUser(username, spec, provisioning)) {
+            qWarning() << "Failed to provision" << username;
+            return 1;
+        }
+        usernames.append(username);
+    }
+
+    const QHash<QString, qint64> locksBefore = lockStatistics();
+    out << "Running " << users << " users for " << parser.value("duration") << " s..." << Qt::endl;
+
+    std::vector<OperationResults> results(users);
+    std::vector<std::unique_ptr<QThread> > threads;
+    QElapsedTimer wallClock;
+    wallClock.start();
+    for (int i = 0; i < users; ++i) {
+        threads.emplace_back(QThread::create([&results, &workload, username = usernames.at(i), i, seed] {
+            results[i] = simulateUser(username, workload, seed + 1 + i);
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread: threads) {
+        thread->wait();
+    }
+    const double wallSeconds = wallClock.nsecsElapsed() / 1e9;
+    const QHash<QString, qint64> locksAfter = lockStatistics();
+
+    out << "\n" << QString("%1 %2 %3 %4 %5 %6 %7")
+            .arg("operation", -16).arg("count", 8).arg("ops/s", 9).arg("p50 ms", 9).arg("p99 ms", 9)
+            .arg("p99.9 ms", 9).arg("errors", 7) << Qt::endl;
+
+    QJsonArray operations;
+    qint64 totalOperations = 0;
+    for (int op = 0; op < OperationCount; ++op) {
+        QList<qint64> samples;
+        int failures = 0;
+        for (const OperationResults &result: results) {
+            samples.append(result.nanoseconds[op]);
+            failures += result.failures[op];
+        }
+        if (samples.isEmpty()) {
+            continue;
+        }
+        std::sort(samples.begin(), samples.end());
+        totalOperations += samples.size();
+
+        const double throughput = samples.size() / wallSeconds;
+        out << QString("%1 %2 %3 %4 %5 %6 %7")
+                .arg(OPERATION_NAMES[op], -16).arg(samples.size(), 8).arg(throughput, 9, 'f', 1)
+                .arg(percentileMillis(samples, 0.5), 9, 'f', 2).arg(percentileMillis(samples, 0.99), 9, 'f', 2)
+                .arg(percentileMillis(samples, 0.999), 9, 'f', 2).arg(failures, 7) << Qt::endl;
+
+        operations.append(QJsonObject{
+            {"operation", OPERATION_NAMES[op]},
+            {"count", samples.size()},
+            {"ops_per_second", throughput},
+            {"p50_ms", percentileMillis(samples, 0.5)},
+            {"p99_ms", percentileMillis(samples, 0.99)},
+            {"p999_ms", percentileMillis(samples, 0.999)},
+            {"max_ms", percentileMillis(samples, 1.0)},
+            {"errors", failures}
+        });
+    }
+    out << "\n" << totalOperations << " operations, " << totalOperations / wallSeconds << " ops/s" << Qt::endl;
+
+    QJsonObject locks;
+    if (!locksAfter.isEmpty()) {
+        out << "\nLock statistics (delta over run)" << Qt::endl;
+        for (auto it = locksAfter.constBegin(); it != locksAfter.constEnd(); ++it) {
+            const bool isMax = it.key().endsWith("_max");
+            const qint64 value = isMax ? it.value() : it.value() - locksBefore.value(it.key());
+            out << QString("  %1 %2").arg(it.key(), -28).arg(value) << Qt::endl;
+            locks.insert(it.key(), value);
+        }
+    }
+
+    if (parser.isSet("report")) {
+        QFile report(parser.value("report"));
+        if (!report.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Cannot write report" << report.fileName();
+            return 1;
+        }
+        report.write(QJsonDocument(QJsonObject{
+            {"users", users},
+            {"wall_seconds", wallSeconds},
+            {"operations", operations},
+            {"locks", locks}
+        }).toJson());
+    }
+    return 0;
+}
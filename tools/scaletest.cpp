@@ -0,0 +1,206 @@
+#include "storeoptions.h"
+#include "syntheticvault.h"
+#include "core/dbmanager.h"
+#include "core/encryption.h"
+#include "models/loginpipeline.h"
+#include "ui/passwordmanagerwidget.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+
+// Measures the user-visible operations of a session at several vault sizes.
+// Each size gets its own freshly generated user so results do not depend on
+// what earlier sizes left behind.
+
+struct Samples {
+    QString operation;
+    QList<double> millis;
+
+    double percentile(const double p) const {
+        QList<double> sorted = millis;
+        std::sort(sorted.begin(), sorted.end());
+        const int index = qBound(0, static_cast<int>(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+        return sorted.at(index);
+    }
+};
+
+static double elapsedMillis(const QElapsedTimer &timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+static QList<PasswordEntry> search(const QList<PasswordEntry> &entries, const QString &term) {
+    QList<PasswordEntry> matches;
+    for (const PasswordEntry &entry: entries) {
+        if (entry.service.contains(term, Qt::CaseInsensitive)
+            || entry.url.contains(term, Qt::CaseInsensitive)
+            || entry.username.contains(term, Qt::CaseInsensitive)
+            || entry.email.contains(term, Qt::CaseInsensitive)) {
+            matches.append(entry);
+        }
+    }
+    return matches;
+}
+
+static int newestPasswordId(const int userId) {
+    QSqlQuery query(DBManager::instance().getDatabase());
+    query.prepare("SELECT MAX(id) FROM passwords WHERE user_id = ?");
+    query.addBindValue(userId);
+    if (!query.exec() || !query.next()) {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+static QList<Samples> measureSize(const QString &username, const SyntheticVaultSpec &spec, const int repeat,
+                                  QRandomGenerator &random) {
+    Samples unlock{"unlock"};
+    Samples listBuild{"list_build"};
+    Samples searchSamples{"search"};
+    Samples save{"save"};
+    Samples remove{"delete"};
+
+    PasswordManagerWidget widget;
+
+    for (int i = 0; i < repeat; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        LoginPipeline pipeline;
+        pipeline.start(username, spec.password);
+        if (!pipeline.verification().result()) {
+            qWarning() << "Unlock failed for" << username;
+            return {};
+        }
+        const QByteArray vaultKey = pipeline.vaultKey();
+        const QList<PasswordEntry> passwords = pipeline.passwords();
+        pipeline.notes();
+        unlock.millis.append(elapsedMillis(timer));
+
+        const User *user = pipeline.takeUser();
+        const int userId = user->getId();
+        delete user;
+
+        Encryption encryption(vaultKey);
+        PasswordManager manager(userId, &encryption);
+        widget.setPasswordManager(&manager);
+
+        timer.restart();
+        widget.showPasswords(passwords);
+        listBuild.millis.append(elapsedMillis(timer));
+
+        const QString term = passwords.isEmpty()
+                                 ? QString("example")
+                                 : passwords.at(random.bounded(passwords.size())).service.left(3);
+        timer.restart();
+        search(passwords, term);
+        searchSamples.millis.append(elapsedMillis(timer));
+
+        timer.restart();
+        manager.addPassword(SyntheticVault::randomPasswordEntry(random));
+        save.millis.append(elapsedMillis(timer));
+
+        const int id = newestPasswordId(userId);
+        timer.restart();
+        manager.deletePassword(id);
+        remove.millis.append(elapsedMillis(timer));
+
+        widget.setPasswordManager(nullptr);
+    }
+    return {unlock, listBuild, searchSamples, save, remove};
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("enigma_scaletest");
+
+    QTemporaryDir scratch;
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures unlock, list, search, save and delete latency at several vault sizes.");
+    parser.addHelpOption();
+    StoreOptions::addOptions(parser, scratch.filePath("scaletest.sqlite"));
+    parser.addOption({"sizes", "Comma-separated password counts to test.", "list", "100,1000,10000"});
+    parser.addOption({"notes-ratio", "Notes generated per password.", "ratio", "0.1"});
+    parser.addOption({"max-note-bytes", "Largest generated note.", "bytes", QString::number(1024 * 1024)});
+    parser.addOption({"repeat", "Measurements per operation and size.", "count", "5"});
+    parser.addOption({"seed", "Random seed.", "seed", "1"});
+    parser.addOption({"report", "Write the report as JSON to <file>.", "file"});
+    parser.process(app);
+
+    if (!StoreOptions::open(parser)) {
+        return 1;
+    }
+
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+    QRandomGenerator random(parser.value("seed").toUInt());
+    const QString runId = QString::number(QDateTime::currentSecsSinceEpoch());
+
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4 %5 %6")
+            .arg("size", 8).arg("operation", -12).arg("p50 ms", 10).arg("p95 ms", 10).arg("min ms", 10)
+            .arg("max ms", 10) << Qt::endl;
+
+    QJsonArray results;
+    for (const QString &sizeText: parser.value("sizes").split(',', Qt::SkipEmptyParts)) {
+        SyntheticVaultSpec spec;
+        spec.passwordsPerUser = sizeText.toInt();
+        spec.notesPerUser = static_cast<int>(spec.passwordsPerUser * parser.value("notes-ratio").toDouble());
+        spec.maxNoteBytes = parser.value("max-note-bytes").toInt();
+
+        const QString username = QString("scale%1_%2").arg(spec.passwordsPerUser).arg(runId);
+        if (!SyntheticVault::generateUser(username, spec, random)) {
+            qWarning() << "Failed to generate vault of size" << spec.passwordsPerUser;
+            return 1;
+        }
+
+        const QList<Samples> samples = measureSize(username, spec, repeat, random);
+        if (samples.isEmpty()) {
+            return 1;
+        }
+
+        for (const Samples &sample: samples) {
+            const double p50 = sample.percentile(0.5);
+            const double p95 = sample.percentile(0.95);
+            const double min = sample.percentile(0.0);
+            const double max = sample.percentile(1.0);
+            out << QString("%1 %2 %3 %4 %5 %6")
+                    .arg(spec.passwordsPerUser, 8).arg(sample.operation, -12)
+                    .arg(p50, 10, 'f', 2).arg(p95, 10, 'f', 2).arg(min, 10, 'f', 2).arg(max, 10, 'f', 2)
+                    << Qt::endl;
+
+            results.append(QJsonObject{
+                {"size", spec.passwordsPerUser},
+                {"notes", spec.notesPerUser},
+                {"operation", sample.operation},
+                {"p50_ms", p50},
+                {"p95_ms", p95},
+                {"min_ms", min},
+                {"max_ms", max},
+                {"samples", repeat}
+            });
+        }
+    }
+
+    if (parser.isSet("report")) {
+        QFile report(parser.value("report"));
+        if (!report.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Cannot write report" << report.fileName();
+            return 1;
+        }
+        report.write(QJsonDocument(QJsonObject{{"run", runId}, {"results", results}}).toJson());
+    }
+    return 0;
+}
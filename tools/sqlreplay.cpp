@@ -0,0 +1,323 @@
+#include "storeoptions.h"
+#include "core/dbmanager.h"
+#include "core/sqlrecorder.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Replays a trace written with ENIGMA_SQL_RECORD. Every recorded thread is
+// replayed on its own thread with its own connection, keeping the recorded
+// order and, unless --speedup is 0, the recorded gaps divided by the speed-up.
+// --concurrency runs that many copies of the whole session side by side. Each
+// copy gets its own key space, so the copies insert disjoint rows instead of
+// colliding on the recorded keys: integer binds to an id column are moved up
+// by the session number times the largest recorded id, and text and blob binds
+// carry the session number (see SqlRecorder::replayValue).
+
+struct ReplaySample {
+    int statement;
+    qint64 nanoseconds;
+    bool ok;
+};
+
+static QList<double> sortedMillis(QList<double> values) {
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+static double percentile(const QList<double> &sorted, const double p) {
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    return sorted.at(qBound(0, static_cast<int>(p * (sorted.size() - 1) + 0.5), sorted.size() - 1));
+}
+
+struct KeySpace {
+    int session = 0;
+    qint64 stride = 1;
+    QList<QList<bool> > keyParams; // per statement, per placeholder
+};
+
+static QStringList sqlTokens(const QString &sql) {
+    static const QRegularExpression token(R"([A-Za-z_][A-Za-z0-9_.]*|'(?:[^']|'')*'|<=|>=|!=|<>|\S)");
+    QStringList tokens;
+    QRegularExpressionMatchIterator it = token.globalMatch(sql);
+    while (it.hasNext()) {
+        tokens.append(it.next().captured());
+    }
+    return tokens;
+}
+
+static bool isIdentifier(const QString &token) {
+    return !token.isEmpty() && (token.at(0).isLetter() || token.at(0) == '_');
+}
+
+static bool isKeyColumn(const QString &column) {
+    const QString name = column.mid(column.lastIndexOf('.') + 1).toLower();
+    return name == "id" || name.endsWith("_id");
+}
+
+// Marks the placeholders that bind an id column: the values of an INSERT by
+// its column list, any other placeholder by the column it is compared with
+// ("col = ?", "col IN (?, ?)").
+static QList<bool> keyPlaceholders(const QString &sql) {
+    static const QStringList comparisons = {"=", "<", ">", "<=", ">=", "!=", "<>", "IN"};
+    const QStringList tokens = sqlTokens(sql);
+
+    QStringList insertColumns;
+    int valuesOpen = -1;
+    if (!tokens.isEmpty() && tokens.first().compare("INSERT", Qt::CaseInsensitive) == 0) {
+        const int open = static_cast<int>(tokens.indexOf("("));
+        for (int i = open + 1; open >= 0 && i < tokens.size() && tokens.at(i) != ")"; ++i) {
+            if (isIdentifier(tokens.at(i))) {
+                insertColumns.append(tokens.at(i));
+            }
+        }
+        for (int i = 0; i + 1 < tokens.size(); ++i) {
+            if (tokens.at(i).compare("VALUES", Qt::CaseInsensitive) == 0 && tokens.at(i + 1) == "(") {
+                valuesOpen = i + 1;
+                break;
+            }
+        }
+    }
+
+    QList<bool> keys;
+    int depth = 0;
+    int item = 0;
+    for (int i = 0; i < tokens.size(); ++i) {
+        const QString &token = tokens.at(i);
+        if (valuesOpen >= 0 && i > valuesOpen && depth >= 0) {
+            if (token == "(") {
+                ++depth;
+            } else if (token == ")") {
+                --depth;
+            } else if (token == "," && depth == 0) {
+                ++item;
+            }
+        }
+        if (token != "?") {
+            continue;
+        }
+        if (valuesOpen >= 0 && i > valuesOpen && depth == 0) {
+            keys.append(isKeyColumn(insertColumns.value(item)));
+            continue;
+        }
+        int j = i - 1;
+        while (j >= 0 && (tokens.at(j) == "?" || tokens.at(j) == "," || tokens.at(j) == "(")) {
+            --j;
+        }
+        const bool compared = j >= 0 && comparisons.contains(tokens.at(j).toUpper());
+        keys.append(compared && j > 0 && isIdentifier(tokens.at(j - 1)) && isKeyColumn(tokens.at(j - 1)));
+    }
+    return keys;
+}
+
+static QVariant sessionValue(const SqlTraceParam &param, const bool key, const KeySpace &keySpace) {
+    if (key && param.type == SqlTraceParam::Integer && keySpace.session > 0) {
+        return param.value + keySpace.session * keySpace.stride;
+    }
+    return SqlRecorder::replayValue(param, keySpace.session);
+}
+
+static void bindValues(QSqlQuery &query, const SqlTraceExecution &execution, const KeySpace &keySpace) {
+    const QList<bool> &keys = keySpace.keyParams.at(execution.statement);
+    if (!execution.batched) {
+        for (int i = 0; i < execution.params.size(); ++i) {
+            query.addBindValue(sessionValue(execution.params.at(i), keys.value(i), keySpace));
+        }
+        return;
+    }
+
+    for (int column = 0; column < execution.paramCount; ++column) {
+        QVariantList values;
+        for (int row = 0; row < execution.batchRows; ++row) {
+            values.append(sessionValue(execution.params.at(row * execution.paramCount + column), keys.value(column),
+                                       keySpace));
+        }
+        query.addBindValue(values);
+    }
+}
+
+static std::vector<ReplaySample> replayThread(const SqlTrace &trace, const QList<int> &executions,
+                                              const double speedup, const KeySpace &keySpace) {
+    std::vector<ReplaySample> samples;
+    samples.reserve(executions.size());
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QHash<int, QSqlQuery> prepared;
+    QElapsedTimer clock;
+    clock.start();
+    const qint64 origin = executions.isEmpty() ? 0 : trace.executions.at(executions.first()).start;
+
+    for (const int index: executions) {
+        const SqlTraceExecution &execution = trace.executions.at(index);
+        if (speedup > 0) {
+            const auto due = static_cast<qint64>((execution.start - origin) / speedup);
+            if (const qint64 wait = due - clock.nsecsElapsed(); wait > 0) {
+                QThread::usleep(static_cast<unsigned long>(wait / 1000));
+            }
+        }
+
+        auto it = prepared.find(execution.statement);
+        if (it == prepared.end()) {
+            QSqlQuery query(db);
+            query.prepare(trace.statements.at(execution.statement).sql);
+            it = prepared.insert(execution.statement, query);
+        }
+        QSqlQuery &query = it.value();
+        bindValues(query, execution, keySpace);
+
+        QElapsedTimer timer;
+        timer.start();
+        const bool ok = execution.batched ? query.execBatch() : query.exec();
+        samples.push_back({execution.statement, timer.nsecsElapsed(), ok});
+        query.finish();
+    }
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("enigma_sqlreplay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays an SQL workload recorded with ENIGMA_SQL_RECORD.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Trace file written by the recorder.");
+    StoreOptions::addOptions(parser, "replay.sqlite");
+    parser.addOption({"concurrency", "Number of sessions replayed side by side.", "count", "1"});
+    parser.addOption({"speedup", "Divide recorded gaps by <factor>; 0 replays back to back.", "factor", "1"});
+    parser.addOption({"report", "Write the report as JSON to <file>.", "file"});
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    SqlTrace trace;
+    if (!SqlRecorder::readTrace(parser.positionalArguments().first(), trace) || !StoreOptions::open(parser)) {
+        return 1;
+    }
+
+    QMap<int, QList<int> > executionsByThread;
+    for (int i = 0; i < trace.executions.size(); ++i) {
+        executionsByThread[trace.executions.at(i).thread].append(i);
+    }
+
+    const int concurrency = qMax(1, parser.value("concurrency").toInt());
+    const double speedup = parser.value("speedup").toDouble();
+
+    KeySpace keys;
+    for (const SqlTraceStatement &statement: trace.statements) {
+        keys.keyParams.append(keyPlaceholders(statement.sql));
+    }
+    for (const SqlTraceExecution &execution: trace.executions) {
+        const QList<bool> &statementKeys = keys.keyParams.at(execution.statement);
+        for (int i = 0; i < execution.params.size(); ++i) {
+            const SqlTraceParam &param = execution.params.at(i);
+            const int column = execution.batched ? i % qMax(1, execution.paramCount) : i;
+            if (statementKeys.value(column) && param.type == SqlTraceParam::Integer) {
+                keys.stride = qMax(keys.stride, param.value + 1);
+            }
+        }
+    }
+
+    std::vector<std::vector<ReplaySample> > results(concurrency * executionsByThread.size());
+    std::vector<std::unique_ptr<QThread> > threads;
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    int slot = 0;
+    for (int session = 0; session < concurrency; ++session) {
+        KeySpace sessionKeys = keys;
+        sessionKeys.session = session;
+        for (const QList<int> &executions: executionsByThread) {
+            std::vector<ReplaySample> &result = results[slot++];
+            threads.emplace_back(QThread::create([&trace, executions, speedup, sessionKeys, &result] {
+                result = replayThread(trace, executions, speedup, sessionKeys);
+            }));
+            threads.back()->start();
+        }
+    }
+    for (const auto &thread: threads) {
+        thread->wait();
+    }
+    const qint64 wallNanoseconds = wallClock.nsecsElapsed();
+
+    QHash<QByteArray, QList<double> > recorded;
+    QHash<QByteArray, QList<double> > replayed;
+    QHash<QByteArray, int> failures;
+    for (const SqlTraceExecution &execution: trace.executions) {
+        recorded[trace.statements.at(execution.statement).id].append(execution.duration / 1e6);
+    }
+    qint64 total = 0;
+    for (const auto &samples: results) {
+        for (const ReplaySample &sample: samples) {
+            const QByteArray &id = trace.statements.at(sample.statement).id;
+            replayed[id].append(sample.nanoseconds / 1e6);
+            failures[id] += sample.ok ? 0 : 1;
+            ++total;
+        }
+    }
+
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4 %5 %6")
+            .arg("statement", -28).arg("count", 8).arg("rec p50", 10).arg("p50 ms", 10).arg("p95 ms", 10)
+            .arg("errors", 8) << Qt::endl;
+
+    QJsonArray statements;
+    QList<QByteArray> ids = replayed.keys();
+    std::sort(ids.begin(), ids.end());
+    for (const QByteArray &id: ids) {
+        const QList<double> rec = sortedMillis(recorded.value(id));
+        const QList<double> rep = sortedMillis(replayed.value(id));
+        out << QString("%1 %2 %3 %4 %5 %6")
+                .arg(QString::fromUtf8(id), -28).arg(rep.size(), 8)
+                .arg(percentile(rec, 0.5), 10, 'f', 3).arg(percentile(rep, 0.5), 10, 'f', 3)
+                .arg(percentile(rep, 0.95), 10, 'f', 3).arg(failures.value(id), 8) << Qt::endl;
+
+        statements.append(QJsonObject{
+            {"statement", QString::fromUtf8(id)},
+            {"count", rep.size()},
+            {"recorded_p50_ms", percentile(rec, 0.5)},
+            {"p50_ms", percentile(rep, 0.5)},
+            {"p95_ms", percentile(rep, 0.95)},
+            {"max_ms", percentile(rep, 1.0)},
+            {"errors", failures.value(id)}
+        });
+    }
+
+    out << "\n" << total << " statements in " << wallNanoseconds / 1e9 << " s ("
+        << (wallNanoseconds > 0 ? total * 1e9 / wallNanoseconds : 0) << " statements/s)" << Qt::endl;
+
+    if (parser.isSet("report")) {
+        QFile report(parser.value("report"));
+        if (!report.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Cannot write report" << report.fileName();
+            return 1;
+        }
+        report.write(QJsonDocument(QJsonObject{
+            {"concurrency", concurrency},
+            {"speedup", speedup},
+            {"wall_seconds", wallNanoseconds / 1e9},
+            {"statements", statements}
+        }).toJson());
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include "storeoptions.h"
+#include "syntheticvault.h"
+#include "core/dbmanager.h"
+#include "core/schemamigrator.h"
+
+#include <QCommandLineParser>
+#include <QDebug>
+
+void StoreOptions::addOptions(QCommandLineParser &parser, const QString &defaultSqlitePath) {
+    parser.addOption({"sqlite", "SQLite database file to use.", "path", defaultSqlitePath});
+    parser.addOption({"mysql-host", "Use the MySQL server on <host> instead of SQLite.", "host"});
+    parser.addOption({"mysql-db", "MySQL database name.", "name", "enigma_db"});
+    parser.addOption({"mysql-user", "MySQL user.", "user"});
+    parser.addOption({"mysql-password", "MySQL password.", "password"});
+}
+
+bool StoreOptions::open(const QCommandLineParser &parser) {
+    if (parser.isSet("mysql-host")) {
+        return DBManager::instance().openConnection(parser.value("mysql-host"), parser.value("mysql-db"),
+                                                    parser.value("mysql-user"), parser.value("mysql-password"))
+               && SchemaMigrator(DBManager::instance().getDatabase()).migrate();
+    }
+    if (!SyntheticVault::openSqliteStore(parser.value("sqlite"))) {
+        qWarning() << "Failed to open SQLite store" << parser.value("sqlite");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef STOREOPTIONS_H
+#define STOREOPTIONS_H
+
+#include <QString>
+
+class QCommandLineParser;
+
+namespace StoreOptions {
+    void addOptions(QCommandLineParser &parser, const QString &defaultSqlitePath);
+
+    bool open(const QCommandLineParser &parser);
+}
+
+#endif // STOREOPTIONS_H
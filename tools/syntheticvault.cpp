@@ -0,0 +1,228 @@
+#include "syntheticvault.h"
+#include "core/dbmanager.h"
+#include "core/schemamigrator.h"
+#include "core/encryption.h"
+#include "models/user.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <cmath>
+
+// Bulk copies in populatePasswords() start from a handful of rows encrypted
+// for real. Every copy is still decrypted on its own, so reads cost the same
+// as in a vault where every row is distinct.
+static const int TEMPLATE_ROWS = 16;
+
+// Rows are committed in batches so generating large vaults is not dominated
+// by one fsync per insert.
+static const int GENERATE_BATCH_SIZE = 500;
+
+static const QString WORD_CHARACTERS = "abcdefghijklmnopqrstuvwxyz";
+static const QString PASSWORD_CHARACTERS =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*()-_=+[]{}|;:,.<>?";
+static const QString BASE32_CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+static const QString TEXT_CHARACTERS = "abcdefghijklmnopqrstuvwxyz      .,\n";
+
+static QString randomString(QRandomGenerator &random, const QString &alphabet, const int length) {
+    QString result;
+    result.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        result.append(alphabet.at(random.bounded(alphabet.size())));
+    }
+    return result;
+}
+
+static int randomLength(QRandomGenerator &random, const int min, const int max) {
+    return min + random.bounded(max - min + 1);
+}
+
+// Note sizes are log-uniform: most notes are short, a few reach maxBytes.
+static int randomNoteSize(QRandomGenerator &random, const int maxBytes) {
+    const double minLog = std::log(64.0);
+    const double maxLog = std::log(static_cast<double>(qMax(maxBytes, 64)));
+    return static_cast<int>(std::exp(minLog + random.generateDouble() * (maxLog - minLog)));
+}
+
+QByteArray SyntheticVault::benchmarkKey() {
+    return QByteArray(32, '\x5a');
+}
+
+bool SyntheticVault::openInMemoryStore() {
+    return openSqliteStore(":memory:");
+}
+
+bool SyntheticVault::openSqliteStore(const QString &path) {
+    return DBManager::instance().openSqliteConnection(path)
+           && SchemaMigrator(DBManager::instance().getDatabase()).migrate();
+}
+
+PasswordEntry SyntheticVault::randomPasswordEntry(QRandomGenerator &random) {
+    PasswordEntry entry;
+    entry.id = -1;
+    entry.service = randomString(random, WORD_CHARACTERS, randomLength(random, 4, 24));
+    entry.url = "https://" + randomString(random, WORD_CHARACTERS, randomLength(random, 6, 30)) + ".example.com/"
+                + randomString(random, WORD_CHARACTERS, randomLength(random, 0, 40));
+    entry.username = randomString(random, WORD_CHARACTERS, randomLength(random, 6, 20));
+    entry.email = entry.username + "@" + randomString(random, WORD_CHARACTERS, randomLength(random, 5, 15)) + ".com";
+    entry.password = randomString(random, PASSWORD_CHARACTERS, randomLength(random, 12, 32));
+    if (random.bounded(10) < 3) {
+        entry.description = randomString(random, TEXT_CHARACTERS, randomLength(random, 20, 300));
+    }
+    if (random.bounded(10) < 3) {
+        entry.totpSecret = randomString(random, BASE32_CHARACTERS, 32);
+    }
+    return entry;
+}
+
+NoteEntry SyntheticVault::randomNoteEntry(QRandomGenerator &random, const int maxNoteBytes) {
+    NoteEntry entry;
+    entry.id = -1;
+    entry.title = randomString(random, WORD_CHARACTERS, randomLength(random, 4, 40));
+    entry.content = randomString(random, TEXT_CHARACTERS, randomNoteSize(random, maxNoteBytes));
+    return entry;
+}
+
+bool SyntheticVault::populatePasswords(const int userId, const int rowCount, Encryption *encryption) {
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    QSqlQuery query(db);
+
+    query.prepare("DELETE FROM passwords WHERE user_id = ?");
+    query.addBindValue(userId);
+    if (!query.exec()) {
+        qDebug() << "Clear Synthetic Vault Error:" << query.lastError().text();
+        return false;
+    }
+
+    QRandomGenerator random(static_cast<quint32>(userId));
+    const PasswordManager manager(userId, encryption);
+    for (int i = 0; i < qMin(rowCount, TEMPLATE_ROWS); ++i) {
+        if (!manager.addPassword(randomPasswordEntry(random))) {
+            return false;
+        }
+    }
+
+    // Copies leave password_fingerprint NULL, as rows written before the
+    // fingerprint column existed do, so the audit backfill computes them
+    // instead of trusting a value copied from another row.
+    int inserted = qMin(rowCount, TEMPLATE_ROWS);
+    while (inserted < rowCount) {
+        const int copies = qMin(inserted, rowCount - inserted);
+        query.prepare(R"(
+            INSERT INTO passwords (
+                user_id,
+                salt,
+                encrypted_service,
+                encrypted_url,
+                encrypted_username,
+                encrypted_email,
+                encrypted_password,
+                encrypted_description,
+                encrypted_totp_secret,
+                record_format,
+                key_schedule,
+                password_fingerprint
+            )
+            SELECT
+                user_id,
+                salt,
+                encrypted_service,
+                encrypted_url,
+                encrypted_username,
+                encrypted_email,
+                encrypted_password,
+                encrypted_description,
+                encrypted_totp_secret,
+                record_format,
+                key_schedule,
+                NULL
+            FROM passwords
+            WHERE user_id = ?
+            ORDER BY id
+            LIMIT ?
+        )");
+        query.addBindValue(userId);
+        query.addBindValue(copies);
+        if (!query.exec()) {
+            qDebug() << "Grow Synthetic Vault Error:" << query.lastError().text();
+            return false;
+        }
+        inserted += copies;
+    }
+    return true;
+}
+
+QByteArray SyntheticVault::unlockVault(const QString &username, const QString &password, int *userId) {
+    const UserRecord record = User::fetchRecord(username);
+    const QByteArray keyEncryptionKey = User::unlockKeyEncryptionKey(username, password);
+    if (!record.isValid() || keyEncryptionKey.isEmpty()) {
+        return QByteArray();
+    }
+    if (userId) {
+        *userId = record.id;
+    }
+    return User::unwrapVaultKey(record, keyEncryptionKey);
+}
+
+bool SyntheticVault::generateUser(const QString &username, const SyntheticVaultSpec &spec, QRandomGenerator &random,
+                                  const std::function<void(int done, int total)> &progress) {
+    if (!User::registerUser(username, spec.password)) {
+        return false;
+    }
+
+    int userId = -1;
+    const QByteArray vaultKey = unlockVault(username, spec.password, &userId);
+    if (vaultKey.isEmpty()) {
+        qWarning() << "Failed to unlock synthetic vault for" << username;
+        return false;
+    }
+
+    Encryption encryption(vaultKey);
+    const PasswordManager passwordManager(userId, &encryption);
+    const NoteManager noteManager(userId, &encryption);
+
+    QSqlDatabase db = DBManager::instance().getDatabase();
+    const int total = spec.passwordsPerUser + spec.notesPerUser;
+    for (int done = 0; done < total;) {
+        db.transaction();
+        const int batchEnd = qMin(done + GENERATE_BATCH_SIZE, total);
+        for (; done < batchEnd; ++done) {
+            const bool ok = done < spec.passwordsPerUser
+                                ? passwordManager.addPassword(randomPasswordEntry(random))
+                                : noteManager.addNote(randomNoteEntry(random, spec.maxNoteBytes));
+            if (!ok) {
+                db.rollback();
+                return false;
+            }
+        }
+        if (!db.commit()) {
+            qDebug() << "Synthetic Vault Commit Error:" << db.lastError().text();
+            return false;
+        }
+        if (progress) {
+            progress(done, total);
+        }
+    }
+    return true;
+}
+
+bool SyntheticVault::generate(const SyntheticVaultSpec &spec, const std::function<void(int done, int total)> &progress) {
+    QRandomGenerator random(spec.seed);
+    const int total = spec.users * (spec.passwordsPerUser + spec.notesPerUser);
+    int finished = 0;
+
+    for (int i = 0; i < spec.users; ++i) {
+        const QString username = QString("%1%2").arg(spec.usernamePrefix).arg(i);
+        const bool ok = generateUser(username, spec, random, [&](const int done, const int) {
+            if (progress) {
+                progress(finished + done, total);
+            }
+        });
+        if (!ok) {
+            qWarning() << "Failed to generate synthetic user" << username;
+            return false;
+        }
+        finished += spec.passwordsPerUser + spec.notesPerUser;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SYNTHETICVAULT_H
+#define SYNTHETICVAULT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QRandomGenerator>
+#include <functional>
+#include "models/passwordmanager.h"
+#include "models/notemanager.h"
+
+class Encryption;
+
+struct SyntheticVaultSpec {
+    int users = 1;
+    int passwordsPerUser = 100;
+    int notesPerUser = 10;
+    int maxNoteBytes = 4 * 1024 * 1024;
+    quint32 seed = 1;
+    QString usernamePrefix = "synthetic";
+    QString password = "synthetic-password";
+};
+
+namespace SyntheticVault {
+    QByteArray benchmarkKey();
+
+    bool openInMemoryStore();
+
+    bool openSqliteStore(const QString &path);
+
+    PasswordEntry randomPasswordEntry(QRandomGenerator &random);
+
+    NoteEntry randomNoteEntry(QRandomGenerator &random, int maxNoteBytes);
+
+    bool populatePasswords(int userId, int rowCount, Encryption *encryption);
+
+    QByteArray unlockVault(const QString &username, const QString &password, int *userId = nullptr);
+
+    bool generateUser(const QString &username, const SyntheticVaultSpec &spec, QRandomGenerator &random,
+                      const std::function<void(int done, int total)> &progress = nullptr);
+
+    bool generate(const SyntheticVaultSpec &spec,
+                  const std::function<void(int done, int total)> &progress = nullptr);
+}
+
+#endif // SYNTHETICVAULT_H
@@ -0,0 +1,96 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <vector>
+#include <zdict.h>
+
+// Trains the zstd dictionary embedded with -DENIGMA_ZSTD_DICTIONARY. Every
+// file is one sample unless --lines splits it into one sample per line, which
+// suits exports of short fields such as descriptions. The samples end up in
+// the dictionary, so they must not contain anything private.
+
+static const int MAX_SAMPLE_SIZE = 16 * 1024;
+
+static void addSamples(const QString &path, const bool lines, QByteArray *buffer, std::vector<size_t> *sizes) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QTextStream(stderr) << "Failed to open " << path << ": " << file.errorString() << Qt::endl;
+        return;
+    }
+    const QByteArray data = file.readAll();
+    const QList<QByteArray> samples = lines ? data.split('\n') : QList<QByteArray>{data};
+    for (const QByteArray &sample: samples) {
+        // Fields larger than this are compressed without the dictionary.
+        if (sample.isEmpty() || sample.size() > MAX_SAMPLE_SIZE) {
+            continue;
+        }
+        buffer->append(sample);
+        sizes->push_back(static_cast<size_t>(sample.size()));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("enigma_zstdtrain");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Trains the zstd dictionary used to compress short note and description fields.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("samples", "Sample files, or directories searched recursively.", "samples...");
+    parser.addOption({"output", "Where to write the dictionary.", "path", "fields.dict"});
+    parser.addOption({"max-size", "Largest dictionary size in bytes.", "bytes", "16384"});
+    parser.addOption({"lines", "Treat every line of a sample file as a separate sample."});
+    parser.process(app);
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(1);
+    }
+    const bool lines = parser.isSet("lines");
+
+    QByteArray buffer;
+    std::vector<size_t> sizes;
+    for (const QString &source: parser.positionalArguments()) {
+        if (!QFileInfo(source).isDir()) {
+            addSamples(source, lines, &buffer, &sizes);
+            continue;
+        }
+        QDirIterator it(source, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            addSamples(it.next(), lines, &buffer, &sizes);
+        }
+    }
+
+    QTextStream out(stdout);
+    if (sizes.empty()) {
+        out << "No samples to train on." << Qt::endl;
+        return 1;
+    }
+
+    bool ok = false;
+    const int maxSize = parser.value("max-size").toInt(&ok);
+    if (!ok || maxSize <= 0) {
+        out << "Invalid --max-size " << parser.value("max-size") << Qt::endl;
+        return 1;
+    }
+
+    QByteArray dictionary(maxSize, Qt::Uninitialized);
+    const size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.constData(),
+                                              sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        out << "Training failed: " << ZDICT_getErrorName(size) << Qt::endl;
+        return 1;
+    }
+    dictionary.resize(static_cast<int>(size));
+
+    QFile file(parser.value("output"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(dictionary) != dictionary.size()) {
+        out << "Failed to write " << parser.value("output") << ": " << file.errorString() << Qt::endl;
+        return 1;
+    }
+    out << "Wrote " << dictionary.size() << " byte dictionary " << ZDICT_getDictID(dictionary.constData(), size)
+            << " trained on " << sizes.size() << " samples to " << parser.value("output") << Qt::endl;
+    return 0;
+}